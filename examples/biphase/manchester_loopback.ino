@@ -0,0 +1,38 @@
+#include <FlexIO_t4.h>
+#include <TeensyFlexBiphase.h>
+
+// Manchester loopback on FlexIO2 at 5 Mbit/s (10 Mbaud line rate).
+// Connect pin 10 (TX, FXIO2 D0) to pin 12 (RX, FXIO2 D1).
+TeensyFlexBiphase link(10, 12, BiphaseCoding::Manchester);
+
+uint8_t frame[64];
+
+void setup() {
+  while (!Serial && millis() < 4000);
+  Serial.begin(115200);
+
+  if (!link.begin(1, 5000000)) {
+    Serial.println("Biphase begin failed");
+    return;
+  }
+  Serial.printf("Bit rate: %u\n", link.bitRate());
+  for (uint8_t i = 0; i < sizeof(frame); i++)
+    frame[i] = i;
+}
+
+void loop() {
+  static elapsedMillis since_send;
+  if (since_send >= 1000 && !link.busy()) {
+    since_send = 0;
+    link.write(frame, sizeof(frame));
+  }
+
+  uint8_t buffer[64];
+  size_t count = link.read(buffer, sizeof(buffer));
+  if (count) {
+    Serial.printf("Received %u bytes:", count);
+    for (size_t i = 0; i < count; i++)
+      Serial.printf(" %02x", buffer[i]);
+    Serial.println();
+  }
+}
@@ -0,0 +1,53 @@
+#include <FlexIO_t4.h>
+#include <TeensyFlexCapture.h>
+
+// Capture QQVGA RGB565 frames from an OV7670 class sensor on FlexIO2.
+// The sensor must already be configured over SCCB/I2C and clocked (XCLK).
+// D0-D7 on FXIO2 D4-D11 (pins 40-45, 6, 9), PCLK on pin 8, HREF on pin 7, VSYNC on pin 33.
+const uint8_t data_pins[8] = {40, 41, 42, 43, 44, 45, 6, 9};
+TeensyFlexCapture camera(8, 7, 33, data_pins);
+
+#define FRAME_WIDTH 160
+#define FRAME_HEIGHT 120
+DMAMEM uint16_t frame_buffer1[FRAME_WIDTH * FRAME_HEIGHT] __attribute__((aligned(32)));
+DMAMEM uint16_t frame_buffer2[FRAME_WIDTH * FRAME_HEIGHT] __attribute__((aligned(32)));
+
+EventResponder frame_event;
+elapsedMillis stats_timer;
+
+void frameComplete(EventResponderRef event_responder) {
+  digitalToggleFast(13);
+}
+
+void setup() {
+  pinMode(13, OUTPUT);
+  while (!Serial && millis() < 4000);
+  Serial.begin(115200);
+
+  if (!camera.begin(1, FRAME_WIDTH, FRAME_HEIGHT, 2)) {
+    Serial.println("Capture begin failed");
+    return;
+  }
+  camera.addFrameBuffer(frame_buffer1, sizeof(frame_buffer1));
+  camera.addFrameBuffer(frame_buffer2, sizeof(frame_buffer2));
+  frame_event.attach(&frameComplete);
+  camera.setFrameEvent(frame_event);
+  camera.start();
+  Serial.println("End Setup");
+}
+
+void loop() {
+  uint16_t *frame = (uint16_t *)camera.readFrame();
+  if (frame) {
+    // Do something with the frame, then hand it back to the capture ring
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < FRAME_WIDTH * FRAME_HEIGHT; i++) sum += frame[i];
+    camera.releaseFrame();
+  }
+
+  if (stats_timer >= 1000) {
+    stats_timer = 0;
+    Serial.printf("frames: %u dropped: %u lines: %u fps: %.1f\n", camera.framesCaptured(),
+                  camera.framesDropped(), camera.linesCaptured(), camera.frameRate());
+  }
+}
@@ -0,0 +1,38 @@
+#include <FlexIO_t4.h>
+#include <TeensyFlexCounter.h>
+
+// Count pulses on pins 2 and 3 (FXIO1 D4/D5) and measure the high time on pin 4
+// (FXIO1 D6). For a quick test, jumper pin 5 (PWM) to the inputs.
+TeensyFlexCounter counter;
+int ch_a, ch_b, ch_width;
+
+void setup() {
+  while (!Serial && millis() < 4000);
+  Serial.begin(115200);
+
+  analogWriteFrequency(5, 10000);
+  analogWrite(5, 64);
+
+  counter.begin(0);
+  ch_a = counter.addCounter(2, 100);
+  ch_b = counter.addCounter(3, 100);
+  ch_width = counter.addPulseWidth(4);
+  if ((ch_a < 0) || (ch_b < 0) || (ch_width < 0))
+    Serial.println("Counter setup failed");
+}
+
+void loop() {
+  static elapsedMillis since_print;
+  if (since_print < 1000)
+    return;
+  since_print = 0;
+
+  uint32_t counts[TeensyFlexCounter::MAX_CHANNELS];
+  uint32_t start = ARM_DWT_CYCCNT;
+  counter.snapshot(counts);
+  uint32_t cycles = ARM_DWT_CYCCNT - start;
+
+  Serial.printf("A: %lu (%.1f Hz)  B: %lu (%.1f Hz)  width: %.2f us  snapshot: %lu cycles\n",
+                counts[ch_a], counter.frequency(ch_a), counts[ch_b], counter.frequency(ch_b),
+                counter.pulseWidthUs(ch_width), cycles);
+}
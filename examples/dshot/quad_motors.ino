@@ -0,0 +1,38 @@
+#include <FlexIO_t4.h>
+#include <TeensyFlexDShot.h>
+
+// Four ESCs on FlexIO2 D0-D3 with bidirectional DShot600.
+// Frames go out at 2 kHz and the eRPM of every motor is printed twice a second.
+const uint8_t motor_pins[4] = {10, 12, 11, 13}; // FXIO2 D0, D1, D2, D3
+TeensyFlexDShot dshot(motor_pins, 4);
+
+void setup() {
+  while (!Serial && millis() < 4000);
+  Serial.begin(115200);
+
+  if (!dshot.begin(1, DShotSpeed::DShot600, true)) {
+    Serial.println("DShot begin failed");
+    return;
+  }
+  Serial.printf("Bit time %f ns (%f%% off nominal)\n", dshot.timing().bitNs, dshot.timing().errorPercent);
+}
+
+void loop() {
+  static elapsedMicros since_frame;
+  static elapsedMillis since_print;
+
+  if (since_frame >= 500 && dshot.send()) {
+    since_frame = 0;
+    // ESCs need a stream of zero throttle frames to arm, then ramp gently
+    uint16_t throttle = (millis() < 3000) ? 0 : 200;
+    for (uint8_t motor = 0; motor < 4; motor++)
+      dshot.setThrottle(motor, throttle);
+  }
+
+  if (since_print >= 500) {
+    since_print = 0;
+    for (uint8_t motor = 0; motor < 4; motor++)
+      Serial.printf("M%u %6u eRPM (%u errors)  ", motor, dshot.erpm(motor), dshot.telemetryErrors(motor));
+    Serial.printf(" encode %u cycles\n", dshot.encodeCycles());
+  }
+}
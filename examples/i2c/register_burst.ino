@@ -0,0 +1,43 @@
+#include <FlexIO_t4.h>
+#include <TeensyFlexI2C.h>
+
+// I2C master on FlexIO2: SDA on pin 10 (FXIO2 D0), SCL on pin 12 (FXIO2 D1).
+// Scans the bus, then keeps reading a 64 byte block from an EEPROM at 0x50
+// in the background while loop() stays free.
+TeensyFlexI2C i2c(10, 12);
+
+EventResponder burst_event;
+uint8_t block[64];
+const uint8_t block_address = 0;
+
+void burstDone(EventResponderRef event) {
+  if (event.getStatus() == TeensyFlexI2C::OK) {
+    Serial.printf("Block: %02x %02x %02x %02x ...\n", block[0], block[1], block[2], block[3]);
+  } else {
+    Serial.printf("Burst failed: %d\n", event.getStatus());
+  }
+}
+
+void setup() {
+  while (!Serial && millis() < 4000);
+  Serial.begin(115200);
+
+  if (!i2c.begin(1, 400000)) {
+    Serial.println("I2C begin failed");
+    return;
+  }
+
+  for (uint8_t address = 0x08; address < 0x78; address++) {
+    if (i2c.write(address, nullptr, 0) == TeensyFlexI2C::OK)
+      Serial.printf("Found device at 0x%02x\n", address);
+  }
+  burst_event.attachImmediate(&burstDone);
+}
+
+void loop() {
+  static elapsedMillis since_read;
+  if (since_read > 500 && !i2c.busy()) {
+    since_read = 0;
+    i2c.transfer(0x50, &block_address, 1, block, sizeof(block), burst_event);
+  }
+}
@@ -0,0 +1,57 @@
+#include <Arduino.h>
+#include "TeensyFlexMIDI.h"
+
+// Dense controller automation on a FlexIO MIDI port. Events are queued with
+// a time and leave on the 320 us tick with running status; a SysEx goes out
+// by DMA every second. Prints the event rate and the tick jitter.
+
+TeensyFlexSerial port(32, -1, 2); // MIDI OUT on pin 32, FlexIO2 (add an RX pin for MIDI IN)
+TeensyFlexMIDI midi(port);
+uint8_t sysex_in[64];
+const uint8_t identity_request[] = {0xF0, 0x7E, 0x7F, 0x06, 0x01, 0xF7};
+uint32_t next_time = 0;
+uint8_t value = 0;
+uint32_t last_events = 0, last_bytes = 0;
+elapsedMillis report_timer;
+
+void setup() {
+    while (!Serial && millis() < 4000);
+    Serial.begin(115200);
+    midi.setSysExBuffer(sysex_in, sizeof(sysex_in));
+    if (!midi.begin())
+        Serial.println("TeensyFlexMIDI begin failed (no free timer?)");
+    next_time = midi.now();
+}
+
+void loop() {
+    // Keep the queue topped up: a sweep on CC 1 and 2, a pair every 1280 us (4 bytes,
+    // what the line carries with running status)
+    while (midi.availableForSend() > 8) {
+        next_time += 1280;
+        midi.sendControlChange(1, 1, value, next_time);
+        midi.sendControlChange(1, 2, 127 - value, next_time);
+        value = (value + 1) & 0x7f;
+    }
+
+    TeensyFlexMIDIEvent event;
+    while (midi.read(event)) {
+        if (event.status == 0xF0)
+            Serial.printf("%u: SysEx, %u bytes\n", event.time, event.length);
+        else if (event.status < 0xF8)
+            Serial.printf("%u: %02x %u %u\n", event.time, event.status, event.data1, event.data2);
+    }
+
+    if (report_timer >= 1000) {
+        report_timer = 0;
+        const TeensyFlexServiceStats &stats = midi.tickStats();
+        uint32_t events = midi.eventsSent(), bytes = midi.bytesSent();
+        Serial.printf("%u events/s, %u bytes/s, tick jitter %.2f us (stddev %.2f us)\n",
+                      events - last_events, bytes - last_bytes,
+                      stats.jitterCycles() / (F_CPU_ACTUAL / 1000000.0f),
+                      stats.stddevCycles() / (F_CPU_ACTUAL / 1000000.0f));
+        last_events = events;
+        last_bytes = bytes;
+        midi.resetTickStats();
+        midi.sendSysEx(identity_request, sizeof(identity_request));
+    }
+}
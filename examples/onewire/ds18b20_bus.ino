@@ -0,0 +1,85 @@
+#include <FlexIO_t4.h>
+#include <TeensyFlexOneWire.h>
+
+// Read every DS18B20 on a 1-Wire bus without blocking.
+// Bus on pin 10 (FXIO2 D0) with a 4.7k pull-up to 3.3V.
+TeensyFlexOneWire bus(10);
+
+EventResponder search_event;
+EventResponder convert_event;
+EventResponder scratchpad_event;
+
+const uint8_t MAX_SENSORS = 8;
+uint8_t roms[MAX_SENSORS][8];
+uint8_t sensor_count = 0;
+uint8_t scratchpad[9];
+uint8_t current = 0;
+elapsedMillis since_convert;
+bool converting = false;
+
+void readNextSensor() {
+  if (current >= sensor_count)
+    return;
+  bus.select(roms[current]);
+  bus.write(0xBE);  // READ SCRATCHPAD
+  bus.read(scratchpad, sizeof(scratchpad), &scratchpad_event);
+}
+
+void searchDone(EventResponderRef event) {
+  sensor_count = event.getStatus();
+  Serial.printf("%u device(s) found\n", sensor_count);
+  for (uint8_t i = 0; i < sensor_count; i++) {
+    Serial.print("  ");
+    for (uint8_t b = 0; b < 8; b++)
+      Serial.printf("%02x", roms[i][b]);
+    Serial.println();
+  }
+}
+
+void convertStarted(EventResponderRef event) {
+  since_convert = 0;
+  converting = true;
+}
+
+void scratchpadRead(EventResponderRef event) {
+  if (TeensyFlexOneWire::crc8(scratchpad, 8) == scratchpad[8]) {
+    int16_t raw = scratchpad[0] | (scratchpad[1] << 8);
+    Serial.printf("sensor %u: %.2f C\n", current, raw / 16.0f);
+  } else {
+    Serial.printf("sensor %u: CRC error\n", current);
+  }
+  current++;
+  readNextSensor();
+}
+
+void setup() {
+  while (!Serial && millis() < 4000);
+  Serial.begin(115200);
+
+  if (!bus.begin(1)) {
+    Serial.println("OneWire begin failed");
+    return;
+  }
+  search_event.attachImmediate(&searchDone);
+  convert_event.attachImmediate(&convertStarted);
+  scratchpad_event.attachImmediate(&scratchpadRead);
+
+  bus.search(roms, MAX_SENSORS, search_event);
+}
+
+void loop() {
+  static elapsedMillis since_start;
+  if (bus.busy() || !sensor_count)
+    return;
+
+  // Start a conversion on every sensor at once, then read them in turn
+  if (!converting && since_start >= 1000) {
+    since_start = 0;
+    bus.skip();
+    bus.write(0x44, &convert_event);  // CONVERT T
+  } else if (converting && since_convert >= 750) {
+    converting = false;
+    current = 0;
+    readNextSensor();
+  }
+}
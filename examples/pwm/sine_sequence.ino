@@ -0,0 +1,42 @@
+#include <FlexIO_t4.h>
+#include <TeensyFlexPWM.h>
+
+// Three phase aligned 20 kHz PWM outputs on FlexIO2: pins 10, 12 and 11 (FXIO2 D0-D2).
+// Channels 0 and 1 play a 64 step sine table by DMA, channel 2 is set from loop().
+TeensyFlexPWM pwm;
+
+const uint16_t STEPS = 64;
+uint32_t frames[STEPS * 2];
+
+void setup() {
+  while (!Serial && millis() < 4000);
+  Serial.begin(115200);
+
+  if (!pwm.begin(1, 20000.0f)) {
+    Serial.println("PWM begin failed");
+    return;
+  }
+  int a = pwm.addChannel(10);
+  int b = pwm.addChannel(12);
+  pwm.addChannel(11);
+  Serial.printf("%.1f Hz, %u bit resolution\n", pwm.frequency(), pwm.resolutionBits());
+
+  // Two channels per frame, the second one a quarter turn behind
+  for (uint16_t i = 0; i < STEPS; i++) {
+    float angle = 2.0f * PI * i / STEPS;
+    frames[i * 2] = pwm.sequenceCompare((0.5f + 0.45f * sinf(angle)) * TeensyFlexPWM::DUTY_MAX);
+    frames[i * 2 + 1] = pwm.sequenceCompare((0.5f + 0.45f * cosf(angle)) * TeensyFlexPWM::DUTY_MAX);
+  }
+  if (!pwm.playSequence(a, b - a + 1, frames, STEPS))
+    Serial.println("Sequence needs consecutive timers");
+}
+
+void loop() {
+  static elapsedMillis since_step;
+  static uint16_t duty = 0;
+  if (since_step >= 10) {
+    since_step = 0;
+    duty += 256;
+    pwm.setDuty(2, duty);
+  }
+}
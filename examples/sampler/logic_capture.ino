@@ -0,0 +1,46 @@
+#include <FlexIO_t4.h>
+#include <TeensyFlexSampler.h>
+
+// Sample 4 FlexIO2 pins at 10 MHz, trigger on a rising edge of pin 40.
+// The capture is written to USB Serial in the TeensyFlexSamplerFormat, turn it
+// into a VCD with tools/flexsampler_vcd.py.
+const uint8_t sample_pins[4] = {40, 41, 42, 43}; // FXIO2 D4-D7
+TeensyFlexSampler sampler(sample_pins, 4);
+
+DMAMEM uint32_t ring[8192] __attribute__((aligned(32)));
+uint8_t capture[16384];
+
+void setup() {
+  while (!Serial && millis() < 4000);
+  Serial.begin(115200);
+
+  if (!sampler.begin(1, ring, sizeof(ring))) {
+    Serial.println("Sampler begin failed");
+    return;
+  }
+  Serial.printf("Sample rate: %u\n", sampler.setSampleRate(10000000));
+
+  SamplerTrigger trigger;
+  trigger.condition = TimerEnable::PinRising;
+  trigger.pin = 40;
+  sampler.setTrigger(trigger);
+  sampler.setDepth(1000, 20000);
+  sampler.arm();
+  Serial.println("Armed");
+}
+
+void loop() {
+  static bool compressing = false;
+  if (sampler.isDone() && !compressing) {
+    compressing = sampler.beginCompress(capture, sizeof(capture));
+  }
+  // Compress in the background, a chunk per loop
+  if (compressing && sampler.compressStep(512)) {
+    compressing = false;
+    Serial.printf("Captured %u samples, trigger at %u, %u bytes\n", sampler.sampleCount(),
+                  sampler.triggerIndex(), sampler.compressedSize());
+    Serial.write(capture, sampler.compressedSize());
+    delay(1000);
+    sampler.arm();
+  }
+}
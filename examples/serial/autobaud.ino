@@ -0,0 +1,27 @@
+#include <Arduino.h>
+#include "TeensyFlexSerial.h"
+
+// Finds the rate of a device that sends at an unknown baud rate. Here Serial1
+// (TX pin 1, wire it to pin 6) plays the device and changes its rate each round.
+
+TeensyFlexSerial flexSerial(5, 6, 1, -1, -1, 2); // RX on pin 6, FlexIO2
+const uint32_t rates[] = {9600, 57600, 115200, 250000, 921600, 2000000};
+uint8_t round_index = 0;
+
+void setup() {
+    while (!Serial && millis() < 4000);
+    Serial.begin(115200);
+    flexSerial.begin(115200);
+}
+
+void loop() {
+    uint32_t rate = rates[round_index++ % (sizeof(rates) / sizeof(rates[0]))];
+    Serial1.begin(rate);
+    Serial1.print("UUUU");
+
+    uint32_t start = micros();
+    uint32_t found = flexSerial.autobaud(100);
+    Serial.printf("sent at %lu, detected %lu (%lu us)\n", rate, found, micros() - start);
+    Serial1.flush();
+    delay(500);
+}
@@ -0,0 +1,36 @@
+#include <Arduino.h>
+#include "TeensyFlexSerial.h"
+
+// 6 Mbaud link to a modem or USB UART with RTS/CTS. CTS is a FlexIO pin that
+// gates the TX timer, so a character only starts while the other side is ready.
+// RTS drops when the RX buffer is 3/4 full and comes back at 1/4.
+
+TeensyFlexSerial modem(2, 3, 1, -1, -1, 1); // TX pin 2, RX pin 3, FlexIO1
+const int RTS_PIN = 6; // any pin
+const int CTS_PIN = 4; // FlexIO1 pin
+uint32_t received = 0;
+elapsedMillis report_timer;
+
+void setup() {
+    while (!Serial && millis() < 4000);
+    Serial.begin(115200);
+    modem.begin(6000000);
+    if (!modem.attachCts(CTS_PIN))
+        Serial.println("attachCts failed (pin not on FlexIO1?)");
+    modem.attachRts(RTS_PIN);
+}
+
+void loop() {
+    // Echo back, slowly enough that RTS has to hold the sender off
+    while (modem.available()) {
+        modem.write(modem.read());
+        received++;
+    }
+    delayMicroseconds(50);
+
+    if (report_timer >= 1000) {
+        report_timer = 0;
+        Serial.printf("%u bytes/s\n", received);
+        received = 0;
+    }
+}
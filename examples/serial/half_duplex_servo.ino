@@ -0,0 +1,38 @@
+#include <Arduino.h>
+#include "TeensyFlexSerial.h"
+
+// Pings a Dynamixel (protocol 1.0) servo on a single data wire. TX and RX share
+// pin 2 and the echo of the request is suppressed in hardware, so everything
+// read back is the servo's status packet.
+
+TeensyFlexSerial bus(2, 2, 1, -1, -1, 1); // one pin, FlexIO1
+const uint8_t SERVO_ID = 1;
+
+void setup() {
+    while (!Serial && millis() < 4000);
+    Serial.begin(115200);
+    bus.begin(1000000);
+    if (!bus.enableHalfDuplex())
+        Serial.println("enableHalfDuplex failed");
+}
+
+void loop() {
+    // FF FF id len instr checksum
+    uint8_t ping[6] = {0xff, 0xff, SERVO_ID, 2, 0x01, 0};
+    ping[5] = ~(ping[2] + ping[3] + ping[4]);
+    uint32_t start = micros();
+    bus.write(ping, sizeof(ping));
+
+    uint8_t reply[6];
+    size_t got = 0;
+    while ((got < sizeof(reply)) && ((micros() - start) < 5000)) {
+        int c = bus.read();
+        if (c >= 0)
+            reply[got++] = c;
+    }
+    if (got == sizeof(reply))
+        Serial.printf("servo %u: error 0x%02x, round trip %lu us\n", reply[2], reply[4], micros() - start);
+    else
+        Serial.println("no reply");
+    delay(500);
+}
@@ -0,0 +1,49 @@
+#include <Arduino.h>
+#include "TeensyFlexSerial.h"
+
+// Line based receive without an interrupt per byte: DMA stores the bytes and
+// a match shifter wakes the CPU on '\n' only. Connect Serial1 TX (pin 1) to
+// pin 6.
+
+TeensyFlexSerial flexSerial(-1, 6, -1, -1, -1, 2); // RX on pin 6, FlexIO2
+EventResponder lineEvent;
+volatile bool lineArrived = false;
+elapsedMillis output_timer;
+
+void lineReceived(EventResponderRef event_responder) {
+    lineArrived = true;
+}
+
+void setup() {
+    while (!Serial && millis() < 4000);
+    Serial.begin(115200);
+    Serial1.begin(115200);
+    flexSerial.begin(115200);
+
+    lineEvent.attachImmediate(&lineReceived);
+    flexSerial.setMatchEvent(lineEvent);
+    if (!flexSerial.enableMatch('\n'))
+        Serial.println("enableMatch failed (RX shifter without DMA request?)");
+}
+
+void loop() {
+    if (output_timer >= 500) {
+        output_timer = 0;
+        Serial1.printf("millis %lu\n", millis());
+    }
+
+    // The event is the fast path, the poll picks up anything it missed
+    static elapsedMillis poll_timer;
+    if (lineArrived || (poll_timer >= 100)) {
+        lineArrived = false;
+        poll_timer = 0;
+        uint8_t line[64];
+        size_t length;
+        while ((length = flexSerial.readUntilMatch(line, sizeof(line))) > 0) {
+            Serial.printf("(%lu wakeups) ", flexSerial.matchCount());
+            Serial.write(line, length);
+        }
+        if (flexSerial.rxOverruns())
+            Serial.printf("%lu overruns\n", flexSerial.rxOverruns());
+    }
+}
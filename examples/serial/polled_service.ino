@@ -0,0 +1,41 @@
+#include <Arduino.h>
+#include "TeensyFlexSerial.h"
+
+// Runs a FlexSerial TX without FlexIO interrupts: loop() calls poll(), which
+// services every driver on FLEXIO1 in one pass. Every few seconds the module
+// switches between interrupt and polled service and prints the refill jitter
+// of both.
+
+TeensyFlexSerial flexSerial(5, -1, 1); // TX on pin 5, FlexIO1
+elapsedMillis switch_timer;
+bool polled = false;
+
+static void printStats(const char *name, const TeensyFlexServiceStats &stats) {
+    float us_per_cycle = 1000000.0f / (float)F_CPU_ACTUAL;
+    Serial.printf("%s: %lu refills, mean %.2f us, jitter %.3f us (stddev %.3f us)\n", name,
+                  stats.count(), stats.meanCycles() * us_per_cycle,
+                  stats.jitterCycles() * us_per_cycle, stats.stddevCycles() * us_per_cycle);
+}
+
+void setup() {
+    while (!Serial && millis() < 4000);
+    Serial.begin(115200);
+    flexSerial.begin(115200);
+    switch_timer = 0;
+}
+
+void loop() {
+    if (polled)
+        TeensyFlexIO::poll(TeensyFlexIO::FLEXIO1);
+
+    if (flexSerial.availableForWrite() > 32)
+        flexSerial.print("The quick brown fox jumps over the lazy dog\n");
+
+    if (switch_timer >= 3000) {
+        switch_timer = 0;
+        printStats("interrupt", flexSerial.txServiceStats(false));
+        printStats("polled   ", flexSerial.txServiceStats(true));
+        polled = !polled;
+        TeensyFlexIO::setPolling(TeensyFlexIO::FLEXIO1, polled);
+    }
+}
@@ -0,0 +1,29 @@
+#include <Arduino.h>
+#include "TeensyFlexSerial.h"
+
+// RS-485 half duplex (e.g. a MAX485 with DE and /RE tied together). The DE pin
+// is driven by FlexIO timers from the TX buffer state, so the driver is on
+// 1 us before the first start bit and the bus is released 2 us after the last
+// stop bit without any software involvement.
+
+TeensyFlexSerial rs485(5, 6, 1, -1, -1, 1); // TX pin 5, RX pin 6, FlexIO1
+const int DE_PIN = 4;
+elapsedMillis poll_timer;
+
+void setup() {
+    while (!Serial && millis() < 4000);
+    Serial.begin(115200);
+    rs485.begin(115200);
+    if (!rs485.enableRS485(DE_PIN, 2000, false, 1000))
+        Serial.println("enableRS485 failed (no free timers, or DE pin not on FlexIO1?)");
+}
+
+void loop() {
+    // Poll a slave and print whatever it answers
+    if (poll_timer >= 250) {
+        poll_timer = 0;
+        rs485.print("?01\r\n");
+    }
+    while (rs485.available())
+        Serial.write(rs485.read());
+}
@@ -12,6 +12,9 @@ TeensyFlexSPI SPIFLEX(2, 3, 4, -1); // Setup on (int mosiPin, int sckPin, int mi
 #define release_cs() digitalWriteFast(5, HIGH)
 #endif
 
+// Resolved once in setup(), beginTransaction then only stores the register image
+TeensyFlexSPISettings spi_settings(20000000, MSBFIRST, SPI_MODE0);
+
 void setup() {
   pinMode(13, OUTPUT);
   while (!Serial && millis() < 4000);
@@ -29,6 +32,8 @@ void setup() {
   //SPIFLEX.flexIOHandler()->setClockSettings(2, 1, 7);	// clksel(0-3PLL4, Pll3 PFD2 PLL5, *PLL3_sw)
 
   Serial.printf("Updated Flex IO speed: %u\n", SPIFLEX.flexIOHandler()->computeClockRate());
+  spi_settings.resolve(SPIFLEX);
+  Serial.printf("SCK: %u\n", spi_settings.achievedClock());
 
   Serial.println("End Setup");
 }
@@ -37,7 +42,7 @@ uint16_t ret_buf[256];
 uint8_t ch_out = 0;
 
 void loop() {
-  SPIFLEX.beginTransaction(TeensyFlexSPISettings(20000000, MSBFIRST, SPI_MODE0));
+  SPIFLEX.beginTransaction(spi_settings);
   assert_cs();
   for (uint8_t ch_out = 0; ch_out < 64; ch_out++) {
     ret_buf[ch_out] = SPIFLEX.transfer(ch_out);
@@ -55,9 +60,9 @@ void loop() {
   Serial.println("After Transfer16 loop");
   delay(25);
   assert_cs();
-  SPIFLEX.transfer(buf, NULL, sizeof(buf));
+  TeensyFlexSPI::Status status = SPIFLEX.transfer(buf, NULL, sizeof(buf));
   release_cs();
-  Serial.println("After Transfer buf");
+  Serial.printf("After Transfer buf, status %d\n", status);
   SPIFLEX.endTransaction();
   delay(500);
 }
\ No newline at end of file
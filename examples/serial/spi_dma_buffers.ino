@@ -0,0 +1,47 @@
+#include <FlexIO_t4.h>
+#include <TeensyFlexSPI.h>
+
+// Send the same display lines over and over from pool buffers. The small pool
+// is in DTCM and never needs cache maintenance, the big one is in OCRAM and is
+// only flushed when a line changes.
+// MOSI 2, SCK 3, MISO 4 (FXIO1).
+TeensyFlexSPI SPIFLEX(2, 3, 4);
+
+TeensyFlexDMAPool<64, 2> command_pool;
+DMAMEM TeensyFlexDMAPool<1024, 4> line_pool;
+
+TeensyFlexDMABuffer *command;
+TeensyFlexDMABuffer *line;
+EventResponder spi_event;
+volatile bool busy = false;
+
+void spiDone(EventResponderRef event) {
+  busy = false;
+}
+
+void setup() {
+  while (!Serial && millis() < 4000);
+  Serial.begin(115200);
+
+  if (!SPIFLEX.begin(0)) {
+    Serial.println("SPIFlex Begin Failed");
+    return;
+  }
+  SPIFLEX.beginTransaction(TeensyFlexSPISettings(20000000, MSBFIRST, SPI_MODE0));
+  spi_event.attachImmediate(&spiDone);
+
+  command = command_pool.acquire();
+  line = line_pool.acquire();
+  memset(line->write(), 0x55, 1024);
+  Serial.printf("command cached:%u line cached:%u\n", command->cached(), line->cached());
+}
+
+void loop() {
+  static uint32_t frames = 0;
+  if (busy)
+    return;
+  if ((++frames % 100) == 0)
+    line->write()[0] = frames; // the next send flushes once
+  busy = true;
+  SPIFLEX.transferBuffers(line, nullptr, 1024, spi_event);
+}
@@ -0,0 +1,55 @@
+#include <FlexIO_t4.h>
+#include <TeensyFlexSPI.h>
+
+// Stream 24 bit samples from an ADC straight into a packed buffer with DMA,
+// 3 bytes per sample, nothing to repack afterwards.
+// MOSI 2, SCK 3, MISO 4 (FXIO1). CS on pin 10 by hand.
+TeensyFlexSPI SPIFLEX(2, 3, 4);
+const uint8_t CS_PIN = 10;
+
+const size_t SAMPLES = 256;
+uint8_t samples[SAMPLES * 3];
+EventResponder read_event;
+volatile bool done = false;
+
+void readDone(EventResponderRef event) {
+  digitalWriteFast(CS_PIN, HIGH);
+  done = true;
+}
+
+int32_t sample(size_t i) {
+  const uint8_t *p = &samples[i * 3];
+  int32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+  return (v << 8) >> 8; // sign extend
+}
+
+void setup() {
+  while (!Serial && millis() < 4000);
+  Serial.begin(115200);
+  pinMode(CS_PIN, OUTPUT);
+  digitalWriteFast(CS_PIN, HIGH);
+
+  if (!SPIFLEX.begin(0)) {
+    Serial.println("SPIFlex Begin Failed");
+    return;
+  }
+  SPIFLEX.beginTransaction(TeensyFlexSPISettings(4000000, MSBFIRST, SPI_MODE1, 24, true));
+  read_event.attachImmediate(&readDone);
+}
+
+void loop() {
+  static elapsedMillis since_read;
+  if (since_read >= 500) {
+    since_read = 0;
+    done = false;
+    digitalWriteFast(CS_PIN, LOW);
+    SPIFLEX.transfer(nullptr, samples, SAMPLES, read_event);
+  }
+  if (done) {
+    done = false;
+    int64_t sum = 0;
+    for (size_t i = 0; i < SAMPLES; i++)
+      sum += sample(i);
+    Serial.printf("first %ld mean %ld\n", sample(0), (int32_t)(sum / (int64_t)SAMPLES));
+  }
+}
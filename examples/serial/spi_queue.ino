@@ -0,0 +1,55 @@
+#include <FlexIO_t4.h>
+#include <TeensyFlexSPI.h>
+
+// Read 4 channels of an MCP3204 style ADC with one queued DMA program.
+// MOSI 2, SCK 3, MISO 4, hardware CS 5 (FXIO1).
+TeensyFlexSPI SPIFLEX(2, 3, 4, 5);
+
+const uint8_t CHANNELS = 4;
+uint8_t tx_cmd[CHANNELS][3];
+uint8_t rx_data[CHANNELS][3];
+TeensyFlexSPICommand commands[CHANNELS];
+EventResponder queue_event;
+volatile bool done = false;
+
+void queueDone(EventResponderRef event) {
+  done = true;
+}
+
+void setup() {
+  while (!Serial && millis() < 4000);
+  Serial.begin(115200);
+
+  if (!SPIFLEX.begin(0)) {
+    Serial.println("SPIFlex Begin Failed");
+    return;
+  }
+  SPIFLEX.beginTransaction(TeensyFlexSPISettings(2000000, MSBFIRST, SPI_MODE0));
+
+  for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+    // start, single ended, channel
+    tx_cmd[ch][0] = 0x06;
+    tx_cmd[ch][1] = ch << 6;
+    tx_cmd[ch][2] = 0;
+    commands[ch].txBuffer = tx_cmd[ch];
+    commands[ch].rxBuffer = rx_data[ch];
+    commands[ch].count = 3;
+    commands[ch].gapNs = 500;
+  }
+  queue_event.attachImmediate(&queueDone);
+}
+
+void loop() {
+  static elapsedMillis since_read;
+  if (since_read >= 100 && !SPIFLEX.queueActive()) {
+    since_read = 0;
+    done = false;
+    SPIFLEX.queue(commands, CHANNELS, queue_event);
+  }
+  if (done) {
+    done = false;
+    for (uint8_t ch = 0; ch < CHANNELS; ch++)
+      Serial.printf("%4u ", ((rx_data[ch][1] & 0x0f) << 8) | rx_data[ch][2]);
+    Serial.println();
+  }
+}
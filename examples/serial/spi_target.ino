@@ -0,0 +1,48 @@
+#include <FlexIO_t4.h>
+#include <TeensyFlexSPI.h>
+
+// SPI target on FlexIO2: MOSI 10, MISO 12, SCK 11, CS 13 (FXIO2 D0-D3).
+// Two buffer sets are swapped at every CS release, so the next response is always
+// armed before the controller starts the next transaction.
+TeensyFlexSPI SPITARGET(10, 12, 11, 13);
+
+const size_t FRAME = 32;
+uint8_t tx_buf[2][FRAME];
+uint8_t rx_buf[2][FRAME];
+uint8_t next_set = 0;
+EventResponder target_event[2];
+volatile uint32_t frames = 0;
+
+void transactionDone(EventResponderRef event) {
+  uint8_t set = (&event == &target_event[0]) ? 0 : 1;
+  frames++;
+  // Reply with what was received, plus one
+  for (size_t i = 0; i < FRAME; i++)
+    tx_buf[set][i] = rx_buf[set][i] + 1;
+  SPITARGET.setTargetBuffers(tx_buf[set], rx_buf[set], FRAME, target_event[set]);
+}
+
+void setup() {
+  while (!Serial && millis() < 4000);
+  Serial.begin(115200);
+
+  target_event[0].attachImmediate(&transactionDone);
+  target_event[1].attachImmediate(&transactionDone);
+
+  if (!SPITARGET.beginTarget(1, SPI_MODE0)) {
+    Serial.println("SPI target begin failed");
+    return;
+  }
+  // Arm one set and queue the other
+  SPITARGET.setTargetBuffers(tx_buf[0], rx_buf[0], FRAME, target_event[0]);
+  SPITARGET.setTargetBuffers(tx_buf[1], rx_buf[1], FRAME, target_event[1]);
+}
+
+void loop() {
+  static elapsedMillis since_print;
+  if (since_print >= 1000) {
+    since_print = 0;
+    Serial.printf("frames: %lu overruns: %lu underruns: %lu\n", frames, SPITARGET.targetOverruns(),
+                  SPITARGET.targetUnderruns());
+  }
+}
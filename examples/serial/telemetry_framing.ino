@@ -0,0 +1,59 @@
+#include <Arduino.h>
+#include "TeensyFlexFramer.h"
+
+// COBS framed telemetry with a CRC-16 on a FlexIO serial port (loop TX pin 2
+// back to RX pin 3). Packets are encoded straight into the TX buffer from a
+// header and a payload, received frames are decoded by the RX ISR into our own
+// buffers and handed over from there.
+
+TeensyFlexSerial link(2, 3, 1, -1, -1, 1); // TX pin 2, RX pin 3, FlexIO1
+TeensyFlexFramer framer(link, TeensyFlexFraming::COBS, true);
+
+struct Header {
+    uint8_t type;
+    uint8_t sequence;
+    uint16_t length;
+};
+float samples[8];
+uint8_t rx_buffers[2][64];
+volatile uint8_t *ready_packet = nullptr;
+volatile size_t ready_length = 0;
+elapsedMillis send_timer;
+uint8_t sequence = 0;
+
+// From the ISR: keep the packet for loop(), which gives the buffer back
+void onPacket(void *context, uint8_t *packet, size_t length) {
+    ready_length = length;
+    ready_packet = packet;
+}
+
+void setup() {
+    while (!Serial && millis() < 4000);
+    Serial.begin(115200);
+    link.begin(2000000);
+    framer.addBuffer(rx_buffers[0], sizeof(rx_buffers[0]));
+    framer.addBuffer(rx_buffers[1], sizeof(rx_buffers[1]));
+    framer.begin(&onPacket, nullptr, true); // DMA RX, one interrupt per frame
+}
+
+void loop() {
+    if (send_timer >= 100) {
+        send_timer = 0;
+        for (int i = 0; i < 8; i++)
+            samples[i] = analogRead(A0 + i) * (3.3f / 1023.0f);
+        Header header = {1, sequence++, sizeof(samples)};
+        TeensyFlexFrameSegment segments[2] = {{(const uint8_t *)&header, sizeof(header)},
+                                              {(const uint8_t *)samples, sizeof(samples)}};
+        framer.send(segments, 2);
+    }
+
+    if (ready_packet) {
+        uint8_t *packet = (uint8_t *)ready_packet;
+        ready_packet = nullptr;
+        Header header;
+        memcpy(&header, packet, sizeof(header));
+        Serial.printf("packet %u, type %u, %u bytes (%u frames, %u CRC errors)\n", header.sequence,
+                      header.type, ready_length, framer.decoder().frames(), framer.decoder().crcErrors());
+        framer.addBuffer(packet, sizeof(rx_buffers[0]));
+    }
+}
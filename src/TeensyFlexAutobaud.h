@@ -0,0 +1,139 @@
+#ifndef _TEENSY_FLEX_AUTOBAUD_H_
+#define _TEENSY_FLEX_AUTOBAUD_H_
+
+// Baud rate estimate from a sampled RX line (TeensyFlexSerial::autobaud).
+//
+// The samples are cut into runs of equal level. The shortest run is taken as
+// one bit, every run is rounded to a whole number of those bits and the bit
+// time is the total length over the total bit count (refined twice), so the
+// quantization and edge noise of single pulses average out. Runs longer than
+// 9 bits (idle line) are left out.
+// Needs a character with an isolated 0 or 1 bit (most do, 'U' = 0x55 is ideal):
+// a stream of 0xF0 looks exactly like 0x55 at five times the rate.
+#include <stdint.h>
+
+class TeensyFlexAutobaud {
+  public:
+    static const uint8_t MAX_RUNS = 48;
+    // Two 8N1 characters
+    static const uint16_t READY_BITS = 16;
+
+    void reset() {
+        _run_count = 0;
+        _level = 0;
+        _length = 0;
+        _partial = true;
+    }
+
+    // count samples, the oldest in bit 0 (a FlexIO Receive shifter, width 1)
+    void feed(uint32_t samples, uint8_t count = 32) {
+        for (uint8_t i = 0; i < count; i++) {
+            uint8_t level = (samples >> i) & 1;
+            if (_length && (level != _level)) {
+                // The run cut by the start of sampling (or a gap) is not a pulse
+                if (!_partial)
+                    addRun(_length);
+                _partial = false;
+                _length = 0;
+            }
+            _level = level;
+            _length++;
+        }
+    }
+
+    // Samples were lost (shifter overrun), the run in progress is not usable
+    void gap() {
+        _length = 0;
+        _partial = true;
+    }
+
+    bool ready() const {
+        uint32_t bits, ones;
+        return estimate(bits, ones) && (bits >= READY_BITS) && (ones >= 2);
+    }
+
+    // Samples per bit, 0 before any pulse was seen
+    float bitSamples() const {
+        uint32_t bits, ones;
+        return estimate(bits, ones);
+    }
+
+    // The measured rate, or the standard one within tolerance of it
+    uint32_t baud(uint32_t sampleRate, bool standard = true, float tolerance = 0.03f) const {
+        float samples = bitSamples();
+        if (samples <= 0.0f)
+            return 0;
+        uint32_t measured = (uint32_t)((float)sampleRate / samples + 0.5f);
+        return standard ? closestStandard(measured, tolerance) : measured;
+    }
+
+    static uint32_t closestStandard(uint32_t baud, float tolerance = 0.03f) {
+        static const uint32_t rates[] = {300, 600, 1200, 2400, 4800, 9600, 14400, 19200, 28800,
+                                         31250, 38400, 57600, 76800, 115200, 230400, 250000, 460800,
+                                         500000, 921600, 1000000, 1500000, 2000000, 3000000};
+        uint32_t best = baud;
+        float best_error = tolerance;
+        for (uint32_t rate : rates) {
+            float error = ((float)baud - (float)rate) / (float)rate;
+            if (error < 0.0f)
+                error = -error;
+            if (error <= best_error) {
+                best = rate;
+                best_error = error;
+            }
+        }
+        return best;
+    }
+
+    uint8_t runCount() const { return _run_count; }
+
+  private:
+    void addRun(uint32_t length) {
+        if (_run_count < MAX_RUNS)
+            _runs[_run_count++] = length;
+    }
+
+    // Bit time in samples, with the bit count it is based on and how many
+    // runs were a single bit
+    float estimate(uint32_t &bits, uint32_t &ones) const {
+        uint32_t shortest = UINT32_MAX;
+        for (uint8_t i = 0; i < _run_count; i++) {
+            if (_runs[i] < shortest)
+                shortest = _runs[i];
+        }
+        if (shortest == UINT32_MAX) {
+            bits = ones = 0;
+            return 0.0f;
+        }
+        // The shortest run comes out short on a noisy edge, so round again
+        // against the first average
+        float bit = fit((float)shortest, bits, ones);
+        for (uint8_t pass = 0; pass < 2 && bits; pass++)
+            bit = fit(bit, bits, ones);
+        return bit;
+    }
+
+    float fit(float bit, uint32_t &bits, uint32_t &ones) const {
+        bits = 0;
+        ones = 0;
+        uint32_t total = 0;
+        for (uint8_t i = 0; i < _run_count; i++) {
+            uint32_t n = (uint32_t)((float)_runs[i] / bit + 0.5f);
+            if (!n || (n > 9))
+                continue;
+            bits += n;
+            total += _runs[i];
+            if (n == 1)
+                ones++;
+        }
+        return bits ? (float)total / (float)bits : 0.0f;
+    }
+
+    uint32_t _runs[MAX_RUNS];
+    uint8_t _run_count = 0;
+    uint8_t _level = 0;
+    uint32_t _length = 0;
+    bool _partial = true;
+};
+
+#endif // _TEENSY_FLEX_AUTOBAUD_H_
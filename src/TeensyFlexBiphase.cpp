@@ -0,0 +1,322 @@
+#include "TeensyFlexBiphase.h"
+
+//=============================================================================
+// TeensyFlexBiphase::begin
+//=============================================================================
+bool TeensyFlexBiphase::begin(int flexio_module, uint32_t bitRate) {
+    if (((_txPin == -1) && (_rxPin == -1)) || !bitRate)
+        return false;
+
+    _flexIO = new TeensyFlexIO();
+    _flexIO->begin(static_cast<TeensyFlexIO::FlexIOModule>(flexio_module));
+    _module = flexio_module;
+
+    if (_txPin != -1) {
+        _tx_timer = _flexIO->requestTimers(1);
+        _tx_shifter = _flexIO->requestShifter();
+    }
+    if (_rxPin != -1) {
+        _rx_timer = _flexIO->requestTimers(1);
+        _rx_shifter = _flexIO->requestShifter();
+    }
+    if (((_txPin != -1) && ((_tx_timer == 0xff) || (_tx_shifter == 0xff))) ||
+        ((_rxPin != -1) && ((_rx_timer == 0xff) || (_rx_shifter == 0xff)))) {
+        _flexIO->getFlexIOHandler()->freeTimers(_tx_timer);
+        _tx_timer = 0xff;
+        _flexIO->getFlexIOHandler()->freeTimers(_rx_timer);
+        _rx_timer = 0xff;
+        _flexIO->getFlexIOHandler()->freeShifter(_tx_shifter);
+        _tx_shifter = 0xff;
+        _flexIO->getFlexIOHandler()->freeShifter(_rx_shifter);
+        _rx_shifter = 0xff;
+        #ifdef DEBUG_FlexBiphase
+            DEBUG_FlexBiphase.println("TeensyFlexBiphase - Failed to allocate timers or shifters");
+        #endif
+        end();
+        return false;
+    }
+
+    // Shift clock is the half bit rate: clock / (2 * (div + 1)) == 2 * bitRate
+    uint32_t clock_speed = _flexIO->getFlexIOHandler()->computeClockRate();
+    uint32_t div = (clock_speed / 4 + bitRate / 2) / bitRate;
+    if (div < 1)
+        div = 1;
+    else if (div > 256)
+        div = 256;
+    _bit_rate = clock_speed / (4 * div);
+    #ifdef DEBUG_FlexBiphase
+        DEBUG_FlexBiphase.printf("TeensyFlexBiphase - bit rate %u (div %u)\n", _bit_rate, div);
+    #endif
+
+    ShifterConfig shifter_config;
+    TimerConfig timer_config;
+    timer_config.mode = TimerMode::Baud;
+    timer_config.pinConfig = PinConfig::Disabled;
+    timer_config.timerDecrement = TimerDecrement::FlexIOClock;
+    timer_config.asDual().bits_in_word = 32 * 2 - 1;
+    timer_config.asDual().baud_rate_div = div - 1;
+
+    if (_txPin != -1) {
+        shifter_config.mode = ShifterMode::Transmit;
+        shifter_config.pinSelect = _txPin;
+        shifter_config.pinConfig = PinConfig::Output;
+        shifter_config.timerSelect = _tx_timer;
+        shifter_config.timerPolarity = TimerPolarity::ActiveHigh;
+        _flexIO->configureShifter(_tx_shifter, shifter_config);
+
+        // Runs while the DMA keeps the shifter fed
+        timer_config.triggerSelect = _flexIO->calculateTriggerSelect(TriggerType::SHIFTER, _tx_shifter);
+        timer_config.triggerPolarity = TriggerPolarity::ActiveLow;
+        timer_config.triggerSource = TriggerSource::Internal;
+        timer_config.timerEnable = TimerEnable::TriggerHigh;
+        timer_config.timerDisable = TimerDisable::OnCompare;
+        timer_config.timerReset = TimerReset::Never;
+        timer_config.timerOutput = TimerOutput::One;
+        _flexIO->configureTimer(_tx_timer, timer_config);
+
+        _flexIO->setPinFlexioMode(_txPin);
+        _flexIO->setPinParameters(_txPin, PullUp::DISABLED, 7, 3);
+        _flexIO->getFlexIO()->SHIFTBUF[_tx_shifter] = 0; // idle low
+    }
+
+    if (_rxPin != -1) {
+        shifter_config.mode = ShifterMode::Receive;
+        shifter_config.pinSelect = _rxPin;
+        shifter_config.pinConfig = PinConfig::Disabled;
+        shifter_config.timerSelect = _rx_timer;
+        // The timer output goes high on the edge, sample on its falling edge half a symbol later
+        shifter_config.timerPolarity = TimerPolarity::ActiveLow;
+        _flexIO->configureShifter(_rx_shifter, shifter_config);
+
+        timer_config.pinSelect = _rxPin;
+        timer_config.triggerSelect = 0;
+        timer_config.triggerPolarity = TriggerPolarity::ActiveHigh;
+        timer_config.triggerSource = TriggerSource::External;
+        timer_config.timerEnable = TimerEnable::Always;
+        timer_config.timerDisable = TimerDisable::Never;
+        timer_config.timerReset = TimerReset::PinRising;
+        timer_config.timerOutput = TimerOutput::EnableAndReset;
+        _flexIO->configureTimer(_rx_timer, timer_config);
+
+        _flexIO->setPinFlexioMode(_rxPin);
+        _flexIO->setPinParameters(_rxPin, PullUp::DISABLED, 0, 0);
+    }
+
+    _flexIO->enable();
+    if (!initDMAChannels()) {
+        end();
+        return false;
+    }
+    return true;
+}
+
+void TeensyFlexBiphase::end(void) {
+    if (!_flexIO)
+        return;
+    if (!_flexIO->getFlexIOHandler()) {
+        delete _flexIO;
+        _flexIO = nullptr;
+        return;
+    }
+    if (_dmaTX) {
+        _dmaTX->disable();
+        TeensyFlexDMADispatch::detach(_dmaTX->channel);
+        delete _dmaTX;
+        _dmaTX = nullptr;
+    }
+    if (_dmaRX) {
+        _dmaRX->disable();
+        TeensyFlexDMADispatch::detach(_dmaRX->channel);
+        delete _dmaRX;
+        _dmaRX = nullptr;
+    }
+    if (_tx_shifter != 0xff)
+        _flexIO->disableDMARequests(SHIFTER_MASK(_tx_shifter));
+    if (_rx_shifter != 0xff)
+        _flexIO->disableDMARequests(SHIFTER_MASK(_rx_shifter));
+    _flexIO->getFlexIOHandler()->freeTimers(_tx_timer);
+    _tx_timer = 0xff;
+    _flexIO->getFlexIOHandler()->freeTimers(_rx_timer);
+    _rx_timer = 0xff;
+    _flexIO->getFlexIOHandler()->freeShifter(_tx_shifter);
+    _tx_shifter = 0xff;
+    _flexIO->getFlexIOHandler()->freeShifter(_rx_shifter);
+    _rx_shifter = 0xff;
+    _transmitting = false;
+    delete _flexIO;
+    _flexIO = nullptr;
+}
+
+//=========================================================================
+// Init the DMA channels - TX one frame at a time, RX into a circular ring
+//=========================================================================
+bool TeensyFlexBiphase::initDMAChannels() {
+    if (_tx_shifter != 0xff) {
+        _dmaTX = new DMAChannel();
+        if (_dmaTX == nullptr)
+            return false;
+        _dmaTX->disable();
+        _dmaTX->destination(_flexIO->getFlexIO()->SHIFTBUF[_tx_shifter]);
+        _dmaTX->disableOnCompletion();
+        _dmaTX->interruptAtCompletion();
+        _dmaTX->triggerAtHardwareEvent(_flexIO->getFlexIOHandler()->shiftersDMAChannel(_tx_shifter));
+        _dmaTX->attachInterrupt(TeensyFlexDMADispatch::attach(
+            _dmaTX->channel, &TeensyFlexDMADispatch::member<TeensyFlexBiphase, &TeensyFlexBiphase::dma_txisr>, this));
+    }
+
+    if (_rx_shifter != 0xff) {
+        _dmaRX = new DMAChannel();
+        if (_dmaRX == nullptr)
+            return false;
+        _dmaRX->disable();
+        _dmaRX->source(_flexIO->getFlexIO()->SHIFTBUF[_rx_shifter]);
+        _dmaRX->destinationCircular(_rx_ring, sizeof(_rx_ring));
+        _dmaRX->triggerAtHardwareEvent(_flexIO->getFlexIOHandler()->shiftersDMAChannel(_rx_shifter));
+        // Counts half rings, so processRx() can tell when the DMA lapped it
+        _dmaRX->interruptAtHalf();
+        _dmaRX->interruptAtCompletion();
+        _dmaRX->attachInterrupt(TeensyFlexDMADispatch::attach(
+            _dmaRX->channel, &TeensyFlexDMADispatch::member<TeensyFlexBiphase, &TeensyFlexBiphase::dma_rxisr>, this));
+        _rx_tail = 0;
+        _rx_halves = 0;
+        _rx_decoded = 0;
+        _rx_overruns = 0;
+        _decoder.reset();
+        (void)_flexIO->getFlexIO()->SHIFTBUF[_rx_shifter];
+        _flexIO->enableDMARequests(SHIFTER_MASK(_rx_shifter));
+        _dmaRX->enable();
+    }
+    return true;
+}
+
+//=========================================================================
+// Transmit
+//=========================================================================
+bool TeensyFlexBiphase::write(const uint8_t *data, size_t count, EventResponderRef event_responder) {
+    return startWrite(data, count, &event_responder);
+}
+
+bool TeensyFlexBiphase::write(const uint8_t *data, size_t count) {
+    return startWrite(data, count, nullptr);
+}
+
+bool TeensyFlexBiphase::startWrite(const uint8_t *data, size_t count, EventResponder *event_responder) {
+    // Busy first: the responder of the frame in progress stays
+    if (!_dmaTX || _transmitting || (count > MAX_FRAME))
+        return false;
+    _event_responder = event_responder;
+
+    static const uint8_t header[TeensyFlexBiphaseCodec::PREAMBLE_BYTES + 1] = {
+        TeensyFlexBiphaseCodec::PREAMBLE, TeensyFlexBiphaseCodec::PREAMBLE, TeensyFlexBiphaseCodec::SYNC};
+    uint16_t *out = _tx_symbols;
+    uint8_t level = _codec.encode(_coding, header, sizeof(header), out, _tx_level);
+    out += sizeof(header);
+    level = _codec.encode(_coding, data, count, out, level);
+    out += count;
+
+    // At least one idle byte, and whole 32 bit words for the DMA
+    size_t symbols = sizeof(header) + count + 1;
+    symbols += symbols & 1;
+    while (out < _tx_symbols + symbols)
+        *out++ = TeensyFlexBiphaseCodec::idle(_coding, level);
+    _tx_level = level;
+
+    if ((uint32_t)_tx_symbols >= 0x20200000u)
+        arm_dcache_flush(_tx_symbols, symbols * 2);
+
+    _transmitting = true;
+    _dmaTX->sourceBuffer((uint32_t *)_tx_symbols, symbols * 2);
+    _dmaTX->enable();
+    _flexIO->enableDMARequests(SHIFTER_MASK(_tx_shifter));
+    return true;
+}
+
+//-------------------------------------------------------------------------
+// DMA TX ISR - the frame has been handed to the shifter
+//-------------------------------------------------------------------------
+void TeensyFlexBiphase::dma_txisr(void) {
+    _dmaTX->clearInterrupt();
+    _dmaTX->clearComplete();
+    _flexIO->disableDMARequests(SHIFTER_MASK(_tx_shifter));
+    _transmitting = false;
+    if (_event_responder) {
+        EventResponder *event_responder = _event_responder;
+        _event_responder = nullptr;
+        event_responder->triggerEvent(0, this);
+    }
+}
+
+//=========================================================================
+// Receive
+//=========================================================================
+void TeensyFlexBiphase::dma_rxisr(void) {
+    _dmaRX->clearInterrupt();
+    _rx_halves = _rx_halves + 1;
+    asm volatile("dsb");
+}
+
+void TeensyFlexBiphase::processRx(void) {
+    if (!_dmaRX)
+        return;
+    const uint32_t half = RX_RING_WORDS / 2;
+    __disable_irq();
+    uint32_t head = (uint32_t *)_dmaRX->destinationAddress() - _rx_ring;
+    uint32_t halves = _rx_halves;
+    __enable_irq();
+    if (head >= RX_RING_WORDS)
+        head = 0;
+    // Words the DMA has written since begin: the half interrupt may not have
+    // run yet for a boundary the DMA just crossed
+    if ((head / half) != (halves & 1))
+        halves++;
+    uint32_t written = halves * half + (head % half);
+    if ((written - _rx_decoded) > (RX_RING_WORDS - 1)) {
+        // Lapped: the oldest words are overwritten, the frame in progress is lost
+        _rx_overruns = _rx_overruns + 1;
+        _rx_decoded = written - (RX_RING_WORDS - 1);
+        _rx_tail = _rx_decoded % RX_RING_WORDS;
+        _decoder.reset();
+    }
+
+    while (_rx_tail != head) {
+        if ((uint32_t)_rx_ring >= 0x20200000u)
+            arm_dcache_delete(&_rx_ring[_rx_tail], 4);
+        uint8_t bytes[4];
+        size_t count = _decoder.feed(_rx_ring[_rx_tail], bytes, sizeof(bytes));
+        for (size_t i = 0; i < count; i++) {
+            uint16_t next = (_rx_head + 1) % RX_BUFFER_SIZE;
+            if (next == _rx_buffer_tail) {
+                _rx_overruns = _rx_overruns + 1; // full, drop
+                break;
+            }
+            _rx_buffer[_rx_head] = bytes[i];
+            _rx_head = next;
+        }
+        if (++_rx_tail >= RX_RING_WORDS)
+            _rx_tail = 0;
+        _rx_decoded++;
+    }
+}
+
+int TeensyFlexBiphase::available(void) {
+    processRx();
+    return (_rx_head + RX_BUFFER_SIZE - _rx_buffer_tail) % RX_BUFFER_SIZE;
+}
+
+int TeensyFlexBiphase::read(void) {
+    if (!available())
+        return -1;
+    uint8_t c = _rx_buffer[_rx_buffer_tail];
+    _rx_buffer_tail = (_rx_buffer_tail + 1) % RX_BUFFER_SIZE;
+    return c;
+}
+
+size_t TeensyFlexBiphase::read(uint8_t *buffer, size_t count) {
+    size_t n = 0;
+    available();
+    while ((n < count) && (_rx_buffer_tail != _rx_head)) {
+        buffer[n++] = _rx_buffer[_rx_buffer_tail];
+        _rx_buffer_tail = (_rx_buffer_tail + 1) % RX_BUFFER_SIZE;
+    }
+    return n;
+}
@@ -0,0 +1,91 @@
+#include "TeensyFlexIO.h"
+#include "TeensyFlexBiphaseCodec.h"
+#include "TeensyFlexDMADispatch.h"
+#include <Arduino.h>
+#include <DMAChannel.h>
+#include <EventResponder.h>
+
+#ifndef _TEENSY_FLEX_BIPHASE_H_
+#define _TEENSY_FLEX_BIPHASE_H_
+
+// Manchester / biphase mark link on FlexIO.
+//
+// TX: frames are expanded to half bit symbols with the codec tables and sent by
+// DMA through a Transmit shifter clocked by a Baud timer at twice the bit rate.
+// RX: a Receive shifter samples at twice the bit rate. Its Baud timer is reset on
+// every rising edge of the input (TimerReset::PinRising), which keeps the sample
+// point in the middle of each half bit. A circular DMA ring collects the symbols
+// and available()/read() run the decoder over whatever has arrived.
+class TeensyFlexBiphase {
+  public:
+    enum { MAX_FRAME = 256,
+           RX_RING_WORDS = 256,
+           RX_BUFFER_SIZE = 256 };
+
+    // Either pin may be -1 for a one direction link
+    TeensyFlexBiphase(int txPin, int rxPin, BiphaseCoding coding = BiphaseCoding::Manchester)
+        : _txPin(txPin), _rxPin(rxPin), _coding(coding), _decoder(_codec, coding){};
+    ~TeensyFlexBiphase() { end(); }
+
+    bool begin(int flexio_module, uint32_t bitRate);
+    void end(void);
+    uint32_t bitRate() { return _bit_rate; }
+
+    // Send one frame (preamble, sync, data) in the background
+    bool write(const uint8_t *data, size_t count, EventResponderRef event_responder);
+    bool write(const uint8_t *data, size_t count);
+    bool busy() { return _transmitting; }
+
+    // Decoded bytes of received frames
+    int available(void);
+    int read(void);
+    size_t read(uint8_t *buffer, size_t count);
+    bool inFrame() { return _decoder.locked(); }
+    uint32_t framesReceived() { return _decoder.framesEnded(); }
+    // Received data lost: available()/read() not called within RX_RING_WORDS
+    // words (the decoder restarts), or the decoded bytes not read in time
+    uint32_t rxOverruns() { return _rx_overruns; }
+
+  private:
+    int _txPin;
+    int _rxPin;
+    BiphaseCoding _coding;
+    TeensyFlexBiphaseCodec _codec;
+    TeensyFlexBiphaseDecoder _decoder;
+
+    TeensyFlexIO *_flexIO = nullptr;
+    uint8_t _module = 0xff;
+    uint8_t _tx_timer = 0xff;
+    uint8_t _rx_timer = 0xff;
+    uint8_t _tx_shifter = 0xff;
+    uint8_t _rx_shifter = 0xff;
+    uint32_t _bit_rate = 0;
+
+    // preamble + sync + data + idle, padded to whole words
+    uint16_t _tx_symbols[MAX_FRAME + TeensyFlexBiphaseCodec::PREAMBLE_BYTES + 4] __attribute__((aligned(32)));
+    uint8_t _tx_level = 0;
+    volatile bool _transmitting = false;
+
+    // The DMA wraps it with destination modulo addressing, which needs a power
+    // of two size and the ring aligned to it
+    static_assert((RX_RING_WORDS & (RX_RING_WORDS - 1)) == 0, "RX_RING_WORDS must be a power of two");
+    uint32_t _rx_ring[RX_RING_WORDS] __attribute__((aligned(sizeof(uint32_t) * RX_RING_WORDS)));
+    uint32_t _rx_tail = 0; // next ring word to decode
+    volatile uint32_t _rx_halves = 0; // half rings the DMA completed
+    uint32_t _rx_decoded = 0;         // ring words decoded since begin
+    volatile uint32_t _rx_overruns = 0;
+    uint8_t _rx_buffer[RX_BUFFER_SIZE];
+    uint16_t _rx_head = 0;
+    uint16_t _rx_buffer_tail = 0;
+
+    DMAChannel *_dmaTX = nullptr;
+    DMAChannel *_dmaRX = nullptr;
+    EventResponder *_event_responder = nullptr;
+
+    bool initDMAChannels();
+    bool startWrite(const uint8_t *data, size_t count, EventResponder *event_responder);
+    void processRx(void);
+    void dma_txisr(void);
+    void dma_rxisr(void);
+};
+#endif //_TEENSY_FLEX_BIPHASE_H_
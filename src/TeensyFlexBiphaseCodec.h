@@ -0,0 +1,195 @@
+#ifndef _TEENSY_FLEX_BIPHASE_CODEC_H_
+#define _TEENSY_FLEX_BIPHASE_CODEC_H_
+
+// Manchester and biphase mark (BMC) line coding for TeensyFlexBiphase.
+//
+// Every data bit becomes two half bit symbols. Bytes go out LSB first and the
+// symbols are packed LSB first as well, so the uint16_t of a byte can be written
+// straight into a transmit shifter (two bytes per 32 bit SHIFTBUF word).
+//   Manchester (IEEE 802.3): '0' = high, low    '1' = low, high
+//   Biphase mark: a transition at every bit start, '1' adds one mid bit
+// Frames start with PREAMBLE_BYTES of 0x55 and a sync byte so the receiver can
+// find the half bit phase and the byte boundary.
+#include <stddef.h>
+#include <stdint.h>
+
+enum class BiphaseCoding : uint8_t {
+    Manchester,
+    BiphaseMark
+};
+
+class TeensyFlexBiphaseCodec {
+  public:
+    static const uint8_t PREAMBLE = 0x55;
+    static const uint8_t PREAMBLE_BYTES = 2;
+    static const uint8_t SYNC = 0xd5;
+    static const uint8_t INVALID = 0xff;
+
+    TeensyFlexBiphaseCodec() {
+        for (uint32_t x = 0; x < 256; x++) {
+            uint16_t man = 0, bmc = 0;
+            uint8_t level = 0;
+            for (uint8_t i = 0; i < 8; i++) {
+                uint8_t bit = (x >> i) & 1;
+                man |= (bit ? 2 : 1) << (i * 2);
+                level ^= 1; // transition at the start of every bit
+                uint8_t first = level;
+                if (bit)
+                    level ^= 1;
+                bmc |= (first | (level << 1)) << (i * 2);
+            }
+            _manchester[x] = man;
+            _bmc[x] = bmc;
+
+            // 8 half bits -> 4 data bits
+            uint8_t man_nibble = 0, bmc_nibble = 0;
+            for (uint8_t i = 0; i < 4; i++) {
+                uint8_t first = (x >> (i * 2)) & 1;
+                uint8_t second = (x >> (i * 2 + 1)) & 1;
+                if (first == second)
+                    man_nibble = INVALID;
+                else if (man_nibble != INVALID)
+                    man_nibble |= second << i;
+                bmc_nibble |= (first ^ second) << i;
+                // BMC needs a transition between the bits inside the nibble too
+                if ((i < 3) && (second == ((x >> (i * 2 + 2)) & 1)))
+                    bmc_nibble |= 0x80;
+            }
+            _manchester_decode[x] = man_nibble;
+            _bmc_decode[x] = bmc_nibble;
+        }
+    }
+
+    // Symbols for one byte. For BMC 'level' is the line level before the byte and
+    // is updated to the level after it.
+    uint16_t encode(BiphaseCoding coding, uint8_t value, uint8_t &level) const {
+        if (coding == BiphaseCoding::Manchester)
+            return _manchester[value];
+        uint16_t symbols = _bmc[value] ^ (uint16_t)(0 - level); // table starts from level 0
+        level = symbols >> 15;
+        return symbols;
+    }
+
+    // Expand count bytes into count symbol words. Returns the level after the last byte.
+    uint8_t encode(BiphaseCoding coding, const uint8_t *in, size_t count, uint16_t *out, uint8_t level = 0) const {
+        if (coding == BiphaseCoding::Manchester) {
+            for (size_t i = 0; i < count; i++)
+                out[i] = _manchester[in[i]];
+            return 0;
+        }
+        for (size_t i = 0; i < count; i++) {
+            uint16_t symbols = _bmc[in[i]] ^ (uint16_t)(0 - level);
+            level = symbols >> 15;
+            out[i] = symbols;
+        }
+        return level;
+    }
+
+    // Decode 16 half bits back into a byte. 'last' is the half bit before them (BMC only).
+    // Returns false if the symbols are not valid for the coding.
+    bool decode(BiphaseCoding coding, uint16_t symbols, uint8_t last, uint8_t &value) const {
+        if (coding == BiphaseCoding::Manchester) {
+            uint8_t lo = _manchester_decode[symbols & 0xff];
+            uint8_t hi = _manchester_decode[symbols >> 8];
+            if ((lo | hi) & 0x80)
+                return false;
+            value = lo | (hi << 4);
+            return true;
+        }
+        uint8_t lo = _bmc_decode[symbols & 0xff];
+        uint8_t hi = _bmc_decode[symbols >> 8];
+        if ((lo | hi) & 0x80)
+            return false;
+        // Transitions at the nibble boundary and at the start of the byte
+        if ((((symbols >> 7) ^ (symbols >> 8)) & 1) == 0 || ((symbols ^ last) & 1) == 0)
+            return false;
+        value = (lo & 0x0f) | ((hi & 0x0f) << 4);
+        return true;
+    }
+
+    // Idle symbols that keep the line at 'level'
+    static uint16_t idle(BiphaseCoding coding, uint8_t level) {
+        return (coding == BiphaseCoding::Manchester || !level) ? 0 : 0xffff;
+    }
+
+  private:
+    uint16_t _manchester[256];
+    uint16_t _bmc[256];
+    uint8_t _manchester_decode[256];
+    uint8_t _bmc_decode[256];
+};
+
+// Turns a stream of received half bit symbols (32 per word, oldest in bit 0) into
+// bytes. It hunts for the sync byte one half bit at a time, then decodes whole
+// bytes until it sees symbols that are not valid, which ends the frame.
+class TeensyFlexBiphaseDecoder {
+  public:
+    TeensyFlexBiphaseDecoder(const TeensyFlexBiphaseCodec &codec, BiphaseCoding coding)
+        : _codec(codec), _coding(coding) {}
+
+    void reset() {
+        _acc = 0;
+        _have = 0;
+        _last = 0;
+        _locked = false;
+    }
+
+    // Returns the number of bytes written to out (at most capacity, excess is dropped)
+    size_t feed(uint32_t word, uint8_t *out, size_t capacity) {
+        size_t count = 0;
+        // A quiet line cannot hold a frame, skip it cheaply
+        if (!_locked && ((word == 0) || (word == 0xffffffff))) {
+            _last = word & 1;
+            _acc = 0;
+            _have = 0;
+            return 0;
+        }
+        _acc |= (uint64_t)word << _have;
+        _have += 32;
+
+        uint8_t value;
+        while (_have >= 16) {
+            uint16_t symbols = _acc & 0xffff;
+            if (_locked) {
+                if (!_codec.decode(_coding, symbols, _last, value)) {
+                    _locked = false;
+                    _frames_ended++;
+                    continue; // hunt again from the same position
+                }
+                if (count < capacity)
+                    out[count++] = value;
+                else
+                    _overruns++;
+                consume(16);
+            } else if (_codec.decode(_coding, symbols, _last, value) && (value == TeensyFlexBiphaseCodec::SYNC)) {
+                _locked = true;
+                consume(16);
+            } else {
+                consume(1);
+            }
+        }
+        return count;
+    }
+
+    bool locked() const { return _locked; }
+    uint32_t framesEnded() const { return _frames_ended; }
+    uint32_t overruns() const { return _overruns; }
+
+  private:
+    void consume(uint8_t halfBits) {
+        _last = (_acc >> (halfBits - 1)) & 1;
+        _acc >>= halfBits;
+        _have -= halfBits;
+    }
+
+    const TeensyFlexBiphaseCodec &_codec;
+    BiphaseCoding _coding;
+    uint64_t _acc = 0;
+    uint8_t _have = 0;
+    uint8_t _last = 0;
+    bool _locked = false;
+    uint32_t _frames_ended = 0;
+    uint32_t _overruns = 0;
+};
+
+#endif // _TEENSY_FLEX_BIPHASE_CODEC_H_
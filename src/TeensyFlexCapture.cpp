@@ -0,0 +1,323 @@
+#include "TeensyFlexCapture.h"
+
+//=============================================================================
+// TeensyFlexCapture::begin
+//=============================================================================
+bool TeensyFlexCapture::begin(int flexio_module, uint16_t width, uint16_t height, uint8_t bytesPerPixel) {
+    _width = width;
+    _height = height;
+    _lineBytes = width * bytesPerPixel;
+
+    // DMA moves whole 32 bit shifter words, so lines have to be a multiple of 4 bytes
+    if ((_lineBytes == 0) || (_lineBytes & 3) || (_height == 0)) {
+        #ifdef DEBUG_FlexCapture
+            DEBUG_FlexCapture.printf("TeensyFlexCapture - line length %u not a multiple of 4\n", _lineBytes);
+        #endif
+        return false;
+    }
+
+    _flexIO = new TeensyFlexIO();
+    _flexIO->begin(static_cast<TeensyFlexIO::FlexIOModule>(flexio_module));
+    _module = flexio_module;
+
+    //-------------------------------------------------------------------------
+    // Data pins have to be 8 consecutive FXIO pins so one shifter can sample them
+    //-------------------------------------------------------------------------
+    uint8_t data_flex_pin = _flexIO->getFlexIOHandler()->mapIOPinToFlexPin(_dataPins[0]);
+    uint8_t href_flex_pin = _flexIO->getFlexIOHandler()->mapIOPinToFlexPin(_hrefPin);
+    if ((data_flex_pin == 0xff) || (href_flex_pin == 0xff) ||
+        (_flexIO->getFlexIOHandler()->mapIOPinToFlexPin(_pclkPin) == 0xff)) {
+        #ifdef DEBUG_FlexCapture
+            DEBUG_FlexCapture.println("TeensyFlexCapture - PCLK, HREF or D0 is not a FlexIO pin");
+        #endif
+        end();
+        return false;
+    }
+    for (uint8_t i = 1; i < DATA_PIN_COUNT; i++) {
+        if (_flexIO->getFlexIOHandler()->mapIOPinToFlexPin(_dataPins[i]) != data_flex_pin + i) {
+            #ifdef DEBUG_FlexCapture
+                DEBUG_FlexCapture.printf("TeensyFlexCapture - data pin %d is not FXIO D%d\n", _dataPins[i], data_flex_pin + i);
+            #endif
+            end();
+            return false;
+        }
+    }
+
+    // Now reserve timer and shifter
+    _timer = _flexIO->requestTimers(1);
+    _shifter = _flexIO->requestShifter();
+
+    if ((_timer == 0xff) || (_shifter == 0xff)) {
+        #ifdef DEBUG_FlexCapture
+            DEBUG_FlexCapture.println("TeensyFlexCapture - Failed to allocate timer or shifter");
+        #endif
+        end();
+        return false;
+    }
+
+    // Receive shifter, 8 bits per shift clock, sample on the rising edge of PCLK
+    ShifterConfig shifter_config;
+    shifter_config.mode = ShifterMode::Receive;
+    shifter_config.pinSelect = _dataPins[0];
+    shifter_config.pinConfig = PinConfig::Disabled;
+    shifter_config.timerSelect = _timer;
+    shifter_config.timerPolarity = TimerPolarity::ActiveHigh;
+    shifter_config.parallelWidth = 7;
+    _flexIO->configureShifter(_shifter, shifter_config);
+
+    // Timer decrements on both PCLK edges and is only enabled while HREF is high.
+    // 4 shifts of 8 bits fill the 32 bit shifter, which then requests DMA.
+    TimerConfig timer_config;
+    timer_config.mode = TimerMode::Baud;
+    timer_config.pinSelect = _pclkPin;
+    timer_config.pinPolarity = PinPolarity::ActiveHigh;
+    timer_config.pinConfig = PinConfig::Disabled;
+    timer_config.triggerSelect = _flexIO->calculateTriggerSelect(TriggerType::PIN, href_flex_pin);
+    timer_config.triggerPolarity = TriggerPolarity::ActiveHigh;
+    timer_config.triggerSource = TriggerSource::Internal;
+    timer_config.timerEnable = TimerEnable::TriggerRising;
+    timer_config.timerDisable = TimerDisable::TriggerFallingEdge;
+    timer_config.timerReset = TimerReset::Never;
+    timer_config.timerDecrement = TimerDecrement::PinInput;
+    timer_config.timerOutput = TimerOutput::One;
+    timer_config.asDual().bits_in_word = 4 * 2 - 1;
+    timer_config.asDual().baud_rate_div = 0;
+    _flexIO->configureTimer(_timer, timer_config);
+
+    _flexIO->setPinFlexioMode(_pclkPin);
+    _flexIO->setPinFlexioMode(_hrefPin);
+    for (uint8_t i = 0; i < DATA_PIN_COUNT; i++) {
+        _flexIO->setPinFlexioMode(_dataPins[i]);
+    }
+    pinMode(_vsyncPin, INPUT);
+
+    _flexIO->enable();
+
+    if (!initDMAChannel()) {
+        end();
+        return false;
+    }
+
+    #ifdef DEBUG_FlexCapture
+        IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+        DEBUG_FlexCapture.printf("TeensyFlexCapture timer: %d shifter: %d line bytes: %u\n", _timer, _shifter, _lineBytes);
+        DEBUG_FlexCapture.printf("SHIFTCTL:%x SHIFTCFG:%x\n", p->SHIFTCTL[_shifter], p->SHIFTCFG[_shifter]);
+        DEBUG_FlexCapture.printf("TIMCTL:%x TIMCFG:%x TIMCMP:%x\n", p->TIMCTL[_timer], p->TIMCFG[_timer], p->TIMCMP[_timer]);
+    #endif
+    return true;
+}
+
+void TeensyFlexCapture::end(void) {
+    if (!_flexIO)
+        return;
+    if (!_flexIO->getFlexIOHandler()) {
+        delete _flexIO;
+        _flexIO = nullptr;
+        return;
+    }
+    stop();
+    _flexIO->getFlexIOHandler()->freeTimers(_timer);
+    _timer = 0xff;
+    _flexIO->getFlexIOHandler()->freeShifter(_shifter);
+    _shifter = 0xff;
+    if (_dmaRX) {
+        _dmaRX->disable();
+        TeensyFlexDMADispatch::detach(_dmaRX->channel);
+        delete _dmaRX;
+        _dmaRX = nullptr;
+    }
+    delete _flexIO;
+    _flexIO = nullptr;
+}
+
+//=========================================================================
+// Init the DMA channel
+//=========================================================================
+bool TeensyFlexCapture::initDMAChannel() {
+    _dmaRX = new DMAChannel();
+    if (_dmaRX == nullptr) {
+        #ifdef DEBUG_FlexCapture
+            DEBUG_FlexCapture.println("Failed to allocate DMA RX channel");
+        #endif
+        return false;
+    }
+
+    _dmaRX->disable();
+    _dmaRX->source(_flexIO->getFlexIO()->SHIFTBUF[_shifter]);
+    _dmaRX->disableOnCompletion();
+    _dmaRX->interruptAtCompletion();
+    _dmaRX->triggerAtHardwareEvent(_flexIO->getFlexIOHandler()->shiftersDMAChannel(_shifter));
+    _dmaRX->attachInterrupt(TeensyFlexDMADispatch::attach(
+        _dmaRX->channel, &TeensyFlexDMADispatch::member<TeensyFlexCapture, &TeensyFlexCapture::dma_rxisr>, this));
+    return true;
+}
+
+bool TeensyFlexCapture::addFrameBuffer(void *buffer, size_t size) {
+    if (_capturing || !buffer || (size < frameSize()) || (_frame_buffer_count >= MAX_FRAME_BUFFERS))
+        return false;
+    if (((uint32_t)buffer >= 0x20200000u) && (((uint32_t)buffer & 31) || (size < ((frameSize() + 31) & ~(size_t)31)))) {
+        #ifdef DEBUG_FlexCapture
+            DEBUG_FlexCapture.printf("TeensyFlexCapture - frame buffer %p is not cache line aligned\n", buffer);
+        #endif
+        return false;
+    }
+    _frame_buffers[_frame_buffer_count++] = (uint8_t *)buffer;
+    return true;
+}
+
+//=========================================================================
+// Start/Stop - frames are armed on each VSYNC
+//=========================================================================
+bool TeensyFlexCapture::start(void) {
+    if (!_dmaRX || !_frame_buffer_count)
+        return false;
+    if (_capturing)
+        return true;
+
+    _frame_head = 0;
+    _frame_tail = 0;
+    _frames_ready = 0;
+    _frame_active = false;
+    _last_frame_us = 0;
+    _capturing = true;
+
+    // Start of frame is the falling edge of VSYNC, data follows with the first HREF
+    TeensyFlexPinDispatch::Isr vsync_isr = TeensyFlexPinDispatch::attach(
+        _vsyncPin, &TeensyFlexPinDispatch::member<TeensyFlexCapture, &TeensyFlexCapture::vsyncisr>, this);
+    if (!vsync_isr) {
+        _capturing = false;
+        return false;
+    }
+    attachInterrupt(digitalPinToInterrupt(_vsyncPin), vsync_isr, FALLING);
+    return true;
+}
+
+void TeensyFlexCapture::stop(void) {
+    if (!_capturing)
+        return;
+    detachInterrupt(digitalPinToInterrupt(_vsyncPin));
+    TeensyFlexPinDispatch::detach(_vsyncPin);
+    __disable_irq();
+    _dmaRX->disable();
+    _flexIO->disableDMARequests(SHIFTER_MASK(_shifter));
+    _frame_active = false;
+    _capturing = false;
+    __enable_irq();
+}
+
+void TeensyFlexCapture::armFrame(void) {
+    if (_frame_active) {
+        // VSYNC came before the last line completed, throw the partial frame away
+        _dmaRX->disable();
+        _frame_active = false;
+        _frames_dropped = _frames_dropped + 1;
+    }
+
+    if (_frames_ready >= _frame_buffer_count) {
+        // Consumer still owns every buffer, skip this frame
+        _frames_dropped = _frames_dropped + 1;
+        return;
+    }
+
+    uint8_t *frame = _frame_buffers[_frame_head];
+    if ((uint32_t)frame >= 0x20200000u)
+        arm_dcache_delete(frame, frameSize());
+
+    _line = 0;
+    _dmaRX->destinationBuffer((uint32_t *)frame, _lineBytes);
+    _dmaRX->TCD->DLASTSGA = 0; // Leave it pointing at the next line
+
+    // Throw away anything left in the shifter from the vertical blanking period
+    IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+    (void)p->SHIFTBUF[_shifter];
+    p->SHIFTERR = SHIFTER_MASK(_shifter);
+    _flexIO->enableDMARequests(SHIFTER_MASK(_shifter));
+
+    _frame_active = true;
+    _dmaRX->enable();
+}
+
+//=========================================================================
+// Consumer side
+//=========================================================================
+uint8_t *TeensyFlexCapture::readFrame(void) {
+    if (!_frames_ready)
+        return nullptr;
+    return _frame_buffers[_frame_tail];
+}
+
+void TeensyFlexCapture::releaseFrame(void) {
+    if (!_frames_ready)
+        return;
+    if (++_frame_tail >= _frame_buffer_count)
+        _frame_tail = 0;
+    __disable_irq();
+    _frames_ready = _frames_ready - 1;
+    __enable_irq();
+}
+
+float TeensyFlexCapture::frameRate() {
+    uint32_t period = _frame_period_us;
+    return period ? 1000000.0f / (float)period : 0.0f;
+}
+
+void TeensyFlexCapture::resetStats(void) {
+    __disable_irq();
+    _frames_captured = 0;
+    _frames_dropped = 0;
+    _lines_captured = 0;
+    _frame_period_us = 0;
+    _last_frame_us = 0;
+    __enable_irq();
+}
+
+//=========================================================================
+// Interrupt handlers
+//=========================================================================
+void TeensyFlexCapture::vsyncisr(void) {
+    if (_capturing)
+        armFrame();
+}
+
+//-------------------------------------------------------------------------
+// DMA RX ISR - called at the end of every line
+//-------------------------------------------------------------------------
+void TeensyFlexCapture::dma_rxisr(void) {
+    _dmaRX->clearInterrupt();
+    _dmaRX->clearComplete();
+
+    uint8_t *frame = _frame_buffers[_frame_head];
+    uint16_t line = _line;
+    _line = line + 1;
+    _lines_captured = _lines_captured + 1;
+
+    if (_line < _height) {
+        // DMA is idle until the next HREF, so there is plenty of time to restart it
+        _dmaRX->enable();
+        if (_line_event_responder)
+            _line_event_responder->triggerEvent(line, frame + (uint32_t)line * _lineBytes);
+        return;
+    }
+
+    // Last line, the frame is complete
+    _flexIO->disableDMARequests(SHIFTER_MASK(_shifter));
+    _frame_active = false;
+
+    uint32_t now = micros();
+    if (_last_frame_us) {
+        uint32_t period = now - _last_frame_us;
+        _frame_period_us = _frame_period_us ? (_frame_period_us * 7 + period) / 8 : period;
+    }
+    _last_frame_us = now;
+
+    uint32_t frame_number = _frames_captured;
+    _frames_captured = frame_number + 1;
+    if (++_frame_head >= _frame_buffer_count)
+        _frame_head = 0;
+    _frames_ready = _frames_ready + 1;
+
+    if (_line_event_responder)
+        _line_event_responder->triggerEvent(line, frame + (uint32_t)line * _lineBytes);
+    if (_frame_event_responder)
+        _frame_event_responder->triggerEvent(frame_number, frame);
+}
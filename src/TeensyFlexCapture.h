@@ -0,0 +1,105 @@
+#include "TeensyFlexDMADispatch.h"
+#include "TeensyFlexIO.h"
+#include <Arduino.h>
+#include <DMAChannel.h>
+#include <EventResponder.h>
+
+#ifndef _TEENSY_FLEX_CAPTURE_H_
+#define _TEENSY_FLEX_CAPTURE_H_
+
+// Parallel (DVP) camera capture, e.g. OV7670 class sensors, through FlexIO.
+//
+// One Receive shifter samples 8 consecutive FXIO data pins (parallelWidth = 7)
+// on every PCLK rising edge. The shifter timer is clocked from the PCLK pin and
+// gated by HREF, so bytes are only shifted while a line is active. DMA moves one
+// line at a time into a ring of caller supplied frame buffers; VSYNC marks the
+// start of each frame.
+class TeensyFlexCapture {
+  public:
+    enum { MAX_FRAME_BUFFERS = 4,
+           DATA_PIN_COUNT = 8 };
+
+    // dataPins must map to 8 consecutive FXIO pins on the same module, D0 first.
+    TeensyFlexCapture(int pclkPin, int hrefPin, int vsyncPin, const uint8_t dataPins[DATA_PIN_COUNT]) : _pclkPin(pclkPin), _hrefPin(hrefPin), _vsyncPin(vsyncPin) {
+        memcpy(_dataPins, dataPins, sizeof(_dataPins));
+    };
+
+    ~TeensyFlexCapture() { end(); }
+    bool begin(int flexio_module, uint16_t width, uint16_t height, uint8_t bytesPerPixel = 2);
+    void end(void);
+
+    // Frame buffer ring. Each buffer must hold width * height * bytesPerPixel bytes.
+    // Buffers in cached memory (DMAMEM, EXTMEM) are invalidated before every
+    // frame, so they must start on a 32 byte cache line and size must cover the
+    // frame rounded up to a whole line, otherwise the invalidate would throw away
+    // whatever shares the first or last line. Such buffers are rejected.
+    bool addFrameBuffer(void *buffer, size_t size);
+    size_t frameSize() { return (size_t)_lineBytes * _height; }
+
+    bool start(void);
+    void stop(void);
+    bool isCapturing() { return _capturing; }
+
+    // Events are triggered from the DMA/VSYNC interrupts.
+    // Line event: status = line number, data = start of that line in the frame buffer.
+    // Frame event: status = frame number, data = completed frame buffer.
+    void setLineEvent(EventResponderRef event_responder) { _line_event_responder = &event_responder; }
+    void setFrameEvent(EventResponderRef event_responder) { _frame_event_responder = &event_responder; }
+
+    // Consumer side of the ring. readFrame returns the oldest completed frame
+    // (or nullptr) and keeps it out of the ring until releaseFrame is called.
+    uint8_t *readFrame(void);
+    void releaseFrame(void);
+    uint8_t framesAvailable() { return _frames_ready; }
+
+    // Statistics
+    uint32_t framesCaptured() { return _frames_captured; }
+    uint32_t framesDropped() { return _frames_dropped; }
+    uint32_t linesCaptured() { return _lines_captured; }
+    float frameRate();
+    void resetStats(void);
+
+    FlexIOHandler *flexIOHandler() { return _flexIO ? _flexIO->getFlexIOHandler() : nullptr; }
+
+  private:
+    int _pclkPin;
+    int _hrefPin;
+    int _vsyncPin;
+    uint8_t _dataPins[DATA_PIN_COUNT];
+
+    TeensyFlexIO *_flexIO = nullptr;
+    uint8_t _timer = 0xff;
+    uint8_t _shifter = 0xff;
+    uint8_t _module = 0xff;
+
+    uint16_t _width = 0;
+    uint16_t _height = 0;
+    uint16_t _lineBytes = 0;
+
+    // Frame ring
+    uint8_t *_frame_buffers[MAX_FRAME_BUFFERS] = {nullptr};
+    uint8_t _frame_buffer_count = 0;
+    uint8_t _frame_head = 0;               // buffer being (or next to be) filled
+    uint8_t _frame_tail = 0;               // oldest completed buffer
+    volatile uint8_t _frames_ready = 0;    // completed frames not yet released
+    volatile bool _frame_active = false;   // DMA is filling _frame_head
+    volatile bool _capturing = false;
+    volatile uint16_t _line = 0;
+
+    // Statistics
+    volatile uint32_t _frames_captured = 0;
+    volatile uint32_t _frames_dropped = 0;
+    volatile uint32_t _lines_captured = 0;
+    volatile uint32_t _last_frame_us = 0;
+    volatile uint32_t _frame_period_us = 0;  // filtered frame to frame time
+
+    EventResponder *_line_event_responder = nullptr;
+    EventResponder *_frame_event_responder = nullptr;
+
+    DMAChannel *_dmaRX = nullptr;
+    bool initDMAChannel();
+    void armFrame(void);
+    void dma_rxisr(void);
+    void vsyncisr(void);
+};
+#endif //_TEENSY_FLEX_CAPTURE_H_
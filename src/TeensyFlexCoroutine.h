@@ -0,0 +1,173 @@
+#ifndef _TEENSY_FLEX_COROUTINE_H_
+#define _TEENSY_FLEX_COROUTINE_H_
+
+// C++20 coroutine support for the asynchronous transfers. Only built when the
+// compiler has coroutines (-std=gnu++20), the rest of the library does not need it.
+//
+//   TeensyFlexTask readSensor() {
+//       bool ok = co_await spi.transferAsync(tx, rx, 4);
+//       co_await serial.drain();
+//   }
+//   void loop() { TeensyFlexExecutor::global().run(); }
+//
+// A TeensyFlexTask starts running when it is called and frees itself when it
+// returns. Frames come from a static pool: TEENSY_FLEX_CORO_FRAMES frames of
+// TEENSY_FLEX_CORO_FRAME_SIZE bytes. A task that does not fit is not started
+// (started() is false), nothing is allocated from the heap.
+//
+// Drivers complete a TeensyFlexCompletion from their ISR. That only queues the
+// waiting coroutine on the executor, which resumes it from loop().
+#if defined(__cpp_impl_coroutine)
+#include <atomic>
+#include <coroutine>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef TEENSY_FLEX_CORO_FRAMES
+#define TEENSY_FLEX_CORO_FRAMES 8
+#endif
+#ifndef TEENSY_FLEX_CORO_FRAME_SIZE
+#define TEENSY_FLEX_CORO_FRAME_SIZE 256
+#endif
+
+class TeensyFlexCoroutineFrames {
+  public:
+    static const uint8_t FRAMES = TEENSY_FLEX_CORO_FRAMES;
+    static const size_t FRAME_SIZE = TEENSY_FLEX_CORO_FRAME_SIZE;
+    static_assert(FRAMES <= 32, "TEENSY_FLEX_CORO_FRAMES is limited to 32");
+
+    // Called from the main loop only (tasks start and end there)
+    static void *allocate(size_t size) {
+        if (size > FRAME_SIZE)
+            return nullptr;
+        uint32_t &used = usedMask();
+        for (uint8_t i = 0; i < FRAMES; i++) {
+            if (!(used & (1u << i))) {
+                used |= 1u << i;
+                return storage() + i * FRAME_SIZE;
+            }
+        }
+        return nullptr;
+    }
+
+    static void release(void *frame) {
+        size_t offset = (uint8_t *)frame - storage();
+        if (offset < FRAMES * FRAME_SIZE)
+            usedMask() &= ~(1u << (offset / FRAME_SIZE));
+    }
+
+    static uint8_t inUse() { return __builtin_popcount(usedMask()); }
+
+  private:
+    static uint8_t *storage() {
+        alignas(8) static uint8_t frames[FRAMES * FRAME_SIZE];
+        return frames;
+    }
+    static uint32_t &usedMask() {
+        static uint32_t used = 0;
+        return used;
+    }
+};
+
+// Runs coroutines that became ready in an ISR. post() may be called from any
+// interrupt priority, run() from the main loop.
+class TeensyFlexExecutor {
+  public:
+    static const uint8_t QUEUE_SIZE = 32;
+    static_assert(QUEUE_SIZE >= TeensyFlexCoroutineFrames::FRAMES, "every task needs a queue slot");
+
+    static TeensyFlexExecutor &global() {
+        static TeensyFlexExecutor executor;
+        return executor;
+    }
+
+    void post(std::coroutine_handle<> handle) {
+        uint32_t slot = _reserve.fetch_add(1, std::memory_order_relaxed) % QUEUE_SIZE;
+        _slots[slot].address = handle.address();
+        _slots[slot].full.store(true, std::memory_order_release);
+    }
+
+    // Resume everything that is ready, returns how many were resumed
+    uint32_t run() {
+        uint32_t count = 0;
+        for (;;) {
+            Slot &slot = _slots[_next % QUEUE_SIZE];
+            if (!slot.full.load(std::memory_order_acquire))
+                return count;
+            void *address = slot.address;
+            slot.full.store(false, std::memory_order_relaxed);
+            _next++;
+            count++;
+            std::coroutine_handle<>::from_address(address).resume();
+        }
+    }
+
+  private:
+    struct Slot {
+        std::atomic<bool> full{false};
+        void *address = nullptr;
+    };
+    Slot _slots[QUEUE_SIZE];
+    std::atomic<uint32_t> _reserve{0};
+    uint32_t _next = 0;
+};
+
+// One shot completion with a status, awaited by one coroutine and completed
+// (once) from an ISR or from the main loop.
+class TeensyFlexCompletion {
+  public:
+    void reset() {
+        _state.store(IDLE, std::memory_order_relaxed);
+        _status = 0;
+    }
+
+    void complete(int status) {
+        _status = status;
+        if (_state.exchange(FIRED, std::memory_order_acq_rel) == WAITING)
+            TeensyFlexExecutor::global().post(_waiter);
+    }
+    bool fired() const { return _state.load(std::memory_order_acquire) == FIRED; }
+    int status() const { return _status; }
+
+    bool await_ready() const noexcept { return fired(); }
+    bool await_suspend(std::coroutine_handle<> handle) noexcept {
+        _waiter = handle;
+        uint8_t expected = IDLE;
+        // false: it completed in the meantime, carry on without suspending
+        return _state.compare_exchange_strong(expected, WAITING, std::memory_order_acq_rel);
+    }
+    int await_resume() const noexcept { return _status; }
+
+  private:
+    enum : uint8_t { IDLE,
+                     WAITING,
+                     FIRED };
+    std::atomic<uint8_t> _state{IDLE};
+    volatile int _status = 0;
+    std::coroutine_handle<> _waiter;
+};
+
+class TeensyFlexTask {
+  public:
+    struct promise_type {
+        TeensyFlexTask get_return_object() noexcept { return TeensyFlexTask(true); }
+        static TeensyFlexTask get_return_object_on_allocation_failure() noexcept { return TeensyFlexTask(false); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept {}
+
+        static void *operator new(size_t size) noexcept { return TeensyFlexCoroutineFrames::allocate(size); }
+        static void operator delete(void *frame) noexcept { TeensyFlexCoroutineFrames::release(frame); }
+    };
+
+    // False when no frame was free
+    bool started() const { return _started; }
+
+  private:
+    explicit TeensyFlexTask(bool started) : _started(started) {}
+    bool _started;
+};
+
+#endif // __cpp_impl_coroutine
+#endif // _TEENSY_FLEX_COROUTINE_H_
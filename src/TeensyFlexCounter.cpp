@@ -0,0 +1,240 @@
+#include "TeensyFlexCounter.h"
+
+//=============================================================================
+// TeensyFlexCounter::begin
+//=============================================================================
+bool TeensyFlexCounter::begin(int flexio_module) {
+    _flexIO = new TeensyFlexIO();
+    _flexIO->begin(static_cast<TeensyFlexIO::FlexIOModule>(flexio_module));
+    _module = flexio_module;
+    _clock_rate = _flexIO->getFlexIOHandler()->computeClockRate();
+    _channel_count = 0;
+    _timer_mask = 0;
+
+    _flexIO->enable();
+    _flexIO->getFlexIOHandler()->addIOHandlerCallback(this);
+    return true;
+}
+
+void TeensyFlexCounter::end(void) {
+    if (!_flexIO)
+        return;
+    if (!_flexIO->getFlexIOHandler()) {
+        delete _flexIO;
+        _flexIO = nullptr;
+        return;
+    }
+    _flexIO->getFlexIOHandler()->removeIOHandlerCallback(this);
+    for (uint8_t i = 0; i < _channel_count; i++) {
+        Channel &ch = _channels[i];
+        _flexIO->disableTimerInterrupt(ch.timer);
+        _flexIO->getFlexIO()->TIMCTL[ch.timer] = 0;
+        _flexIO->getFlexIOHandler()->freeTimers(ch.timer);
+        if (ch.width_timer != 0xff) {
+            _flexIO->getFlexIO()->TIMCTL[ch.width_timer] = 0;
+            _flexIO->getFlexIOHandler()->freeTimers(ch.width_timer);
+        }
+    }
+    _channel_count = 0;
+    _timer_mask = 0;
+    delete _flexIO;
+    _flexIO = nullptr;
+}
+
+//=========================================================================
+// Channels
+//=========================================================================
+void TeensyFlexCounter::configureCounter(uint8_t timer, int pin, uint16_t prescale) {
+    // Decrements on both pin edges, so one wrap is 2 * prescale edges
+    TimerConfig timer_config;
+    timer_config.mode = TimerMode::SingleCounter;
+    timer_config.pinSelect = pin;
+    timer_config.pinConfig = PinConfig::Disabled;
+    timer_config.timerEnable = TimerEnable::Always;
+    timer_config.timerDisable = TimerDisable::Never;
+    timer_config.timerReset = TimerReset::Never;
+    timer_config.timerDecrement = TimerDecrement::PinInput;
+    timer_config.timerOutput = TimerOutput::One;
+    _flexIO->configureTimer(timer, timer_config);
+    _flexIO->getFlexIO()->TIMCMP[timer] = (uint32_t)prescale * 2 - 1;
+}
+
+int TeensyFlexCounter::addCounter(int pin, uint16_t prescale) {
+    if (!_flexIO || (_channel_count >= MAX_CHANNELS) || !prescale || (prescale > 32768) ||
+        (_flexIO->getFlexIOHandler()->mapIOPinToFlexPin(pin) == 0xff))
+        return -1;
+
+    uint8_t timer = _flexIO->requestTimers(1);
+    if (timer == 0xff) {
+        #ifdef DEBUG_FlexCounter
+            DEBUG_FlexCounter.println("TeensyFlexCounter - no free timer");
+        #endif
+        return -1;
+    }
+
+    Channel &ch = _channels[_channel_count];
+    ch.pin = pin;
+    ch.timer = timer;
+    ch.width_timer = 0xff;
+    ch.prescale = prescale;
+    ch.count = 0;
+    ch.last_cycles = 0;
+    ch.period_cycles = 0;
+    ch.width = 0;
+
+    _flexIO->setPinFlexioMode(pin);
+    configureCounter(timer, pin, prescale);
+    _flexIO->clearTimerStatus(timer);
+    __disable_irq();
+    _timer_mask |= TIMER_MASK(timer);
+    _channel_count++;
+    __enable_irq();
+    _flexIO->enableTimerInterrupt(timer);
+    return _channel_count - 1;
+}
+
+int TeensyFlexCounter::addPulseWidth(int pin, PinPolarity polarity, uint16_t window) {
+    int channel = addCounter(pin, window);
+    if (channel < 0)
+        return -1;
+
+    Channel &ch = _channels[channel];
+    uint8_t timer = _flexIO->requestTimers(1);
+    if (timer == 0xff) {
+        // Give the window counter back
+        __disable_irq();
+        _timer_mask &= ~TIMER_MASK(ch.timer);
+        _channel_count--;
+        __enable_irq();
+        _flexIO->disableTimerInterrupt(ch.timer);
+        _flexIO->getFlexIO()->TIMCTL[ch.timer] = 0;
+        _flexIO->getFlexIOHandler()->freeTimers(ch.timer);
+        return -1;
+    }
+
+    // Runs from the active edge to the next edge, the status flag says the
+    // pulse reached the compare value.
+    TimerConfig timer_config;
+    timer_config.mode = TimerMode::SingleCounter;
+    timer_config.pinSelect = pin;
+    timer_config.pinPolarity = polarity;
+    timer_config.pinConfig = PinConfig::Disabled;
+    timer_config.timerEnable = TimerEnable::PinRising;
+    timer_config.timerDisable = TimerDisable::PinRisingOrFalling;
+    timer_config.timerReset = TimerReset::Never;
+    timer_config.timerDecrement = TimerDecrement::FlexIOClock;
+    timer_config.timerOutput = TimerOutput::One;
+    _flexIO->configureTimer(timer, timer_config);
+
+    __disable_irq();
+    ch.width_timer = timer;
+    startApproximation(ch);
+    __enable_irq();
+    return channel;
+}
+
+//-------------------------------------------------------------------------
+// Pulse width successive approximation, run from the window interrupt
+//-------------------------------------------------------------------------
+void TeensyFlexCounter::startApproximation(Channel &ch) {
+    ch.sar_bit = 0x8000;
+    ch.sar_result = 0;
+    ch.settle = true;
+    _flexIO->getFlexIO()->TIMCMP[ch.width_timer] = ch.sar_bit - 1;
+    _flexIO->clearTimerStatus(ch.width_timer);
+}
+
+void TeensyFlexCounter::approximationStep(Channel &ch) {
+    // A pulse that started before the compare value changed still runs
+    // against the old one, so the first window after a change is ignored.
+    if (ch.settle) {
+        ch.settle = false;
+        _flexIO->clearTimerStatus(ch.width_timer);
+        return;
+    }
+
+    uint16_t trial = ch.sar_result | ch.sar_bit;
+    if (_flexIO->getFlexIO()->TIMSTAT & TIMER_MASK(ch.width_timer))
+        ch.sar_result = trial;
+    ch.sar_bit >>= 1;
+    if (!ch.sar_bit) {
+        ch.width = ch.sar_result;
+        startApproximation(ch);
+        return;
+    }
+    _flexIO->getFlexIO()->TIMCMP[ch.width_timer] = (ch.sar_result | ch.sar_bit) - 1;
+    _flexIO->clearTimerStatus(ch.width_timer);
+    ch.settle = true;
+}
+
+//=========================================================================
+// Readings
+//=========================================================================
+uint32_t TeensyFlexCounter::count(uint8_t channel) {
+    return (channel < _channel_count) ? _channels[channel].count : 0;
+}
+
+void TeensyFlexCounter::clear(uint8_t channel) {
+    if (channel < _channel_count)
+        _channels[channel].count = 0;
+}
+
+float TeensyFlexCounter::frequency(uint8_t channel) {
+    if (channel >= _channel_count)
+        return 0.0f;
+    Channel &ch = _channels[channel];
+    __disable_irq();
+    uint32_t period = ch.period_cycles;
+    uint32_t since = ARM_DWT_CYCCNT - ch.last_cycles;
+    __enable_irq();
+    if (!period)
+        return 0.0f;
+    // No wrap for longer than a period: the input slowed down or stopped
+    if (since > period)
+        period = since;
+    return (float)ch.prescale * F_CPU_ACTUAL / period;
+}
+
+uint32_t TeensyFlexCounter::pulseWidthClocks(uint8_t channel) {
+    return (channel < _channel_count) ? _channels[channel].width : 0;
+}
+
+float TeensyFlexCounter::pulseWidthUs(uint8_t channel) {
+    return _clock_rate ? pulseWidthClocks(channel) * 1e6f / _clock_rate : 0.0f;
+}
+
+uint32_t TeensyFlexCounter::snapshot(uint32_t *counts) {
+    __disable_irq();
+    uint32_t cycles = ARM_DWT_CYCCNT;
+    for (uint8_t i = 0; i < _channel_count; i++)
+        counts[i] = _channels[i].count;
+    __enable_irq();
+    return cycles;
+}
+
+//=========================================================================
+// Interrupt handler - one call per counter wrap
+//=========================================================================
+bool TeensyFlexCounter::call_back(FlexIOHandler *pflex) {
+    if (pflex != _flexIO->getFlexIOHandler())
+        return false;
+
+    uint32_t status = TIME_STAT(*_flexIO) & _timer_mask;
+    if (!status)
+        return false;
+    uint32_t now = ARM_DWT_CYCCNT;
+    TIME_STAT(*_flexIO) = status;
+
+    for (uint8_t i = 0; i < _channel_count; i++) {
+        Channel &ch = _channels[i];
+        if (!(status & TIMER_MASK(ch.timer)))
+            continue;
+        ch.count = ch.count + ch.prescale;
+        if (ch.last_cycles)
+            ch.period_cycles = now - ch.last_cycles;
+        ch.last_cycles = now ? now : 1;
+        if (ch.width_timer != 0xff)
+            approximationStep(ch);
+    }
+    return false;
+}
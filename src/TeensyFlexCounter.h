@@ -0,0 +1,78 @@
+#include "TeensyFlexIO.h"
+#include <Arduino.h>
+
+#ifndef _TEENSY_FLEX_COUNTER_H_
+#define _TEENSY_FLEX_COUNTER_H_
+
+// Pulse counting, frequency and pulse width inputs on spare FlexIO timers.
+//
+// The RT1062 FlexIO timers cannot be read back while they count, so every channel
+// works from the timer status flag:
+//  - Counter: a SingleCounter timer decrements on both edges of its pin and wraps
+//    every 'prescale' periods. Only the wrap interrupts reach the CPU; count() has a
+//    resolution of 'prescale' and frequency() is the reciprocal of the time between
+//    the last two wraps (ARM_DWT_CYCCNT), so it stays accurate at low rates.
+//  - Pulse width: a second timer is enabled by the pin's active edge, disabled by the
+//    next edge and counts FlexIO clocks. Its compare value is a threshold: the status
+//    flag means "a pulse was at least this long". A successive approximation over
+//    16 threshold steps (each one measured over two windows of 'window' periods)
+//    finds the longest pulse, up to 65535 FlexIO clocks.
+// Quadrature decoding is not available this way: a down counter cannot follow the
+// direction and re-enabling a timer reloads it.
+class TeensyFlexCounter : public FlexIOHandlerCallback {
+  public:
+    enum { MAX_CHANNELS = 8 };
+
+    TeensyFlexCounter(){};
+    ~TeensyFlexCounter() { end(); }
+
+    bool begin(int flexio_module);
+    void end(void);
+
+    // Both return the channel number or -1 when the pin or a timer is not available.
+    // prescale: periods per interrupt, 1-32768
+    int addCounter(int pin, uint16_t prescale = 256);
+    // Longest active pulse over successive windows. Uses two timers.
+    int addPulseWidth(int pin, PinPolarity polarity = PinPolarity::ActiveHigh, uint16_t window = 16);
+
+    uint8_t channels() { return _channel_count; }
+    uint32_t count(uint8_t channel);
+    float frequency(uint8_t channel);
+    uint32_t pulseWidthClocks(uint8_t channel);
+    float pulseWidthUs(uint8_t channel);
+    void clear(uint8_t channel);
+
+    // Copy every channel's count at one instant, returns the ARM_DWT_CYCCNT stamp
+    uint32_t snapshot(uint32_t *counts);
+
+    // Call back from flexIO when ISR hapens
+    virtual bool call_back(FlexIOHandler *pflex);
+
+  private:
+    struct Channel {
+        int pin;
+        uint8_t timer;
+        uint8_t width_timer; // 0xff for plain counters
+        uint16_t prescale;
+        volatile uint32_t count;
+        volatile uint32_t last_cycles;
+        volatile uint32_t period_cycles;
+        // pulse width successive approximation
+        uint16_t sar_bit;
+        uint16_t sar_result;
+        bool settle;
+        volatile uint16_t width;
+    };
+
+    TeensyFlexIO *_flexIO = nullptr;
+    uint8_t _module = 0xff;
+    uint32_t _clock_rate = 0;
+    Channel _channels[MAX_CHANNELS];
+    uint8_t _channel_count = 0;
+    uint32_t _timer_mask = 0;
+
+    void configureCounter(uint8_t timer, int pin, uint16_t prescale);
+    void startApproximation(Channel &ch);
+    void approximationStep(Channel &ch);
+};
+#endif //_TEENSY_FLEX_COUNTER_H_
@@ -0,0 +1,114 @@
+#include <Arduino.h>
+
+#ifndef _TEENSY_FLEX_DMA_BUFFER_H_
+#define _TEENSY_FLEX_DMA_BUFFER_H_
+
+// A block of memory handed to DMA that knows whether it needs cache maintenance.
+//
+// DTCM (plain globals and the stack) is not cached, so those buffers never need
+// maintenance. OCRAM (DMAMEM, malloc) and EXTMEM are cached: a buffer there must
+// start on a cache line and be a whole number of lines long, or maintenance would
+// clobber the neighbours. The buffer also tracks CPU writes, so one sent again
+// without changes is not flushed again.
+//
+// Write through write() (it marks the buffer dirty), read through read().
+class TeensyFlexDMABuffer {
+  public:
+    static const size_t CACHE_LINE = 32;
+
+    TeensyFlexDMABuffer() {}
+    TeensyFlexDMABuffer(void *data, size_t size) { attach(data, size); }
+
+    void attach(void *data, size_t size) {
+        _data = (uint8_t *)data;
+        _size = size;
+        _cached = (uint32_t)data >= 0x20200000u;
+        _dirty = true;
+    }
+
+    // False for cached memory that does not own whole cache lines
+    bool valid() const {
+        return _data && (!_cached || !(((uint32_t)_data | _size) & (CACHE_LINE - 1)));
+    }
+    bool cached() const { return _cached; }
+    bool dirty() const { return _dirty; }
+    size_t size() const { return _size; }
+
+    uint8_t *write() {
+        _dirty = true;
+        return _data;
+    }
+    const uint8_t *read() const { return _data; }
+
+    // Before DMA reads bytes of the buffer
+    void prepareForDevice(size_t bytes) {
+        if (_cached && _dirty) {
+            arm_dcache_flush(_data, bytes);
+            _dirty = false;
+        }
+    }
+
+    // Before DMA writes bytes of the buffer, returns the DMA destination.
+    // Anything the CPU wrote is lost. The buffer stays clean (write() would
+    // mark it dirty), so sending what was received needs no flush.
+    uint8_t *prepareForReceive(size_t bytes) {
+        if (_cached)
+            arm_dcache_delete(_data, bytes);
+        _dirty = false;
+        return _data;
+    }
+
+  private:
+    uint8_t *_data = nullptr;
+    size_t _size = 0;
+    bool _cached = false;
+    bool _dirty = true;
+};
+
+// COUNT buffers of at least BLOCK bytes, padded to whole cache lines. Where the
+// pool object lives decides the memory:
+//   TeensyFlexDMAPool<512, 4> fast_pool;          // DTCM, no maintenance
+//   DMAMEM TeensyFlexDMAPool<4096, 8> big_pool;   // OCRAM
+template <size_t BLOCK, uint8_t COUNT>
+class TeensyFlexDMAPool {
+  public:
+    static const size_t BLOCK_SIZE = (BLOCK + TeensyFlexDMABuffer::CACHE_LINE - 1) & ~(TeensyFlexDMABuffer::CACHE_LINE - 1);
+    static_assert(COUNT <= 32, "TeensyFlexDMAPool holds up to 32 buffers");
+
+    TeensyFlexDMAPool() {
+        for (uint8_t i = 0; i < COUNT; i++)
+            _buffers[i].attach(_storage[i], BLOCK_SIZE);
+    }
+
+    // nullptr when every buffer is in use
+    TeensyFlexDMABuffer *acquire(void) {
+        TeensyFlexDMABuffer *buffer = nullptr;
+        __disable_irq();
+        for (uint8_t i = 0; i < COUNT; i++) {
+            if (!(_used & (1u << i))) {
+                _used = _used | (1u << i);
+                buffer = &_buffers[i];
+                break;
+            }
+        }
+        __enable_irq();
+        return buffer;
+    }
+
+    void release(TeensyFlexDMABuffer *buffer) {
+        if ((buffer < _buffers) || (buffer >= _buffers + COUNT))
+            return;
+        __disable_irq();
+        _used &= ~(1u << (buffer - _buffers));
+        __enable_irq();
+    }
+
+    uint8_t available(void) const { return COUNT - __builtin_popcount(_used); }
+
+  private:
+    uint8_t _storage[COUNT][BLOCK_SIZE] __attribute__((aligned(32)));
+    TeensyFlexDMABuffer _buffers[COUNT];
+    volatile uint32_t _used = 0;
+};
+
+#endif //_TEENSY_FLEX_DMA_BUFFER_H_
@@ -0,0 +1,85 @@
+#ifndef _TEENSY_FLEX_DMA_DISPATCH_H_
+#define _TEENSY_FLEX_DMA_DISPATCH_H_
+
+// Routes DMA channel interrupts to objects. DMAChannel::attachInterrupt() only
+// takes a plain function, so every channel gets its own trampoline (generated
+// from a template) that looks up the object registered for that channel. Any
+// number of objects can have transfers in flight, one per DMA channel.
+//
+//   _dmaRX->attachInterrupt(TeensyFlexDMADispatch::attach(_dmaRX->channel,
+//       &TeensyFlexDMADispatch::member<TeensyFlexSPI, &TeensyFlexSPI::dma_rxisr>, this));
+//
+// TeensyFlexPinDispatch does the same for attachInterrupt() on a pin, keyed by
+// the pin number.
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+
+template <class Tag, uint8_t N>
+class TeensyFlexISRDispatch {
+  public:
+    static const uint8_t CHANNELS = N;
+    typedef void (*Handler)(void *context);
+    typedef void (*Isr)(void);
+
+    // Returns the trampoline to attach to the channel, nullptr for a bad channel
+    static Isr attach(uint8_t channel, Handler handler, void *context) {
+        if ((channel >= CHANNELS) || !handler)
+            return nullptr;
+        Entry &e = entries()[channel];
+        e.context = context;
+        e.handler = handler;
+        return trampolines()[channel];
+    }
+
+    static void detach(uint8_t channel) {
+        if (channel < CHANNELS) {
+            entries()[channel].handler = nullptr;
+            entries()[channel].context = nullptr;
+        }
+    }
+
+    static void *context(uint8_t channel) { return (channel < CHANNELS) ? entries()[channel].context : nullptr; }
+
+    static void dispatch(uint8_t channel) {
+        Entry &e = entries()[channel];
+        if (e.handler)
+            e.handler(e.context);
+    }
+
+    // Handler that calls a member function
+    template <class T, void (T::*M)(void)>
+    static void member(void *context) { (static_cast<T *>(context)->*M)(); }
+
+  private:
+    struct Entry {
+        Handler handler;
+        void *context;
+    };
+
+    static Entry *entries() {
+        static Entry table[CHANNELS];
+        return table;
+    }
+
+    template <uint8_t CH>
+    static void trampoline(void) { dispatch(CH); }
+
+    template <size_t... CH>
+    static const Isr *trampolines(std::index_sequence<CH...>) {
+        static const Isr table[CHANNELS] = {&trampoline<CH>...};
+        return table;
+    }
+
+    static const Isr *trampolines() { return trampolines(std::make_index_sequence<CHANNELS>()); }
+};
+
+struct TeensyFlexDMAChannels {};
+struct TeensyFlexPins {};
+
+class TeensyFlexDMADispatch : public TeensyFlexISRDispatch<TeensyFlexDMAChannels, 32> {};
+
+// Pin numbers up to 63, enough for every Teensy 4.x pin
+class TeensyFlexPinDispatch : public TeensyFlexISRDispatch<TeensyFlexPins, 64> {};
+
+#endif // _TEENSY_FLEX_DMA_DISPATCH_H_
@@ -0,0 +1,302 @@
+#include "TeensyFlexDShot.h"
+
+TeensyFlexDShot::TeensyFlexDShot(const uint8_t *pins, uint8_t pinCount) {
+    if (pinCount > TeensyFlexDShotCodec::MOTORS)
+        pinCount = TeensyFlexDShotCodec::MOTORS;
+    _pin_count = pinCount;
+    memcpy(_pins, pins, pinCount);
+    _mask = (1 << pinCount) - 1;
+}
+
+//=============================================================================
+// TeensyFlexDShot::begin
+//=============================================================================
+bool TeensyFlexDShot::begin(int flexio_module, DShotSpeed speed, bool bidirectional) {
+    if (!_pin_count)
+        return false;
+    _bidirectional = bidirectional;
+
+    _flexIO = new TeensyFlexIO();
+    _flexIO->begin(static_cast<TeensyFlexIO::FlexIOModule>(flexio_module));
+    _module = flexio_module;
+
+    // Motor pins have to be consecutive FXIO pins
+    uint8_t first_flex_pin = _flexIO->getFlexIOHandler()->mapIOPinToFlexPin(_pins[0]);
+    if (first_flex_pin == 0xff) {
+        end();
+        return false;
+    }
+    for (uint8_t i = 1; i < _pin_count; i++) {
+        if (_flexIO->getFlexIOHandler()->mapIOPinToFlexPin(_pins[i]) != first_flex_pin + i) {
+            #ifdef DEBUG_FlexDShot
+                DEBUG_FlexDShot.printf("TeensyFlexDShot - pin %d is not FXIO D%d\n", _pins[i], first_flex_pin + i);
+            #endif
+            end();
+            return false;
+        }
+    }
+
+    _tx_timer = _flexIO->requestTimers(1);
+    _tx_shifter = _flexIO->requestShifter();
+    if (bidirectional) {
+        _rx_timer = _flexIO->requestTimers(1);
+        _rx_shifter = _flexIO->requestShifter();
+    }
+
+    if ((_tx_timer == 0xff) || (_tx_shifter == 0xff) ||
+        (bidirectional && ((_rx_timer == 0xff) || (_rx_shifter == 0xff)))) {
+        #ifdef DEBUG_FlexDShot
+            DEBUG_FlexDShot.println("TeensyFlexDShot - Failed to allocate timers or shifters");
+        #endif
+        end();
+        return false;
+    }
+
+    // The module clock is shared, so work with the one it has. Slot edges are
+    // exact when it is a multiple of 2 * slot rate (96 MHz is for every speed);
+    // set it with FlexIOHandler::setClock before begin when it is too far off.
+    _timing = TeensyFlexDShotCodec::timing(_flexIO->getFlexIOHandler()->computeClockRate(), speed);
+    if (!TeensyFlexDShotCodec::usable(_timing)) {
+        #ifdef DEBUG_FlexDShot
+            DEBUG_FlexDShot.printf("TeensyFlexDShot - FlexIO clock %u is %f%% off for DShot%u\n",
+                                   _flexIO->getFlexIOHandler()->computeClockRate(), _timing.errorPercent, (unsigned)speed);
+        #endif
+        end();
+        return false;
+    }
+    #ifdef DEBUG_FlexDShot
+        DEBUG_FlexDShot.printf("TeensyFlexDShot - slot rate %u, bit %f ns (%f%%)\n", _timing.slotRate,
+                               _timing.bitNs, _timing.errorPercent);
+    #endif
+
+    ShifterConfig shifter_config;
+    shifter_config.mode = ShifterMode::Transmit;
+    shifter_config.pinSelect = _pins[0];
+    shifter_config.pinConfig = PinConfig::Output;
+    shifter_config.timerSelect = _tx_timer;
+    shifter_config.timerPolarity = TimerPolarity::ActiveHigh;
+    shifter_config.parallelWidth = TeensyFlexDShotCodec::MOTORS - 1;
+    _flexIO->configureShifter(_tx_shifter, shifter_config);
+
+    // Free running shift clock, a word every 4 slots. Stopping it after every
+    // word would put a gap between the words of a frame. Between frames the
+    // shifter reloads the last word it got, which is the idle level.
+    TimerConfig timer_config;
+    timer_config.mode = TimerMode::Baud;
+    timer_config.pinConfig = PinConfig::Disabled;
+    timer_config.timerEnable = TimerEnable::Always;
+    timer_config.timerDisable = TimerDisable::Never;
+    timer_config.timerDecrement = TimerDecrement::FlexIOClock;
+    timer_config.timerOutput = TimerOutput::One;
+    timer_config.asDual().bits_in_word = 4 * 2 - 1;
+    timer_config.asDual().baud_rate_div = _timing.baudDiv;
+    _flexIO->configureTimer(_tx_timer, timer_config);
+
+    if (bidirectional) {
+        shifter_config.mode = ShifterMode::Receive;
+        shifter_config.pinConfig = PinConfig::Disabled;
+        shifter_config.timerSelect = _rx_timer;
+        _flexIO->configureShifter(_rx_shifter, shifter_config);
+
+        // Same clock for sampling (6.4 samples per telemetry bit), parked until
+        // the frame has gone out
+        _flexIO->configureTimer(_rx_timer, timer_config);
+        _rx_timctl = _flexIO->getFlexIO()->TIMCTL[_rx_timer];
+        _flexIO->getFlexIO()->TIMCTL[_rx_timer] = 0;
+    }
+
+    for (uint8_t i = 0; i < _pin_count; i++) {
+        _flexIO->setPinFlexioMode(_pins[i]);
+        // Bidirectional ESCs idle high and release the line while replying
+        if (bidirectional)
+            _flexIO->setPinParameters(_pins[i], PullUp::PULLUP_22K, 7, 3);
+        else
+            _flexIO->setPinParameters(_pins[i], PullUp::DISABLED, 7, 3);
+        setThrottle(i, 0);
+    }
+
+    // Park the lines at the idle level
+    _flexIO->getFlexIO()->SHIFTBUF[_tx_shifter] = bidirectional ? 0xffffffff : 0;
+
+    _flexIO->enable();
+    _flexIO->getFlexIOHandler()->addIOHandlerCallback(this);
+
+    if (!initDMAChannels()) {
+        end();
+        return false;
+    }
+    return true;
+}
+
+void TeensyFlexDShot::end(void) {
+    if (!_flexIO)
+        return;
+    if (!_flexIO->getFlexIOHandler()) {
+        delete _flexIO;
+        _flexIO = nullptr;
+        return;
+    }
+    _flexIO->getFlexIOHandler()->removeIOHandlerCallback(this);
+    if (_dmaTX) {
+        _dmaTX->disable();
+        TeensyFlexDMADispatch::detach(_dmaTX->channel);
+        delete _dmaTX;
+        _dmaTX = nullptr;
+    }
+    if (_dmaRX) {
+        _dmaRX->disable();
+        TeensyFlexDMADispatch::detach(_dmaRX->channel);
+        delete _dmaRX;
+        _dmaRX = nullptr;
+    }
+    _flexIO->disableDMARequests(((_tx_shifter != 0xff) ? SHIFTER_MASK(_tx_shifter) : 0) |
+                                ((_rx_shifter != 0xff) ? SHIFTER_MASK(_rx_shifter) : 0));
+    _flexIO->getFlexIOHandler()->freeTimers(_tx_timer);
+    _tx_timer = 0xff;
+    _flexIO->getFlexIOHandler()->freeTimers(_rx_timer);
+    _rx_timer = 0xff;
+    _flexIO->getFlexIOHandler()->freeShifter(_tx_shifter);
+    _tx_shifter = 0xff;
+    _flexIO->getFlexIOHandler()->freeShifter(_rx_shifter);
+    _rx_shifter = 0xff;
+    _state = State::idle;
+    delete _flexIO;
+    _flexIO = nullptr;
+}
+
+//=========================================================================
+// Init the DMA channels
+//=========================================================================
+bool TeensyFlexDShot::initDMAChannels() {
+    _dmaTX = new DMAChannel();
+    if (_dmaTX == nullptr)
+        return false;
+    _dmaTX->disable();
+    _dmaTX->destination(_flexIO->getFlexIO()->SHIFTBUF[_tx_shifter]);
+    _dmaTX->disableOnCompletion();
+    _dmaTX->interruptAtCompletion();
+    _dmaTX->triggerAtHardwareEvent(_flexIO->getFlexIOHandler()->shiftersDMAChannel(_tx_shifter));
+    _dmaTX->attachInterrupt(TeensyFlexDMADispatch::attach(
+        _dmaTX->channel, &TeensyFlexDMADispatch::member<TeensyFlexDShot, &TeensyFlexDShot::dma_txisr>, this));
+
+    if (_bidirectional) {
+        _dmaRX = new DMAChannel();
+        if (_dmaRX == nullptr)
+            return false;
+        _dmaRX->disable();
+        _dmaRX->source(_flexIO->getFlexIO()->SHIFTBUF[_rx_shifter]);
+        _dmaRX->destinationBuffer(_telemetry_buffer, sizeof(_telemetry_buffer));
+        _dmaRX->disableOnCompletion();
+        _dmaRX->interruptAtCompletion();
+        _dmaRX->triggerAtHardwareEvent(_flexIO->getFlexIOHandler()->shiftersDMAChannel(_rx_shifter));
+        _dmaRX->attachInterrupt(TeensyFlexDMADispatch::attach(
+            _dmaRX->channel, &TeensyFlexDMADispatch::member<TeensyFlexDShot, &TeensyFlexDShot::dma_rxisr>, this));
+    }
+    return true;
+}
+
+//=========================================================================
+// Frames
+//=========================================================================
+void TeensyFlexDShot::setThrottle(uint8_t motor, uint16_t throttle, bool telemetry) {
+    if (motor >= _pin_count)
+        return;
+    _frames[motor] = TeensyFlexDShotCodec::frame(throttle, telemetry, _bidirectional);
+}
+
+bool TeensyFlexDShot::send(void) {
+    if (!_dmaTX || (_state != State::idle))
+        return false;
+
+    uint32_t start = ARM_DWT_CYCCNT;
+    _codec.encode(_frames, _frame_buffer, _mask, _bidirectional);
+    _encode_cycles = ARM_DWT_CYCCNT - start;
+
+    if ((uint32_t)_frame_buffer >= 0x20200000u)
+        arm_dcache_flush(_frame_buffer, sizeof(_frame_buffer));
+
+    _state = State::transmitting;
+    _dmaTX->sourceBuffer(_frame_buffer, sizeof(_frame_buffer));
+    _dmaTX->enable();
+    _flexIO->enableDMARequests(SHIFTER_MASK(_tx_shifter));
+    return true;
+}
+
+void TeensyFlexDShot::startTelemetry(void) {
+    IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+
+    // Release the lines, the ESCs answer about 30us after the frame
+    p->SHIFTCTL[_tx_shifter] = p->SHIFTCTL[_tx_shifter] & ~FLEXIO_SHIFTCTL_PINCFG(3);
+
+    if ((uint32_t)_telemetry_buffer >= 0x20200000u)
+        arm_dcache_delete(_telemetry_buffer, sizeof(_telemetry_buffer));
+    _state = State::receiving;
+    (void)p->SHIFTBUF[_rx_shifter];
+    _dmaRX->destinationBuffer(_telemetry_buffer, sizeof(_telemetry_buffer));
+    _dmaRX->enable();
+    _flexIO->enableDMARequests(SHIFTER_MASK(_rx_shifter));
+    p->TIMCTL[_rx_timer] = _rx_timctl;
+}
+
+//=========================================================================
+// Interrupt handlers
+//=========================================================================
+bool TeensyFlexDShot::call_back(FlexIOHandler *pflex) {
+    if (pflex != _flexIO->getFlexIOHandler())
+        return false;
+
+    // Last word moved into the shifter, its slots are all idle level
+    if ((_state == State::draining) && (SHIFT_STAT(*_flexIO) & SHIFTER_MASK(_tx_shifter)) &&
+        _flexIO->shifterInterruptEnabled(_tx_shifter)) {
+        _flexIO->disableShifterInterrupt(_tx_shifter);
+        startTelemetry();
+    }
+    return false;
+}
+
+//-------------------------------------------------------------------------
+// DMA TX ISR - the whole frame has been handed to the shifter
+//-------------------------------------------------------------------------
+void TeensyFlexDShot::dma_txisr(void) {
+    _dmaTX->clearInterrupt();
+    _dmaTX->clearComplete();
+    _flexIO->disableDMARequests(SHIFTER_MASK(_tx_shifter));
+
+    if (_bidirectional) {
+        _state = State::draining;
+        _flexIO->enableShifterInterrupt(_tx_shifter);
+    } else {
+        _state = State::idle;
+    }
+}
+
+//-------------------------------------------------------------------------
+// DMA RX ISR - telemetry window sampled, decode every motor
+//-------------------------------------------------------------------------
+void TeensyFlexDShot::dma_rxisr(void) {
+    _dmaRX->clearInterrupt();
+    _dmaRX->clearComplete();
+
+    IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+    p->TIMCTL[_rx_timer] = 0;
+    _flexIO->disableDMARequests(SHIFTER_MASK(_rx_shifter));
+    p->SHIFTCTL[_tx_shifter] = p->SHIFTCTL[_tx_shifter] | FLEXIO_SHIFTCTL_PINCFG(static_cast<uint8_t>(PinConfig::Output));
+
+    if ((uint32_t)_telemetry_buffer >= 0x20200000u)
+        arm_dcache_delete(_telemetry_buffer, sizeof(_telemetry_buffer));
+
+    // Telemetry bits run at 5/4 of the DShot bit rate
+    const float samples_per_bit = TeensyFlexDShotCodec::SLOTS_PER_BIT / 1.25f;
+    for (uint8_t motor = 0; motor < _pin_count; motor++) {
+        uint32_t period = TeensyFlexDShotCodec::decodeTelemetry((const uint8_t *)_telemetry_buffer, TELEMETRY_SAMPLES,
+                                                                motor, samples_per_bit);
+        if (period == TeensyFlexDShotCodec::TELEMETRY_INVALID)
+            _telemetry_errors[motor] = _telemetry_errors[motor] + 1;
+        else
+            _period[motor] = period;
+    }
+
+    _state = State::idle;
+    if (_telemetry_event_responder)
+        _telemetry_event_responder->triggerEvent(0, this);
+}
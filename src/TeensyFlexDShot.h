@@ -0,0 +1,90 @@
+#include "TeensyFlexDMADispatch.h"
+#include "TeensyFlexIO.h"
+#include "TeensyFlexDShotCodec.h"
+#include <Arduino.h>
+#include <DMAChannel.h>
+#include <EventResponder.h>
+
+#ifndef _TEENSY_FLEX_DSHOT_H_
+#define _TEENSY_FLEX_DSHOT_H_
+
+// DShot ESC output for up to 8 motors on consecutive FXIO pins of one module.
+//
+// All motors share a Transmit shifter with parallel width 8, so one DMA transfer
+// of TeensyFlexDShotCodec::FRAME_BYTES slot bytes sends every frame at the same
+// time. In bidirectional mode the shifter output is switched off as soon as the
+// last slot is in the shifter, and a Receive shifter on the same pins samples the
+// GCR eRPM replies into a DMA buffer that is decoded when it is full.
+class TeensyFlexDShot : public FlexIOHandlerCallback {
+  public:
+    enum { TELEMETRY_SAMPLES = 512 };
+
+    // pins must map to consecutive FXIO pins, motor 0 first (1 to 8 pins)
+    TeensyFlexDShot(const uint8_t *pins, uint8_t pinCount);
+    ~TeensyFlexDShot() { end(); }
+
+    // Uses the module's FlexIO clock as it is and fails when the slot rate it
+    // gives is more than TeensyFlexDShotCodec::MAX_ERROR_PERCENT off
+    bool begin(int flexio_module, DShotSpeed speed = DShotSpeed::DShot600, bool bidirectional = false);
+    void end(void);
+
+    // Stage the next frame for a motor, sent with the next send()
+    void setThrottle(uint8_t motor, uint16_t throttle, bool telemetry = false);
+    void setCommand(uint8_t motor, uint8_t command) { setThrottle(motor, command, true); }
+
+    // Encode all staged frames and start the transfer. Returns false while busy.
+    bool send(void);
+    bool busy() { return _state != State::idle; }
+
+    // Telemetry from the last bidirectional exchange
+    uint32_t erpm(uint8_t motor) { return TeensyFlexDShotCodec::periodToERPM(period(motor)); }
+    uint32_t period(uint8_t motor) { return (motor < _pin_count) ? _period[motor] : 0; }
+    uint32_t telemetryErrors(uint8_t motor) { return (motor < _pin_count) ? _telemetry_errors[motor] : 0; }
+    void setTelemetryEvent(EventResponderRef event_responder) { _telemetry_event_responder = &event_responder; }
+
+    const TeensyFlexDShotTiming &timing() { return _timing; }
+    uint32_t encodeCycles() { return _encode_cycles; }
+
+    // Call back from flexIO when ISR hapens
+    virtual bool call_back(FlexIOHandler *pflex);
+
+  private:
+    uint8_t _pins[TeensyFlexDShotCodec::MOTORS];
+    uint8_t _pin_count;
+    uint8_t _mask;
+
+    TeensyFlexIO *_flexIO = nullptr;
+    uint8_t _module = 0xff;
+    uint8_t _tx_timer = 0xff;
+    uint8_t _rx_timer = 0xff;
+    uint8_t _tx_shifter = 0xff;
+    uint8_t _rx_shifter = 0xff;
+    uint32_t _rx_timctl = 0;
+
+    bool _bidirectional = false;
+    TeensyFlexDShotTiming _timing;
+    TeensyFlexDShotCodec _codec;
+    uint16_t _frames[TeensyFlexDShotCodec::MOTORS] = {};
+    uint32_t _frame_buffer[TeensyFlexDShotCodec::FRAME_WORDS] __attribute__((aligned(32)));
+    uint32_t _telemetry_buffer[TELEMETRY_SAMPLES / 4] __attribute__((aligned(32)));
+    uint32_t _encode_cycles = 0;
+
+    volatile uint32_t _period[TeensyFlexDShotCodec::MOTORS] = {};
+    volatile uint32_t _telemetry_errors[TeensyFlexDShotCodec::MOTORS] = {};
+
+    enum class State { idle,
+                       transmitting,
+                       draining,
+                       receiving };
+    volatile State _state = State::idle;
+
+    DMAChannel *_dmaTX = nullptr;
+    DMAChannel *_dmaRX = nullptr;
+    EventResponder *_telemetry_event_responder = nullptr;
+
+    bool initDMAChannels();
+    void startTelemetry(void);
+    void dma_txisr(void);
+    void dma_rxisr(void);
+};
+#endif //_TEENSY_FLEX_DSHOT_H_
@@ -0,0 +1,211 @@
+#ifndef _TEENSY_FLEX_DSHOT_CODEC_H_
+#define _TEENSY_FLEX_DSHOT_CODEC_H_
+
+// DShot frame encoding and bidirectional (GCR eRPM) telemetry decoding for
+// TeensyFlexDShot.
+//
+// A frame is 11 bits of throttle/command, a telemetry request bit and a 4 bit
+// checksum, sent MSB first. Every DShot bit is SLOTS_PER_BIT shifter slots and
+// the 8 motors share one parallel width 8 shifter, so bit n of a slot byte is the
+// level of motor n:
+//   '0' = 3 slots high, 5 low (37.5%)    '1' = 6 slots high, 2 low (75%)
+// Bidirectional DShot inverts the line (idle high) and the checksum.
+#include <stddef.h>
+#include <stdint.h>
+
+enum class DShotSpeed : uint16_t {
+    DShot150 = 150,
+    DShot300 = 300,
+    DShot600 = 600,
+    DShot1200 = 1200
+};
+
+struct TeensyFlexDShotTiming {
+    uint32_t slotRate = 0;   ///< achieved shifter slot rate in Hz
+    uint8_t baudDiv = 0;     ///< TIMCMP low byte for the shift timer
+    float bitNs = 0;         ///< achieved DShot bit period
+    float zeroHighNs = 0;
+    float oneHighNs = 0;
+    float errorPercent = 0;  ///< bit period error against the nominal rate
+};
+
+class TeensyFlexDShotCodec {
+  public:
+    static const uint8_t MOTORS = 8;
+    static const uint8_t FRAME_BITS = 16;
+    static const uint8_t SLOTS_PER_BIT = 8;
+    static const uint8_t ZERO_HIGH_SLOTS = 3;
+    static const uint8_t ONE_HIGH_SLOTS = 6;
+    static const uint8_t IDLE_SLOTS = 8;
+    static const size_t FRAME_BYTES = FRAME_BITS * SLOTS_PER_BIT + IDLE_SLOTS;
+    static const size_t FRAME_WORDS = FRAME_BYTES / 4;
+
+    // Telemetry: 21 line bits at 5/4 of the DShot bit rate
+    static const uint8_t TELEMETRY_BITS = 21;
+    static const uint32_t TELEMETRY_INVALID = 0xffffffff;
+
+    // Bit rate error ESCs still lock on to
+    static constexpr float MAX_ERROR_PERCENT = 5.0f;
+
+    TeensyFlexDShotCodec() {
+        // _spread[x] has bit i of x in bit 0 of byte i
+        for (uint32_t x = 0; x < 256; x++) {
+            uint64_t v = 0;
+            for (uint8_t i = 0; i < 8; i++) {
+                if (x & (1 << i))
+                    v |= (uint64_t)1 << (i * 8);
+            }
+            _spread[x] = v;
+        }
+    }
+
+    // 11 bit value (0 = disarmed, 1-47 commands, 48-2047 throttle)
+    static uint16_t frame(uint16_t value, bool telemetry = false, bool inverted = false) {
+        uint16_t v = ((value & 0x7ff) << 1) | (telemetry ? 1 : 0);
+        uint16_t crc = (v ^ (v >> 4) ^ (v >> 8)) & 0x0f;
+        if (inverted)
+            crc = ~crc & 0x0f;
+        return (v << 4) | crc;
+    }
+
+    // Turn one frame per motor into FRAME_BYTES slot bytes (32 bit aligned output).
+    // Motors outside 'mask' stay at the idle level.
+    void encode(const uint16_t frames[MOTORS], uint32_t *out, uint8_t mask = 0xff, bool inverted = false) const {
+        // Transpose: byte i of lo/hi holds frame bit i (8 + i) of every motor
+        uint64_t lo = 0, hi = 0;
+        for (uint8_t m = 0; m < MOTORS; m++) {
+            lo |= _spread[frames[m] & 0xff] << m;
+            hi |= _spread[frames[m] >> 8] << m;
+        }
+        uint32_t flip = inverted ? 0xffffffff : 0;
+        uint32_t active = mask * 0x00010101u; // slots 0-2 high for every bit
+        for (int8_t bit = FRAME_BITS - 1; bit >= 0; bit--) {
+            uint32_t b = (bit >= 8) ? (hi >> ((bit - 8) * 8)) & mask : (lo >> (bit * 8)) & mask;
+            *out++ = (active | (b << 24)) ^ flip;  // slots 0-3
+            *out++ = (b | (b << 8)) ^ flip;        // slots 4-7
+        }
+        for (uint8_t i = 0; i < IDLE_SLOTS / 4; i++)
+            *out++ = flip;
+    }
+
+    // Shift timer setup for a FlexIO clock: slot rate = clock / (2 * (div + 1)).
+    // The timer runs free through the frame, so every slot has the same length
+    // and word boundaries add nothing.
+    static TeensyFlexDShotTiming timing(uint32_t flexioClock, DShotSpeed speed) {
+        TeensyFlexDShotTiming t;
+        uint32_t bit_rate = (uint32_t)speed * 1000;
+        uint32_t slot_rate = bit_rate * SLOTS_PER_BIT;
+        uint32_t div = (flexioClock / 2 + slot_rate / 2) / slot_rate;
+        if (div < 1)
+            div = 1;
+        else if (div > 256)
+            div = 256;
+        t.baudDiv = div - 1;
+        t.slotRate = flexioClock / (2 * div);
+        float slot_ns = 2e9f * div / flexioClock;
+        t.bitNs = slot_ns * SLOTS_PER_BIT;
+        t.zeroHighNs = slot_ns * ZERO_HIGH_SLOTS;
+        t.oneHighNs = slot_ns * ONE_HIGH_SLOTS;
+        t.errorPercent = (t.bitNs * bit_rate / 1e9f - 1.0f) * 100.0f;
+        return t;
+    }
+
+    static bool usable(const TeensyFlexDShotTiming &t) {
+        return (t.errorPercent <= MAX_ERROR_PERCENT) && (t.errorPercent >= -MAX_ERROR_PERCENT);
+    }
+
+    // Decode one motor's telemetry from parallel samples (bit 'motor' of each byte),
+    // taken at samplesPerBit samples per telemetry bit. Returns the eRPM period in us,
+    // 0 for a stopped motor, or TELEMETRY_INVALID.
+    static uint32_t decodeTelemetry(const uint8_t *samples, size_t count, uint8_t motor, float samplesPerBit) {
+        uint8_t mask = 1 << motor;
+        size_t i = 0;
+        // The reply starts with a falling edge out of the idle high level
+        while ((i < count) && !(samples[i] & mask))
+            i++;
+        while ((i < count) && (samples[i] & mask))
+            i++;
+        if (i >= count)
+            return TELEMETRY_INVALID;
+
+        uint32_t value = 0;
+        uint8_t bits = 0;
+        uint8_t level = 0;
+        size_t run_start = i;
+        for (; (i < count) && (bits < TELEMETRY_BITS); i++) {
+            uint8_t s = (samples[i] & mask) ? 1 : 0;
+            if (s == level)
+                continue;
+            uint8_t len = (uint8_t)((i - run_start) / samplesPerBit + 0.5f);
+            if (!len || (bits + len > TELEMETRY_BITS))
+                return TELEMETRY_INVALID;
+            value = (value << len) | (1 << (len - 1));
+            bits += len;
+            level = s;
+            run_start = i;
+        }
+        // The last run ends in the idle level
+        if (bits < TELEMETRY_BITS) {
+            uint8_t len = TELEMETRY_BITS - bits;
+            value = (value << len) | (1 << (len - 1));
+        }
+        return decodeLine(value);
+    }
+
+    // Decode the 21 line bits (1 = transition) into the eRPM period
+    static uint32_t decodeLine(uint32_t line) {
+        static const uint8_t gcr_decode[32] = {
+            0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 9, 10, 11, 0xff, 13, 14, 15,
+            0xff, 0xff, 2, 3, 0xff, 5, 6, 7, 0xff, 0, 8, 1, 0xff, 4, 12, 0xff};
+        uint32_t gcr = line ^ (line >> 1);
+        uint32_t value = 0;
+        for (uint8_t i = 0; i < 4; i++) {
+            uint8_t nibble = gcr_decode[(gcr >> (i * 5)) & 0x1f];
+            if (nibble == 0xff)
+                return TELEMETRY_INVALID;
+            value |= (uint32_t)nibble << (i * 4);
+        }
+        uint32_t csum = value ^ (value >> 8);
+        csum ^= csum >> 4;
+        if ((csum & 0x0f) != 0x0f)
+            return TELEMETRY_INVALID;
+        value >>= 4;
+        if (value == 0x0fff)
+            return 0;
+        return (value & 0x1ff) << (value >> 9);
+    }
+
+    // Build the line bits an ESC sends for a period (used for loopback and tests)
+    static uint32_t encodeLine(uint32_t periodUs) {
+        static const uint8_t gcr_encode[16] = {0x19, 0x1b, 0x12, 0x13, 0x1d, 0x15, 0x16, 0x17,
+                                               0x1a, 0x09, 0x0a, 0x0b, 0x1e, 0x0d, 0x0e, 0x0f};
+        uint32_t value = 0x0fff;
+        if (periodUs) {
+            uint8_t exponent = 0;
+            while ((periodUs >> exponent) > 0x1ff)
+                exponent++;
+            value = ((uint32_t)exponent << 9) | (periodUs >> exponent);
+        }
+        uint32_t csum = value ^ (value >> 4) ^ (value >> 8);
+        value = (value << 4) | (~csum & 0x0f);
+
+        uint32_t gcr = 0;
+        for (uint8_t i = 0; i < 4; i++)
+            gcr |= (uint32_t)gcr_encode[(value >> (i * 4)) & 0x0f] << (i * 5);
+
+        // line ^ (line >> 1) == gcr, with the leading transition as bit 20
+        uint32_t line = 1u << 20;
+        for (int8_t i = 19; i >= 0; i--) {
+            uint32_t next = (line >> (i + 1)) & 1;
+            line |= (((gcr >> i) & 1) ^ next) << i;
+        }
+        return line;
+    }
+
+    static uint32_t periodToERPM(uint32_t periodUs) { return periodUs ? 60000000u / periodUs : 0; }
+
+  private:
+    uint64_t _spread[256];
+};
+
+#endif // _TEENSY_FLEX_DSHOT_CODEC_H_
@@ -0,0 +1,66 @@
+#ifndef _TEENSY_FLEX_FLOW_CONTROL_H_
+#define _TEENSY_FLEX_FLOW_CONTROL_H_
+
+// RTS from the fill level of a receive buffer, with hysteresis: the sender is
+// stopped at the high water mark and released again at the low water mark.
+// The space above the high water mark has to hold what the sender still puts
+// out after RTS drops (its reaction time plus the character in progress).
+#include <stdint.h>
+
+class TeensyFlexRtsWatermark {
+  public:
+    TeensyFlexRtsWatermark(uint16_t high = 0, uint16_t low = 0) : _high(high), _low(low) {}
+
+    // low < high, both in bytes
+    bool setLevels(uint16_t high, uint16_t low) {
+        if (low >= high)
+            return false;
+        _high = high;
+        _low = low;
+        return true;
+    }
+    uint16_t high() const { return _high; }
+    uint16_t low() const { return _low; }
+
+    // New fill level, returns true while the sender may send
+    bool update(uint16_t level) {
+        if (_ready && (level >= _high))
+            _ready = false;
+        else if (!_ready && (level <= _low))
+            _ready = true;
+        return _ready;
+    }
+    bool ready() const { return _ready; }
+
+  private:
+    uint16_t _high;
+    uint16_t _low;
+    bool _ready = true;
+};
+
+// RS-485 driver enable timing in FlexIO clocks, from the TIMCMP of the TX
+// Baud timer (bits * 2 - 1 in [15:8], half a bit time - 1 in [7:0]).
+struct TeensyFlexRS485Timing {
+    // Start, data and stop bits of one character
+    static uint32_t characterClocks(uint32_t tx_timcmp) {
+        uint32_t bits = (((tx_timcmp >> 8) & 0xff) + 1) / 2 + 2;
+        return bits * 2 * ((tx_timcmp & 0xff) + 1);
+    }
+
+    // The pre delay makes the TX timer follow the buffer that much late, while
+    // DE is held one character plus the post delay after the buffer empties.
+    // Longer than a character, DE would drop inside the last frame.
+    static bool preDelayFits(uint32_t pre_clocks, uint32_t tx_timcmp) {
+        return pre_clocks <= characterClocks(tx_timcmp);
+    }
+
+    // TIMCMP of the 16 bit DE timer
+    static uint32_t holdCompare(uint32_t tx_timcmp, uint32_t post_clocks) {
+        uint32_t hold = characterClocks(tx_timcmp) + post_clocks;
+        if (hold > 0x10000)
+            hold = 0x10000;
+        return hold - 1;
+    }
+};
+
+#endif // _TEENSY_FLEX_FLOW_CONTROL_H_
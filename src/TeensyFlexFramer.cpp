@@ -0,0 +1,48 @@
+#include "TeensyFlexFramer.h"
+
+//=============================================================================
+// TeensyFlexFramer::begin
+//=============================================================================
+bool TeensyFlexFramer::begin(Callback callback, void *context, bool useMatch) {
+    if (_started)
+        return false;
+    _decoder.begin(_mode, _crc, callback, context);
+    if (useMatch) {
+        if (!_serial.enableMatch(TeensyFlexFraming::delimiter(_mode))) {
+            #ifdef DEBUG_FlexFramer
+                DEBUG_FlexFramer.println("TeensyFlexFramer - enableMatch failed, using the RX interrupt");
+            #endif
+        } else {
+            _match = true;
+        }
+    }
+    _serial.setReceiveHandler(&receive, this);
+    _started = true;
+    return true;
+}
+
+void TeensyFlexFramer::end(void) {
+    if (!_started)
+        return;
+    _serial.setReceiveHandler(nullptr, nullptr);
+    if (_match)
+        _serial.disableMatch();
+    _match = false;
+    _started = false;
+}
+
+size_t TeensyFlexFramer::send(const TeensyFlexFrameSegment *segments, uint8_t count) {
+    SerialSink sink(_serial);
+    return TeensyFlexFraming::encode(_mode, segments, count, _crc, sink);
+}
+
+bool TeensyFlexFramer::SerialSink::next() {
+    flush();
+    uint32_t start_time = millis();
+    while (!(_span = _serial.reserveWrite(_room))) {
+        if ((millis() - start_time) > FLUSH_TIMEOUT)
+            return false;
+        yield();
+    }
+    return true;
+}
@@ -0,0 +1,84 @@
+#include "TeensyFlexSerial.h"
+#include "TeensyFlexFraming.h"
+#include <Arduino.h>
+
+#ifndef _TEENSY_FLEX_FRAMER_H_
+#define _TEENSY_FLEX_FRAMER_H_
+
+// Packet framing (COBS or SLIP, optional CRC-16) on a TeensyFlexSerial.
+//  - send() encodes the packet segments straight into the serial's TX buffer,
+//    encode() into a caller's buffer to send by DMA with writeAsync().
+//  - Received frames are decoded by the RX ISR straight into the buffers given
+//    with addBuffer(). The callback gets each good packet from the ISR, the
+//    buffer belongs to the caller again from then on (add it back when done).
+//    With useMatch the bytes come in by DMA and the serial wakes up for the
+//    frame delimiter and every RX_BUFFER_SIZE / 2 bytes, the callback runs
+//    from those interrupts. Frames can be longer than the serial's ring, but
+//    bytes the DMA overwrites before an interrupt gets to them are lost
+//    (TeensyFlexSerial::rxOverruns()), keep the CRC on to drop such frames.
+class TeensyFlexFramer {
+  public:
+    typedef TeensyFlexFrameDecoder::Callback Callback;
+
+    TeensyFlexFramer(TeensyFlexSerial &serial, TeensyFlexFraming::Mode mode = TeensyFlexFraming::COBS, bool crc = true)
+        : _serial(serial), _mode(mode), _crc(crc) {}
+    ~TeensyFlexFramer() { end(); }
+
+    // After serial.begin()
+    bool begin(Callback callback, void *context = nullptr, bool useMatch = false);
+    void end(void);
+
+    bool addBuffer(uint8_t *buffer, uint16_t size) { return _decoder.addBuffer(buffer, size); }
+
+    // Bytes put on the line, 0 when the TX buffer stayed full for FLUSH_TIMEOUT
+    // (part of the frame may be out, the receiver drops it). Main loop only.
+    size_t send(const TeensyFlexFrameSegment *segments, uint8_t count);
+    size_t send(const uint8_t *packet, size_t length) {
+        TeensyFlexFrameSegment segment = {packet, length};
+        return send(&segment, 1);
+    }
+    // Frame into buffer, 0 when it does not fit (see maxEncodedLength())
+    size_t encode(const TeensyFlexFrameSegment *segments, uint8_t count, uint8_t *buffer, size_t size) {
+        TeensyFlexBufferSink sink(buffer, size);
+        return TeensyFlexFraming::encode(_mode, segments, count, _crc, sink);
+    }
+    size_t maxEncodedLength(size_t length) { return TeensyFlexFraming::maxEncodedLength(_mode, length, _crc); }
+
+    const TeensyFlexFrameDecoder &decoder() { return _decoder; }
+
+  private:
+    static const uint32_t FLUSH_TIMEOUT = 1000;
+
+    // Writes into the serial's TX buffer in place, a contiguous piece at a time
+    class SerialSink {
+      public:
+        explicit SerialSink(TeensyFlexSerial &serial) : _serial(serial) {}
+        bool put(uint8_t c) {
+            if ((_used == _room) && !next())
+                return false;
+            _span[_used++] = c;
+            return true;
+        }
+        void flush() {
+            _serial.commitWrite(_used);
+            _used = _room = 0;
+        }
+
+      private:
+        bool next();
+        TeensyFlexSerial &_serial;
+        uint8_t *_span = nullptr;
+        size_t _room = 0;
+        size_t _used = 0;
+    };
+
+    static void receive(void *context, uint8_t c) { ((TeensyFlexFramer *)context)->_decoder.feed(c); }
+
+    TeensyFlexSerial &_serial;
+    TeensyFlexFraming::Mode _mode;
+    bool _crc;
+    bool _started = false;
+    bool _match = false;
+    TeensyFlexFrameDecoder _decoder;
+};
+#endif //_TEENSY_FLEX_FRAMER_H_
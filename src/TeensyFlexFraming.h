@@ -0,0 +1,409 @@
+#ifndef _TEENSY_FLEX_FRAMING_H_
+#define _TEENSY_FLEX_FRAMING_H_
+
+// COBS and SLIP packet framing without intermediate buffers (TeensyFlexFramer).
+//
+// Encoding reads the packet from the caller's segments (header, payload, ...)
+// and writes the framed bytes straight to a sink: the TeensyFlexSerial TX
+// buffer or a DMA buffer. COBS needs to know where the next zero is before it
+// writes a block, so it scans ahead in the source (at most 254 bytes) instead
+// of staging the block. The optional CRC-16/CCITT (MSB first) is appended to
+// the packet inside the framing.
+//
+// Decoding is a byte at a time state machine (called from the RX ISR) that
+// writes the packet straight into a caller-owned buffer and hands that buffer
+// over when the delimiter arrives.
+//
+//   COBS: frames end with 0x00, which does not occur inside a frame
+//   SLIP (RFC 1055): frames end with 0xC0, 0xC0/0xDB inside are escaped
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+struct TeensyFlexFrameSegment {
+    const uint8_t *data;
+    size_t length;
+};
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF). Run over a packet followed by
+// its CRC (high byte first) it comes out 0.
+class TeensyFlexCrc16 {
+  public:
+    static const uint16_t INIT = 0xFFFF;
+
+    static uint16_t update(uint16_t crc, uint8_t c) {
+        static const uint16_t table[16] = {0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+                                           0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef};
+        crc = (crc << 4) ^ table[(crc >> 12) ^ (c >> 4)];
+        return (crc << 4) ^ table[(crc >> 12) ^ (c & 0x0f)];
+    }
+
+    static uint16_t compute(const uint8_t *data, size_t length, uint16_t crc = INIT) {
+        while (length--)
+            crc = update(crc, *data++);
+        return crc;
+    }
+};
+
+// Sink for a plain buffer (a DMA segment). Sinks take one byte with put(),
+// which returns false when there is no room left.
+class TeensyFlexBufferSink {
+  public:
+    TeensyFlexBufferSink(uint8_t *buffer, size_t size) : _buffer(buffer), _size(size) {}
+    bool put(uint8_t c) {
+        if (_length >= _size)
+            return false;
+        _buffer[_length++] = c;
+        return true;
+    }
+    void flush() {}
+    size_t length() const { return _length; }
+
+  private:
+    uint8_t *_buffer;
+    size_t _size;
+    size_t _length = 0;
+};
+
+class TeensyFlexFraming {
+  public:
+    enum Mode : uint8_t { COBS,
+                          SLIP };
+    static const uint8_t COBS_END = 0x00;
+    static const uint8_t SLIP_END = 0xC0;
+    static const uint8_t SLIP_ESC = 0xDB;
+    static const uint8_t SLIP_ESC_END = 0xDC;
+    static const uint8_t SLIP_ESC_ESC = 0xDD;
+
+    static uint8_t delimiter(Mode mode) { return (mode == COBS) ? COBS_END : SLIP_END; }
+
+    // Largest encoding of a packet of length bytes, delimiter and CRC included
+    static size_t maxEncodedLength(Mode mode, size_t length, bool crc) {
+        if (crc)
+            length += 2;
+        return ((mode == COBS) ? length + length / 254 + 1 : 2 * length) + 1;
+    }
+
+    // Frames the packet made of count segments into sink. Returns the number
+    // of bytes written, 0 when the sink ran out of room.
+    template <class Sink>
+    static size_t encode(Mode mode, const TeensyFlexFrameSegment *segments, uint8_t count, bool crc, Sink &sink) {
+        Source source(segments, count, crc);
+        size_t written = (mode == COBS) ? encodeCobs(source, sink) : encodeSlip(source, sink);
+        sink.flush();
+        return written;
+    }
+
+    template <class Sink>
+    static size_t encode(Mode mode, const uint8_t *packet, size_t length, bool crc, Sink &sink) {
+        TeensyFlexFrameSegment segment = {packet, length};
+        return encode(mode, &segment, 1, crc, sink);
+    }
+
+  private:
+    // The packet segments and the CRC after them, read one byte at a time.
+    // The CRC is accumulated by one reader (the first to pass each byte) and
+    // becomes readable once all data bytes went through it.
+    struct Source {
+        Source(const TeensyFlexFrameSegment *segments, uint8_t count, bool crc)
+            : shared{segments, count, crc, TeensyFlexCrc16::INIT, {0xFF, 0xFF}} {}
+        struct Shared {
+            const TeensyFlexFrameSegment *segments;
+            uint8_t count;
+            bool crc;
+            uint16_t value;
+            uint8_t trailer[2];
+        } shared;
+    };
+
+    struct Reader {
+        Source::Shared *shared;
+        uint8_t segment = 0;
+        size_t offset = 0;
+        bool accumulate;
+
+        Reader(Source::Shared *s, bool accumulateCrc) : shared(s), accumulate(accumulateCrc) {}
+
+        bool next(uint8_t &c) {
+            while (segment < shared->count) {
+                const TeensyFlexFrameSegment &s = shared->segments[segment];
+                if (offset < s.length) {
+                    c = s.data[offset++];
+                    if (accumulate && shared->crc)
+                        shared->value = TeensyFlexCrc16::update(shared->value, c);
+                    return true;
+                }
+                segment++;
+                offset = 0;
+                if ((segment == shared->count) && accumulate && shared->crc) {
+                    shared->trailer[0] = shared->value >> 8;
+                    shared->trailer[1] = shared->value & 0xff;
+                }
+            }
+            if (!shared->crc || (offset >= 2))
+                return false;
+            c = shared->trailer[offset++];
+            return true;
+        }
+    };
+
+    template <class Sink>
+    static size_t encodeCobs(Source &source, Sink &sink) {
+        Reader scan(&source.shared, true);
+        Reader copy(&source.shared, false);
+        size_t written = 0;
+        for (;;) {
+            // Length of the block: up to the next zero, the end or 254 bytes
+            uint8_t run = 0;
+            bool zero = false, end = false;
+            uint8_t c = 0;
+            while (run < 254) {
+                if (!scan.next(c)) {
+                    end = true;
+                    break;
+                }
+                if (c == 0) {
+                    zero = true;
+                    break;
+                }
+                run++;
+            }
+            if (!sink.put(run + 1))
+                return 0;
+            for (uint8_t i = 0; i < run; i++) {
+                copy.next(c);
+                if (!sink.put(c))
+                    return 0;
+            }
+            written += run + 1;
+            if (zero) {
+                copy.next(c); // the zero is implied by the code
+            } else if (end) {
+                break;
+            } else {
+                // A full 0xFF block, another one only when something follows
+                Reader peek = scan;
+                peek.accumulate = false;
+                if (!peek.next(c))
+                    break;
+            }
+        }
+        if (!sink.put(COBS_END))
+            return 0;
+        return written + 1;
+    }
+
+    template <class Sink>
+    static size_t encodeSlip(Source &source, Sink &sink) {
+        Reader reader(&source.shared, true);
+        size_t written = 0;
+        uint8_t c;
+        while (reader.next(c)) {
+            bool ok;
+            if (c == SLIP_END) {
+                ok = sink.put(SLIP_ESC) && sink.put(SLIP_ESC_END);
+                written += 2;
+            } else if (c == SLIP_ESC) {
+                ok = sink.put(SLIP_ESC) && sink.put(SLIP_ESC_ESC);
+                written += 2;
+            } else {
+                ok = sink.put(c);
+                written++;
+            }
+            if (!ok)
+                return 0;
+        }
+        if (!sink.put(SLIP_END))
+            return 0;
+        return written + 1;
+    }
+};
+
+// Byte by byte frame decoder into caller-owned buffers. The buffers are handed
+// in with addBuffer() (main loop) and come back, filled, through the callback
+// (from feed(), so from the ISR). A frame that arrives while no buffer is free,
+// does not fit, fails the CRC or is malformed is dropped and counted.
+class TeensyFlexFrameDecoder {
+  public:
+    typedef void (*Callback)(void *context, uint8_t *packet, size_t length);
+    static const uint8_t MAX_BUFFERS = 8;
+
+    void begin(TeensyFlexFraming::Mode mode, bool crc, Callback callback, void *context) {
+        _mode = mode;
+        _crc_enabled = crc;
+        _callback = callback;
+        _context = context;
+        _frames = 0;
+        _crc_errors = 0;
+        _errors = 0;
+        _overruns = 0;
+        _no_buffer = 0;
+        restart();
+    }
+
+    // A buffer for a future frame. False when MAX_BUFFERS are already waiting.
+    bool addBuffer(uint8_t *buffer, uint16_t size) {
+        uint8_t head = _free_head.load(std::memory_order_relaxed);
+        uint8_t next = (head + 1) % (MAX_BUFFERS + 1);
+        if (next == _free_tail.load(std::memory_order_acquire))
+            return false;
+        _free[head].data = buffer;
+        _free[head].size = size;
+        _free_head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    void feed(uint8_t c) {
+        if (_mode == TeensyFlexFraming::COBS)
+            feedCobs(c);
+        else
+            feedSlip(c);
+    }
+
+    uint32_t frames() const { return _frames; }
+    uint32_t crcErrors() const { return _crc_errors; }
+    // Bad COBS code or SLIP escape
+    uint32_t errors() const { return _errors; }
+    // Frames longer than their buffer
+    uint32_t overruns() const { return _overruns; }
+    // Frames that found no free buffer
+    uint32_t noBuffer() const { return _no_buffer; }
+
+  private:
+    struct Buffer {
+        uint8_t *data;
+        uint16_t size;
+    };
+
+    void restart() {
+        _length = 0;
+        _code = 0;
+        _pending_zero = false;
+        _escape = false;
+        _discard = false;
+        _crc = TeensyFlexCrc16::INIT;
+    }
+
+    // Next decoded byte into the packet buffer
+    void store(uint8_t c) {
+        if (_discard)
+            return;
+        if (!_current.data && !takeBuffer()) {
+            _no_buffer = _no_buffer + 1;
+            _discard = true;
+            return;
+        }
+        if (_length >= _current.size) {
+            _overruns = _overruns + 1;
+            _discard = true;
+            return;
+        }
+        _current.data[_length++] = c;
+        if (_crc_enabled)
+            _crc = TeensyFlexCrc16::update(_crc, c);
+    }
+
+    bool takeBuffer() {
+        uint8_t tail = _free_tail.load(std::memory_order_relaxed);
+        if (tail == _free_head.load(std::memory_order_acquire))
+            return false;
+        _current = _free[tail];
+        _free_tail.store((tail + 1) % (MAX_BUFFERS + 1), std::memory_order_release);
+        return true;
+    }
+
+    void error() {
+        _errors = _errors + 1;
+        _discard = true;
+    }
+
+    void endFrame() {
+        if (!_discard && _length) {
+            size_t length = _length;
+            bool ok = true;
+            if (_crc_enabled) {
+                ok = (length >= 2) && !_crc;
+                if (ok)
+                    length -= 2;
+                else
+                    _crc_errors = _crc_errors + 1;
+            }
+            if (ok) {
+                uint8_t *packet = _current.data;
+                _current.data = nullptr;
+                _frames = _frames + 1;
+                if (_callback)
+                    _callback(_context, packet, length);
+            }
+        }
+        // A dropped frame leaves its buffer for the next one
+        restart();
+    }
+
+    void feedCobs(uint8_t c) {
+        if (c == TeensyFlexFraming::COBS_END) {
+            if (_code > 0)
+                error(); // cut off inside a block
+            endFrame();
+            return;
+        }
+        if (_code == 0) {
+            // A code byte: the zero implied by the last block comes first
+            if (_pending_zero)
+                store(0);
+            _code = c - 1;
+            _pending_zero = (c != 0xFF);
+            return;
+        }
+        store(c);
+        _code--;
+    }
+
+    void feedSlip(uint8_t c) {
+        if (c == TeensyFlexFraming::SLIP_END) {
+            if (_escape)
+                error();
+            endFrame();
+            return;
+        }
+        if (_escape) {
+            _escape = false;
+            if (c == TeensyFlexFraming::SLIP_ESC_END)
+                store(TeensyFlexFraming::SLIP_END);
+            else if (c == TeensyFlexFraming::SLIP_ESC_ESC)
+                store(TeensyFlexFraming::SLIP_ESC);
+            else
+                error();
+            return;
+        }
+        if (c == TeensyFlexFraming::SLIP_ESC)
+            _escape = true;
+        else
+            store(c);
+    }
+
+    TeensyFlexFraming::Mode _mode = TeensyFlexFraming::COBS;
+    bool _crc_enabled = false;
+    Callback _callback = nullptr;
+    void *_context = nullptr;
+
+    Buffer _free[MAX_BUFFERS + 1];
+    std::atomic<uint8_t> _free_head{0};
+    std::atomic<uint8_t> _free_tail{0};
+    Buffer _current = {nullptr, 0};
+
+    size_t _length = 0;
+    uint8_t _code = 0;
+    bool _pending_zero = false;
+    bool _escape = false;
+    bool _discard = false;
+    uint16_t _crc = TeensyFlexCrc16::INIT;
+
+    volatile uint32_t _frames = 0;
+    volatile uint32_t _crc_errors = 0;
+    volatile uint32_t _errors = 0;
+    volatile uint32_t _overruns = 0;
+    volatile uint32_t _no_buffer = 0;
+};
+
+#endif // _TEENSY_FLEX_FRAMING_H_
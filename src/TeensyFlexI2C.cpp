@@ -0,0 +1,513 @@
+#include "TeensyFlexI2C.h"
+
+// SCL timer compare: 9 bits (8 data + ACK) is 18 edges per byte. The last byte
+// before a STOP gets one more clock so SDA can be pulled low ahead of the stop bit.
+#define I2C_BYTE_EDGES 17
+#define I2C_STOP_EDGES 19
+
+//=============================================================================
+// TeensyFlexI2C::begin
+//=============================================================================
+bool TeensyFlexI2C::begin(int flexio_module, uint32_t clock) {
+    _flexIO = new TeensyFlexIO();
+    _flexIO->begin(static_cast<TeensyFlexIO::FlexIOModule>(flexio_module));
+    _module = flexio_module;
+
+    if ((_flexIO->getFlexIOHandler()->mapIOPinToFlexPin(_sdaPin) == 0xff) ||
+        (_flexIO->getFlexIOHandler()->mapIOPinToFlexPin(_sclPin) == 0xff)) {
+        #ifdef DEBUG_FlexI2C
+            DEBUG_FlexI2C.println("TeensyFlexI2C - SDA or SCL is not a FlexIO pin on this module");
+        #endif
+        end();
+        return false;
+    }
+
+    // The byte timer is enabled by the SCL timer, so they have to be adjacent
+    _timer = _flexIO->requestTimers(2);
+    _tx_shifter = _flexIO->requestShifter();
+    _rx_shifter = _flexIO->requestShifter();
+
+    if ((_timer == 0xff) || (_tx_shifter == 0xff) || (_rx_shifter == 0xff)) {
+        _flexIO->getFlexIOHandler()->freeTimers(_timer, 2);
+        _timer = 0xff;
+        _flexIO->getFlexIOHandler()->freeShifter(_tx_shifter);
+        _tx_shifter = 0xff;
+        _flexIO->getFlexIOHandler()->freeShifter(_rx_shifter);
+        _rx_shifter = 0xff;
+        #ifdef DEBUG_FlexI2C
+            DEBUG_FlexI2C.println("TeensyFlexI2C - Failed to allocate timers or shifters");
+        #endif
+        end();
+        return false;
+    }
+
+    setClock(clock);
+
+    uint8_t trigger = _flexIO->calculateTriggerSelect(TriggerType::SHIFTER, _tx_shifter);
+
+    // TX: start bit low makes the START, stop bit is the ACK slot
+    ShifterConfig shifter_config;
+    shifter_config.mode = ShifterMode::Transmit;
+    shifter_config.pinSelect = _sdaPin;
+    shifter_config.pinConfig = PinConfig::OpenDrain;
+    shifter_config.pinPolarity = PinPolarity::ActiveLow;
+    shifter_config.timerSelect = _timer + 1;
+    shifter_config.timerPolarity = TimerPolarity::ActiveHigh;
+    shifter_config.startBit = 2;
+    shifter_config.stopBit = 3;
+    _flexIO->configureShifter(_tx_shifter, shifter_config);
+
+    // RX: samples on the falling edge, stop bit 0 expected (ACK)
+    shifter_config.mode = ShifterMode::Receive;
+    shifter_config.pinConfig = PinConfig::Disabled;
+    shifter_config.pinPolarity = PinPolarity::ActiveHigh;
+    shifter_config.timerPolarity = TimerPolarity::ActiveLow;
+    shifter_config.startBit = 0;
+    shifter_config.stopBit = 2;
+    _flexIO->configureShifter(_rx_shifter, shifter_config);
+
+    // SCL: runs while the TX shifter has data, holds its count while SCL is stretched
+    TimerConfig timer_config;
+    timer_config.mode = TimerMode::Baud;
+    timer_config.pinSelect = _sclPin;
+    timer_config.pinConfig = PinConfig::OpenDrain;
+    timer_config.pinPolarity = PinPolarity::ActiveHigh;
+    timer_config.triggerSelect = trigger;
+    timer_config.triggerPolarity = TriggerPolarity::ActiveLow;
+    timer_config.triggerSource = TriggerSource::Internal;
+    timer_config.timerEnable = TimerEnable::TriggerHigh;
+    timer_config.timerDisable = TimerDisable::Never;
+    timer_config.timerReset = TimerReset::PinEqualOutput;
+    timer_config.timerDecrement = TimerDecrement::FlexIOClock;
+    timer_config.timerOutput = TimerOutput::Zero;
+    timer_config.startBit = 1;
+    timer_config.stopBit = 0;
+    timer_config.asDual().bits_in_word = I2C_BYTE_EDGES;
+    timer_config.asDual().baud_rate_div = _baud_div;
+    _flexIO->configureTimer(_timer, timer_config);
+    _timcfg_scl = _flexIO->getFlexIO()->TIMCFG[_timer];
+
+    // Byte framing: counts SCL edges, stop bit on compare is the ACK slot
+    timer_config.mode = TimerMode::SingleCounter;
+    timer_config.pinConfig = PinConfig::Disabled;
+    timer_config.pinPolarity = PinPolarity::ActiveLow;
+    timer_config.timerEnable = TimerEnable::N1Enable;
+    timer_config.timerDisable = TimerDisable::N1Disable;
+    timer_config.timerReset = TimerReset::Never;
+    timer_config.timerDecrement = TimerDecrement::PinInput;
+    timer_config.timerOutput = TimerOutput::One;
+    timer_config.startBit = 1;
+    timer_config.stopBit = 1;
+    timer_config.asCounter().compareValue = 0;
+    timer_config.asCounter().reloadValue = 0x0F;
+    _flexIO->configureTimer(_timer + 1, timer_config);
+
+    _flexIO->setPinFlexioMode(_sdaPin);
+    _flexIO->setPinFlexioMode(_sclPin);
+    _flexIO->setPinParameters(_sdaPin, PullUp::PULLUP_22K, 7, 3);
+    _flexIO->setPinParameters(_sclPin, PullUp::PULLUP_22K, 7, 3);
+
+    _flexIO->enable();
+    _flexIO->getFlexIOHandler()->addIOHandlerCallback(this);
+
+    if (!initDMAChannels()) {
+        end();
+        return false;
+    }
+    _state = State::idle;
+    return true;
+}
+
+void TeensyFlexI2C::end(void) {
+    if (!_flexIO)
+        return;
+    if (!_flexIO->getFlexIOHandler()) {
+        delete _flexIO;
+        _flexIO = nullptr;
+        return;
+    }
+    if (_state == State::active)
+        abort();
+    _flexIO->getFlexIOHandler()->removeIOHandlerCallback(this);
+    _flexIO->getFlexIOHandler()->freeTimers(_timer, 2);
+    _timer = 0xff;
+    _flexIO->getFlexIOHandler()->freeShifter(_tx_shifter);
+    _tx_shifter = 0xff;
+    _flexIO->getFlexIOHandler()->freeShifter(_rx_shifter);
+    _rx_shifter = 0xff;
+    if (_dmaTX) {
+        _dmaTX->disable();
+        delete _dmaTX;
+        _dmaTX = nullptr;
+    }
+    if (_dmaRX) {
+        _dmaRX->disable();
+        TeensyFlexDMADispatch::detach(_dmaRX->channel);
+        delete _dmaRX;
+        _dmaRX = nullptr;
+    }
+    _state = State::notAllocated;
+    delete _flexIO;
+    _flexIO = nullptr;
+}
+
+uint32_t TeensyFlexI2C::setClock(uint32_t clock) {
+    uint32_t clock_speed = _flexIO->getFlexIOHandler()->computeClockRate();
+    if (!clock)
+        clock = 100000;
+
+    // SCL period is 2 * (div + 1) FlexIO clocks, round towards the slower side
+    uint32_t div = (clock_speed / 2 + clock - 1) / clock;
+    if (div < 1)
+        div = 1;
+    else if (div > 256)
+        div = 256;
+    _baud_div = div - 1;
+
+    if (_timer != 0xff) {
+        IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+        p->TIMCMP[_timer] = (p->TIMCMP[_timer] & 0xff00) | _baud_div;
+    }
+    #ifdef DEBUG_FlexI2C
+        DEBUG_FlexI2C.printf("TeensyFlexI2C::setClock %u -> div %u (%u Hz)\n", clock, _baud_div, clock_speed / (2 * div));
+    #endif
+    return clock_speed / (2 * div);
+}
+
+//=========================================================================
+// Init the DMA channels
+//=========================================================================
+bool TeensyFlexI2C::initDMAChannels() {
+    _dmaTX = new DMAChannel();
+    _dmaRX = new DMAChannel();
+    if ((_dmaTX == nullptr) || (_dmaRX == nullptr)) {
+        #ifdef DEBUG_FlexI2C
+            DEBUG_FlexI2C.println("Failed to allocate DMA channels");
+        #endif
+        return false;
+    }
+
+    IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+    _dmaTX->disable();
+    _dmaTX->destination(*(volatile uint8_t *)&p->SHIFTBUFBBS[_tx_shifter]);
+    _dmaTX->disableOnCompletion();
+    _dmaTX->triggerAtHardwareEvent(_flexIO->getFlexIOHandler()->shiftersDMAChannel(_tx_shifter));
+
+    _dmaRX->disable();
+    _dmaRX->source(*(volatile uint8_t *)&p->SHIFTBUFBIS[_rx_shifter]);
+    _dmaRX->disableOnCompletion();
+    _dmaRX->interruptAtCompletion();
+    _dmaRX->triggerAtHardwareEvent(_flexIO->getFlexIOHandler()->shiftersDMAChannel(_rx_shifter));
+
+    _dmaRX->attachInterrupt(TeensyFlexDMADispatch::attach(
+        _dmaRX->channel, &TeensyFlexDMADispatch::member<TeensyFlexI2C, &TeensyFlexI2C::dma_rxisr>, this));
+    return true;
+}
+
+//=========================================================================
+// Transfers
+//=========================================================================
+bool TeensyFlexI2C::queue(uint8_t address, const uint8_t *txBuffer, size_t txCount, uint8_t *rxBuffer,
+                          size_t rxCount, bool sendStop, EventResponder *event_responder) {
+    // Busy first: the responder of the transfer in progress stays
+    if (_state != State::idle) {
+        _status = (_state == State::active) ? Busy : InvalidArgument;
+        return false;
+    }
+    if ((address > 0x7f) || (txCount > 0x7fff) || (rxCount > 0x7fff) || (txCount && !txBuffer) ||
+        (rxCount && !rxBuffer)) {
+        _status = InvalidArgument;
+        return false;
+    }
+
+    _phase_count = 0;
+    // A plain read skips the write phase, an address only write still needs one
+    if (txCount || !rxCount) {
+        Phase &ph = _phases[_phase_count++];
+        ph.tx = txBuffer;
+        ph.rx = nullptr;
+        ph.count = txCount;
+        ph.address = address << 1;
+        ph.stop = sendStop && !rxCount;
+        if (txCount && ((uint32_t)txBuffer >= 0x20200000u))
+            arm_dcache_flush((void *)txBuffer, txCount);
+    }
+    if (rxCount) {
+        Phase &ph = _phases[_phase_count++];
+        ph.tx = nullptr;
+        ph.rx = rxBuffer;
+        ph.count = rxCount;
+        ph.address = (address << 1) | 1;
+        ph.stop = sendStop;
+        if ((uint32_t)rxBuffer >= 0x20200000u)
+            arm_dcache_delete(rxBuffer, rxCount);
+    }
+
+    _phase_index = 0;
+    _status = OK;
+    _event_responder = event_responder;
+    _state = State::active;
+    startPhase();
+    return true;
+}
+
+bool TeensyFlexI2C::transfer(uint8_t address, const uint8_t *txBuffer, size_t txCount, uint8_t *rxBuffer,
+                             size_t rxCount, EventResponderRef event_responder, bool sendStop) {
+    return queue(address, txBuffer, txCount, rxBuffer, rxCount, sendStop, &event_responder);
+}
+
+TeensyFlexI2C::Status TeensyFlexI2C::write(uint8_t address, const uint8_t *data, size_t count, bool sendStop) {
+    if (!queue(address, data, count, nullptr, 0, sendStop, nullptr))
+        return _status;
+    return wait();
+}
+
+TeensyFlexI2C::Status TeensyFlexI2C::read(uint8_t address, uint8_t *data, size_t count, bool sendStop) {
+    if (!count)
+        return InvalidArgument;
+    if (!queue(address, nullptr, 0, data, count, sendStop, nullptr))
+        return _status;
+    return wait();
+}
+
+TeensyFlexI2C::Status TeensyFlexI2C::writeRegister(uint8_t address, uint8_t reg, uint8_t value) {
+    uint8_t buffer[2] = {reg, value};
+    return write(address, buffer, 2);
+}
+
+TeensyFlexI2C::Status TeensyFlexI2C::readRegisters(uint8_t address, uint8_t reg, uint8_t *data, size_t count) {
+    if (!count)
+        return InvalidArgument;
+    if (!queue(address, &reg, 1, data, count, true, nullptr))
+        return _status;
+    return wait();
+}
+
+TeensyFlexI2C::Status TeensyFlexI2C::wait(void) {
+    elapsedMillis timer;
+    while (_state == State::active) {
+        if (timer > _timeout_ms) {
+            abort();
+            _status = Timeout;
+            break;
+        }
+        yield();
+    }
+    return _status;
+}
+
+//-------------------------------------------------------------------------
+// Phase sequencing
+//-------------------------------------------------------------------------
+void TeensyFlexI2C::startPhase(void) {
+    Phase &ph = _phases[_phase_index];
+    uint16_t bytes = ph.count + 1;
+    IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+
+    _rx_index = 0;
+    (void)p->SHIFTBUF[_rx_shifter];
+    p->SHIFTERR = SHIFTER_MASK(_rx_shifter) | SHIFTER_MASK(_tx_shifter);
+    // The address byte is ACKed by the target in both directions
+    p->SHIFTCFG[_rx_shifter] = FLEXIO_SHIFTCFG_SSTOP(2);
+    p->SHIFTCFG[_tx_shifter] = FLEXIO_SHIFTCFG_SSTART(2) | FLEXIO_SHIFTCFG_SSTOP(3);
+    p->TIMCFG[_timer] = _timcfg_scl;
+    p->TIMCMP[_timer] = (((ph.stop && (bytes <= 2)) ? I2C_STOP_EDGES : I2C_BYTE_EDGES) << 8) | _baud_div;
+    _flexIO->clearTimerStatus(_timer);
+
+    // The address goes out by hand, the TX DMA follows once it is in the shifter
+    p->SHIFTBUFBBS[_tx_shifter] = ph.address;
+    if (ph.count) {
+        if (ph.tx)
+            _dmaTX->sourceBuffer(ph.tx, ph.count);
+        else {
+            _dmaTX->source(_fill);
+            _dmaTX->transferCount(ph.count);
+        }
+        _dmaTX->enable();
+        _flexIO->enableDMARequests(SHIFTER_MASK(_tx_shifter));
+    }
+    _flexIO->enableShifterInterrupt(_rx_shifter);
+    rxByteDone(0);
+}
+
+// Called once 'index' bytes of the phase have been received (0 right after the start).
+// Byte index + 1 is on the bus at this point.
+void TeensyFlexI2C::rxByteDone(uint16_t index) {
+    Phase &ph = _phases[_phase_index];
+    uint16_t bytes = ph.count + 1;
+    IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+
+    // The SCL timer loads the new compare at the end of the current byte
+    if (ph.stop && index && (index + 2 == bytes))
+        p->TIMCMP[_timer] = (I2C_STOP_EDGES << 8) | _baud_div;
+
+    if (index + 1 == bytes) {
+        // Last byte is shifting: stop at its compare, NACK it when reading
+        p->TIMCFG[_timer] = (_timcfg_scl & ~FLEXIO_TIMCFG_TIMDIS(7)) |
+                            FLEXIO_TIMCFG_TIMDIS(static_cast<uint8_t>(TimerDisable::OnCompare)) |
+                            (ph.stop ? FLEXIO_TIMCFG_TSTOP(2) : 0);
+        if (!ph.tx && ph.count)
+            p->SHIFTCFG[_tx_shifter] = FLEXIO_SHIFTCFG_SSTOP(3);
+        _flexIO->disableDMARequests(SHIFTER_MASK(_tx_shifter));
+        if (ph.stop) {
+            // Queue a zero byte behind the last one, it pulls SDA low for the
+            // STOP. The last byte normally left the buffer already, if not the
+            // TX shifter interrupt writes it (within that byte time).
+            if (SHIFT_STAT(*_flexIO) & SHIFTER_MASK(_tx_shifter)) {
+                p->SHIFTBUFBBS[_tx_shifter] = 0;
+            } else {
+                _stop_pending = true;
+                _flexIO->enableShifterInterrupt(_tx_shifter);
+            }
+        }
+        _flexIO->clearTimerStatus(_timer);
+        _flexIO->enableTimerInterrupt(_timer);
+    }
+}
+
+void TeensyFlexI2C::rxByte(void) {
+    Phase &ph = _phases[_phase_index];
+    uint16_t bytes = ph.count + 1;
+    IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+
+    uint8_t value = p->SHIFTBUFBIS[_rx_shifter] & 0xff;
+    uint16_t index = _rx_index + 1;
+    _rx_index = index;
+    bool nack = (ph.tx || index == 1) && (p->SHIFTERR & SHIFTER_MASK(_rx_shifter));
+
+    if (index == 1) {
+        if (!ph.tx && !nack) {
+            // Reading: the master ACKs from now on and the RX stop bit is not checked
+            p->SHIFTCFG[_rx_shifter] = 0;
+            p->SHIFTCFG[_tx_shifter] = FLEXIO_SHIFTCFG_SSTOP(2);
+        }
+    } else if (ph.rx) {
+        ph.rx[index - 2] = value;
+    }
+
+    if (nack) {
+        // Make the byte on the bus the last one of the transfer
+        _status = (index == 1) ? AddressNack : DataNack;
+        p->SHIFTERR = SHIFTER_MASK(_rx_shifter);
+        _dmaTX->disable();
+        ph.count = index;
+        ph.stop = true;
+        _phase_count = _phase_index + 1;
+        bytes = index + 1;
+        ph.tx = nullptr; // the byte on the bus is not checked
+    }
+
+    rxByteDone(index);
+
+    if (index == bytes) {
+        _flexIO->disableShifterInterrupt(_rx_shifter);
+    } else if ((index == 1) && (bytes > 3)) {
+        // Everything up to the last two bytes goes through the RX DMA
+        _flexIO->disableShifterInterrupt(_rx_shifter);
+        if (ph.rx)
+            _dmaRX->destinationBuffer(ph.rx, bytes - 3);
+        else {
+            _dmaRX->destination(_bit_bucket);
+            _dmaRX->transferCount(bytes - 3);
+        }
+        _dmaRX->enable();
+        _flexIO->enableDMARequests(SHIFTER_MASK(_rx_shifter));
+    }
+}
+
+void TeensyFlexI2C::endPhase(void) {
+    _stop_pending = false;
+    _flexIO->disableShifterInterrupt(_tx_shifter);
+    _flexIO->disableTimerInterrupt(_timer);
+    _flexIO->clearTimerStatus(_timer);
+    _flexIO->disableShifterInterrupt(_rx_shifter);
+    _flexIO->disableDMARequests(SHIFTER_MASK(_tx_shifter) | SHIFTER_MASK(_rx_shifter));
+    _dmaTX->disable();
+    _dmaRX->disable();
+
+    if ((_status != OK) || (++_phase_index >= _phase_count)) {
+        finish(_status);
+        return;
+    }
+    startPhase();
+}
+
+void TeensyFlexI2C::finish(Status status) {
+    _status = status;
+    _state = State::idle;
+    if (_event_responder) {
+        EventResponder *event_responder = _event_responder;
+        _event_responder = nullptr;
+        event_responder->triggerEvent((int)status, this);
+    }
+}
+
+void TeensyFlexI2C::abort(void) {
+    IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+    __disable_irq();
+    _dmaTX->disable();
+    _dmaRX->disable();
+    _flexIO->disableDMARequests(SHIFTER_MASK(_tx_shifter) | SHIFTER_MASK(_rx_shifter));
+    _flexIO->disableShifterInterrupt(_rx_shifter);
+    _flexIO->disableShifterInterrupt(_tx_shifter);
+    _stop_pending = false;
+    _flexIO->disableTimerInterrupt(_timer);
+    // Cycling the timer mode stops SCL and releases both lines
+    uint32_t timctl = p->TIMCTL[_timer];
+    p->TIMCTL[_timer] = timctl & ~FLEXIO_TIMCTL_TIMOD(3);
+    p->TIMCTL[_timer] = timctl;
+    (void)p->SHIFTBUF[_rx_shifter];
+    p->SHIFTERR = SHIFTER_MASK(_rx_shifter) | SHIFTER_MASK(_tx_shifter);
+    _state = State::idle;
+    __enable_irq();
+}
+
+//=========================================================================
+// Interrupt handlers
+//=========================================================================
+bool TeensyFlexI2C::call_back(FlexIOHandler *pflex) {
+    if ((pflex != _flexIO->getFlexIOHandler()) || (_state != State::active))
+        return false;
+
+    if (_stop_pending && (SHIFT_STAT(*_flexIO) & SHIFTER_MASK(_tx_shifter))) {
+        _flexIO->getFlexIO()->SHIFTBUFBBS[_tx_shifter] = 0;
+        _flexIO->disableShifterInterrupt(_tx_shifter);
+        _stop_pending = false;
+    }
+
+    if ((SHIFT_STAT(*_flexIO) & SHIFTER_MASK(_rx_shifter)) && _flexIO->shifterInterruptEnabled(_rx_shifter))
+        rxByte();
+
+    if ((TIME_STAT(*_flexIO) & TIMER_MASK(_timer)) && _flexIO->timerInterruptEnabled(_timer))
+        endPhase();
+    return false;
+}
+
+//-------------------------------------------------------------------------
+// DMA RX ISR - the middle of a phase has been received
+//-------------------------------------------------------------------------
+void TeensyFlexI2C::dma_rxisr(void) {
+    _dmaRX->clearInterrupt();
+    _dmaRX->clearComplete();
+
+    IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+    _flexIO->disableDMARequests(SHIFTER_MASK(_rx_shifter));
+
+    Phase &ph = _phases[_phase_index];
+    _rx_index = ph.count - 1;
+    if (ph.rx && ((uint32_t)ph.rx >= 0x20200000u))
+        arm_dcache_delete(ph.rx, ph.count);
+
+    if (ph.tx && (p->SHIFTERR & SHIFTER_MASK(_rx_shifter)) && (_status == OK)) {
+        // A data byte was NACKed somewhere in the burst, end with the next byte
+        _status = DataNack;
+        p->SHIFTERR = SHIFTER_MASK(_rx_shifter);
+        _dmaTX->disable();
+        ph.count = _rx_index;
+        ph.stop = true;
+        ph.tx = nullptr;
+        _phase_count = _phase_index + 1;
+    }
+    rxByteDone(_rx_index);
+    _flexIO->enableShifterInterrupt(_rx_shifter);
+}
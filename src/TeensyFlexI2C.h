@@ -0,0 +1,115 @@
+#include "TeensyFlexIO.h"
+#include "TeensyFlexDMADispatch.h"
+#include <Arduino.h>
+#include <DMAChannel.h>
+#include <EventResponder.h>
+
+#ifndef _TEENSY_FLEX_I2C_H_
+#define _TEENSY_FLEX_I2C_H_
+
+// I2C master on FlexIO using two shifters and two timers, laid out like the
+// NXP FlexIO I2C master:
+//  - TX shifter drives SDA open drain; its start bit makes the (repeated) START
+//    and its stop bit is the ACK slot, released for writes and pulled low by the
+//    master while reading
+//  - RX shifter samples SDA; its stop bit check sets SHIFTERR on a NACK
+//  - timer 0 drives SCL open drain and restarts its count while a target holds
+//    SCL low, so clock stretching works
+//  - timer 1 (N1Enable on timer 0) frames each 8 bit + ACK byte off SCL
+//
+// Timer 0 reloads once per byte and only gets told to stop during the last byte,
+// so a transfer is not limited by the 8 bit baud counter. The first and the last
+// two bytes of a phase are handled by the shifter interrupt, everything in between
+// is moved by DMA in both directions.
+class TeensyFlexI2C : public FlexIOHandlerCallback {
+  public:
+    enum Status { OK = 0,
+                  Busy,
+                  AddressNack,
+                  DataNack,
+                  Timeout,
+                  InvalidArgument };
+
+    enum { DEFAULT_TIMEOUT_MS = 100 };
+
+    TeensyFlexI2C(int sdaPin, int sclPin) : _sdaPin(sdaPin), _sclPin(sclPin){};
+    ~TeensyFlexI2C() { end(); }
+
+    bool begin(int flexio_module, uint32_t clock = 100000);
+    void end(void);
+
+    // 100k, 400k and 1M work with the default FlexIO clock. Returns the achieved SCL rate.
+    uint32_t setClock(uint32_t clock);
+
+    // Blocking helpers - they yield() while the transfer runs in the background
+    Status write(uint8_t address, const uint8_t *data, size_t count, bool sendStop = true);
+    Status read(uint8_t address, uint8_t *data, size_t count, bool sendStop = true);
+    Status writeRegister(uint8_t address, uint8_t reg, uint8_t value);
+    Status readRegisters(uint8_t address, uint8_t reg, uint8_t *data, size_t count);
+
+    // Asynchronous write, then repeated START and read. Either count may be 0.
+    // The event is triggered with the final Status as its status value.
+    bool transfer(uint8_t address, const uint8_t *txBuffer, size_t txCount, uint8_t *rxBuffer, size_t rxCount,
+                  EventResponderRef event_responder, bool sendStop = true);
+
+    bool busy() { return _state == State::active; }
+    Status status() { return _status; }
+    void setTimeout(uint32_t ms) { _timeout_ms = ms; }
+
+    FlexIOHandler *flexIOHandler() { return _flexIO ? _flexIO->getFlexIOHandler() : nullptr; }
+
+    // Call back from flexIO when ISR hapens
+    virtual bool call_back(FlexIOHandler *pflex);
+
+  private:
+    int _sdaPin;
+    int _sclPin;
+
+    TeensyFlexIO *_flexIO = nullptr;
+    uint8_t _module = 0xff;
+    uint8_t _timer = 0xff; // SCL timer, _timer + 1 frames the bytes
+    uint8_t _tx_shifter = 0xff;
+    uint8_t _rx_shifter = 0xff;
+    uint8_t _baud_div = 0;
+    uint32_t _timcfg_scl = 0; // TIMCFG of the SCL timer with TIMDIS = Never and no stop bit
+
+    // One phase is START + address byte + data bytes, optionally followed by STOP
+    struct Phase {
+        const uint8_t *tx; // nullptr for a read
+        uint8_t *rx;
+        uint16_t count;    // data bytes, the address byte is not included
+        uint8_t address;   // address byte including the R/W bit
+        bool stop;
+    };
+    Phase _phases[2];
+    uint8_t _phase_count = 0;
+    uint8_t _phase_index = 0;
+    volatile uint16_t _rx_index = 0; // bytes of the current phase received so far
+
+    enum class State { notAllocated,
+                       idle,
+                       active };
+    volatile State _state = State::notAllocated;
+    volatile Status _status = OK;
+    uint32_t _timeout_ms = DEFAULT_TIMEOUT_MS;
+    uint8_t _fill = 0xff;
+    uint8_t _bit_bucket;
+
+    DMAChannel *_dmaTX = nullptr;
+    DMAChannel *_dmaRX = nullptr;
+    EventResponder *_event_responder = nullptr;
+    volatile bool _stop_pending = false; // the STOP byte waits for room in the TX shifter
+
+    bool initDMAChannels();
+    bool queue(uint8_t address, const uint8_t *txBuffer, size_t txCount, uint8_t *rxBuffer, size_t rxCount,
+               bool sendStop, EventResponder *event_responder);
+    void startPhase(void);
+    void rxByteDone(uint16_t index);
+    void rxByte(void);
+    void endPhase(void);
+    void finish(Status status);
+    void abort(void);
+    Status wait(void);
+    void dma_rxisr(void);
+};
+#endif //_TEENSY_FLEX_I2C_H_
@@ -1,25 +1,40 @@
 #include "TeensyFlexIO.h"
 
+TeensyFlexIO::RegisterShadow TeensyFlexIO::_shadows[3];
+TeensyFlexIO::ServiceState TeensyFlexIO::_service[3];
+
+static const uint8_t flexio_irqs[3] = {IRQ_FLEXIO1, IRQ_FLEXIO2, IRQ_FLEXIO3};
+
 void TeensyFlexIO::begin(FlexIOModule module) {
     Serial.printf("Initializing FlexIO %d\n", module);
     switch(module) {
         case FLEXIO1:
             _flexio = (IMXRT_FLEXIO_t*)&IMXRT_FLEXIO1_S;
             _flexio_handler = FlexIOHandler::flexIOHandler_list[0]; // Create handler for FlexIO1
-            CCM_CCGR5 |= CCM_CCGR5_FLEXIO1(CCM_CCGR_ON);
+            CCM_CCGR5 = CCM_CCGR5 | CCM_CCGR5_FLEXIO1(CCM_CCGR_ON);
             break;
         case FLEXIO2:
             _flexio = (IMXRT_FLEXIO_t*)&IMXRT_FLEXIO2_S;
             _flexio_handler = FlexIOHandler::flexIOHandler_list[1];  // Create handler for FlexIO2
-            CCM_CCGR3 |= CCM_CCGR3_FLEXIO2(CCM_CCGR_ON);
+            CCM_CCGR3 = CCM_CCGR3 | CCM_CCGR3_FLEXIO2(CCM_CCGR_ON);
             break;
         case FLEXIO3:
             _flexio = (IMXRT_FLEXIO_t*)&IMXRT_FLEXIO3_S;
             _flexio_handler = FlexIOHandler::flexIOHandler_list[2];  // Create handler for FlexIO3
-            CCM_CCGR7 |= CCM_CCGR7_FLEXIO3(CCM_CCGR_ON);
+            CCM_CCGR7 = CCM_CCGR7 | CCM_CCGR7_FLEXIO3(CCM_CCGR_ON);
             break;
     }
 
+    // The first object on a module reads the registers, the rest share them
+    _shadow = &_shadows[module];
+    if (!_shadow->ctrl.attached()) {
+        _shadow->ctrl.attach(&_flexio->CTRL);
+        _shadow->shiftsien.attach(&_flexio->SHIFTSIEN);
+        _shadow->timien.attach(&_flexio->TIMIEN);
+        _shadow->shiftsden.attach(&_flexio->SHIFTSDEN);
+    }
+    _service_state = &_service[module];
+
     _is_initialized = true;
 }
 
@@ -423,20 +438,91 @@ void TeensyFlexIO::setClockSettings(uint8_t clk_sel, uint8_t clk_pred, uint8_t c
     _flexio_handler->setClockSettings(clk_sel, clk_pred, clk_podf);
 }
 
+// The shadow read-modify-write must not be split by an interrupt handler
+// changing the same register
+void TeensyFlexIO::updateShadow(TeensyFlexShadowRegister<volatile uint32_t> &reg, uint32_t mask, bool set) {
+    uint32_t primask;
+    asm volatile("mrs %0, primask" : "=r"(primask)::"memory");
+    __disable_irq();
+    if (set)
+        reg.set(mask);
+    else
+        reg.clear(mask);
+    if (!primask)
+        __enable_irq();
+}
+
+void TeensyFlexIO::enable() {
+    updateShadow(_shadow->ctrl, FLEXIO_CTRL_FLEXEN, true);
+}
+
+void TeensyFlexIO::disable() {
+    updateShadow(_shadow->ctrl, FLEXIO_CTRL_FLEXEN, false);
+}
+
 void TeensyFlexIO::disableShifterInterrupt(uint8_t shifter) {
-    _flexio->SHIFTSIEN &= ~SHIFTER_MASK(shifter);  // Disable shifter interrupt
+    updateShadow(_shadow->shiftsien, SHIFTER_MASK(shifter), false);  // Disable shifter interrupt
 }
 
 void TeensyFlexIO::enableShifterInterrupt(uint8_t shifter) {
-    _flexio->SHIFTSIEN |= SHIFTER_MASK(shifter);  // Enable shifter interrupt
+    updateShadow(_shadow->shiftsien, SHIFTER_MASK(shifter), true);  // Enable shifter interrupt
 }
 
 void TeensyFlexIO::disableTimerInterrupt(uint8_t timer) {
-    _flexio->TIMIEN &= ~TIMER_MASK(timer);  
+    updateShadow(_shadow->timien, TIMER_MASK(timer), false);
 }
 
 void TeensyFlexIO::enableTimerInterrupt(uint8_t timer) {
-    _flexio->TIMIEN |= TIMER_MASK(timer);  // Enable timer interrupt
+    updateShadow(_shadow->timien, TIMER_MASK(timer), true);  // Enable timer interrupt
+}
+
+void TeensyFlexIO::enableDMARequests(uint32_t shifterMask) {
+    updateShadow(_shadow->shiftsden, shifterMask, true);
+}
+
+void TeensyFlexIO::disableDMARequests(uint32_t shifterMask) {
+    updateShadow(_shadow->shiftsden, shifterMask, false);
+}
+
+void TeensyFlexIO::syncRegisterShadow() {
+    _shadow->ctrl.sync();
+    _shadow->shiftsien.sync();
+    _shadow->timien.sync();
+    _shadow->shiftsden.sync();
+}
+
+void TeensyFlexIO::setPolling(FlexIOModule module, bool polling) {
+    _service[module].polling = polling;
+    if (polling) {
+        NVIC_DISABLE_IRQ(flexio_irqs[module]);
+    } else {
+        NVIC_ENABLE_IRQ(flexio_irqs[module]);
+    }
+}
+
+uint32_t TeensyFlexIO::poll(FlexIOModule module) {
+    ServiceState &service = _service[module];
+    RegisterShadow &shadow = _shadows[module];
+    if (!service.polling || !shadow.ctrl.attached())
+        return 0;
+    // A driver begin() while polling attaches (and unmasks) the interrupt again
+    NVIC_DISABLE_IRQ(flexio_irqs[module]);
+
+    FlexIOHandler *handler = FlexIOHandler::flexIOHandler_list[module];
+    IMXRT_FLEXIO_t *port = &handler->port();
+    uint32_t shiftstat = port->SHIFTSTAT;
+    uint32_t timstat = port->TIMSTAT;
+    uint32_t pending = __builtin_popcount(shiftstat & shadow.shiftsien.value()) +
+                       __builtin_popcount(timstat & shadow.timien.value());
+    if (!pending)
+        return 0;
+
+    service.shiftstat = shiftstat;
+    service.timstat = timstat;
+    service.in_pass = true;
+    handler->IRQHandler();
+    service.in_pass = false;
+    return pending;
 }
 
 void TeensyFlexIO::clearShifterStatus(uint8_t shifter) {
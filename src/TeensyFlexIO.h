@@ -3,6 +3,7 @@
 
 #include <Arduino.h>
 #include <FlexIO_t4.h>
+#include "TeensyFlexShadowRegister.h"
 
 #define SHIFTER_MASK(n) (1 << n)
 #define TIMER_MASK(n) (1 << n)
@@ -152,7 +153,9 @@
         /// Reset on timer trigger low
         TriggerLow = 6,
         /// Reset on timer disable
-        OnDisable = 7
+        OnDisable = 7,
+        /// Reset on timer trigger rising or falling edge (the i.MX RT1060 meaning of 7)
+        TriggerRisingOrFalling = 7
     };
 
     /// Timer decrement configurations
@@ -268,6 +271,30 @@ private:
     FlexIOHandler* _flexio_handler;
     IMXRT_FLEXIO_t* _flexio;
     bool _is_initialized = false;
+
+    // Registers only software changes, shadowed once per module and shared by
+    // every TeensyFlexIO object on that module. Interrupt handlers change them
+    // too, so every change goes through updateShadow() with interrupts masked.
+    struct RegisterShadow {
+        TeensyFlexShadowRegister<volatile uint32_t> ctrl;
+        TeensyFlexShadowRegister<volatile uint32_t> shiftsien;
+        TeensyFlexShadowRegister<volatile uint32_t> timien;
+        TeensyFlexShadowRegister<volatile uint32_t> shiftsden;
+    };
+    static RegisterShadow _shadows[3];
+    RegisterShadow* _shadow = nullptr;
+    static void updateShadow(TeensyFlexShadowRegister<volatile uint32_t> &reg, uint32_t mask, bool set);
+
+    // Polled service, per module. During a poll() pass the callbacks see the
+    // status registers as they were read once at its start.
+    struct ServiceState {
+        volatile bool polling = false;
+        bool in_pass = false;
+        uint32_t shiftstat = 0;
+        uint32_t timstat = 0;
+    };
+    static ServiceState _service[3];
+    ServiceState* _service_state = nullptr;
     
 
 public:
@@ -420,10 +447,10 @@ public:
         uint8_t slewRate = 2);
 
     // Enable FlexIO module operations
-    void enable() { _flexio->CTRL |= FLEXIO_CTRL_FLEXEN; }
+    void enable();
     
     // Disable FlexIO module operations
-    void disable() { _flexio->CTRL &= ~FLEXIO_CTRL_FLEXEN; }
+    void disable();
 
     // Basic data transfer methods
     void writeShifter(uint8_t shifterIndex, uint32_t data) { _flexio->SHIFTBUF[shifterIndex] = data; }
@@ -447,6 +474,33 @@ public:
     void disableTimerInterrupt(uint8_t timer);
     void enableTimerInterrupt(uint8_t timer);
 
+    // Answered from the shadow, no bus access
+    bool shifterInterruptEnabled(uint8_t shifter) { return _shadow->shiftsien.test(SHIFTER_MASK(shifter)); }
+    bool timerInterruptEnabled(uint8_t timer) { return _shadow->timien.test(TIMER_MASK(timer)); }
+
+    // Shifter DMA requests (SHIFTSDEN), for one or more SHIFTER_MASK bits
+    void enableDMARequests(uint32_t shifterMask);
+    void disableDMARequests(uint32_t shifterMask);
+    bool dmaRequestsEnabled(uint8_t shifter) { return _shadow->shiftsden.test(SHIFTER_MASK(shifter)); }
+
+    // Re-read the shadowed registers after writing them directly
+    void syncRegisterShadow();
+
+    // Interrupt free operation: the module's interrupt is masked and poll(),
+    // called from a tight loop or a timer tick, services every driver on it
+    // (all their call_back()s) in one pass. Can be switched at any time, the
+    // drivers keep their interrupt enables as "work wanted" flags.
+    static void setPolling(FlexIOModule module, bool polling);
+    static bool polling(FlexIOModule module) { return _service[module].polling; }
+    bool polling() { return _service_state->polling; }
+    // Returns the number of pending shifter/timer flags that were serviced
+    static uint32_t poll(FlexIOModule module);
+
+    // SHIFTSTAT/TIMSTAT for call_back(): the snapshot taken by poll(), or the
+    // register itself when running from the interrupt
+    uint32_t shifterStatus() { return _service_state->in_pass ? _service_state->shiftstat : _flexio->SHIFTSTAT; }
+    uint32_t timerStatus() { return _service_state->in_pass ? _service_state->timstat : _flexio->TIMSTAT; }
+
     void clearShifterStatus(uint8_t shifter);
     void clearTimerStatus(uint8_t timer);
 
@@ -0,0 +1,251 @@
+#include "TeensyFlexMIDI.h"
+
+//=============================================================================
+// TeensyFlexMIDI::begin
+//=============================================================================
+bool TeensyFlexMIDI::begin(uint32_t tickUs, uint32_t baud) {
+    if (_flexIO || !tickUs)
+        return false;
+    _serial.begin(baud);
+    _flexIO = _serial.txFlexIO().isInitialized() ? &_serial.txFlexIO() : &_serial.rxFlexIO();
+    if (!_flexIO->isInitialized()) {
+        _flexIO = nullptr;
+        return false;
+    }
+
+    int8_t timer = _flexIO->requestTimers(1);
+    if (timer < 0) {
+        #ifdef DEBUG_FlexMIDI
+            DEBUG_FlexMIDI.println("TeensyFlexMIDI - no free timer for the tick");
+        #endif
+        _flexIO = nullptr;
+        return false;
+    }
+
+    // Free running 16 bit counter, the status flag sets once per tick
+    float clock = _flexIO->getFlexIOHandler()->computeClockRate();
+    uint32_t clocks = (uint32_t)((float)tickUs * clock / 1000000.0f + 0.5f);
+    if (clocks < 2) clocks = 2;
+    if (clocks > 0x10000) {
+        clocks = 0x10000;
+        tickUs = (uint32_t)(65536.0f * 1000000.0f / clock);
+    }
+    TimerConfig timer_config;
+    timer_config.mode = TimerMode::SingleCounter;
+    timer_config.pinConfig = PinConfig::Disabled;
+    timer_config.timerEnable = TimerEnable::Always;
+    timer_config.timerDisable = TimerDisable::Never;
+    timer_config.timerReset = TimerReset::Never;
+    timer_config.timerDecrement = TimerDecrement::FlexIOClock;
+    timer_config.timerOutput = TimerOutput::One;
+    _flexIO->configureTimer(timer, timer_config);
+    _flexIO->getFlexIO()->TIMCMP[timer] = clocks - 1;
+
+    _tick_timer = timer;
+    _tick_us = tickUs;
+    _now = 0;
+    _last_time = 0;
+    _encoder.reset();
+    _parser.reset();
+    _tick_stats.reset();
+    _flexIO->getFlexIOHandler()->addIOHandlerCallback(this);
+    // Nothing queued yet, the first send() starts the tick interrupt
+    _idle_us = micros();
+    _idle = true;
+    _serial.setReceiveHandler(&receiveByte, this);
+    return true;
+}
+
+void TeensyFlexMIDI::end(void) {
+    if (!_flexIO)
+        return;
+    _serial.setReceiveHandler(nullptr, nullptr);
+    _flexIO->disableTimerInterrupt(_tick_timer);
+    _flexIO->getFlexIOHandler()->removeIOHandlerCallback(this);
+    _flexIO->getFlexIO()->TIMCTL[_tick_timer] = 0;
+    _flexIO->releaseTimer(_tick_timer);
+    _tick_timer = -1;
+    _flexIO = nullptr;
+}
+
+//=============================================================================
+// Sending, from the main loop
+//=============================================================================
+bool TeensyFlexMIDI::send(uint8_t status, uint8_t data1, uint8_t data2, uint32_t time) {
+    if (!_flexIO || (status < 0x80) || (status == 0xF0) || (status == 0xF7))
+        return false;
+    TeensyFlexMIDIEvent event;
+    if (!TeensyFlexMIDICodec::queueTime(time, now(), _last_time, event.time))
+        return false;
+    event.length = TeensyFlexMIDICodec::dataBytes(status) + 1;
+    event.status = status;
+    event.data1 = data1;
+    event.data2 = data2;
+    if (!_tx_queue.push(event))
+        return false;
+    _last_time = event.time;
+    wake();
+    return true;
+}
+
+bool TeensyFlexMIDI::sendSysEx(const uint8_t *data, uint16_t length, uint32_t time) {
+    if (!_flexIO || _sysex_data || (length < 2) || (data[0] != 0xF0) || (data[length - 1] != 0xF7))
+        return false;
+    // The queue entry marks its place, the data goes by DMA when it is reached
+    TeensyFlexMIDIEvent event;
+    if (!TeensyFlexMIDICodec::queueTime(time, now(), _last_time, event.time))
+        return false;
+    event.length = length;
+    event.status = 0xF0;
+    event.data1 = event.data2 = 0;
+    _sysex_length = length;
+    _sysex_data = data;
+    if (!_tx_queue.push(event)) {
+        _sysex_data = nullptr;
+        return false;
+    }
+    _last_time = event.time;
+    wake();
+    return true;
+}
+
+void TeensyFlexMIDI::sysExDone(void *context, size_t count) {
+    TeensyFlexMIDI *midi = (TeensyFlexMIDI *)context;
+    midi->_bytes_sent = midi->_bytes_sent + count;
+    midi->_events_sent = midi->_events_sent + 1;
+    midi->_sysex_active = false;
+    midi->_sysex_data = nullptr;
+}
+
+void TeensyFlexMIDI::setRunningStatus(bool enable) {
+    __disable_irq();
+    _encoder.setRunningStatus(enable);
+    __enable_irq();
+}
+
+void TeensyFlexMIDI::resetTickStats(void) {
+    __disable_irq();
+    _tick_stats.reset();
+    __enable_irq();
+}
+
+//=============================================================================
+// Tick clock. While idle the tick interrupt is off and the clock goes on
+// from micros() in whole ticks.
+//=============================================================================
+uint32_t TeensyFlexMIDI::now(void) {
+    uint32_t primask;
+    asm volatile("mrs %0, primask" : "=r"(primask)::"memory");
+    __disable_irq();
+    uint32_t now = _now;
+    if (_idle && _tick_us)
+        now += ((micros() - _idle_us) / _tick_us) * _tick_us;
+    if (!primask)
+        __enable_irq();
+    return now;
+}
+
+// A new event is queued, start the tick if it was idle
+void TeensyFlexMIDI::wake(void) {
+    __disable_irq();
+    if (_idle) {
+        _now = now();
+        _idle = false;
+        _tick_stats.restart();
+        _flexIO->clearTimerStatus(_tick_timer);
+        _flexIO->enableTimerInterrupt(_tick_timer);
+    }
+    __enable_irq();
+}
+
+//=============================================================================
+// Tick
+//=============================================================================
+bool TeensyFlexMIDI::call_back(FlexIOHandler *pflex) {
+    if (!_flexIO || (pflex != _flexIO->getFlexIOHandler()) ||
+        !(_flexIO->timerStatus() & TIMER_MASK(_tick_timer)))
+        return false;
+    _flexIO->clearTimerStatus(_tick_timer);
+    _tick_stats.mark(ARM_DWT_CYCCNT);
+    _now = _now + _tick_us;
+    transmit();
+    if (!_sysex_active && !_tx_queue.peek()) {
+        // Nothing left to send, sleep until send() queues the next event
+        _flexIO->disableTimerInterrupt(_tick_timer);
+        _idle_us = micros();
+        _idle = true;
+    }
+    return false;
+}
+
+// Hand every due event to the serial, as long as its TX buffer takes them.
+// What does not fit waits for the next tick. The bytes go straight into the
+// buffer (reserveWrite), write() would wait for room.
+void TeensyFlexMIDI::transmit(void) {
+    if (_sysex_active)
+        return; // the DMA has the shifter
+    uint32_t now = _now;
+    int room = _serial.availableForWrite();
+    uint8_t batch[TX_BATCH_BYTES];
+    uint16_t used = 0;
+    const TeensyFlexMIDIEvent *event;
+    while ((event = _tx_queue.peek()) && ((int32_t)(event->time - now) <= 0)) {
+        if (event->status == 0xF0) {
+            // Needs the serial's buffer empty, so everything before it is out
+            if (used)
+                break;
+            _sysex_active = true;
+            if (!_serial.writeAsync(_sysex_data, _sysex_length, &sysExDone, this)) {
+                _sysex_active = false;
+                return;
+            }
+            _tx_queue.pop();
+            _encoder.reset();
+            return;
+        }
+        uint8_t bytes[TeensyFlexMIDIEncoder::MAX_BYTES];
+        TeensyFlexMIDIEncoder encoder = _encoder;
+        uint8_t length = encoder.encode(*event, bytes);
+        if ((int)(used + length) > room)
+            break;
+        if (used + length > TX_BATCH_BYTES) {
+            commitBatch(batch, used);
+            room -= used;
+            used = 0;
+        }
+        memcpy(batch + used, bytes, length);
+        used += length;
+        _encoder = encoder;
+        _bytes_sent = _bytes_sent + length;
+        _events_sent = _events_sent + 1;
+        _tx_queue.pop();
+    }
+    commitBatch(batch, used);
+}
+
+// room was checked, so this fits (in two pieces where the buffer wraps)
+void TeensyFlexMIDI::commitBatch(const uint8_t *bytes, uint16_t count) {
+    while (count) {
+        size_t space;
+        uint8_t *head = _serial.reserveWrite(space);
+        if (!head)
+            return;
+        if (space > count)
+            space = count;
+        memcpy(head, bytes, space);
+        _serial.commitWrite(space);
+        bytes += space;
+        count -= space;
+    }
+}
+
+// From the serial's RX interrupt
+void TeensyFlexMIDI::receiveByte(void *context, uint8_t c) {
+    TeensyFlexMIDI *midi = (TeensyFlexMIDI *)context;
+    TeensyFlexMIDIEvent event;
+    if (midi->_parser.feed(c, event)) {
+        event.time = midi->now();
+        if (!midi->_rx_queue.push(event))
+            midi->_rx_dropped = midi->_rx_dropped + 1;
+    }
+}
@@ -0,0 +1,126 @@
+#include "TeensyFlexSerial.h"
+#include "TeensyFlexMIDICodec.h"
+#include <Arduino.h>
+
+#ifndef _TEENSY_FLEX_MIDI_H_
+#define _TEENSY_FLEX_MIDI_H_
+
+// MIDI transport on a TeensyFlexSerial, driven by a tick timer on the same
+// FlexIO module:
+//  - send*() queue timestamped events (main loop). Each tick hands the ones
+//    that are due to the serial's buffer in one go, with running status, so
+//    dense controller streams take 2 bytes per event and events leave on the
+//    tick, not when loop() gets to them.
+//  - sendSysEx() streams a whole message by DMA (TeensyFlexSerial::writeAsync)
+//    in its turn in the queue. Events after it wait until the DMA is done.
+//  - Received bytes are parsed as they arrive (the serial's receive handler)
+//    into a lock-free event queue, read() takes them from the main loop.
+// Times are microseconds on the tick clock (now()), 0 means "as soon as
+// possible". The queue drains in order, so send() refuses an event timed
+// before one that still waits. The tick interrupt only runs while events
+// wait; in between now() follows micros().
+// Timing is software: an event starts on the wire after the first tick at or
+// past its time, so it is late by up to one tick plus the FlexIO interrupt
+// latency, plus waiting for the characters queued before it (tickStats()
+// shows the interrupt part). The tick does not start the serial's TX timer in
+// hardware; that timer's trigger is its shifter (and CTS/RS-485 use it too).
+// The serial is owned by this class: don't read or write it directly.
+class TeensyFlexMIDI : public FlexIOHandlerCallback {
+  public:
+    static const uint16_t TX_QUEUE_SIZE = 64;
+    static const uint16_t RX_QUEUE_SIZE = 64;
+
+    TeensyFlexMIDI(TeensyFlexSerial &serial) : _serial(serial) {}
+    ~TeensyFlexMIDI() { end(); }
+
+    // Starts the serial at 31250 baud and the tick (one character time by
+    // default). Needs a free timer on the TX (or RX only: the RX) module.
+    bool begin(uint32_t tickUs = 320, uint32_t baud = 31250);
+    void end(void);
+
+    uint32_t now(void);
+    uint32_t tickUs() { return _tick_us; }
+
+    bool send(uint8_t status, uint8_t data1 = 0, uint8_t data2 = 0, uint32_t time = 0);
+    bool sendNoteOn(uint8_t channel, uint8_t note, uint8_t velocity, uint32_t time = 0) {
+        return send(0x90 | ((channel - 1) & 0x0f), note, velocity, time);
+    }
+    bool sendNoteOff(uint8_t channel, uint8_t note, uint8_t velocity = 0, uint32_t time = 0) {
+        return send(0x80 | ((channel - 1) & 0x0f), note, velocity, time);
+    }
+    bool sendControlChange(uint8_t channel, uint8_t control, uint8_t value, uint32_t time = 0) {
+        return send(0xB0 | ((channel - 1) & 0x0f), control, value, time);
+    }
+    bool sendProgramChange(uint8_t channel, uint8_t program, uint32_t time = 0) {
+        return send(0xC0 | ((channel - 1) & 0x0f), program, 0, time);
+    }
+    bool sendPitchBend(uint8_t channel, int16_t value, uint32_t time = 0) {
+        uint16_t bend = (uint16_t)(value + 8192) & 0x3fff;
+        return send(0xE0 | ((channel - 1) & 0x0f), bend & 0x7f, bend >> 7, time);
+    }
+    bool sendRealTime(uint8_t status, uint32_t time = 0) { return (status >= 0xF8) && send(status, 0, 0, time); }
+
+    // A complete message, 0xF0 ... 0xF7. data must stay untouched until
+    // sysExBusy() is false. One at a time.
+    bool sendSysEx(const uint8_t *data, uint16_t length, uint32_t time = 0);
+    bool sysExBusy() { return _sysex_data != nullptr; }
+
+    // Free places in the send queue
+    uint16_t availableForSend() { return _tx_queue.space(); }
+    // Compare against plain status bytes (on by default)
+    void setRunningStatus(bool enable);
+
+    // Received events, with now() when they were parsed. A SysEx has
+    // status 0xF0 and its length in the buffer given here (nullptr: not kept),
+    // the next SysEx overwrites it. Call before begin().
+    void setSysExBuffer(uint8_t *buffer, uint16_t size) { _parser.setSysExBuffer(buffer, size); }
+    bool read(TeensyFlexMIDIEvent &event) { return _rx_queue.pop(event); }
+    uint16_t available() { return _rx_queue.count(); }
+    // Events lost because read() did not keep up
+    uint32_t rxDropped() { return _rx_dropped; }
+
+    // Statistics: the tick interrupt interval in CPU cycles, the jitter of
+    // when events are handed to the serial
+    const TeensyFlexServiceStats &tickStats() { return _tick_stats; }
+    void resetTickStats(void);
+
+    // Bytes written since begin, to compare the rate with and without running status
+    uint32_t bytesSent() { return _bytes_sent; }
+    uint32_t eventsSent() { return _events_sent; }
+
+    // Call back from flexIO when ISR hapens
+    virtual bool call_back(FlexIOHandler *pflex);
+
+  private:
+    TeensyFlexSerial &_serial;
+    TeensyFlexIO *_flexIO = nullptr;
+    int8_t _tick_timer = -1;
+    uint32_t _tick_us = 0;
+    volatile uint32_t _now = 0;
+    volatile bool _idle = false;   // tick interrupt off, nothing to send
+    uint32_t _idle_us = 0;         // micros() at the last tick before idling
+    uint32_t _last_time = 0;       // time of the newest queued event
+
+    TeensyFlexMIDIEncoder _encoder;
+    TeensyFlexMIDIParser _parser;
+    TeensyFlexMIDIQueue<TX_QUEUE_SIZE> _tx_queue;
+    TeensyFlexMIDIQueue<RX_QUEUE_SIZE> _rx_queue;
+    volatile uint32_t _rx_dropped = 0;
+
+    // SysEx in the queue or on the wire
+    const uint8_t *volatile _sysex_data = nullptr;
+    uint16_t _sysex_length = 0;
+    volatile bool _sysex_active = false;
+    static void sysExDone(void *context, size_t count);
+
+    TeensyFlexServiceStats _tick_stats;
+    volatile uint32_t _bytes_sent = 0;
+    volatile uint32_t _events_sent = 0;
+
+    enum { TX_BATCH_BYTES = 32 };
+    void transmit(void);
+    void commitBatch(const uint8_t *bytes, uint16_t count);
+    void wake(void);
+    static void receiveByte(void *context, uint8_t c);
+};
+#endif //_TEENSY_FLEX_MIDI_H_
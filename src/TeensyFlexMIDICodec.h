@@ -0,0 +1,241 @@
+#ifndef _TEENSY_FLEX_MIDI_CODEC_H_
+#define _TEENSY_FLEX_MIDI_CODEC_H_
+
+// MIDI 1.0 byte stream encoding and parsing for TeensyFlexMIDI.
+//
+// The encoder leaves out the status byte of a channel message when it is the
+// same as the previous one (running status), so a stream of control changes
+// on one channel costs 2 bytes per event instead of 3. System common messages
+// and SysEx cancel running status, real time messages (0xF8-0xFF) don't.
+// The parser accepts running status, real time bytes anywhere (also inside a
+// message or a SysEx) and collects SysEx into a caller's buffer.
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+struct TeensyFlexMIDIEvent {
+    uint32_t time;   // microseconds on the TeensyFlexMIDI tick clock
+    uint16_t length; // SysEx: bytes in the buffer, including 0xF0 and 0xF7
+    uint8_t status;  // 0x80-0xFF, 0xF0 for a SysEx
+    uint8_t data1;
+    uint8_t data2;
+};
+
+class TeensyFlexMIDICodec {
+  public:
+    // Data bytes that follow a status byte
+    static uint8_t dataBytes(uint8_t status) {
+        if (status < 0x80)
+            return 0;
+        if (status < 0xF0)
+            return ((status & 0xE0) == 0xC0) ? 1 : 2; // program change, channel pressure
+        if ((status == 0xF1) || (status == 0xF3))
+            return 1;
+        return (status == 0xF2) ? 2 : 0;
+    }
+
+    // Send time of a new queue entry. The send queue drains in order, so an
+    // event timed before one that still waits would be held back by it: false.
+    // requested 0 is as soon as possible, right behind whatever still waits.
+    static bool queueTime(uint32_t requested, uint32_t now, uint32_t last, uint32_t &time) {
+        bool waiting = (int32_t)(last - now) > 0;
+        if (!requested) {
+            time = waiting ? last : now;
+            return true;
+        }
+        if (waiting && ((int32_t)(requested - last) < 0))
+            return false;
+        time = requested;
+        return true;
+    }
+};
+
+class TeensyFlexMIDIEncoder {
+  public:
+    static const uint8_t MAX_BYTES = 3;
+
+    // Next message always starts with its status
+    void reset() { _running = 0; }
+    void setRunningStatus(bool enable) {
+        _enabled = enable;
+        _running = 0;
+    }
+    bool runningStatus() const { return _enabled; }
+
+    // Bytes for event in out (up to MAX_BYTES), 0 for a status this can't send
+    // (SysEx goes by TeensyFlexMIDI::sendSysEx)
+    uint8_t encode(const TeensyFlexMIDIEvent &event, uint8_t *out) {
+        uint8_t status = event.status;
+        if ((status < 0x80) || (status == 0xF0) || (status == 0xF7))
+            return 0;
+        if (status >= 0xF8) {
+            out[0] = status;
+            return 1;
+        }
+        uint8_t length = 0;
+        if ((status >= 0xF0) || !_enabled || (status != _running))
+            out[length++] = status;
+        _running = (status < 0xF0) ? status : 0;
+        uint8_t data = TeensyFlexMIDICodec::dataBytes(status);
+        if (data > 0)
+            out[length++] = event.data1 & 0x7f;
+        if (data > 1)
+            out[length++] = event.data2 & 0x7f;
+        return length;
+    }
+
+  private:
+    uint8_t _running = 0;
+    bool _enabled = true;
+};
+
+class TeensyFlexMIDIParser {
+  public:
+    // Where incoming SysEx goes, nullptr to skip them. A SysEx longer than the
+    // buffer is cut, its event has length == size and no 0xF7 at the end.
+    void setSysExBuffer(uint8_t *buffer, uint16_t size) {
+        _sysex = buffer;
+        _sysex_size = size;
+        _in_sysex = false;
+    }
+
+    void reset() {
+        _running = 0;
+        _expected = 0;
+        _count = 0;
+        _in_sysex = false;
+    }
+
+    // One byte from the line, true when it completed event (time is not set)
+    bool feed(uint8_t c, TeensyFlexMIDIEvent &event) {
+        if (c >= 0xF8) {
+            // Real time, does not disturb anything in progress
+            event.status = c;
+            event.data1 = event.data2 = 0;
+            event.length = 1;
+            return true;
+        }
+        if (c == 0xF0) {
+            _running = 0;
+            _in_sysex = _sysex != nullptr;
+            _sysex_length = 0;
+            store(c);
+            return false;
+        }
+        if (c == 0xF7) {
+            if (!_in_sysex)
+                return false;
+            _in_sysex = false;
+            store(c);
+            event.status = 0xF0;
+            event.data1 = event.data2 = 0;
+            event.length = _sysex_length;
+            return true;
+        }
+        if (c & 0x80) {
+            // Any other status ends an unterminated SysEx, it is dropped
+            _in_sysex = false;
+            _running = c;
+            _expected = TeensyFlexMIDICodec::dataBytes(c);
+            _count = 0;
+            if (c >= 0xF0) {
+                // System common: no running status
+                if (_expected == 0) {
+                    _running = 0;
+                    return complete(c, event);
+                }
+            }
+            return false;
+        }
+        if (_in_sysex) {
+            store(c);
+            return false;
+        }
+        if (!_running)
+            return false; // data without a status, skip
+        _data[_count++] = c;
+        if (_count < _expected)
+            return false;
+        _count = 0;
+        uint8_t status = _running;
+        if (status >= 0xF0)
+            _running = 0;
+        return complete(status, event);
+    }
+
+  private:
+    bool complete(uint8_t status, TeensyFlexMIDIEvent &event) {
+        event.status = status;
+        event.data1 = _data[0];
+        event.data2 = (_expected > 1) ? _data[1] : 0;
+        event.length = _expected + 1;
+        return true;
+    }
+
+    void store(uint8_t c) {
+        if (_sysex_length < _sysex_size)
+            _sysex[_sysex_length++] = c;
+    }
+
+    uint8_t _running = 0;
+    uint8_t _expected = 0;
+    uint8_t _count = 0;
+    uint8_t _data[2] = {0, 0};
+    uint8_t *_sysex = nullptr;
+    uint16_t _sysex_size = 0;
+    uint16_t _sysex_length = 0;
+    bool _in_sysex = false;
+};
+
+// Single producer, single consumer event FIFO, one side in an ISR and the
+// other in the main loop, without locking. SIZE is a power of two, it holds
+// SIZE - 1 events.
+template <uint16_t SIZE>
+class TeensyFlexMIDIQueue {
+  public:
+    static_assert((SIZE & (SIZE - 1)) == 0, "SIZE must be a power of two");
+
+    bool push(const TeensyFlexMIDIEvent &event) {
+        uint16_t head = _head.load(std::memory_order_relaxed);
+        uint16_t next = (head + 1) & (SIZE - 1);
+        if (next == _tail.load(std::memory_order_acquire))
+            return false;
+        _events[head] = event;
+        _head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // The oldest event, nullptr when empty. Stays valid until pop().
+    const TeensyFlexMIDIEvent *peek() const {
+        uint16_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire))
+            return nullptr;
+        return &_events[tail];
+    }
+
+    void pop() {
+        uint16_t tail = _tail.load(std::memory_order_relaxed);
+        _tail.store((tail + 1) & (SIZE - 1), std::memory_order_release);
+    }
+
+    bool pop(TeensyFlexMIDIEvent &event) {
+        const TeensyFlexMIDIEvent *oldest = peek();
+        if (!oldest)
+            return false;
+        event = *oldest;
+        pop();
+        return true;
+    }
+
+    uint16_t count() const {
+        return (_head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire)) & (SIZE - 1);
+    }
+    uint16_t space() const { return SIZE - 1 - count(); }
+
+  private:
+    TeensyFlexMIDIEvent _events[SIZE];
+    std::atomic<uint16_t> _head{0};
+    std::atomic<uint16_t> _tail{0};
+};
+
+#endif // _TEENSY_FLEX_MIDI_CODEC_H_
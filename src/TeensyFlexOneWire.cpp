@@ -0,0 +1,435 @@
+#include "TeensyFlexOneWire.h"
+
+//=============================================================================
+// TeensyFlexOneWire::begin
+//=============================================================================
+bool TeensyFlexOneWire::begin(int flexio_module) {
+    _flexIO = new TeensyFlexIO();
+    _flexIO->begin(static_cast<TeensyFlexIO::FlexIOModule>(flexio_module));
+    _module = flexio_module;
+
+    _timer = _flexIO->requestTimers(1);
+    _tx_shifter = _flexIO->requestShifter();
+    _rx_shifter = _flexIO->requestShifter();
+
+    if ((_timer == 0xff) || (_tx_shifter == 0xff) || (_rx_shifter == 0xff)) {
+        #ifdef DEBUG_FlexOneWire
+            DEBUG_FlexOneWire.println("TeensyFlexOneWire - Failed to allocate timer or shifters");
+        #endif
+        end();
+        return false;
+    }
+
+    // 2us ticks: clock / (2 * (div + 1)) == 500kHz
+    uint32_t div = _flexIO->getFlexIOHandler()->computeClockRate() / 1000000;
+    if (div < 1)
+        div = 1;
+    else if (div > 256)
+        div = 256;
+
+    // TX: a 0 in the pattern pulls the line low, a 1 releases it
+    ShifterConfig shifter_config;
+    shifter_config.mode = ShifterMode::Transmit;
+    shifter_config.pinSelect = _pin;
+    shifter_config.pinConfig = PinConfig::OpenDrain;
+    shifter_config.pinPolarity = PinPolarity::ActiveLow;
+    shifter_config.timerSelect = _timer;
+    shifter_config.timerPolarity = TimerPolarity::ActiveHigh;
+    _flexIO->configureShifter(_tx_shifter, shifter_config);
+    // Keep the shifter off between operations so it never holds the bus low
+    _tx_shiftctl = _flexIO->getFlexIO()->SHIFTCTL[_tx_shifter];
+    _flexIO->getFlexIO()->SHIFTCTL[_tx_shifter] = _tx_shiftctl & ~FLEXIO_SHIFTCTL_SMOD(7);
+
+    // RX: sample in the middle of each tick
+    shifter_config.mode = ShifterMode::Receive;
+    shifter_config.pinConfig = PinConfig::Disabled;
+    shifter_config.pinPolarity = PinPolarity::ActiveHigh;
+    shifter_config.timerPolarity = TimerPolarity::ActiveLow;
+    _flexIO->configureShifter(_rx_shifter, shifter_config);
+
+    // One 32 tick slot per word, runs while the DMA keeps the TX shifter fed
+    TimerConfig timer_config;
+    timer_config.mode = TimerMode::Baud;
+    timer_config.pinConfig = PinConfig::Disabled;
+    timer_config.triggerSelect = _flexIO->calculateTriggerSelect(TriggerType::SHIFTER, _tx_shifter);
+    timer_config.triggerPolarity = TriggerPolarity::ActiveLow;
+    timer_config.triggerSource = TriggerSource::Internal;
+    timer_config.timerEnable = TimerEnable::TriggerHigh;
+    timer_config.timerDisable = TimerDisable::OnCompare;
+    timer_config.timerDecrement = TimerDecrement::FlexIOClock;
+    timer_config.timerOutput = TimerOutput::One;
+    timer_config.asDual().bits_in_word = 32 * 2 - 1;
+    timer_config.asDual().baud_rate_div = div - 1;
+    _flexIO->configureTimer(_timer, timer_config);
+
+    _flexIO->setPinFlexioMode(_pin);
+    // Most buses have an external 4.7k pull-up, this only helps short ones
+    _flexIO->setPinParameters(_pin, PullUp::PULLUP_22K, 7, 0);
+
+    _flexIO->enable();
+    if (!initDMAChannels()) {
+        end();
+        return false;
+    }
+    return true;
+}
+
+void TeensyFlexOneWire::end(void) {
+    if (!_flexIO)
+        return;
+    if (!_flexIO->getFlexIOHandler()) {
+        delete _flexIO;
+        _flexIO = nullptr;
+        return;
+    }
+    if (_dmaTX) {
+        _dmaTX->disable();
+        delete _dmaTX;
+        _dmaTX = nullptr;
+    }
+    if (_dmaRX) {
+        _dmaRX->disable();
+        TeensyFlexDMADispatch::detach(_dmaRX->channel);
+        delete _dmaRX;
+        _dmaRX = nullptr;
+    }
+    if (_tx_shifter != 0xff) {
+        _flexIO->disableDMARequests(SHIFTER_MASK(_tx_shifter));
+        _flexIO->getFlexIO()->SHIFTCTL[_tx_shifter] = 0;
+    }
+    if (_rx_shifter != 0xff)
+        _flexIO->disableDMARequests(SHIFTER_MASK(_rx_shifter));
+    _flexIO->getFlexIOHandler()->freeTimers(_timer);
+    _timer = 0xff;
+    _flexIO->getFlexIOHandler()->freeShifter(_tx_shifter);
+    _tx_shifter = 0xff;
+    _flexIO->getFlexIOHandler()->freeShifter(_rx_shifter);
+    _rx_shifter = 0xff;
+    _running = false;
+    _queue_head = 0;
+    _queue_tail = 0;
+    delete _flexIO;
+    _flexIO = nullptr;
+}
+
+//=========================================================================
+// Init the DMA channels
+//=========================================================================
+bool TeensyFlexOneWire::initDMAChannels() {
+    _dmaTX = new DMAChannel();
+    _dmaRX = new DMAChannel();
+    if ((_dmaTX == nullptr) || (_dmaRX == nullptr)) {
+        #ifdef DEBUG_FlexOneWire
+            DEBUG_FlexOneWire.println("Failed to allocate DMA channels");
+        #endif
+        return false;
+    }
+
+    _dmaTX->disable();
+    _dmaTX->destination(_flexIO->getFlexIO()->SHIFTBUF[_tx_shifter]);
+    _dmaTX->disableOnCompletion();
+    _dmaTX->triggerAtHardwareEvent(_flexIO->getFlexIOHandler()->shiftersDMAChannel(_tx_shifter));
+
+    _dmaRX->disable();
+    _dmaRX->source(_flexIO->getFlexIO()->SHIFTBUF[_rx_shifter]);
+    _dmaRX->disableOnCompletion();
+    _dmaRX->interruptAtCompletion();
+    _dmaRX->triggerAtHardwareEvent(_flexIO->getFlexIOHandler()->shiftersDMAChannel(_rx_shifter));
+    _dmaRX->attachInterrupt(TeensyFlexDMADispatch::attach(
+        _dmaRX->channel, &TeensyFlexDMADispatch::member<TeensyFlexOneWire, &TeensyFlexOneWire::dma_rxisr>, this));
+    return true;
+}
+
+//=========================================================================
+// Operation queue
+//=========================================================================
+bool TeensyFlexOneWire::enqueue(OpType type, const uint8_t *data, uint8_t count, uint8_t *rx,
+                                EventResponder *event_responder) {
+    if (!_dmaRX)
+        return false;
+    __disable_irq();
+    uint8_t next = (_queue_head + 1) % QUEUE_SIZE;
+    if (next == _queue_tail) {
+        __enable_irq();
+        return false;
+    }
+    Op &op = _queue[_queue_head];
+    op.type = type;
+    op.count = count;
+    if (data)
+        memcpy(op.data, data, count);
+    op.rx = rx;
+    op.event_responder = event_responder;
+    _queue_head = next;
+    bool start = !_running;
+    _running = true;
+    __enable_irq();
+
+    if (start)
+        startNext();
+    return true;
+}
+
+uint8_t TeensyFlexOneWire::pending(void) {
+    return (_queue_head + QUEUE_SIZE - _queue_tail) % QUEUE_SIZE;
+}
+
+bool TeensyFlexOneWire::reset(EventResponder *event_responder) {
+    return enqueue(OP_RESET, nullptr, 0, nullptr, event_responder);
+}
+
+bool TeensyFlexOneWire::write(const uint8_t *data, size_t count, EventResponder *event_responder) {
+    // Long writes become several operations, the event goes with the last one
+    if ((size_t)(QUEUE_SIZE - 1 - pending()) < (count + MAX_OP_BYTES - 1) / MAX_OP_BYTES)
+        return false;
+    while (count) {
+        uint8_t chunk = (count > MAX_OP_BYTES) ? MAX_OP_BYTES : count;
+        count -= chunk;
+        if (!enqueue(OP_WRITE, data, chunk, nullptr, count ? nullptr : event_responder))
+            return false;
+        data += chunk;
+    }
+    return true;
+}
+
+bool TeensyFlexOneWire::read(uint8_t *buffer, size_t count, EventResponder *event_responder) {
+    if ((size_t)(QUEUE_SIZE - 1 - pending()) < (count + MAX_OP_BYTES - 1) / MAX_OP_BYTES)
+        return false;
+    while (count) {
+        uint8_t chunk = (count > MAX_OP_BYTES) ? MAX_OP_BYTES : count;
+        count -= chunk;
+        if (!enqueue(OP_READ, nullptr, chunk, buffer, count ? nullptr : event_responder))
+            return false;
+        buffer += chunk;
+    }
+    return true;
+}
+
+bool TeensyFlexOneWire::select(const uint8_t rom[8]) {
+    uint8_t command[9];
+    command[0] = MATCH_ROM;
+    memcpy(&command[1], rom, 8);
+    if (QUEUE_SIZE - 1 - pending() < 2)
+        return false;
+    return reset() && write(command, sizeof(command));
+}
+
+bool TeensyFlexOneWire::skip(void) {
+    if (QUEUE_SIZE - 1 - pending() < 2)
+        return false;
+    return reset() && write(SKIP_ROM);
+}
+
+bool TeensyFlexOneWire::search(uint8_t (*roms)[8], uint8_t maxDevices, EventResponderRef event_responder) {
+    // Only one search at a time, its state lives in the object
+    if (_roms || !roms || !maxDevices)
+        return false;
+    _roms = roms;
+    _rom_max = maxDevices;
+    if (enqueue(OP_SEARCH, nullptr, 0, nullptr, &event_responder))
+        return true;
+    _roms = nullptr;
+    return false;
+}
+
+//-------------------------------------------------------------------------
+// Slot patterns
+//-------------------------------------------------------------------------
+void TeensyFlexOneWire::addReset(void) {
+    for (uint8_t i = 0; i < RESET_WORDS / 2; i++)
+        _tx_words[_slots++] = 0;
+    for (uint8_t i = 0; i < RESET_WORDS / 2; i++)
+        _tx_words[_slots++] = 0xFFFFFFFF;
+}
+
+void TeensyFlexOneWire::addByte(uint8_t value) {
+    for (uint8_t i = 0; i < 8; i++)
+        addSlot((value >> i) & 1);
+}
+
+bool TeensyFlexOneWire::resetPresence(uint16_t slot) {
+    // Devices wait 15-60us after the release and then pull low for 60-240us.
+    // Skip the first 16us of the release while the line rises.
+    uint16_t release = slot + RESET_WORDS / 2;
+    return ((_rx_words[release] | 0xFF) != 0xFFFFFFFF) || (_rx_words[release + 1] != 0xFFFFFFFF) ||
+           (_rx_words[release + 2] != 0xFFFFFFFF);
+}
+
+void TeensyFlexOneWire::runBatch(void) {
+    IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+
+    if ((uint32_t)_tx_words >= 0x20200000u)
+        arm_dcache_flush(_tx_words, _slots * 4);
+    if ((uint32_t)_rx_words >= 0x20200000u)
+        arm_dcache_delete(_rx_words, _slots * 4);
+
+    (void)p->SHIFTBUF[_rx_shifter];
+    p->SHIFTERR = SHIFTER_MASK(_rx_shifter);
+    _dmaRX->destinationBuffer(_rx_words, _slots * 4);
+    _dmaTX->sourceBuffer(_tx_words, _slots * 4);
+    _dmaRX->enable();
+    _dmaTX->enable();
+    // Every slot starts low, so enabling the shifter just ahead of its data is harmless
+    p->SHIFTCTL[_tx_shifter] = _tx_shiftctl;
+    _flexIO->enableDMARequests(SHIFTER_MASK(_tx_shifter) | SHIFTER_MASK(_rx_shifter));
+}
+
+void TeensyFlexOneWire::startNext(void) {
+    if (_queue_tail == _queue_head) {
+        _running = false;
+        return;
+    }
+    Op &op = _queue[_queue_tail];
+    _slots = 0;
+    switch (op.type) {
+    case OP_RESET:
+        addReset();
+        break;
+    case OP_WRITE:
+        for (uint8_t i = 0; i < op.count; i++)
+            addByte(op.data[i]);
+        break;
+    case OP_READ:
+        for (uint16_t i = 0; i < op.count * 8; i++)
+            addSlot(true);
+        break;
+    case OP_SEARCH:
+        _rom_count = 0;
+        _last_discrepancy = 0;
+        startSearchPass();
+        return;
+    }
+    runBatch();
+}
+
+void TeensyFlexOneWire::completeOp(int status) {
+    Op &op = _queue[_queue_tail];
+    EventResponder *event_responder = op.event_responder;
+    _queue_tail = (_queue_tail + 1) % QUEUE_SIZE;
+    if (event_responder)
+        event_responder->triggerEvent(status, this);
+    startNext();
+}
+
+//-------------------------------------------------------------------------
+// ROM search - each batch writes the chosen direction and reads the next pair
+//-------------------------------------------------------------------------
+void TeensyFlexOneWire::startSearchPass(void) {
+    _slots = 0;
+    addReset();
+    addByte(SEARCH_ROM);
+    addSlot(true);
+    addSlot(true);
+    _bit_number = 1;
+    _last_zero = 0;
+    _batch_reset = true;
+    runBatch();
+}
+
+// Returns true while the search continues with another batch
+bool TeensyFlexOneWire::searchStep(void) {
+    if (_batch_reset && !resetPresence(0))
+        return false;
+
+    if (_bit_number > 64) {
+        // Direction of bit 64 written, that device is complete
+        if (crc8(_rom, 7) == _rom[7])
+            memcpy(_roms[_rom_count++], _rom, 8);
+        _last_discrepancy = _last_zero;
+        if (!_last_discrepancy || (_rom_count >= _rom_max))
+            return false;
+        startSearchPass();
+        return true;
+    }
+
+    bool id_bit = slotBit(_slots - 2);
+    bool cmp_bit = slotBit(_slots - 1);
+    if (id_bit && cmp_bit)
+        return false; // nobody left on the bus
+
+    uint8_t byte_index = (_bit_number - 1) / 8;
+    uint8_t byte_mask = 1 << ((_bit_number - 1) % 8);
+    bool direction;
+    if (id_bit != cmp_bit) {
+        direction = id_bit;
+    } else {
+        if (_bit_number < _last_discrepancy)
+            direction = _rom[byte_index] & byte_mask;
+        else
+            direction = (_bit_number == _last_discrepancy);
+        if (!direction)
+            _last_zero = _bit_number;
+    }
+    if (direction)
+        _rom[byte_index] |= byte_mask;
+    else
+        _rom[byte_index] &= ~byte_mask;
+
+    _slots = 0;
+    _batch_reset = false;
+    addSlot(direction);
+    if (_bit_number < 64) {
+        addSlot(true);
+        addSlot(true);
+    }
+    _bit_number++;
+    runBatch();
+    return true;
+}
+
+uint8_t TeensyFlexOneWire::crc8(const uint8_t *data, size_t count) {
+    uint8_t crc = 0;
+    while (count--) {
+        uint8_t in = *data++;
+        for (uint8_t i = 0; i < 8; i++) {
+            uint8_t mix = (crc ^ in) & 0x01;
+            crc >>= 1;
+            if (mix)
+                crc ^= 0x8C;
+            in >>= 1;
+        }
+    }
+    return crc;
+}
+
+//-------------------------------------------------------------------------
+// DMA RX ISR - the last slot of the batch has been sampled
+//-------------------------------------------------------------------------
+void TeensyFlexOneWire::dma_rxisr(void) {
+    _dmaRX->clearInterrupt();
+    _dmaRX->clearComplete();
+
+    IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+    _flexIO->disableDMARequests(SHIFTER_MASK(_tx_shifter) | SHIFTER_MASK(_rx_shifter));
+    p->SHIFTCTL[_tx_shifter] = _tx_shiftctl & ~FLEXIO_SHIFTCTL_SMOD(7);
+    _dmaTX->disable();
+
+    if ((uint32_t)_rx_words >= 0x20200000u)
+        arm_dcache_delete(_rx_words, _slots * 4);
+
+    Op &op = _queue[_queue_tail];
+    switch (op.type) {
+    case OP_RESET:
+        _presence = resetPresence(0);
+        completeOp(_presence ? 1 : 0);
+        break;
+    case OP_WRITE:
+        completeOp(0);
+        break;
+    case OP_READ:
+        for (uint8_t i = 0; i < op.count; i++) {
+            uint8_t value = 0;
+            for (uint8_t b = 0; b < 8; b++)
+                value |= slotBit(i * 8 + b) << b;
+            op.rx[i] = value;
+        }
+        completeOp(op.count);
+        break;
+    case OP_SEARCH:
+        if (!searchStep()) {
+            _roms = nullptr;
+            completeOp(_rom_count);
+        }
+        break;
+    }
+}
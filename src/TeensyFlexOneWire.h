@@ -0,0 +1,126 @@
+#include "TeensyFlexDMADispatch.h"
+#include "TeensyFlexIO.h"
+#include <Arduino.h>
+#include <DMAChannel.h>
+#include <EventResponder.h>
+
+#ifndef _TEENSY_FLEX_ONE_WIRE_H_
+#define _TEENSY_FLEX_ONE_WIRE_H_
+
+// Dallas/Maxim 1-Wire master where the slots are generated by FlexIO.
+//
+// A Baud timer ticks every 2us and an open drain Transmit shifter drives one
+// 32 tick word per time slot, so the slot shape is just a bit pattern:
+//   write 1 / read : low for 6us, released for the rest of the 64us slot
+//   write 0        : low for 60us, released for 4us
+//   reset          : 8 words low (512us), 8 words released, presence sampled
+// A Receive shifter on the same pin samples every tick, the bit read is the sample
+// 13us into the slot. Whole operations (reset, bytes, a ROM search step) are one
+// DMA transfer in each direction, and operations are queued so the CPU only sees
+// one interrupt per operation.
+class TeensyFlexOneWire {
+  public:
+    enum { MAX_OP_BYTES = 16,
+           QUEUE_SIZE = 16 };
+
+    // ROM commands
+    enum { SEARCH_ROM = 0xF0,
+           READ_ROM = 0x33,
+           MATCH_ROM = 0x55,
+           SKIP_ROM = 0xCC };
+
+    TeensyFlexOneWire(int pin) : _pin(pin){};
+    ~TeensyFlexOneWire() { end(); }
+
+    bool begin(int flexio_module);
+    void end(void);
+
+    // All of these are queued and return false if the queue is full.
+    // An event, when given, is triggered as the operation completes.
+    // reset: event status is 1 when a presence pulse was seen.
+    bool reset(EventResponder *event_responder = nullptr);
+    bool write(const uint8_t *data, size_t count, EventResponder *event_responder = nullptr);
+    bool write(uint8_t value, EventResponder *event_responder = nullptr) { return write(&value, 1, event_responder); }
+    // buffer must stay valid until the operation completes
+    bool read(uint8_t *buffer, size_t count, EventResponder *event_responder = nullptr);
+    // reset + MATCH ROM / SKIP ROM
+    bool select(const uint8_t rom[8]);
+    bool skip(void);
+
+    // Find up to maxDevices ROM codes. The event status is the number found.
+    bool search(uint8_t (*roms)[8], uint8_t maxDevices, EventResponderRef event_responder);
+
+    bool busy() { return _running; }
+    uint8_t pending(void);
+    bool presence() { return _presence; }
+    uint8_t devicesFound() { return _rom_count; }
+
+    static uint8_t crc8(const uint8_t *data, size_t count);
+
+  private:
+    int _pin;
+
+    TeensyFlexIO *_flexIO = nullptr;
+    uint8_t _module = 0xff;
+    uint8_t _timer = 0xff;
+    uint8_t _tx_shifter = 0xff;
+    uint8_t _rx_shifter = 0xff;
+    uint32_t _tx_shiftctl = 0;
+
+    enum OpType : uint8_t { OP_RESET,
+                            OP_WRITE,
+                            OP_READ,
+                            OP_SEARCH };
+    struct Op {
+        OpType type;
+        uint8_t count;
+        uint8_t data[MAX_OP_BYTES];
+        uint8_t *rx;
+        EventResponder *event_responder;
+    };
+    Op _queue[QUEUE_SIZE];
+    volatile uint8_t _queue_head = 0;
+    volatile uint8_t _queue_tail = 0;
+    volatile bool _running = false;
+    volatile bool _presence = false;
+
+    // One word per slot
+    enum { RESET_WORDS = 16,
+           MAX_SLOTS = RESET_WORDS + MAX_OP_BYTES * 8 };
+    uint32_t _tx_words[MAX_SLOTS] __attribute__((aligned(32)));
+    uint32_t _rx_words[MAX_SLOTS] __attribute__((aligned(32)));
+    uint16_t _slots = 0;
+    bool _batch_reset = false;
+
+    // ROM search (Maxim AN187) state
+    uint8_t (*_roms)[8] = nullptr;
+    uint8_t _rom_max = 0;
+    uint8_t _rom_count = 0;
+    uint8_t _rom[8];
+    uint8_t _bit_number = 0;
+    uint8_t _last_discrepancy = 0;
+    uint8_t _last_zero = 0;
+
+    DMAChannel *_dmaTX = nullptr;
+    DMAChannel *_dmaRX = nullptr;
+
+    bool initDMAChannels();
+    bool enqueue(OpType type, const uint8_t *data, uint8_t count, uint8_t *rx, EventResponder *event_responder);
+    void startNext(void);
+    void addReset(void);
+    void addByte(uint8_t value);
+    void addSlot(bool one) { _tx_words[_slots++] = one ? SLOT_ONE : SLOT_ZERO; }
+    bool slotBit(uint16_t slot) { return (_rx_words[slot] >> SAMPLE_TICK) & 1; }
+    bool resetPresence(uint16_t slot);
+    void runBatch(void);
+    void startSearchPass(void);
+    bool searchStep(void);
+    void completeOp(int status);
+    void dma_rxisr(void);
+
+    // Line levels, tick 0 first, 1 = released
+    static const uint32_t SLOT_ONE = 0xFFFFFFF8;
+    static const uint32_t SLOT_ZERO = 0xC0000000;
+    static const uint8_t SAMPLE_TICK = 6;
+};
+#endif //_TEENSY_FLEX_ONE_WIRE_H_
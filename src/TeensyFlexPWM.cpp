@@ -0,0 +1,325 @@
+#include "TeensyFlexPWM.h"
+
+//=============================================================================
+// TeensyFlexPWM::begin
+//=============================================================================
+bool TeensyFlexPWM::begin(int flexio_module, float frequency) {
+    if (frequency <= 0.0f)
+        return false;
+
+    _flexIO = new TeensyFlexIO();
+    _flexIO->begin(static_cast<TeensyFlexIO::FlexIOModule>(flexio_module));
+    _module = flexio_module;
+
+    _period_timer = _flexIO->requestTimers(1);
+    if (_period_timer == 0xff) {
+        #ifdef DEBUG_FlexPWM
+            DEBUG_FlexPWM.println("TeensyFlexPWM - Failed to allocate the period timer");
+        #endif
+        return false;
+    }
+
+    // 16 bit counters and no timer prescaler. The module clock is shared, so a
+    // period that does not fit is an error rather than a reason to reclock.
+    _clock_rate = _flexIO->getFlexIOHandler()->computeClockRate();
+    if (frequency < minFrequency()) {
+        #ifdef DEBUG_FlexPWM
+            DEBUG_FlexPWM.printf("TeensyFlexPWM - %f Hz is below %f Hz at this FlexIO clock\n", frequency, minFrequency());
+        #endif
+        end();
+        return false;
+    }
+
+    // Output toggles once per period, every edge starts the channels
+    TimerConfig timer_config;
+    timer_config.mode = TimerMode::SingleCounter;
+    timer_config.pinConfig = PinConfig::Disabled;
+    timer_config.timerEnable = TimerEnable::Always;
+    timer_config.timerDisable = TimerDisable::Never;
+    timer_config.timerReset = TimerReset::Never;
+    timer_config.timerDecrement = TimerDecrement::FlexIOClock;
+    timer_config.timerOutput = TimerOutput::One;
+    _flexIO->configureTimer(_period_timer, timer_config);
+    setFrequency(frequency);
+    // Nothing to stage yet, the period is written directly
+    _flexIO->disableTimerInterrupt(_period_timer);
+    _pending = false;
+    _flexIO->getFlexIO()->TIMCMP[_period_timer] = _period - 1;
+
+    _flexIO->enable();
+    _flexIO->getFlexIOHandler()->addIOHandlerCallback(this);
+    return true;
+}
+
+void TeensyFlexPWM::end(void) {
+    if (!_flexIO)
+        return;
+    if (!_flexIO->getFlexIOHandler()) {
+        delete _flexIO;
+        _flexIO = nullptr;
+        return;
+    }
+    stopSequence();
+    _flexIO->getFlexIOHandler()->removeIOHandlerCallback(this);
+    IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+    for (uint8_t i = 0; i < _channel_count; i++) {
+        _flexIO->disableTimerInterrupt(_channels[i].timer);
+        p->TIMCTL[_channels[i].timer] = 0;
+        _flexIO->getFlexIOHandler()->freeTimers(_channels[i].timer);
+    }
+    _channel_count = 0;
+    if (_period_timer != 0xff) {
+        _flexIO->disableTimerInterrupt(_period_timer);
+        p->TIMCTL[_period_timer] = 0;
+        _flexIO->getFlexIOHandler()->freeTimers(_period_timer);
+        _period_timer = 0xff;
+    }
+    if (_seq_shifter != 0xff) {
+        p->SHIFTCTL[_seq_shifter] = 0;
+        _flexIO->getFlexIOHandler()->freeShifter(_seq_shifter);
+        _seq_shifter = 0xff;
+    }
+    if (_dmaSeq) {
+        delete _dmaSeq;
+        _dmaSeq = nullptr;
+    }
+    if (_dmaFill) {
+        delete _dmaFill;
+        _dmaFill = nullptr;
+    }
+    delete _flexIO;
+    _flexIO = nullptr;
+}
+
+//=========================================================================
+// Channels
+//=========================================================================
+int TeensyFlexPWM::addChannel(int pin, bool inverted) {
+    if (!_flexIO || (_period_timer == 0xff) || (_channel_count >= MAX_CHANNELS) ||
+        (_flexIO->getFlexIOHandler()->mapIOPinToFlexPin(pin) == 0xff))
+        return -1;
+
+    uint8_t timer = _flexIO->requestTimers(1);
+    if (timer == 0xff) {
+        #ifdef DEBUG_FlexPWM
+            DEBUG_FlexPWM.println("TeensyFlexPWM - no free timer");
+        #endif
+        return -1;
+    }
+
+    // One shot from each period edge for TIMCMP + 1 clocks, the edges reset it
+    // while it runs so a compare of at least the period keeps it on
+    TimerConfig timer_config;
+    timer_config.mode = TimerMode::SingleCounter;
+    timer_config.pinSelect = pin;
+    timer_config.pinConfig = PinConfig::Output;
+    timer_config.pinPolarity = inverted ? PinPolarity::ActiveLow : PinPolarity::ActiveHigh;
+    timer_config.triggerSelect = _flexIO->calculateTriggerSelect(TriggerType::TIMER, _period_timer);
+    timer_config.triggerPolarity = TriggerPolarity::ActiveHigh;
+    timer_config.triggerSource = TriggerSource::Internal;
+    timer_config.timerEnable = TimerEnable::TriggerRisingOrFalling;
+    timer_config.timerDisable = TimerDisable::OnCompare;
+    timer_config.timerReset = TimerReset::TriggerRisingOrFalling;
+    timer_config.timerDecrement = TimerDecrement::FlexIOClock;
+    timer_config.timerOutput = TimerOutput::One;
+    _flexIO->configureTimer(timer, timer_config);
+
+    IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+    Channel &ch = _channels[_channel_count];
+    ch.pin = pin;
+    ch.timer = timer;
+    ch.inverted = inverted;
+    ch.duty = 0;
+    ch.timctl = p->TIMCTL[timer];
+    ch.state = TeensyFlexPWMStage::Off;
+    // Parked at 0% until the first setDuty
+    p->TIMCTL[timer] = ch.timctl & ~FLEXIO_TIMCTL_TIMOD(3);
+
+    _flexIO->setPinFlexioMode(pin);
+    return _channel_count++;
+}
+
+float TeensyFlexPWM::setFrequency(float frequency) {
+    if (!_clock_rate || (frequency <= 0.0f))
+        return this->frequency();
+    uint32_t period = (uint32_t)(_clock_rate / frequency + 0.5f);
+    if (period < 2)
+        period = 2;
+    else if (period > TeensyFlexPWMStage::MAX_PERIOD)
+        period = TeensyFlexPWMStage::MAX_PERIOD;
+    _period = period;
+    stage();
+    return this->frequency();
+}
+
+void TeensyFlexPWM::setDuty(uint8_t channel, uint16_t duty) {
+    if (channel >= _channel_count)
+        return;
+    _channels[channel].duty = duty;
+    stage();
+}
+
+uint8_t TeensyFlexPWM::resolutionBits(void) {
+    return _period ? 31 - __builtin_clz(_period) : 0;
+}
+
+//-------------------------------------------------------------------------
+// Double buffering: wait for the next boundary, then write everything
+//-------------------------------------------------------------------------
+void TeensyFlexPWM::stage(void) {
+    if (_period_timer == 0xff)
+        return;
+    __disable_irq();
+    if (!_pending) {
+        _flexIO->clearTimerStatus(_period_timer);
+        _pending = true;
+        _flexIO->enableTimerInterrupt(_period_timer);
+    }
+    __enable_irq();
+}
+
+void TeensyFlexPWM::commit(void) {
+    IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+    p->TIMCMP[_period_timer] = _period - 1;
+    for (uint8_t i = 0; i < _channel_count; i++) {
+        if (_sequence_channels && (i >= _sequence_first) && (i < _sequence_first + _sequence_channels))
+            continue;
+        Channel &ch = _channels[i];
+        ChannelTimer timer{_flexIO, ch};
+        TeensyFlexPWMStage::commit(timer, ch.state, ch.duty, _period);
+    }
+}
+
+//=========================================================================
+// DMA duty sequences
+//=========================================================================
+uint32_t TeensyFlexPWM::sequenceCompare(uint16_t duty) {
+    uint32_t clocks = TeensyFlexPWMStage::clocks(duty, _period);
+    if (clocks < 1)
+        clocks = 1;
+    else if (clocks > _period - 1)
+        clocks = _period - 1;
+    return clocks - 1;
+}
+
+bool TeensyFlexPWM::playSequence(uint8_t firstChannel, uint8_t channelCount, const uint32_t *frames,
+                                 uint16_t frameCount, bool loop) {
+    if (!_flexIO || !frames || !channelCount || (firstChannel + channelCount > _channel_count) ||
+        !frameCount || (frameCount > MAX_SEQUENCE_FRAMES))
+        return false;
+    // One minor loop writes consecutive TIMCMP registers
+    for (uint8_t i = 1; i < channelCount; i++) {
+        if (_channels[firstChannel + i].timer != _channels[firstChannel].timer + i)
+            return false;
+    }
+
+    stopSequence();
+    IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+    if (_seq_shifter == 0xff) {
+        _seq_shifter = _flexIO->requestShifter();
+        if (_seq_shifter == 0xff)
+            return false;
+        // No pin, only here to request a DMA transfer when the period timer reloads
+        ShifterConfig shifter_config;
+        shifter_config.mode = ShifterMode::Transmit;
+        shifter_config.pinConfig = PinConfig::Disabled;
+        shifter_config.timerSelect = _period_timer;
+        shifter_config.timerPolarity = TimerPolarity::ActiveHigh;
+        _flexIO->configureShifter(_seq_shifter, shifter_config);
+    }
+    if (!_dmaSeq) {
+        _dmaSeq = new DMAChannel();
+        _dmaFill = new DMAChannel();
+        if (!_dmaSeq || !_dmaFill)
+            return false;
+    }
+
+    if ((uint32_t)frames >= 0x20200000u)
+        arm_dcache_flush((void *)frames, frameCount * channelCount * 4);
+
+    uint32_t frame_bytes = channelCount * 4;
+    _dmaSeq->disable();
+    _dmaSeq->TCD->SADDR = frames;
+    _dmaSeq->TCD->SOFF = 4;
+    _dmaSeq->TCD->ATTR = DMA_TCD_ATTR_SSIZE(2) | DMA_TCD_ATTR_DSIZE(2);
+    // Destination goes back to the first TIMCMP after every frame
+    _dmaSeq->TCD->NBYTES_MLOFFYES = DMA_TCD_NBYTES_DMLOE | DMA_TCD_NBYTES_MLOFFYES_MLOFF(-(int32_t)frame_bytes) |
+                                    DMA_TCD_NBYTES_MLOFFYES_NBYTES(frame_bytes);
+    _dmaSeq->TCD->SLAST = loop ? -(int32_t)(frameCount * frame_bytes) : 0;
+    _dmaSeq->TCD->DADDR = &p->TIMCMP[_channels[firstChannel].timer];
+    _dmaSeq->TCD->DOFF = 4;
+    _dmaSeq->TCD->CITER = frameCount;
+    _dmaSeq->TCD->BITER = frameCount;
+    // The last minor loop applies DLASTSGA instead of MLOFF
+    _dmaSeq->TCD->DLASTSGA = -(int32_t)frame_bytes;
+    _dmaSeq->TCD->CSR = loop ? 0 : DMA_TCD_CSR_DREQ;
+    _dmaSeq->triggerAtHardwareEvent(_flexIO->getFlexIOHandler()->shiftersDMAChannel(_seq_shifter));
+
+    // Every frame refills the shifter so the next reload asks again. The
+    // minor loop link is not taken on the last frame, the major one is.
+    _dmaFill->disable();
+    _dmaFill->source(_seq_fill);
+    _dmaFill->destination(p->SHIFTBUF[_seq_shifter]);
+    _dmaFill->transferCount(1);
+    _dmaFill->triggerAtTransfersOf(*_dmaSeq);
+    _dmaFill->triggerAtCompletionOf(*_dmaSeq);
+
+    __disable_irq();
+    _sequence_first = firstChannel;
+    _sequence_channels = channelCount;
+    _sequence_loop = loop;
+    for (uint8_t i = 0; i < channelCount; i++) {
+        Channel &ch = _channels[firstChannel + i];
+        _flexIO->disableTimerInterrupt(ch.timer);
+        p->TIMCTL[ch.timer] = ch.timctl;
+        ch.state = TeensyFlexPWMStage::Running;
+    }
+    __enable_irq();
+
+    _dmaFill->enable();
+    _dmaSeq->enable();
+    _flexIO->enableDMARequests(SHIFTER_MASK(_seq_shifter));
+    return true;
+}
+
+void TeensyFlexPWM::stopSequence(void) {
+    if (!_sequence_channels)
+        return;
+    _flexIO->disableDMARequests(SHIFTER_MASK(_seq_shifter));
+    _dmaSeq->disable();
+    _dmaFill->disable();
+    _sequence_channels = 0;
+    // Back to the setDuty values
+    stage();
+}
+
+bool TeensyFlexPWM::sequencePlaying(void) {
+    return _sequence_channels && (_sequence_loop || !_dmaSeq->complete());
+}
+
+//=========================================================================
+// Interrupt handler - period boundary with staged values
+//=========================================================================
+bool TeensyFlexPWM::call_back(FlexIOHandler *pflex) {
+    if (pflex != _flexIO->getFlexIOHandler())
+        return false;
+
+    // Channels going to 0% whose last pulse has ended
+    uint32_t status = TIME_STAT(*_flexIO);
+    for (uint8_t i = 0; i < _channel_count; i++) {
+        Channel &ch = _channels[i];
+        if ((ch.state == TeensyFlexPWMStage::Stopping) && (status & TIMER_MASK(ch.timer))) {
+            ChannelTimer timer{_flexIO, ch};
+            TeensyFlexPWMStage::pulseEnded(timer, ch.state);
+            _flexIO->clearTimerStatus(ch.timer);
+        }
+    }
+
+    if (_pending && (TIME_STAT(*_flexIO) & TIMER_MASK(_period_timer))) {
+        commit();
+        _pending = false;
+        _flexIO->disableTimerInterrupt(_period_timer);
+        _flexIO->clearTimerStatus(_period_timer);
+    }
+    return false;
+}
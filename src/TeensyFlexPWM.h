@@ -0,0 +1,115 @@
+#include "TeensyFlexIO.h"
+#include "TeensyFlexPWMStage.h"
+#include <Arduino.h>
+#include <DMAChannel.h>
+
+#ifndef _TEENSY_FLEX_PWM_H_
+#define _TEENSY_FLEX_PWM_H_
+
+// Multi-channel 16 bit PWM on one FlexIO module.
+//
+// A SingleCounter period timer toggles its output once per period. Every channel
+// is a one-shot SingleCounter timer started, or reset when still running, by either
+// edge of that output, so all channels start together at each period boundary and
+// drive their pin for TIMCMP + 1 FlexIO clocks. A timer only loads TIMCMP when it
+// is enabled or reset, so a new compare value never cuts a pulse short;
+// setDuty()/setFrequency() stage the values and the period interrupt writes them
+// all just after a boundary, so they take effect together at the next one. 100%
+// is a compare the count never reaches, 0% switches the timer off once its pulse
+// has ended, see TeensyFlexPWMStage.h.
+//
+// Duty sequences: a Transmit shifter clocked by the period timer asks for DMA once
+// per period. One channel writes the next frame of compare values into the
+// channels' TIMCMP registers, a linked channel refills the shifter.
+class TeensyFlexPWM : public FlexIOHandlerCallback {
+  public:
+    // One timer is the period timer
+    enum { MAX_CHANNELS = 7,
+           MAX_SEQUENCE_FRAMES = 511 };
+    static constexpr uint16_t DUTY_MAX = TeensyFlexPWMStage::DUTY_MAX;
+
+    TeensyFlexPWM(){};
+    ~TeensyFlexPWM() { end(); }
+
+    // Fails when the period is over 65535 clocks of the module's FlexIO clock,
+    // set a slower clock with FlexIOHandler::setClock before begin for those
+    bool begin(int flexio_module, float frequency);
+    void end(void);
+
+    // Returns the channel number or -1. inverted: active low output.
+    int addChannel(int pin, bool inverted = false);
+    uint8_t channels() { return _channel_count; }
+
+    // Both are applied at the next period boundary. Returns the achieved frequency.
+    float setFrequency(float frequency);
+    float frequency() { return _clock_rate ? (float)_clock_rate / _period : 0.0f; }
+    float minFrequency() { return (float)_clock_rate / TeensyFlexPWMStage::MAX_PERIOD; }
+    // duty: 0 - DUTY_MAX (100%)
+    void setDuty(uint8_t channel, uint16_t duty);
+    void setDutyPercent(uint8_t channel, float percent) { setDuty(channel, percent * DUTY_MAX / 100.0f + 0.5f); }
+    uint32_t period() { return _period; }
+    uint8_t resolutionBits();
+
+    // DMA duty sequence for 'channelCount' channels starting at 'firstChannel', which
+    // need consecutive timers (add them one after another). frames holds
+    // channelCount compare values per period, see sequenceCompare(). The buffer must
+    // stay valid while the sequence plays.
+    bool playSequence(uint8_t firstChannel, uint8_t channelCount, const uint32_t *frames, uint16_t frameCount,
+                      bool loop = true);
+    void stopSequence(void);
+    bool sequencePlaying(void);
+    // TIMCMP value for a duty. Sequences can not switch a channel fully off or on,
+    // so the pulse is at least one FlexIO clock and at most period - 1.
+    uint32_t sequenceCompare(uint16_t duty);
+
+    // Call back from flexIO when ISR hapens
+    virtual bool call_back(FlexIOHandler *pflex);
+
+  private:
+    struct Channel {
+        int pin;
+        uint8_t timer;
+        bool inverted;
+        uint16_t duty;
+        uint32_t timctl; // running image
+        TeensyFlexPWMStage::State state;
+    };
+
+    // Register access for TeensyFlexPWMStage
+    struct ChannelTimer {
+        TeensyFlexIO *flexIO;
+        Channel &ch;
+        void setCompare(uint16_t compare) { flexIO->getFlexIO()->TIMCMP[ch.timer] = compare; }
+        void start() { flexIO->getFlexIO()->TIMCTL[ch.timer] = ch.timctl; }
+        void stop() { flexIO->getFlexIO()->TIMCTL[ch.timer] = ch.timctl & ~FLEXIO_TIMCTL_TIMOD(3); }
+        void watchPulseEnd(bool on) {
+            if (on) {
+                flexIO->clearTimerStatus(ch.timer);
+                flexIO->enableTimerInterrupt(ch.timer);
+            } else {
+                flexIO->disableTimerInterrupt(ch.timer);
+            }
+        }
+    };
+
+    TeensyFlexIO *_flexIO = nullptr;
+    uint8_t _module = 0xff;
+    uint8_t _period_timer = 0xff;
+    uint8_t _seq_shifter = 0xff;
+    uint32_t _clock_rate = 0;
+    uint32_t _period = 0;
+    Channel _channels[MAX_CHANNELS];
+    uint8_t _channel_count = 0;
+    volatile bool _pending = false;
+
+    uint8_t _sequence_first = 0;
+    uint8_t _sequence_channels = 0;
+    bool _sequence_loop = false;
+    uint32_t _seq_fill = 0;
+    DMAChannel *_dmaSeq = nullptr;
+    DMAChannel *_dmaFill = nullptr;
+
+    void commit(void);
+    void stage(void);
+};
+#endif //_TEENSY_FLEX_PWM_H_
@@ -0,0 +1,68 @@
+#ifndef _TEENSY_FLEX_PWM_STAGE_H_
+#define _TEENSY_FLEX_PWM_STAGE_H_
+
+// Period boundary staging of one TeensyFlexPWM channel. The register writes go
+// through a Timer (setCompare(), start(), stop(), watchPulseEnd()), so the host
+// test runs the same steps against a model of the timer.
+//
+// A channel timer is a one-shot that the period edges start, and reset while
+// it is still running. commit() runs just after an edge and every change shows
+// from the next edge on:
+//  - a duty: TIMCMP = clocks - 1, loaded when the next edge starts the pulse
+//  - 100%: TIMCMP = FULL_COMPARE. Each edge resets the count before it gets
+//    there, so the output stays on, and going back to a duty only needs the
+//    compare the next reset loads.
+//  - 0%: the timer is switched off once its pulse has ended (compare status),
+//    switching it off from commit() would cut the running pulse short. The
+//    next pulse is staged as one clock meanwhile, so a status interrupt that
+//    comes after the next edge costs that one clock and no more. From 100%
+//    the last period is always one clock longer: the reset that ends it
+//    loads that one clock compare.
+#include <stdint.h>
+
+struct TeensyFlexPWMStage {
+    static const uint16_t DUTY_MAX = 0xffff;
+    static const uint16_t FULL_COMPARE = 0xffff;
+    // Period clocks, the 100% compare must stay out of reach
+    static const uint32_t MAX_PERIOD = 0xffff;
+
+    enum State : uint8_t { Off,
+                           Stopping,  // on until the running pulse ends
+                           Running };
+
+    static uint32_t clocks(uint16_t duty, uint32_t period) {
+        return ((uint32_t)duty * period + DUTY_MAX / 2) / DUTY_MAX;
+    }
+
+    template <class Timer>
+    static void commit(Timer &timer, State &state, uint16_t duty, uint32_t period) {
+        uint32_t count = clocks(duty, period);
+        if (count == 0) {
+            if (state == Running) {
+                timer.setCompare(0);
+                timer.watchPulseEnd(true);
+                state = Stopping;
+            }
+            return;
+        }
+        if (state == Stopping)
+            timer.watchPulseEnd(false);
+        timer.setCompare((count >= period) ? FULL_COMPARE : count - 1);
+        if (state == Off)
+            timer.start(); // idle, and so inactive, until the next edge
+        state = Running;
+    }
+
+    // Compare status of the channel timer: its pulse is over and the output
+    // stays inactive until the next edge, so it can be switched off now
+    template <class Timer>
+    static void pulseEnded(Timer &timer, State &state) {
+        if (state != Stopping)
+            return;
+        timer.watchPulseEnd(false);
+        timer.stop();
+        state = Off;
+    }
+};
+
+#endif // _TEENSY_FLEX_PWM_STAGE_H_
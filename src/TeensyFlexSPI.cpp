@@ -7,7 +7,6 @@
 #define FLEXIO1_CLOCK (480000000L / 16) // Again assuming default clocks?
 
 
-TeensyFlexSPI *TeensyFlexSPI::_dmaActiveObjects[FlexIOHandler::CNT_FLEX_IO_OBJECT] = {nullptr, nullptr};
 
 //=============================================================================
 // TeensyFlexSPI::Begin
@@ -151,10 +150,11 @@ bool TeensyFlexSPI::begin(int flexio_module) {
 
     _flexIO->getFlexIOHandler()->addIOHandlerCallback(this);
 
+    setPollTimeout(_poll_timeout_us);
+
     // Set up pointers to the bit-swapped shift registers for MSB first transfer
     _bitOrder = MSBFIRST;
-    _shiftBufOutReg = &_flexIO->getFlexIOHandler()->port().SHIFTBUFBBS[_tx_shifter];
-    _shiftBufInReg = &_flexIO->getFlexIOHandler()->port().SHIFTBUFBIS[_rx_shifter];
+    selectShiftBufRegs(_bitOrder, _nTransferBytes, _shiftBufOutReg, _shiftBufInReg);
 
     Serial.println("FlexIO1 config done");
 
@@ -185,6 +185,24 @@ bool TeensyFlexSPI::begin(int flexio_module) {
 }
 
 void TeensyFlexSPI::end(void) {
+    if (_target) {
+        _flexIO->disableTimerInterrupt(_timer + 1);
+        _target = false;
+        _target_armed.count = 0;
+        _target_next.count = 0;
+    }
+    if (_dmaRX) {
+        _dmaRX->disable();
+        _dmaTX->disable();
+        TeensyFlexDMADispatch::detach(_dmaRX->channel);
+        delete _dmaRX;
+        delete _dmaTX;
+        _dmaRX = nullptr;
+        _dmaTX = nullptr;
+        _dma_state = DMAState::notAllocated;
+    }
+    // Only after the channels are off, their TCDs link through it
+    freeQueue();
     // If the transmit was allocated free it now as well as timers and shifters.
     if (_flexIO->getFlexIOHandler()) {
         _flexIO->getFlexIOHandler()->freeTimers(_timer, (_csPin != -1) ? 2 : 1);
@@ -197,38 +215,100 @@ void TeensyFlexSPI::end(void) {
     }
 }
 
-void TeensyFlexSPI::beginTransaction(TeensyFlexSPISettings settings) {
+uint8_t TeensyFlexSPI::transferBytes(uint8_t nTransferBits, bool packed24) {
+    uint8_t bytes = (nTransferBits - 1) / 8 + 1;
+    if ((bytes == 3) && !packed24)
+        bytes = 4; // 17-24 bits take a whole uint32_t unless asked to pack them
+    return bytes;
+}
+
+// DMA moves whole bytes, so a word only lines up with the polled transfers
+// (right aligned) when it fills its bytes, or in the directions where the
+// shift buffer view already puts it at the bottom: MSB first reads and LSB
+// first writes.
+bool TeensyFlexSPI::dmaAligned(uint8_t nTransferBits, uint8_t bytes, bool tx, bool rx) {
+    if (nTransferBits == bytes * 8)
+        return true;
+    return (_bitOrder == MSBFIRST) ? !tx : !rx;
+}
+
+uint32_t TeensyFlexSPI::computeTimcmp(uint32_t clock, uint8_t dataMode, uint8_t nTransferBits, uint32_t &achievedClock) {
+    uint32_t clock_speed = _flexIO->getFlexIOHandler()->computeClockRate() / 2;
+    uint32_t div = clock ? clock_speed / clock : 0;
+    if (div) {
+        if ((clock_speed / div) > clock)
+            div++; // unless even multiple increment
+        div--;     // the actual value stored is the -1...
+    }
+    if (!(dataMode & SPI_MODE_TRANSMIT_ONLY)) {
+        if (div == 0)
+            div = 1; // force to at least one as Reads will fail at 0...
+        else if ((div == 1) && (clock > 30000000u))
+            div = 2;
+    }
+    if (div > 0xff)
+        div = 0xff;
+    achievedClock = clock_speed / (div + 1);
+    return div | (nTransferBits * 2 - 1) << 8; // Set the clk div for shifter and set transfer length
+}
+
+void TeensyFlexSPI::selectShiftBufRegs(uint8_t bitOrder, uint8_t bytes, volatile uint8_t *&outReg, volatile uint8_t *&inReg) {
+    // The shifters send bit 0 first and receive into bit 31, so pick the view
+    // and the byte lane where a word of this size lines up:
+    //  MSB first: out to the top bytes of the bit swapped view, in from the bottom.
+    //  LSB first: out to the bottom bytes of SHIFTBUF, in from the top.
+    IMXRT_FLEXIO_t &port = _flexIO->getFlexIOHandler()->port();
+    uint8_t lane = 4 - bytes;
+    if (bitOrder == MSBFIRST) {
+        outReg = (volatile uint8_t *)&port.SHIFTBUFBIS[_tx_shifter] + lane;
+        inReg = (volatile uint8_t *)&port.SHIFTBUFBIS[_rx_shifter];
+    } else {
+        outReg = (volatile uint8_t *)&port.SHIFTBUF[_tx_shifter];
+        inReg = (volatile uint8_t *)&port.SHIFTBUF[_rx_shifter] + lane;
+    }
+}
+
+bool TeensyFlexSPISettings::resolve(TeensyFlexSPI &spi) {
+    if (!spi._flexIO || (spi._timer == 0xff) || !_nTransferBits || (_nTransferBits > 32))
+        return false;
+    _timcmp = spi.computeTimcmp(_clock, _dataMode, _nTransferBits, _achievedClock);
+    _nTransferBytes = TeensyFlexSPI::transferBytes(_nTransferBits, _packed24);
+    spi.selectShiftBufRegs(_bitOrder, _nTransferBytes, _shiftBufOutReg, _shiftBufInReg);
+    _spi = &spi;
+    return true;
+}
+
+void TeensyFlexSPI::beginTransaction(const TeensyFlexSPISettings &settings) {
+    if (settings._spi == this) {
+        // Resolved: just store the image
+        _flexIO->getFlexIO()->TIMCMP[_timer] = settings._timcmp;
+        _clock = settings._clock;
+        _achievedClock = settings._achievedClock;
+        _dataMode = settings._dataMode;
+        _nTransferBits = settings._nTransferBits;
+        _nTransferBytes = settings._nTransferBytes;
+        _packed24 = settings._packed24;
+        _bitOrder = settings._bitOrder;
+        _shiftBufOutReg = settings._shiftBufOutReg;
+        _shiftBufInReg = settings._shiftBufInReg;
+        return;
+    }
 
-    // right now pretty stupid
     if ((settings._clock != _clock) || (settings._dataMode != _dataMode) || (settings._nTransferBits != _nTransferBits)) {
         _clock = settings._clock;
         _dataMode = settings._dataMode;
         _nTransferBits = settings._nTransferBits; // Probaby should have some safety checking to keep this in the 1-32 range for now.
-        _nTransferBytes = (_nTransferBits - 1) / 8 + 1;
-        if (_nTransferBytes == 3)
-            _nTransferBytes = 4;                               // DMA doesn't handle arbitrary pointer shifts so force 32bit alignment even though it would fit into 24bits.
-        uint32_t clock_speed = _flexIO->getFlexIOHandler()->computeClockRate() / 2;
-        uint32_t div = clock_speed / _clock;
-        if (div) {
-            if ((clock_speed / div) > _clock)
-                div++; // unless even multiple increment
-            div--;     // the actual value stored is the -1...
-        }
-        if (!(_dataMode & SPI_MODE_TRANSMIT_ONLY)) {
-            if (div == 0)
-                div = 1; // force to at least one as Reads will fail at 0...
-            else if ((div == 1) && (_clock > 30000000u))
-                div = 2;
-        }
-
-        _flexIO->getFlexIO()->TIMCMP[_timer] = div | (_nTransferBits * 2 - 1) << 8; // Set the clk div for shifter and set transfer length
+        _flexIO->getFlexIO()->TIMCMP[_timer] = computeTimcmp(_clock, _dataMode, _nTransferBits, _achievedClock);
 
         #ifdef DEBUG_FlexSPI
                 DEBUG_FlexSPI.printf("TeensyFlexSPI:beginTransaction TIMCMP: %x\n", _flexIO->getFlexIO()->TIMCMP[_timer]);
         #endif
     }
 
+    _packed24 = settings._packed24;
+    _nTransferBytes = transferBytes(_nTransferBits, _packed24);
     _bitOrder = settings._bitOrder;
+    selectShiftBufRegs(_bitOrder, _nTransferBytes, _shiftBufOutReg, _shiftBufInReg);
 }
 
 // After performing a group of transfers and releasing the chip select
@@ -300,6 +380,28 @@ void TeensyFlexSPI::getShiftBufferIn(void *retbuf, uint8_t nbits, size_t dtype_s
     }
 }
 
+void TeensyFlexSPI::setPollTimeout(uint32_t us) {
+    _poll_timeout_us = us;
+    _poll_timeout_cycles = us * (F_CPU_ACTUAL / 1000000);
+}
+
+// Spin until the shifter's status flag is set, within the poll budget
+bool TeensyFlexSPI::waitShifter(uint8_t shifter) {
+    IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+    if (p->SHIFTSTAT & SHIFTER_MASK(shifter))
+        return true;
+    uint32_t start = ARM_DWT_CYCCNT;
+    while (!(p->SHIFTSTAT & SHIFTER_MASK(shifter))) {
+        if ((ARM_DWT_CYCCNT - start) > _poll_timeout_cycles) {
+            _status = Timeout;
+            return false;
+        }
+        if (_yield_callback)
+            _yield_callback(_yield_context);
+    }
+    return true;
+}
+
 uint32_t TeensyFlexSPI::transferNBits(uint32_t w_out, uint8_t nbits) {
     // Need to do some validation...
 
@@ -307,65 +409,67 @@ uint32_t TeensyFlexSPI::transferNBits(uint32_t w_out, uint8_t nbits) {
     uint16_t timcmp_save = _flexIO->getFlexIO()->TIMCMP[_timer];                        // remember value coming in
     _flexIO->getFlexIO()->TIMCMP[_timer] = (timcmp_save & 0xff) | (nbits * 2 - 1) << 8; // Adjust transmission length to nbits
     // Serial.printf("TCMP bits = %x\n",_flexIO->getFlexIO()).TIMCMP[_timer]);
-    //  Now lets wait for something to come back.
-    uint16_t timeout = 0xffff; // don't completely hang
+    _status = OK;
     // Clear any current pending RX input
     if (_flexIO->getFlexIO()->SHIFTSTAT & SHIFTER_MASK(_rx_shifter)) {
         return_val = getShiftBufferIn(nbits);
     }
+    _flexIO->getFlexIO()->SHIFTERR = SHIFTER_MASK(_rx_shifter);
 
     setShiftBufferOut(w_out, nbits);
 
+    //  Now lets wait for something to come back.
     return_val = 0xff;
-    while (!(_flexIO->getFlexIO()->SHIFTSTAT & SHIFTER_MASK(_rx_shifter)) && (--timeout))
-        ;
-
-    if (_flexIO->getFlexIO()->SHIFTSTAT & SHIFTER_MASK(_rx_shifter)) {
+    if (waitShifter(_rx_shifter)) {
         return_val = getShiftBufferIn(nbits);
+        if (_flexIO->getFlexIO()->SHIFTERR & SHIFTER_MASK(_rx_shifter))
+            _status = Overrun;
     }
 
     _flexIO->getFlexIO()->TIMCMP[_timer] = timcmp_save;
     return return_val;
 }
 
-void TeensyFlexSPI::transferBufferNBits(const void *buf, void *retbuf, size_t count, uint8_t nbits) {
+TeensyFlexSPI::Status TeensyFlexSPI::transferBufferNBits(const void *buf, void *retbuf, size_t count, uint8_t nbits) {
     if (!nbits)
         nbits = _nTransferBits;
-    uint8_t bytestride = (nbits - 1) / 8 + 1;
-    if (bytestride == 3) {
-        bytestride = 4;
-    }
+    uint8_t bytestride = transferBytes(nbits, _packed24);
     uint32_t tx_count = count;
     const uint8_t *tx_buffer = (const uint8_t *)buf;
     uint8_t *rx_buffer = (uint8_t *)retbuf;
 
+    _status = OK;
     if (count <= 0)
-        return; // bail if 0 count passed in.
+        return _status; // bail if 0 count passed in.
 
     // put out the first character.
     _flexIO->getFlexIO()->SHIFTERR = SHIFTER_MASK(_rx_shifter) | SHIFTER_MASK(_tx_shifter); // clear out any previous errors
-    while (!(_flexIO->getFlexIO()->SHIFTSTAT & SHIFTER_MASK(_tx_shifter)))
-        ; // wait for room for the first character
+    if (!waitShifter(_tx_shifter))
+        return _status; // wait for room for the first character
 
     if (tx_buffer) {
         setShiftBufferOut(tx_buffer, nbits, bytestride);
         tx_buffer += bytestride;
+    } else {
+        setShiftBufferOut(_transferWriteFill, nbits);
     }
     tx_count--;
     while (tx_count) {
         // wait for room for the next character
-        while (!(_flexIO->getFlexIO()->SHIFTSTAT & SHIFTER_MASK(_tx_shifter)))
-            ;
+        if (!waitShifter(_tx_shifter))
+            return _status;
 
         if (tx_buffer) {
             setShiftBufferOut(tx_buffer, nbits, bytestride);
             tx_buffer += bytestride;
+        } else {
+            setShiftBufferOut(_transferWriteFill, nbits);
         }
         tx_count--;
 
         // Wait for data to come back
-        while (!(_flexIO->getFlexIO()->SHIFTSTAT & SHIFTER_MASK(_rx_shifter)))
-            ;
+        if (!waitShifter(_rx_shifter))
+            return _status;
 
         if (rx_buffer) {
             getShiftBufferIn(rx_buffer, nbits, bytestride);
@@ -373,17 +477,25 @@ void TeensyFlexSPI::transferBufferNBits(const void *buf, void *retbuf, size_t co
         }
     }
     // wait for last character to come back...
-    while (!(_flexIO->getFlexIO()->SHIFTSTAT & SHIFTER_MASK(_rx_shifter)) && !(_flexIO->getFlexIO()->SHIFTERR & SHIFTER_MASK(_rx_shifter)))
-        ;
+    if (!waitShifter(_rx_shifter))
+        return _status;
 
     if (rx_buffer) {
         getShiftBufferIn(rx_buffer, nbits, bytestride);
         rx_buffer += bytestride;
     }
+    // A word came in before the previous one was read: something was lost
+    if (_flexIO->getFlexIO()->SHIFTERR & SHIFTER_MASK(_rx_shifter))
+        _status = Overrun;
+    return _status;
 }
 
 bool TeensyFlexSPI::call_back(FlexIOHandler *pflex) {
     //	DEBUG_digitalWriteFast(4, HIGH);
+    if (_target && (_flexIO->timerStatus() & TIMER_MASK((_timer + 1)))) {
+        _flexIO->clearTimerStatus(_timer + 1);
+        targetEnd();
+    }
     return false; // right now always return false...
 }
 
@@ -394,7 +506,64 @@ bool TeensyFlexSPI::call_back(FlexIOHandler *pflex) {
 // Try Transfer using DMA.
 //=========================================================================
 static uint8_t bit_bucket;
-#define dontInterruptAtCompletion(dmac) (dmac)->TCD->CSR &= ~DMA_TCD_CSR_INTMAJOR
+#define dontInterruptAtCompletion(dmac) (dmac)->TCD->CSR = (dmac)->TCD->CSR & ~DMA_TCD_CSR_INTMAJOR
+
+// count words from buf (or the write fill) to the transmit shift buffer. Packed
+// 24 bit words are moved a byte at a time with a minor loop offset, so the caller
+// has to write the first word itself: a partly written SHIFTBUF must not be the
+// one that starts the timer.
+void TeensyFlexSPI::setupTxDMA(DMABaseClass &dma, const void *buf, size_t count, volatile uint8_t *reg, uint8_t bytes) {
+    if (bytes == 3) {
+        dma.TCD->SADDR = buf ? buf : &_transferWriteFill;
+        dma.TCD->SOFF = buf ? 1 : 0;
+        dma.TCD->ATTR = DMA_TCD_ATTR_SSIZE(0) | DMA_TCD_ATTR_DSIZE(0);
+        dma.TCD->NBYTES_MLOFFYES = DMA_TCD_NBYTES_DMLOE | DMA_TCD_NBYTES_MLOFFYES_MLOFF(-3) | DMA_TCD_NBYTES_MLOFFYES_NBYTES(3);
+        dma.TCD->SLAST = 0;
+        dma.TCD->DADDR = reg;
+        dma.TCD->DOFF = 1;
+        dma.TCD->CITER = count;
+        dma.TCD->BITER = count;
+        dma.TCD->DLASTSGA = 0;
+        return;
+    }
+    if (buf) {
+        dma.sourceBuffer((const uint8_t *)buf, count);
+        dma.TCD->SLAST = 0; // Finish with it pointing to next location
+    } else {
+        dma.source((uint8_t &)_transferWriteFill); // maybe have setable value
+        dma.transferCount(count);
+    }
+    dma.destination(*reg);
+    dma.transferSize(bytes);
+}
+
+// count words from the receive shift buffer to buf, or to the bit bucket
+void TeensyFlexSPI::setupRxDMA(DMABaseClass &dma, void *buf, size_t count, volatile uint8_t *reg, uint8_t bytes) {
+    if (!buf) {
+        // Any read of the buffer clears the request
+        dma.source(*reg);
+        dma.destination((uint8_t &)bit_bucket);
+        dma.transferCount(count);
+        return;
+    }
+    if (bytes == 3) {
+        dma.TCD->SADDR = reg;
+        dma.TCD->SOFF = 1;
+        dma.TCD->ATTR = DMA_TCD_ATTR_SSIZE(0) | DMA_TCD_ATTR_DSIZE(0);
+        dma.TCD->NBYTES_MLOFFYES = DMA_TCD_NBYTES_SMLOE | DMA_TCD_NBYTES_MLOFFYES_MLOFF(-3) | DMA_TCD_NBYTES_MLOFFYES_NBYTES(3);
+        dma.TCD->SLAST = 0;
+        dma.TCD->DADDR = buf;
+        dma.TCD->DOFF = 1;
+        dma.TCD->CITER = count;
+        dma.TCD->BITER = count;
+        dma.TCD->DLASTSGA = 0;
+        return;
+    }
+    dma.source(*reg);
+    dma.destinationBuffer((uint8_t *)buf, count);
+    dma.TCD->DLASTSGA = 0; // At end point after our bufffer
+    dma.transferSize(bytes);
+}
 
 //=========================================================================
 // Init the DMA channels
@@ -419,26 +588,21 @@ bool TeensyFlexSPI::initDMAChannels() {
         return false;
     }
 
-    int iFlexIndex = _flexIO->getFlexIOHandler()->FlexIOIndex();
     // Let's setup the RX chain
     _dmaRX->disable();
-    _dmaRX->source((volatile uint8_t &)*_shiftBufInReg);
+    _dmaRX->source(*_shiftBufInReg);
     _dmaRX->disableOnCompletion();
     _dmaRX->triggerAtHardwareEvent(_flexIO->getFlexIOHandler()->shiftersDMAChannel(_rx_shifter));
-    if (iFlexIndex == 0) {
-        _dmaRX->attachInterrupt(&_dma_rxISR0);
-        _dmaActiveObjects[0] = this;
-    } else {
-        _dmaRX->attachInterrupt(&_dma_rxISR1);
-        _dmaActiveObjects[1] = this;
-    }
+    // Routed by DMA channel, so every bus can have a transfer in flight
+    _dmaRX->attachInterrupt(TeensyFlexDMADispatch::attach(
+        _dmaRX->channel, &TeensyFlexDMADispatch::member<TeensyFlexSPI, &TeensyFlexSPI::dma_rxisr>, this));
     _dmaRX->interruptAtCompletion();
 
     // We may be using settings chain here so lets set it up.
     // Now lets setup TX chain.  Note if trigger TX is not set
     // we need to have the RX do it for us.
     _dmaTX->disable();
-    _dmaTX->destination((volatile uint8_t &)*_shiftBufOutReg);
+    _dmaTX->destination(*_shiftBufOutReg);
     _dmaTX->disableOnCompletion();
 
     _dmaTX->triggerAtHardwareEvent(_flexIO->getFlexIOHandler()->shiftersDMAChannel(_tx_shifter));
@@ -461,6 +625,31 @@ void dumpDMA_TCD(DMABaseClass *dmabc) {
 #endif
 
 bool TeensyFlexSPI::transfer(const void *buf, void *retbuf, size_t count, EventResponderRef event_responder) {
+    // Any buffer: maintain the cache for everything outside DTCM
+    size_t bytes = count * _nTransferBytes;
+    if (buf && ((uint32_t)buf >= 0x20200000u))
+        arm_dcache_flush((void *)buf, bytes);
+    if (retbuf && ((uint32_t)retbuf >= 0x20200000u))
+        arm_dcache_delete(retbuf, bytes);
+    return startDMA(buf, retbuf, count, event_responder);
+}
+
+bool TeensyFlexSPI::transferBuffers(TeensyFlexDMABuffer *txBuffer, TeensyFlexDMABuffer *rxBuffer, size_t count,
+                                    EventResponderRef event_responder) {
+    size_t bytes = count * _nTransferBytes;
+    if ((txBuffer && (!txBuffer->valid() || (txBuffer->size() < bytes))) ||
+        (rxBuffer && (!rxBuffer->valid() || (rxBuffer->size() < bytes))))
+        return false;
+    if ((_dma_state == DMAState::active) || _queue_active)
+        return false;
+    // Only what the buffers say they need
+    if (txBuffer)
+        txBuffer->prepareForDevice(bytes);
+    uint8_t *rx = rxBuffer ? rxBuffer->prepareForReceive(bytes) : nullptr;
+    return startDMA(txBuffer ? txBuffer->read() : nullptr, rx, count, event_responder);
+}
+
+bool TeensyFlexSPI::startDMA(const void *buf, void *retbuf, size_t count, EventResponderRef event_responder) {
     if (_dma_state == DMAState::notAllocated) {
         if (!initDMAChannels())
             return false;
@@ -470,13 +659,18 @@ bool TeensyFlexSPI::transfer(const void *buf, void *retbuf, size_t count, EventR
         return false; // already active
 
     event_responder.clearEvent(); // Make sure it is not set yet
-    if (count < 2) {
-        // Use non-async version to simplify cases...
+    if ((count < 2) || !dmaAligned(_nTransferBits, _nTransferBytes, buf != nullptr, retbuf != nullptr)) {
+        // Use non-async version to simplify cases, and for words the DMA
+        // would leave left aligned
         transfer(buf, retbuf, count);
         event_responder.triggerEvent();
         return true;
     }
 
+    // Packed 24 bit words can't be split: the TX channel would stall at the seam
+    if ((_nTransferBytes == 3) && (count > MAX_DMA_COUNT))
+        return false;
+
     // Now handle the cases where the count > then how many we can output in one DMA request
     if (count > MAX_DMA_COUNT) {
         _dma_count_remaining = count - MAX_DMA_COUNT;
@@ -486,30 +680,22 @@ bool TeensyFlexSPI::transfer(const void *buf, void *retbuf, size_t count, EventR
     }
 
     // Now See if caller passed in a source buffer.
-    uint8_t *write_data = (uint8_t *)buf;
-    if (buf) {
-        _dmaTX->sourceBuffer((uint8_t *)write_data, count);
-        _dmaTX->TCD->SLAST = 0; // Finish with it pointing to next location
-        if ((uint32_t)write_data >= 0x20200000u)
-            arm_dcache_flush(write_data, count);
-    } else {
-        _dmaTX->source((uint8_t &)_transferWriteFill); // maybe have setable value
-        _dmaTX->transferCount(count);
-    }
-    _dmaTX->transferSize(_nTransferBytes);
-
-    if (retbuf) {
-        // On T3.5 must handle SPI1/2 differently as only one DMA channel
-        _dmaRX->destinationBuffer((uint8_t *)retbuf, count);
-        _dmaRX->TCD->DLASTSGA = 0; // At end point after our bufffer
-        if ((uint32_t)retbuf >= 0x20200000u)
-            arm_dcache_delete(retbuf, count);
-    } else {
-        // Write  only mode
-        _dmaRX->destination((uint8_t &)bit_bucket);
-        _dmaRX->transferCount(count);
+    const uint8_t *write_data = (const uint8_t *)buf;
+
+    size_t tx_count = count;
+    if (_nTransferBytes == 3) {
+        // First packed word by hand, in one store
+        _flexIO->getFlexIO()->SHIFTERR = SHIFTER_MASK(_rx_shifter) | SHIFTER_MASK(_tx_shifter);
+        if (write_data) {
+            setShiftBufferOut(write_data, _nTransferBits, 3);
+            write_data += 3;
+        } else {
+            setShiftBufferOut(_transferWriteFill, _nTransferBits);
+        }
+        tx_count--;
     }
-    _dmaRX->transferSize(_nTransferBytes);
+    setupTxDMA(*_dmaTX, write_data, tx_count, _shiftBufOutReg, _nTransferBytes);
+    setupRxDMA(*_dmaRX, retbuf, count, _shiftBufInReg, _nTransferBytes);
 
     _dma_event_responder = &event_responder;
     // Now try to start it?
@@ -523,7 +709,7 @@ bool TeensyFlexSPI::transfer(const void *buf, void *retbuf, size_t count, EventR
 #endif
 
     // Lets turn on the DMA handling for this
-    _flexIO->getFlexIO()->SHIFTSDEN |= SHIFTER_MASK(_rx_shifter) | SHIFTER_MASK(_tx_shifter);
+    _flexIO->enableDMARequests(SHIFTER_MASK(_rx_shifter) | SHIFTER_MASK(_tx_shifter));
 
     _dmaRX->enable();
     _dmaTX->enable();
@@ -532,13 +718,25 @@ bool TeensyFlexSPI::transfer(const void *buf, void *retbuf, size_t count, EventR
     return true;
 }
 
-void TeensyFlexSPI::_dma_rxISR0(void) {
-    TeensyFlexSPI::_dmaActiveObjects[0]->dma_rxisr();
+#if defined(__cpp_impl_coroutine)
+//-------------------------------------------------------------------------
+// Coroutine transfer: the DMA completion event resumes the coroutine from
+// the executor
+//-------------------------------------------------------------------------
+bool TeensyFlexSPITransfer::await_suspend(std::coroutine_handle<> handle) {
+    _event.setContext(this);
+    _event.attachImmediate(&transferDone);
+    _started = _spi.transfer(_txBuffer, _rxBuffer, _count, _event);
+    if (!_started)
+        return false;
+    return _completion.await_suspend(handle);
 }
 
-void TeensyFlexSPI::_dma_rxISR1(void) {
-    TeensyFlexSPI::_dmaActiveObjects[1]->dma_rxisr();
+void TeensyFlexSPITransfer::transferDone(EventResponderRef event_responder) {
+    TeensyFlexSPITransfer *transfer = (TeensyFlexSPITransfer *)event_responder.getContext();
+    transfer->_completion.complete(event_responder.getStatus());
 }
+#endif
 
 //-------------------------------------------------------------------------
 // DMA RX ISR
@@ -548,6 +746,11 @@ void TeensyFlexSPI::dma_rxisr(void) {
     _dmaTX->clearComplete();
     _dmaRX->clearComplete();
 
+    if (_queue_active) {
+        finishQueue();
+        return;
+    }
+
     if (_dma_count_remaining) {
         // What do I need to do to start it back up again...
         // We will use the BITR/CITR from RX as TX may have prefed some stuff
@@ -563,8 +766,403 @@ void TeensyFlexSPI::dma_rxisr(void) {
         _dmaTX->enable();
     } else {
 
-        _flexIO->getFlexIO()->SHIFTSDEN &= ~(SHIFTER_MASK(_rx_shifter) | SHIFTER_MASK(_tx_shifter)); // turn off DMA on both RX and TX
+        _flexIO->disableDMARequests(SHIFTER_MASK(_rx_shifter) | SHIFTER_MASK(_tx_shifter)); // turn off DMA on both RX and TX
         _dma_state = DMAState::completed;                                   // set back to 1 in case our call wants to start up dma again
         _dma_event_responder->triggerEvent();
     }
-}
\ No newline at end of file
+}
+//=============================================================================
+// Command queue
+//
+// The whole queue is one DMA program. The SCK timer runs with TIMDIS = Never so
+// the chained CS timer stays asserted for every word of a command:
+//  TX channel, per command: the words, then a TIMCFG write with TIMDIS = OnCompare
+//    that lands as the last word starts shifting. That TCD also clears ERQ, so
+//    the channel stops with the next command's words loaded.
+//  RX channel, per command: the words, then three TCDs that start themselves
+//    (CSR START) once the last word is in: write TIMCFG/TIMCMP for the next
+//    command, a burst of dummy reads for the gap, and a write of the TX channel
+//    number to DMA_SERQ, which lets the TX channel carry on.
+// Only the end of the last command interrupts.
+//=============================================================================
+// FlexIO register reads used to time the inter-command gap
+#define QUEUE_GAP_NS_PER_READ 25
+
+struct TeensyFlexSPI::QueueProgram {
+    DMASetting tx[MAX_QUEUE * 2];
+    DMASetting rx[MAX_QUEUE * 4];
+    uint32_t config[MAX_QUEUE][2]; // TIMCFG, TIMCMP at the start of each command
+    uint32_t timcfg_last[MAX_QUEUE];
+    uint32_t scratch;
+    uint8_t serq;
+};
+
+void TeensyFlexSPI::freeQueue(void) {
+    delete _queue;
+    _queue = nullptr;
+    _queue_active = false;
+}
+
+bool TeensyFlexSPI::queue(const TeensyFlexSPICommand *commands, uint8_t count, EventResponderRef event_responder) {
+    if (_dma_state == DMAState::notAllocated) {
+        if (!initDMAChannels())
+            return false;
+    }
+    if ((_dma_state == DMAState::active) || _queue_active || (_csPin == -1) || _target || !commands || !count ||
+        (count > MAX_QUEUE))
+        return false;
+    for (uint8_t k = 0; k < count; k++) {
+        if (!commands[k].count || (commands[k].count > MAX_DMA_COUNT) || !commands[k].nTransferBits ||
+            (commands[k].nTransferBits > 32))
+            return false;
+        uint8_t bytes = transferBytes(commands[k].nTransferBits, _packed24);
+        if ((bytes == 3) ||
+            !dmaAligned(commands[k].nTransferBits, bytes, commands[k].txBuffer != nullptr, commands[k].rxBuffer != nullptr))
+            return false;
+    }
+    if (!_queue) {
+        _queue = new QueueProgram();
+        if (!_queue)
+            return false;
+    }
+
+    QueueProgram &q = *_queue;
+    IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+    uint32_t timcfg = p->TIMCFG[_timer] & ~(FLEXIO_TIMCFG_TIMDIS(7) | FLEXIO_TIMCFG_TSTART | FLEXIO_TIMCFG_TSTOP(3));
+    uint32_t div = p->TIMCMP[_timer] & 0xff;
+    int16_t timcmp_offset = (volatile uint8_t *)&p->TIMCMP[_timer] - (volatile uint8_t *)&p->TIMCFG[_timer];
+
+    for (uint8_t k = 0; k < count; k++) {
+        const TeensyFlexSPICommand &c = commands[k];
+        uint8_t bytes = transferBytes(c.nTransferBits, _packed24);
+        volatile uint8_t *out_reg, *in_reg;
+        selectShiftBufRegs(_bitOrder, bytes, out_reg, in_reg);
+        uint32_t start = c.setupBit ? FLEXIO_TIMCFG_TSTART : 0;
+        q.config[k][0] = timcfg | FLEXIO_TIMCFG_TIMDIS(static_cast<uint8_t>(TimerDisable::Never)) | start;
+        q.config[k][1] = div | (c.nTransferBits * 2 - 1) << 8;
+        q.timcfg_last[k] = timcfg | FLEXIO_TIMCFG_TIMDIS(static_cast<uint8_t>(TimerDisable::OnCompare)) | start |
+                           (c.holdBit ? FLEXIO_TIMCFG_TSTOP(2) : 0);
+
+        // TX: words, then stop the SCK timer after the last one
+        DMASetting &words = q.tx[k * 2];
+        DMASetting &last = q.tx[k * 2 + 1];
+        if (c.txBuffer && ((uint32_t)c.txBuffer >= 0x20200000u))
+            arm_dcache_flush((void *)c.txBuffer, c.count * bytes);
+        setupTxDMA(words, c.txBuffer, c.count, out_reg, bytes);
+        words.replaceSettingsOnCompletion(last);
+
+        last.source(q.timcfg_last[k]);
+        last.destination(p->TIMCFG[_timer]);
+        last.transferCount(1);
+        if (k + 1 < count)
+            last.replaceSettingsOnCompletion(q.tx[(k + 1) * 2]);
+        last.TCD->CSR = last.TCD->CSR | DMA_TCD_CSR_DREQ;
+
+        // RX: words, then set up and release the next command
+        DMASetting &in = q.rx[k * 4];
+        if (c.rxBuffer && ((uint32_t)c.rxBuffer >= 0x20200000u))
+            arm_dcache_delete(c.rxBuffer, c.count * bytes);
+        setupRxDMA(in, c.rxBuffer, c.count, in_reg, bytes);
+        if (k + 1 == count) {
+            in.interruptAtCompletion();
+            in.disableOnCompletion();
+            continue;
+        }
+
+        DMASetting &config = q.rx[k * 4 + 1];
+        DMASetting &gap = q.rx[k * 4 + 2];
+        DMASetting &go = q.rx[k * 4 + 3];
+        in.replaceSettingsOnCompletion(config);
+
+        config.TCD->SADDR = q.config[k + 1];
+        config.TCD->SOFF = 4;
+        config.TCD->ATTR = DMA_TCD_ATTR_SSIZE(2) | DMA_TCD_ATTR_DSIZE(2);
+        config.TCD->NBYTES = 8;
+        config.TCD->SLAST = 0;
+        config.TCD->DADDR = &p->TIMCFG[_timer];
+        config.TCD->DOFF = timcmp_offset;
+        config.TCD->CITER = 1;
+        config.TCD->BITER = 1;
+        config.replaceSettingsOnCompletion(gap);
+        config.TCD->CSR = config.TCD->CSR | DMA_TCD_CSR_START;
+
+        uint32_t reads = c.gapNs / QUEUE_GAP_NS_PER_READ + 1;
+        gap.TCD->SADDR = &p->VERID;
+        gap.TCD->SOFF = 0;
+        gap.TCD->ATTR = DMA_TCD_ATTR_SSIZE(2) | DMA_TCD_ATTR_DSIZE(2);
+        gap.TCD->NBYTES = reads * 4;
+        gap.TCD->SLAST = 0;
+        gap.TCD->DADDR = &q.scratch;
+        gap.TCD->DOFF = 0;
+        gap.TCD->CITER = 1;
+        gap.TCD->BITER = 1;
+        gap.replaceSettingsOnCompletion(go);
+        gap.TCD->CSR = gap.TCD->CSR | DMA_TCD_CSR_START;
+
+        go.source(q.serq);
+        go.destination(DMA_SERQ);
+        go.transferCount(1);
+        go.replaceSettingsOnCompletion(q.rx[(k + 1) * 4]);
+        go.TCD->CSR = go.TCD->CSR | DMA_TCD_CSR_START;
+    }
+    q.serq = _dmaTX->channel;
+    if ((uint32_t)&q >= 0x20200000u)
+        arm_dcache_flush(&q, sizeof(q));
+
+    _queue_count = count;
+    _dma_event_responder = &event_responder;
+    event_responder.clearEvent();
+
+    // First command by hand, the program does the rest
+    _queue_timcfg = p->TIMCFG[_timer];
+    _queue_timcmp = p->TIMCMP[_timer];
+    p->TIMCFG[_timer] = q.config[0][0];
+    p->TIMCMP[_timer] = q.config[0][1];
+    p->SHIFTERR = SHIFTER_MASK(_rx_shifter) | SHIFTER_MASK(_tx_shifter);
+
+    *_dmaTX = q.tx[0];
+    *_dmaRX = q.rx[0];
+    _queue_active = true;
+    _dma_state = DMAState::active;
+    _flexIO->enableDMARequests(SHIFTER_MASK(_rx_shifter) | SHIFTER_MASK(_tx_shifter));
+    _dmaRX->enable();
+    _dmaTX->enable();
+    return true;
+}
+
+void TeensyFlexSPI::finishQueue(void) {
+    IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+    _flexIO->disableDMARequests(SHIFTER_MASK(_rx_shifter) | SHIFTER_MASK(_tx_shifter));
+    _dmaTX->disable();
+    p->TIMCFG[_timer] = _queue_timcfg;
+    p->TIMCMP[_timer] = _queue_timcmp;
+
+    // Put the channels back the way transfer() expects them
+    _dmaTX->disableOnCompletion();
+    _dmaRX->disableOnCompletion();
+    _dmaRX->interruptAtCompletion();
+
+    _queue_active = false;
+    _dma_state = DMAState::completed;
+    _dma_event_responder->triggerEvent(_queue_count, this);
+}
+
+//=============================================================================
+// Target mode
+//=============================================================================
+bool TeensyFlexSPI::beginTarget(int flexio_module, uint8_t dataMode, uint8_t nTransferBits, bool packed24) {
+    if ((_csPin == -1) || !nTransferBits || (nTransferBits > 32))
+        return false;
+    // All but the first word of a transaction come by DMA, MSB first
+    _bitOrder = MSBFIRST;
+    _packed24 = packed24;
+    if (!dmaAligned(nTransferBits, transferBytes(nTransferBits, packed24), true, true))
+        return false;
+
+    _flexIO = new TeensyFlexIO();
+    _flexIO->begin(static_cast<TeensyFlexIO::FlexIOModule>(flexio_module));
+    uint8_t cs_flex_pin = _flexIO->getFlexIOHandler()->mapIOPinToFlexPin(_csPin);
+    if (cs_flex_pin == 0xff)
+        return false;
+
+    // Shift timer and CS release timer
+    _timer = _flexIO->requestTimers(2);
+    _tx_shifter = _flexIO->requestShifter();
+    _rx_shifter = _flexIO->requestShifter(_flexIO->shiftersDMAChannel(_tx_shifter));
+    if (_rx_shifter == 0xff)
+        _rx_shifter = _flexIO->requestShifter();
+
+    if ((_timer == 0xff) || (_tx_shifter == 0xff) || (_rx_shifter == 0xff)) {
+        _flexIO->getFlexIOHandler()->freeTimers(_timer, 2);
+        _timer = 0xff;
+        _flexIO->getFlexIOHandler()->freeShifter(_tx_shifter);
+        _tx_shifter = 0xff;
+        _flexIO->getFlexIOHandler()->freeShifter(_rx_shifter);
+        _rx_shifter = 0xff;
+        #ifdef DEBUG_FlexSPI
+            DEBUG_FlexSPI.println("TeensyFlexSPI - Failed to allocate target timers or shifters");
+        #endif
+        return false;
+    }
+
+    _dataMode = dataMode;
+    _nTransferBits = nTransferBits;
+    _nTransferBytes = transferBytes(_nTransferBits, _packed24);
+    bool cpha = dataMode & 0x04;
+    bool cpol = dataMode & 0x08;
+
+    // CPHA 0: MISO is loaded when CS goes low and changes on the trailing edge.
+    // CPHA 1: it changes on the leading edge, MOSI is sampled on the trailing one.
+    ShifterConfig tx_shifter_config;
+    tx_shifter_config.mode = ShifterMode::Transmit;
+    tx_shifter_config.pinSelect = _misoPin;
+    tx_shifter_config.pinConfig = PinConfig::Output;
+    tx_shifter_config.timerSelect = _timer;
+    tx_shifter_config.timerPolarity = cpha ? TimerPolarity::ActiveHigh : TimerPolarity::ActiveLow;
+    tx_shifter_config.startBit = cpha ? 1 : 0;
+    _flexIO->configureShifter(_tx_shifter, tx_shifter_config);
+
+    ShifterConfig rx_shifter_config;
+    rx_shifter_config.mode = ShifterMode::Receive;
+    rx_shifter_config.pinSelect = _mosiPin;
+    rx_shifter_config.timerSelect = _timer;
+    rx_shifter_config.timerPolarity = cpha ? TimerPolarity::ActiveLow : TimerPolarity::ActiveHigh;
+    _flexIO->configureShifter(_rx_shifter, rx_shifter_config);
+
+    // Counts SCK edges while CS is low
+    TimerConfig timer_config;
+    timer_config.mode = TimerMode::SingleCounter;
+    timer_config.pinSelect = _sckPin;
+    timer_config.pinPolarity = cpol ? PinPolarity::ActiveLow : PinPolarity::ActiveHigh;
+    timer_config.pinConfig = PinConfig::Disabled;
+    timer_config.triggerSelect = _flexIO->calculateTriggerSelect(TriggerType::PIN, cs_flex_pin);
+    timer_config.triggerPolarity = TriggerPolarity::ActiveLow;
+    timer_config.triggerSource = TriggerSource::Internal;
+    timer_config.timerEnable = TimerEnable::TriggerHigh;
+    timer_config.timerDisable = TimerDisable::TriggerFallingEdge; // CS going high
+    timer_config.timerReset = TimerReset::Never;
+    timer_config.timerDecrement = TimerDecrement::PinInput;
+    timer_config.timerOutput = TimerOutput::Zero;
+    timer_config.startBit = cpha ? 1 : 0;
+    _flexIO->configureTimer(_timer, timer_config);
+    _flexIO->getFlexIO()->TIMCMP[_timer] = _nTransferBits * 2 - 1;
+
+    // One tick after CS goes high: end of transaction
+    TimerConfig cs_config;
+    cs_config.mode = TimerMode::SingleCounter;
+    cs_config.pinConfig = PinConfig::Disabled;
+    cs_config.triggerSelect = _flexIO->calculateTriggerSelect(TriggerType::PIN, cs_flex_pin);
+    cs_config.triggerPolarity = TriggerPolarity::ActiveHigh;
+    cs_config.triggerSource = TriggerSource::Internal;
+    cs_config.timerEnable = TimerEnable::TriggerRising;
+    cs_config.timerDisable = TimerDisable::OnCompare;
+    cs_config.timerReset = TimerReset::Never;
+    cs_config.timerDecrement = TimerDecrement::FlexIOClock;
+    cs_config.timerOutput = TimerOutput::One;
+    _flexIO->configureTimer(_timer + 1, cs_config);
+    _flexIO->getFlexIO()->TIMCMP[_timer + 1] = 0;
+
+    _flexIO->enable();
+
+    _flexIO->setPinFlexioMode(_mosiPin);
+    _flexIO->setPinFlexioMode(_sckPin);
+    _flexIO->setPinFlexioMode(_misoPin);
+    _flexIO->setPinFlexioMode(_csPin);
+    _flexIO->setPinParameters(_mosiPin, PullUp::DISABLED, 7, 3);
+    _flexIO->setPinParameters(_sckPin, PullUp::DISABLED, 7, 3);
+    _flexIO->setPinParameters(_misoPin, PullUp::DISABLED, 7, 3);
+    _flexIO->setPinParameters(_csPin, PullUp::PULLUP_22K, 7, 3);
+
+    selectShiftBufRegs(_bitOrder, _nTransferBytes, _shiftBufOutReg, _shiftBufInReg);
+
+    if (!initDMAChannels())
+        return false;
+    // Everything is handled when CS goes high
+    dontInterruptAtCompletion(_dmaRX);
+
+    _target = true;
+    _target_armed.count = 0;
+    _target_next.count = 0;
+    _flexIO->getFlexIOHandler()->addIOHandlerCallback(this);
+    _flexIO->clearTimerStatus(_timer + 1);
+    _flexIO->enableTimerInterrupt(_timer + 1);
+    return true;
+}
+
+bool TeensyFlexSPI::setTargetBuffers(const void *txBuffer, void *rxBuffer, size_t count, EventResponderRef event_responder) {
+    if (!_target || !count || (count > MAX_DMA_COUNT))
+        return false;
+
+    TargetBuffers buffers = {txBuffer, rxBuffer, count, &event_responder};
+    event_responder.clearEvent();
+    bool ok = true;
+    __disable_irq();
+    if (!_target_armed.count)
+        armTarget(buffers);
+    else if (!_target_next.count)
+        _target_next = buffers;
+    else
+        ok = false;
+    __enable_irq();
+    return ok;
+}
+
+//-------------------------------------------------------------------------
+// Called between transactions (CS high)
+//-------------------------------------------------------------------------
+void TeensyFlexSPI::armTarget(const TargetBuffers &buffers) {
+    IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+    _target_armed = buffers;
+    size_t bytes = buffers.count * _nTransferBytes;
+
+    // Drop what the last transaction left in the receive buffer
+    (void)p->SHIFTBUF[_rx_shifter];
+    p->SHIFTERR = SHIFTER_MASK(_rx_shifter) | SHIFTER_MASK(_tx_shifter);
+
+    // The first word goes straight into SHIFTBUF, replacing any word prefetched
+    // for the last transaction. DMA follows with the rest.
+    const uint8_t *tx = (const uint8_t *)buffers.tx;
+    if (tx) {
+        if ((uint32_t)tx >= 0x20200000u)
+            arm_dcache_flush((void *)tx, bytes);
+        setShiftBufferOut(tx, _nTransferBits, _nTransferBytes);
+    } else {
+        setShiftBufferOut(_transferWriteFill, _nTransferBits);
+    }
+    if (buffers.count > 1)
+        setupTxDMA(*_dmaTX, tx ? tx + _nTransferBytes : nullptr, buffers.count - 1, _shiftBufOutReg, _nTransferBytes);
+
+    if (buffers.rx && ((uint32_t)buffers.rx >= 0x20200000u))
+        arm_dcache_delete(buffers.rx, bytes);
+    setupRxDMA(*_dmaRX, buffers.rx, buffers.count, _shiftBufInReg, _nTransferBytes);
+
+    _dmaRX->enable();
+    if (buffers.count > 1) {
+        _dmaTX->enable();
+        _flexIO->enableDMARequests(SHIFTER_MASK(_rx_shifter) | SHIFTER_MASK(_tx_shifter));
+    } else {
+        _flexIO->enableDMARequests(SHIFTER_MASK(_rx_shifter));
+    }
+}
+
+void TeensyFlexSPI::targetEnd(void) {
+    IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+    _flexIO->disableDMARequests(SHIFTER_MASK(_rx_shifter) | SHIFTER_MASK(_tx_shifter));
+    _dmaTX->disable();
+    _dmaRX->disable();
+
+    // Words clocked with no buffer behind them
+    uint32_t errors = p->SHIFTERR & (SHIFTER_MASK(_rx_shifter) | SHIFTER_MASK(_tx_shifter));
+    p->SHIFTERR = errors;
+    if (errors & SHIFTER_MASK(_rx_shifter))
+        _target_overruns = _target_overruns + 1;
+    if (errors & SHIFTER_MASK(_tx_shifter))
+        _target_underruns = _target_underruns + 1;
+
+    if (_target_armed.count) {
+        uint32_t received;
+        if (_dmaRX->complete()) {
+            received = _target_armed.count;
+            _dmaRX->clearComplete();
+            // More words than the buffer holds
+            if (p->SHIFTSTAT & SHIFTER_MASK(_rx_shifter))
+                _target_overruns = _target_overruns + 1;
+        } else {
+            received = _dmaRX->TCD->BITER - _dmaRX->TCD->CITER;
+        }
+        _dmaTX->clearComplete();
+        if (_target_armed.rx && ((uint32_t)_target_armed.rx >= 0x20200000u))
+            arm_dcache_delete(_target_armed.rx, _target_armed.count * _nTransferBytes);
+
+        EventResponder *event_responder = _target_armed.event_responder;
+        _target_armed.count = 0;
+        if (_target_next.count) {
+            armTarget(_target_next);
+            _target_next.count = 0;
+        }
+        event_responder->triggerEvent(received, this);
+    } else if (_target_next.count) {
+        armTarget(_target_next);
+        _target_next.count = 0;
+    }
+}
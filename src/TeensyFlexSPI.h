@@ -3,6 +3,9 @@
  */
 
 #include "TeensyFlexIO.h"
+#include "TeensyFlexCoroutine.h"
+#include "TeensyFlexDMABuffer.h"
+#include "TeensyFlexDMADispatch.h"
 #include <Arduino.h>
 #include <DMAChannel.h>
 #include <EventResponder.h>
@@ -30,25 +33,90 @@
 #endif
 #define SPI_MODE_TRANSMIT_ONLY 0x80 // Hack to allow higher speeds when transmit only
 
-// Pretty stupid settings for now...
+class TeensyFlexSPI;
+
+#if defined(__cpp_impl_coroutine)
+// co_await spi.transferAsync(tx, rx, count) - true once the DMA transfer is
+// done, false if it could not be started
+class TeensyFlexSPITransfer {
+  public:
+    TeensyFlexSPITransfer(TeensyFlexSPI &spi, const void *txBuffer, void *rxBuffer, size_t count)
+        : _spi(spi), _txBuffer(txBuffer), _rxBuffer(rxBuffer), _count(count) {}
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle);
+    bool await_resume() const noexcept { return _started; }
+
+  private:
+    static void transferDone(EventResponderRef event_responder);
+
+    TeensyFlexSPI &_spi;
+    const void *_txBuffer;
+    void *_rxBuffer;
+    size_t _count;
+    bool _started = false;
+    EventResponder _event;
+    TeensyFlexCompletion _completion;
+};
+#endif
+
+// Transaction settings. resolve() works out the register image for one
+// TeensyFlexSPI object once (divider, TIMCMP, shift buffer registers), so
+// beginTransaction() only has to store it. Resolve again after the FlexIO clock
+// changes.
 class TeensyFlexSPISettings {
   public:
     TeensyFlexSPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) : _clock(clock),
                                                                             _bitOrder(bitOrder), _dataMode(dataMode), _nTransferBits(DEFAULT_TRANSFER_BITS){};
 
-    TeensyFlexSPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode, uint8_t nTransBits) : _clock(clock),
-                                                                                                _bitOrder(bitOrder), _dataMode(dataMode), _nTransferBits(nTransBits){};
+    // packed24: 17-24 bit words take 3 bytes in memory instead of a uint32_t
+    TeensyFlexSPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode, uint8_t nTransBits, bool packed24 = false) : _clock(clock),
+                                                                                                _bitOrder(bitOrder), _dataMode(dataMode), _nTransferBits(nTransBits), _packed24(packed24){};
+
+    bool resolve(TeensyFlexSPI &spi);
+    bool resolvedFor(const TeensyFlexSPI &spi) const { return _spi == &spi; }
+    // SCK frequency the resolved divider gives
+    uint32_t achievedClock() const { return _achievedClock; }
 
     uint32_t _clock;
     uint8_t _bitOrder;
     uint8_t _dataMode;
     uint8_t _nTransferBits;
+    bool _packed24 = false;
+
+    // Resolved image
+    const TeensyFlexSPI *_spi = nullptr;
+    uint32_t _timcmp = 0;
+    uint32_t _achievedClock = 0;
+    uint8_t _nTransferBytes = DEFAULT_TRANSFER_BYTES;
+    volatile uint8_t *_shiftBufOutReg = nullptr;
+    volatile uint8_t *_shiftBufInReg = nullptr;
+};
+
+// One entry of a TeensyFlexSPI command queue. Every command is a frame with the
+// hardware CS asserted for all of its words.
+struct TeensyFlexSPICommand {
+    const void *txBuffer = nullptr; ///< nullptr sends the write fill
+    void *rxBuffer = nullptr;       ///< nullptr discards what comes back
+    uint16_t count = 0;             ///< words
+    uint8_t nTransferBits = DEFAULT_TRANSFER_BITS;
+    bool setupBit = true;           ///< one SCK period from CS to the first edge
+    bool holdBit = true;            ///< one SCK period from the last edge to CS release
+    uint16_t gapNs = 0;             ///< extra CS high time before the next command (approximate)
 };
 
 class TeensyFlexSPI : public FlexIOHandlerCallback {
   public:
     enum { TX_BUFFER_SIZE = 64,
-           RX_BUFFER_SIZE = 40 };
+           RX_BUFFER_SIZE = 40,
+           MAX_QUEUE = 16,
+           DEFAULT_POLL_TIMEOUT_US = 1000 };
+
+    // Result of the polled transfers
+    enum Status { OK = 0,
+                  Timeout, // a shifter did not become ready within the poll timeout
+                  Overrun  // a received word was overwritten before it was read
+    };
     TeensyFlexSPI(int mosiPin, int misoPin, int sckPin, int csPin = -1) : _mosiPin(mosiPin), _sckPin(sckPin), _misoPin(misoPin), _csPin(csPin){};
 
     ~TeensyFlexSPI() { end(); }
@@ -60,24 +128,70 @@ class TeensyFlexSPI : public FlexIOHandlerCallback {
     uint32_t transfer32(uint32_t w) { return (uint32_t)transferNBits(w, sizeof(w) * 8); }           // transfer 4 bytes
     uint32_t transferNBits(uint32_t w_out, uint8_t nbits);                                          // transfer arbitrary number of bits up to 32
 
+    // The polled transfers give up when a shifter is not ready within this time
+    // (per word) and report it in status(). transferNBits returns 0xff then.
+    void setPollTimeout(uint32_t us);
+    // Called while a polled transfer waits, for cooperative schedulers. Words can
+    // be lost if it runs longer than a word time, which shows up as Overrun.
+    void setYieldCallback(void (*callback)(void *context), void *context = nullptr) {
+        _yield_callback = callback;
+        _yield_context = context;
+    }
+    Status status() { return _status; }
+
     void setShiftBufferOut(uint32_t val, uint8_t nbits);
     void setShiftBufferOut(const void *buf, uint8_t nbits, size_t dtype_size);
     uint32_t getShiftBufferIn(uint8_t nbits);
     void getShiftBufferIn(void *retbuf, uint8_t nbits, size_t dtype_size);
 
-    void inline transfer(void *buf, size_t count) { transfer(buf, buf, count); }
+    Status inline transfer(void *buf, size_t count) { return transfer(buf, buf, count); }
     void setTransferWriteFill(uint8_t ch) { _transferWriteFill = ch; }
-    void transfer(const void *buf, void *retbuf, size_t count) { transferBufferNBits(buf, retbuf, count, 0); } // 0 on nbits implies use object state
-    void transferBufferNBits(const void *buf, void *retbuf, size_t count, uint8_t nbits);
+    Status transfer(const void *buf, void *retbuf, size_t count) { return transferBufferNBits(buf, retbuf, count, 0); } // 0 on nbits implies use object state
+    Status transferBufferNBits(const void *buf, void *retbuf, size_t count, uint8_t nbits);
 
+    // Words are 1, 2 or 4 bytes in memory, right aligned like the polled
+    // transfers. With packed24 in the settings 17-24 bit words take 3 bytes
+    // (little endian), so a packed 12 bit stream is 24 bit words holding two
+    // samples each. DMA moves whole bytes, so words that don't fill theirs
+    // (e.g. 12 bits, or 24 bits unpacked) are sent polled before this returns
+    // when they are written MSBFIRST or read LSBFIRST.
     bool transfer(const void *txBuffer, void *rxBuffer, size_t count, EventResponderRef event_responder);
+    // Same with buffers that track their own cache state: DTCM buffers get no
+    // maintenance and a transmit buffer is only flushed after a write().
+    // Either may be nullptr. Returns false for buffers that are too small or not
+    // cache line aligned.
+    bool transferBuffers(TeensyFlexDMABuffer *txBuffer, TeensyFlexDMABuffer *rxBuffer, size_t count, EventResponderRef event_responder);
+#if defined(__cpp_impl_coroutine)
+    TeensyFlexSPITransfer transferAsync(const void *txBuffer, void *rxBuffer, size_t count) {
+        return TeensyFlexSPITransfer(*this, txBuffer, rxBuffer, count);
+    }
+#endif
+
+    // Run up to MAX_QUEUE commands back to back without the CPU (needs csPin).
+    // Uses the clock and bit order of the current transaction, no packed 17-24 bit words and none of the
+    // combinations transfer() has to send polled. The event status is the number of commands run.
+    bool queue(const TeensyFlexSPICommand *commands, uint8_t count, EventResponderRef event_responder);
+    bool queueActive() { return _queue_active; }
 
-    static void _dma_rxISR0(void);
-    static void _dma_rxISR1(void);
     inline void dma_rxisr(void);
 
-    void beginTransaction(TeensyFlexSPISettings settings);
+    // Target (slave) mode: SCK, MOSI and CS are inputs, MISO is an output. Needs csPin.
+    // The FlexIO clock has to be about 4x SCK or more.
+    // Words have to fill their bytes (8, 16, 32 or, packed24, 24 bits).
+    bool beginTarget(int flexio_module, uint8_t dataMode = SPI_MODE0, uint8_t nTransferBits = DEFAULT_TRANSFER_BITS,
+                     bool packed24 = false);
+    // Buffers for a transaction, in words. While one set is armed the next can be
+    // queued; they are swapped when CS goes high. The event status is the number
+    // of words received.
+    bool setTargetBuffers(const void *txBuffer, void *rxBuffer, size_t count, EventResponderRef event_responder);
+    bool targetArmed() { return _target_armed.count != 0; }
+    uint32_t targetOverruns() { return _target_overruns; }
+    uint32_t targetUnderruns() { return _target_underruns; }
+
+    void beginTransaction(const TeensyFlexSPISettings &settings);
     void endTransaction(void);
+    // SCK frequency of the current transaction
+    uint32_t achievedClock() { return _achievedClock; }
 
     FlexIOHandler *flexIOHandler() { return _flexIO->getFlexIOHandler(); }
 
@@ -85,6 +199,8 @@ class TeensyFlexSPI : public FlexIOHandlerCallback {
     virtual bool call_back(FlexIOHandler *pflex);
 
   private:
+    friend class TeensyFlexSPISettings;
+
     int _mosiPin;
     int _sckPin;
     int _misoPin;
@@ -95,20 +211,38 @@ class TeensyFlexSPI : public FlexIOHandlerCallback {
     uint8_t _transferWriteFill = 0;
     uint8_t _in_transaction_flag = 0;
 
+    // Polled transfers
+    Status _status = OK;
+    uint32_t _poll_timeout_us = DEFAULT_POLL_TIMEOUT_US;
+    uint32_t _poll_timeout_cycles = DEFAULT_POLL_TIMEOUT_US * 600;
+    void (*_yield_callback)(void *context) = nullptr;
+    void *_yield_context = nullptr;
+    bool waitShifter(uint8_t shifter);
+
     uint32_t _clock = 0;
+    uint32_t _achievedClock = 0;
     uint8_t _bitOrder = MSBFIRST;
     uint8_t _dataMode = SPI_MODE0;
     uint8_t _nTransferBits = DEFAULT_TRANSFER_BITS;
     uint8_t _nTransferBytes = DEFAULT_TRANSFER_BYTES; // Calculated during beginTransaction from _nTransferBits, used for DMA transfers
-    volatile uint32_t *_shiftBufInReg = nullptr;
-    volatile uint32_t *_shiftBufOutReg = nullptr;
+    bool _packed24 = false;
+    volatile uint8_t *_shiftBufInReg = nullptr; // byte lane the DMA reads or writes for the current word size
+    volatile uint8_t *_shiftBufOutReg = nullptr;
 
     uint8_t _timer = 0xff;
     uint8_t _tx_shifter = 0xff;
     uint8_t _rx_shifter = 0xff;
 
+    uint32_t computeTimcmp(uint32_t clock, uint8_t dataMode, uint8_t nTransferBits, uint32_t &achievedClock);
+    void selectShiftBufRegs(uint8_t bitOrder, uint8_t bytes, volatile uint8_t *&outReg, volatile uint8_t *&inReg);
+    static uint8_t transferBytes(uint8_t nTransferBits, bool packed24 = false);
+    bool dmaAligned(uint8_t nTransferBits, uint8_t bytes, bool tx, bool rx);
+    void setupTxDMA(DMABaseClass &dma, const void *buf, size_t count, volatile uint8_t *reg, uint8_t bytes);
+    void setupRxDMA(DMABaseClass &dma, void *buf, size_t count, volatile uint8_t *reg, uint8_t bytes);
+
     // DMA - Async support
     bool initDMAChannels();
+    bool startDMA(const void *buf, void *retbuf, size_t count, EventResponderRef event_responder);
     enum DMAState { notAllocated,
                     idle,
                     active,
@@ -119,6 +253,30 @@ class TeensyFlexSPI : public FlexIOHandlerCallback {
     DMAChannel *_dmaTX = nullptr;
     DMAChannel *_dmaRX = nullptr;
     EventResponder *_dma_event_responder = nullptr;
-    static TeensyFlexSPI *_dmaActiveObjects[FlexIOHandler::CNT_FLEX_IO_OBJECT];
+
+    // Command queue, a DMA program built by queue()
+    struct QueueProgram;
+    QueueProgram *_queue = nullptr;
+    volatile bool _queue_active = false;
+    uint8_t _queue_count = 0;
+    uint32_t _queue_timcfg = 0;
+    uint32_t _queue_timcmp = 0;
+    void finishQueue(void);
+    void freeQueue(void);
+
+    // Target mode
+    struct TargetBuffers {
+        const void *tx;
+        void *rx;
+        size_t count;
+        EventResponder *event_responder;
+    };
+    bool _target = false;
+    TargetBuffers _target_armed = {};
+    TargetBuffers _target_next = {};
+    volatile uint32_t _target_overruns = 0;
+    volatile uint32_t _target_underruns = 0;
+    void armTarget(const TargetBuffers &buffers);
+    void targetEnd(void);
 };
 #endif //_TEENSY_FLEX_SPI_H_
\ No newline at end of file
@@ -0,0 +1,427 @@
+#include "TeensyFlexSampler.h"
+
+TeensyFlexSampler::TeensyFlexSampler(const uint8_t *pins, uint8_t pinCount) {
+    if (pinCount > MAX_PINS)
+        pinCount = MAX_PINS;
+    _pin_count = pinCount;
+    memcpy(_pins, pins, pinCount);
+
+    // The shifter only supports power of 2 parallel widths
+    while (_width < _pin_count)
+        _width <<= 1;
+    _samples_per_word = 32 / _width;
+}
+
+//=============================================================================
+// TeensyFlexSampler::begin
+//=============================================================================
+bool TeensyFlexSampler::begin(int flexio_module, void *ring, size_t ringBytes) {
+    if (!_pin_count || !ring || ((uint32_t)ring & 3) || (ringBytes < 8) || (ringBytes & 7))
+        return false;
+
+    _ring = (uint32_t *)ring;
+    _ring_words = ringBytes / 4;
+
+    _flexIO = new TeensyFlexIO();
+    _flexIO->begin(static_cast<TeensyFlexIO::FlexIOModule>(flexio_module));
+    _module = flexio_module;
+
+    // Sampled pins have to be consecutive FXIO pins
+    uint8_t first_flex_pin = _flexIO->getFlexIOHandler()->mapIOPinToFlexPin(_pins[0]);
+    if (first_flex_pin == 0xff) {
+        end();
+        return false;
+    }
+    for (uint8_t i = 1; i < _pin_count; i++) {
+        if (_flexIO->getFlexIOHandler()->mapIOPinToFlexPin(_pins[i]) != first_flex_pin + i) {
+            #ifdef DEBUG_FlexSampler
+                DEBUG_FlexSampler.printf("TeensyFlexSampler - pin %d is not FXIO D%d\n", _pins[i], first_flex_pin + i);
+            #endif
+            end();
+            return false;
+        }
+    }
+
+    // Now reserve timers and shifter
+    _sample_timer = _flexIO->requestTimers(1);
+    _trigger_timer = _flexIO->requestTimers(1);
+    _shifter = _flexIO->requestShifter();
+
+    if ((_sample_timer == 0xff) || (_trigger_timer == 0xff) || (_shifter == 0xff)) {
+        #ifdef DEBUG_FlexSampler
+            DEBUG_FlexSampler.println("TeensyFlexSampler - Failed to allocate timers or shifter");
+        #endif
+        end();
+        return false;
+    }
+
+    // Apply a rate asked for before begin, default to the fastest
+    setSampleRate(_requested_rate ? _requested_rate : _flexIO->getFlexIOHandler()->computeClockRate() / 2);
+
+    ShifterConfig shifter_config;
+    shifter_config.mode = ShifterMode::Receive;
+    shifter_config.pinSelect = _pins[0];
+    shifter_config.pinConfig = PinConfig::Disabled;
+    shifter_config.timerSelect = _sample_timer;
+    shifter_config.timerPolarity = TimerPolarity::ActiveHigh;
+    shifter_config.parallelWidth = _width - 1;
+    _flexIO->configureShifter(_shifter, shifter_config);
+
+    // Free running sample clock, one word every _samples_per_word shifts
+    TimerConfig timer_config;
+    timer_config.mode = TimerMode::Baud;
+    timer_config.pinConfig = PinConfig::Disabled;
+    timer_config.timerEnable = TimerEnable::Always;
+    timer_config.timerDisable = TimerDisable::Never;
+    timer_config.timerReset = TimerReset::Never;
+    timer_config.timerDecrement = TimerDecrement::FlexIOClock;
+    timer_config.timerOutput = TimerOutput::One;
+    timer_config.asDual().bits_in_word = _samples_per_word * 2 - 1;
+    timer_config.asDual().baud_rate_div = _baud_div;
+    _flexIO->configureTimer(_sample_timer, timer_config);
+
+    for (uint8_t i = 0; i < _pin_count; i++) {
+        _flexIO->setPinFlexioMode(_pins[i]);
+    }
+
+    _flexIO->enable();
+    _flexIO->getFlexIOHandler()->addIOHandlerCallback(this);
+
+    if (!initDMAChannel()) {
+        end();
+        return false;
+    }
+    measureTriggerLatency();
+    return true;
+}
+
+void TeensyFlexSampler::end(void) {
+    if (!_flexIO)
+        return;
+    if (!_flexIO->getFlexIOHandler()) {
+        delete _flexIO;
+        _flexIO = nullptr;
+        return;
+    }
+    abort();
+    _flexIO->getFlexIOHandler()->removeIOHandlerCallback(this);
+    _flexIO->getFlexIOHandler()->freeTimers(_sample_timer);
+    _sample_timer = 0xff;
+    _flexIO->getFlexIOHandler()->freeTimers(_trigger_timer);
+    _trigger_timer = 0xff;
+    _flexIO->getFlexIOHandler()->freeShifter(_shifter);
+    _shifter = 0xff;
+    if (_dmaRX) {
+        TeensyFlexDMADispatch::detach(_dmaRX->channel);
+        delete _dmaRX;
+        _dmaRX = nullptr;
+    }
+    delete _flexIO;
+    _flexIO = nullptr;
+}
+
+uint32_t TeensyFlexSampler::setSampleRate(uint32_t hz) {
+    if (!hz)
+        return _sample_rate;
+    _requested_rate = hz;
+    // Before begin the FlexIO clock is not known yet, begin applies it
+    if (!_flexIO)
+        return 0;
+    uint32_t clock_speed = _flexIO->getFlexIOHandler()->computeClockRate();
+
+    // One sample per baud period of the timer, 2 * (div + 1) FlexIO clocks
+    uint32_t div = (clock_speed / 2 + hz / 2) / hz;
+    if (div < 1)
+        div = 1;
+    else if (div > 256)
+        div = 256;
+    _baud_div = div - 1;
+    _sample_rate = clock_speed / (2 * div);
+
+    if (_sample_timer != 0xff) {
+        IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+        p->TIMCMP[_sample_timer] = (p->TIMCMP[_sample_timer] & 0xff00) | _baud_div;
+    }
+    return _sample_rate;
+}
+
+bool TeensyFlexSampler::setDepth(uint32_t preSamples, uint32_t postSamples) {
+    // The stop point is only checked on the half/complete DMA interrupts, so
+    // keep half the ring free to absorb the overshoot.
+    if (_ring_words && (preSamples + postSamples + _samples_per_word > maxDepth()))
+        return false;
+    _pre_samples = preSamples;
+    _post_samples = postSamples;
+    return true;
+}
+
+//=========================================================================
+// Init the DMA channel - circular ring, interrupt every half ring
+//=========================================================================
+bool TeensyFlexSampler::initDMAChannel() {
+    _dmaRX = new DMAChannel();
+    if (_dmaRX == nullptr) {
+        #ifdef DEBUG_FlexSampler
+            DEBUG_FlexSampler.println("Failed to allocate DMA RX channel");
+        #endif
+        return false;
+    }
+
+    _dmaRX->disable();
+    _dmaRX->source(_flexIO->getFlexIO()->SHIFTBUF[_shifter]);
+    _dmaRX->destinationBuffer(_ring, _ring_words * 4);
+    _dmaRX->interruptAtHalf();
+    _dmaRX->interruptAtCompletion();
+    _dmaRX->triggerAtHardwareEvent(_flexIO->getFlexIOHandler()->shiftersDMAChannel(_shifter));
+    _dmaRX->attachInterrupt(TeensyFlexDMADispatch::attach(
+        _dmaRX->channel, &TeensyFlexDMADispatch::member<TeensyFlexSampler, &TeensyFlexSampler::dma_rxisr>, this));
+    return true;
+}
+
+//=========================================================================
+// Time the trigger interrupt: an Always condition enables the trigger timer
+// as soon as it is written, call_back() stamps the cycle count when the
+// status gets there. That is how late the ring position is read on a trigger.
+//=========================================================================
+void TeensyFlexSampler::measureTriggerLatency(void) {
+    SamplerTrigger trigger = _trigger;
+    _trigger = SamplerTrigger();
+    _latency_cycles = 0;
+    _latency_start = ARM_DWT_CYCCNT;
+    _timing_latency = true;
+    configureTriggerTimer();
+    // Interrupts off or polled service, nothing to time then
+    while (_timing_latency && ((ARM_DWT_CYCCNT - _latency_start) < (F_CPU_ACTUAL / 10000)))
+        ;
+    __disable_irq();
+    _timing_latency = false;
+    _flexIO->disableTimerInterrupt(_trigger_timer);
+    _flexIO->getFlexIO()->TIMCTL[_trigger_timer] = 0;
+    _flexIO->clearTimerStatus(_trigger_timer);
+    __enable_irq();
+    _trigger = trigger;
+}
+
+uint32_t TeensyFlexSampler::triggerSkew(void) {
+    return (uint32_t)(((uint64_t)_latency_cycles * _sample_rate + F_CPU_ACTUAL - 1) / F_CPU_ACTUAL);
+}
+
+void TeensyFlexSampler::configureTriggerTimer(void) {
+    // Park the timer first so the new enable condition starts from scratch
+    _flexIO->getFlexIO()->TIMCTL[_trigger_timer] = 0;
+
+    TimerConfig timer_config;
+    timer_config.mode = TimerMode::SingleCounter;
+    timer_config.pinConfig = PinConfig::Disabled;
+    timer_config.timerEnable = _trigger.condition;
+    timer_config.timerDisable = TimerDisable::OnCompare;
+    timer_config.timerReset = TimerReset::Never;
+    timer_config.timerDecrement = TimerDecrement::FlexIOClock;
+    timer_config.timerOutput = TimerOutput::One;
+
+    // Only take the pin and the trigger the condition looks at, so the unused
+    // defaults (pin -1, trigger pin 0) don't claim a pin for FlexIO
+    bool uses_pin = false;
+    bool uses_trigger = false;
+    switch (_trigger.condition) {
+    case TimerEnable::TriggerHigh:
+    case TimerEnable::TriggerRising:
+    case TimerEnable::TriggerRisingOrFalling:
+        uses_trigger = true;
+        break;
+    case TimerEnable::PinRising:
+        uses_pin = true;
+        break;
+    case TimerEnable::TriggerHighPinHigh:
+    case TimerEnable::PinRisingTriggerHigh:
+        uses_pin = true;
+        uses_trigger = true;
+        break;
+    default:
+        break;
+    }
+    if (uses_pin && (_trigger.pin >= 0)) {
+        _flexIO->setPinFlexioMode(_trigger.pin);
+        timer_config.pinSelect = _trigger.pin;
+        timer_config.pinPolarity = _trigger.pinPolarity;
+    }
+    if (uses_trigger) {
+        uint8_t trigger_number = _trigger.triggerNumber;
+        if (_trigger.triggerType == TriggerType::PIN) {
+            _flexIO->setPinFlexioMode(trigger_number);
+            trigger_number = _flexIO->getFlexIOHandler()->mapIOPinToFlexPin(trigger_number);
+        }
+        timer_config.triggerSelect = _flexIO->calculateTriggerSelect(_trigger.triggerType, trigger_number);
+        timer_config.triggerPolarity = _trigger.triggerPolarity;
+        timer_config.triggerSource = TriggerSource::Internal;
+    }
+    // Compare of 0 sets the status flag right after the timer enables
+    timer_config.asCounter().compareValue = 0;
+    timer_config.asCounter().reloadValue = 0;
+
+    _flexIO->clearTimerStatus(_trigger_timer);
+    _flexIO->configureTimer(_trigger_timer, timer_config);
+    _flexIO->enableTimerInterrupt(_trigger_timer);
+}
+
+//=========================================================================
+// Arm / abort
+//=========================================================================
+bool TeensyFlexSampler::arm(void) {
+    if (!_dmaRX || (_state == State::Armed) || (_state == State::Triggered))
+        return false;
+
+    if ((uint32_t)_ring >= 0x20200000u)
+        arm_dcache_delete(_ring, _ring_words * 4);
+
+    IMXRT_FLEXIO_t *p = _flexIO->getFlexIO();
+    _dmaRX->disable();
+    _dmaRX->destinationBuffer(_ring, _ring_words * 4);
+    _ring_loops = 0;
+    _window_samples = 0;
+    _compressed_size = 0;
+
+    (void)p->SHIFTBUF[_shifter];
+    p->SHIFTERR = SHIFTER_MASK(_shifter);
+    _state = State::Armed;
+    _flexIO->enableDMARequests(SHIFTER_MASK(_shifter));
+    _dmaRX->enable();
+
+    configureTriggerTimer();
+    return true;
+}
+
+void TeensyFlexSampler::abort(void) {
+    if (!_dmaRX)
+        return;
+    __disable_irq();
+    _dmaRX->disable();
+    _flexIO->disableDMARequests(SHIFTER_MASK(_shifter));
+    _flexIO->disableTimerInterrupt(_trigger_timer);
+    _flexIO->getFlexIO()->TIMCTL[_trigger_timer] = 0;
+    if (_state != State::Done)
+        _state = State::Idle;
+    __enable_irq();
+}
+
+// Loop count and CITER have to agree: when the ring wrapped but the
+// completion interrupt has not counted it yet, CITER is already back at the
+// start. With interrupts off the DONE flag tells, re-read CITER after it.
+uint32_t TeensyFlexSampler::wordsWritten(void) {
+    uint32_t primask;
+    asm volatile("mrs %0, primask" : "=r"(primask)::"memory");
+    __disable_irq();
+    uint32_t loops = _ring_loops;
+    uint32_t citer = _dmaRX->TCD->CITER;
+    if (_dmaRX->complete()) {
+        loops++;
+        citer = _dmaRX->TCD->CITER;
+    }
+    if (!primask)
+        __enable_irq();
+    return loops * _ring_words + (_dmaRX->TCD->BITER - citer);
+}
+
+void TeensyFlexSampler::finishCapture(uint32_t stopWord) {
+    _dmaRX->disable();
+    _flexIO->disableDMARequests(SHIFTER_MASK(_shifter));
+
+    uint32_t trigger_sample = _trigger_word * _samples_per_word;
+
+    // Oldest sample still present in the ring
+    uint32_t oldest = 0;
+    if (stopWord > _ring_words)
+        oldest = (stopWord - _ring_words) * _samples_per_word;
+    uint32_t start = (trigger_sample > _pre_samples) ? trigger_sample - _pre_samples : 0;
+    if (start < oldest)
+        start = oldest;
+
+    _window_start = start;
+    _trigger_index = trigger_sample - start;
+    _window_samples = _trigger_index + _post_samples;
+
+    if ((uint32_t)_ring >= 0x20200000u)
+        arm_dcache_delete(_ring, _ring_words * 4);
+
+    _state = State::Done;
+    if (_done_event_responder)
+        _done_event_responder->triggerEvent(_window_samples, this);
+}
+
+uint8_t TeensyFlexSampler::sample(uint32_t index) {
+    uint32_t abs_index = _window_start + index;
+    uint32_t word = (abs_index / _samples_per_word) % _ring_words;
+    uint8_t shift = (abs_index % _samples_per_word) * _width;
+    return (_ring[word] >> shift) & ((1 << _pin_count) - 1);
+}
+
+//=========================================================================
+// Background compression
+//=========================================================================
+bool TeensyFlexSampler::beginCompress(uint8_t *out, size_t capacity) {
+    if (_state != State::Done)
+        return false;
+    TeensyFlexSampleHeader header;
+    header.channels = _pin_count;
+    header.sampleRate = _sample_rate;
+    header.triggerIndex = _trigger_index;
+    _compress_index = 0;
+    _compressed_size = 0;
+    return _encoder.begin(out, capacity, header);
+}
+
+bool TeensyFlexSampler::compressStep(uint32_t maxSamples) {
+    while (maxSamples-- && (_compress_index < _window_samples)) {
+        if (!_encoder.push(sample(_compress_index++))) {
+            _compress_index = _window_samples; // out of room, give up
+            break;
+        }
+    }
+    if (_compress_index < _window_samples)
+        return false;
+    _compressed_size = _encoder.finish();
+    return true;
+}
+
+//=========================================================================
+// Interrupt handlers
+//=========================================================================
+bool TeensyFlexSampler::call_back(FlexIOHandler *pflex) {
+    if (pflex != _flexIO->getFlexIOHandler())
+        return false;
+
+    if (_timing_latency && (TIME_STAT(*_flexIO) & TIMER_MASK(_trigger_timer))) {
+        _latency_cycles = ARM_DWT_CYCCNT - _latency_start;
+        _timing_latency = false;
+        _flexIO->disableTimerInterrupt(_trigger_timer);
+        _flexIO->clearTimerStatus(_trigger_timer);
+        return false;
+    }
+
+    if ((_state == State::Armed) && (TIME_STAT(*_flexIO) & TIMER_MASK(_trigger_timer))) {
+        _trigger_word = wordsWritten();
+        _flexIO->disableTimerInterrupt(_trigger_timer);
+        _flexIO->clearTimerStatus(_trigger_timer);
+        _state = State::Triggered;
+        if (_post_samples == 0)
+            finishCapture(_trigger_word);
+    }
+    return false;
+}
+
+//-------------------------------------------------------------------------
+// DMA RX ISR - every half ring
+//-------------------------------------------------------------------------
+void TeensyFlexSampler::dma_rxisr(void) {
+    _dmaRX->clearInterrupt();
+    if (_dmaRX->complete()) {
+        _dmaRX->clearComplete();
+        _ring_loops = _ring_loops + 1;
+    }
+
+    if (_state == State::Triggered) {
+        uint32_t stop_word = _trigger_word + (_post_samples + _samples_per_word - 1) / _samples_per_word + 1;
+        if (wordsWritten() >= stop_word)
+            finishCapture(stop_word);
+    }
+}
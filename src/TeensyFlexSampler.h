@@ -0,0 +1,135 @@
+#include "TeensyFlexDMADispatch.h"
+#include "TeensyFlexIO.h"
+#include "TeensyFlexSamplerFormat.h"
+#include <Arduino.h>
+#include <DMAChannel.h>
+#include <EventResponder.h>
+
+#ifndef _TEENSY_FLEX_SAMPLER_H_
+#define _TEENSY_FLEX_SAMPLER_H_
+
+// Trigger for TeensyFlexSampler, built from the FlexIO timer enable conditions.
+// The trigger timer is enabled by 'condition'. Its status interrupt reads the
+// ring position, so the recorded trigger lags the enable by the interrupt
+// latency (see TeensyFlexSampler::triggerSkew()).
+//  - Always: trigger as soon as the sampler is armed
+//  - PinRising / PinRisingTriggerHigh / TriggerHighPinHigh: use 'pin' (any FlexIO pin)
+//  - TriggerHigh / TriggerRising / TriggerRisingOrFalling: use 'triggerType'/'triggerNumber'
+//  - N1Enable: trigger when the timer below the trigger timer enables
+struct SamplerTrigger {
+    TimerEnable condition = TimerEnable::Always;
+    int pin = -1;                                ///< Teensy pin for pin conditions
+    PinPolarity pinPolarity = PinPolarity::ActiveHigh;
+    TriggerType triggerType = TriggerType::PIN;
+    uint8_t triggerNumber = 0;                   ///< Teensy pin, shifter or timer number
+    TriggerPolarity triggerPolarity = TriggerPolarity::ActiveHigh;
+};
+
+// Logic analyzer: samples 1-8 consecutive FXIO pins into a circular DMA ring.
+//
+// A Receive shifter with parallel width 1, 2, 4 or 8 is clocked by a free running
+// Baud timer, so up to half the FlexIO clock can be sampled. A second timer waits
+// for the trigger condition; its status interrupt records the ring position.
+// That position is taken in software, not latched by the hardware: it is late
+// by the interrupt latency and rounded down to a whole shifter word.
+// Pre-trigger depth comes from the ring history, post-trigger depth is counted
+// by the DMA interrupts.
+class TeensyFlexSampler : public FlexIOHandlerCallback {
+  public:
+    enum class State { Idle,
+                       Armed,
+                       Triggered,
+                       Done };
+
+    // pins must map to consecutive FXIO pins, channel 0 first (1 to 8 pins)
+    TeensyFlexSampler(const uint8_t *pins, uint8_t pinCount);
+    ~TeensyFlexSampler() { end(); }
+
+    // ring must be 32 bit aligned and a multiple of 8 bytes
+    bool begin(int flexio_module, void *ring, size_t ringBytes);
+    void end(void);
+
+    // Returns the achieved sample rate. Before begin() the rate is kept and
+    // applied by begin(), this returns 0 then.
+    uint32_t setSampleRate(uint32_t hz);
+    uint32_t sampleRate() { return _sample_rate; }
+    void setTrigger(const SamplerTrigger &trigger) { _trigger = trigger; }
+    // pre + post must fit in half the ring
+    bool setDepth(uint32_t preSamples, uint32_t postSamples);
+    uint32_t maxDepth() { return (_ring_words / 2) * _samples_per_word; }
+
+    bool arm(void);
+    void abort(void);
+    State state() { return _state; }
+    bool isDone() { return _state == State::Done; }
+    void setDoneEvent(EventResponderRef event_responder) { _done_event_responder = &event_responder; }
+
+    // Captured window, valid once done. Sample 0 is the oldest pre-trigger sample.
+    uint32_t sampleCount() { return _window_samples; }
+    uint32_t triggerIndex() { return _trigger_index; }
+    // Samples triggerIndex() can lag the trigger by: the latency from the trigger
+    // timer status to call_back(), timed by begin(). Rounding down to a word can
+    // put triggerIndex() up to 32 / parallel width - 1 samples early instead.
+    // Higher priority interrupts or polled service (TeensyFlexIO::setPolling)
+    // add to it, begin() reports 0 when it could not time the interrupt.
+    uint32_t triggerSkew(void);
+    uint8_t sample(uint32_t index);
+    uint8_t channels() { return _pin_count; }
+
+    // Background RLE pass into the TeensyFlexSamplerFormat export format.
+    // Call compressStep from loop() until it returns true, then use compressedSize().
+    bool beginCompress(uint8_t *out, size_t capacity);
+    bool compressStep(uint32_t maxSamples = 1024);
+    size_t compressedSize() { return _compressed_size; }
+
+    // Call back from flexIO when ISR hapens
+    virtual bool call_back(FlexIOHandler *pflex);
+
+  private:
+    enum { MAX_PINS = 8 };
+    uint8_t _pins[MAX_PINS];
+    uint8_t _pin_count;
+    uint8_t _width = 1;            // bits per sample shifted, 1/2/4/8
+    uint8_t _samples_per_word = 32;
+
+    TeensyFlexIO *_flexIO = nullptr;
+    uint8_t _module = 0xff;
+    uint8_t _sample_timer = 0xff;
+    uint8_t _trigger_timer = 0xff;
+    uint8_t _shifter = 0xff;
+
+    uint32_t *_ring = nullptr;
+    uint32_t _ring_words = 0;
+    uint32_t _sample_rate = 0;
+    uint32_t _requested_rate = 0;
+    uint8_t _baud_div = 0;
+
+    SamplerTrigger _trigger;
+    uint32_t _pre_samples = 0;
+    uint32_t _post_samples = 0;
+
+    volatile State _state = State::Idle;
+    volatile uint32_t _ring_loops = 0;        // completed passes over the ring
+    volatile uint32_t _trigger_word = 0;      // absolute word position of the trigger
+    volatile bool _timing_latency = false;    // begin() is timing the trigger interrupt
+    uint32_t _latency_start = 0;
+    volatile uint32_t _latency_cycles = 0;    // trigger status to call_back(), CPU cycles
+    uint32_t _window_start = 0;               // absolute sample index of sample 0
+    uint32_t _window_samples = 0;
+    uint32_t _trigger_index = 0;
+
+    TeensyFlexSampleEncoder _encoder;
+    uint32_t _compress_index = 0;
+    size_t _compressed_size = 0;
+
+    EventResponder *_done_event_responder = nullptr;
+    DMAChannel *_dmaRX = nullptr;
+
+    bool initDMAChannel();
+    void measureTriggerLatency(void);
+    void configureTriggerTimer(void);
+    uint32_t wordsWritten(void);
+    void finishCapture(uint32_t stopWord);
+    void dma_rxisr(void);
+};
+#endif //_TEENSY_FLEX_SAMPLER_H_
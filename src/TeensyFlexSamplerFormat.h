@@ -0,0 +1,181 @@
+#ifndef _TEENSY_FLEX_SAMPLER_FORMAT_H_
+#define _TEENSY_FLEX_SAMPLER_FORMAT_H_
+
+// Compact binary export format for TeensyFlexSampler captures.
+// tools/flexsampler_vcd.py reads it on the PC.
+//
+// Layout (all multi-byte fields little endian):
+//   0  magic        "FXLA"
+//   4  version      1
+//   5  channels     number of sampled pins (1-8), bit n of a sample is channel n
+//   6  reserved     0
+//   8  sampleRate   samples per second
+//   12 sampleCount  total samples described by the records
+//   16 triggerIndex sample index of the trigger (0 if no pre-trigger data)
+//   20 records...   one byte sample value followed by (run length - 1) as an
+//                   unsigned LEB128 varint
+#include <stddef.h>
+#include <stdint.h>
+
+struct TeensyFlexSampleHeader {
+    static const uint32_t MAGIC = 0x414C5846; // "FXLA"
+    static const uint8_t VERSION = 1;
+    static const size_t SIZE = 20;
+
+    uint8_t channels = 0;
+    uint32_t sampleRate = 0;
+    uint32_t sampleCount = 0;
+    uint32_t triggerIndex = 0;
+};
+
+class TeensyFlexSampleEncoder {
+  public:
+    // Returns false if the output buffer cannot even hold the header
+    bool begin(uint8_t *out, size_t capacity, const TeensyFlexSampleHeader &header) {
+        _out = out;
+        _capacity = capacity;
+        _size = 0;
+        _run = 0;
+        _count = 0;
+        _overflow = false;
+        _header = header;
+        if (capacity < TeensyFlexSampleHeader::SIZE) {
+            _overflow = true;
+            return false;
+        }
+        _size = TeensyFlexSampleHeader::SIZE;
+        return true;
+    }
+
+    // Add one sample. Returns false once the output buffer has overflowed.
+    bool push(uint8_t value) {
+        if (_run && value == _value) {
+            _run++;
+        } else {
+            if (_run)
+                emit();
+            _value = value;
+            _run = 1;
+        }
+        _count++;
+        return !_overflow;
+    }
+
+    // Flush the pending run and write the header. Returns the encoded size or 0 on overflow.
+    size_t finish() {
+        if (_run)
+            emit();
+        _run = 0;
+        if (_overflow)
+            return 0;
+        _header.sampleCount = _count;
+        writeHeader();
+        return _size;
+    }
+
+    size_t size() const { return _size; }
+    uint32_t sampleCount() const { return _count; }
+    bool overflow() const { return _overflow; }
+
+  private:
+    void put(uint8_t b) {
+        if (_size < _capacity)
+            _out[_size++] = b;
+        else
+            _overflow = true;
+    }
+
+    void emit() {
+        put(_value);
+        uint32_t extra = _run - 1;
+        do {
+            uint8_t b = extra & 0x7f;
+            extra >>= 7;
+            put(extra ? (b | 0x80) : b);
+        } while (extra);
+    }
+
+    void put32(size_t offset, uint32_t v) {
+        _out[offset] = v & 0xff;
+        _out[offset + 1] = (v >> 8) & 0xff;
+        _out[offset + 2] = (v >> 16) & 0xff;
+        _out[offset + 3] = (v >> 24) & 0xff;
+    }
+
+    void writeHeader() {
+        put32(0, TeensyFlexSampleHeader::MAGIC);
+        _out[4] = TeensyFlexSampleHeader::VERSION;
+        _out[5] = _header.channels;
+        _out[6] = 0;
+        _out[7] = 0;
+        put32(8, _header.sampleRate);
+        put32(12, _header.sampleCount);
+        put32(16, _header.triggerIndex);
+    }
+
+    uint8_t *_out = nullptr;
+    size_t _capacity = 0;
+    size_t _size = 0;
+    uint8_t _value = 0;
+    uint32_t _run = 0;
+    uint32_t _count = 0;
+    bool _overflow = false;
+    TeensyFlexSampleHeader _header;
+};
+
+class TeensyFlexSampleDecoder {
+  public:
+    // Returns false if the buffer does not start with a valid header
+    bool begin(const uint8_t *in, size_t length) {
+        _in = in;
+        _length = length;
+        _pos = 0;
+        _decoded = 0;
+        if (length < TeensyFlexSampleHeader::SIZE || get32(0) != TeensyFlexSampleHeader::MAGIC ||
+            in[4] != TeensyFlexSampleHeader::VERSION)
+            return false;
+        _header.channels = in[5];
+        _header.sampleRate = get32(8);
+        _header.sampleCount = get32(12);
+        _header.triggerIndex = get32(16);
+        _pos = TeensyFlexSampleHeader::SIZE;
+        return true;
+    }
+
+    // Read the next run. Returns false at the end of data or on a truncated record.
+    bool next(uint8_t &value, uint32_t &run) {
+        if (_pos >= _length || _decoded >= _header.sampleCount)
+            return false;
+        value = _in[_pos++];
+        uint32_t extra = 0;
+        uint8_t shift = 0;
+        while (true) {
+            if (_pos >= _length || shift > 28)
+                return false;
+            uint8_t b = _in[_pos++];
+            extra |= (uint32_t)(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                break;
+            shift += 7;
+        }
+        run = extra + 1;
+        _decoded += run;
+        return true;
+    }
+
+    const TeensyFlexSampleHeader &header() const { return _header; }
+
+  private:
+    uint32_t get32(size_t offset) const {
+        return (uint32_t)_in[offset] | ((uint32_t)_in[offset + 1] << 8) |
+               ((uint32_t)_in[offset + 2] << 16) | ((uint32_t)_in[offset + 3] << 24);
+    }
+
+    const uint8_t *_in = nullptr;
+    size_t _length = 0;
+    size_t _pos = 0;
+    uint32_t _decoded = 0;
+    TeensyFlexSampleHeader _header;
+};
+
+#endif // _TEENSY_FLEX_SAMPLER_FORMAT_H_
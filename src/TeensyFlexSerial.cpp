@@ -114,13 +114,66 @@ void TeensyFlexSerial::begin(uint32_t baud, uint16_t format) {
 }
 
 TeensyFlexSerial::~TeensyFlexSerial() {
-	if (_tx_flexio.isInitialized()) {
-		delete _tx_flexio.getFlexIO();
-        delete _tx_flexio.getFlexIOHandler();
-	}
+    end();
+}
+
+void TeensyFlexSerial::end(void) {
+    flush();
+    disableRS485();
+    disableHalfDuplex();
+    disableMatch();
+
+    if (_tx_flexio.isInitialized()) {
+        __disable_irq();
+        _tx_flexio.disableShifterInterrupt(_tx_shifter);
+        _tx_flexio.disableTimerInterrupt(_tx_timer);
+        _tx_flexio.disableDMARequests(SHIFTER_MASK(_tx_shifter));
+        _write_callback = nullptr;
+        _drain_callback = nullptr;
+        _transmitting = 0;
+        _tx_buffer_head = 0;
+        _tx_buffer_tail = 0;
+        __enable_irq();
+        if (_dmaTX) {
+            _dmaTX->disable();
+            TeensyFlexDMADispatch::detach(_dmaTX->channel);
+            delete _dmaTX;
+            _dmaTX = nullptr;
+        }
+        if (_cts_pin >= 0) {
+            pinMode(_cts_pin, INPUT_DISABLE);
+            _cts_pin = -1;
+        }
+        _tx_flexio.getFlexIOHandler()->removeIOHandlerCallback(this);
+        _tx_flexio.configureTimer(_tx_timer, TimerConfig());
+        _tx_flexio.configureShifter(_tx_shifter, ShifterConfig());
+        _tx_flexio.releaseTimer(_tx_timer);
+        _tx_flexio.releaseShifter(_tx_shifter);
+        pinMode(_tx_pin, INPUT_DISABLE);
+        _tx_flexio = TeensyFlexIO();
+    }
+
     if (_rx_lexio.isInitialized()) {
-        delete _rx_lexio.getFlexIO();
-        delete _rx_lexio.getFlexIOHandler();
+        __disable_irq();
+        _rx_lexio.disableShifterInterrupt(_rx_shifter);
+        _read_callback = nullptr;
+        _receive_handler = nullptr;
+        _rx_buffer_head = 0;
+        _rx_buffer_tail = 0;
+        __enable_irq();
+        if (_rts_pin >= 0) {
+            pinMode(_rts_pin, INPUT_DISABLE);
+            _rts_pin = -1;
+        }
+        // Same module as TX in single wire mode, removing it twice is harmless
+        _rx_lexio.getFlexIOHandler()->removeIOHandlerCallback(this);
+        _rx_lexio.configureTimer(_rx_timer, TimerConfig());
+        _rx_lexio.configureShifter(_rx_shifter, ShifterConfig());
+        _rx_lexio.releaseTimer(_rx_timer);
+        _rx_lexio.releaseShifter(_rx_shifter);
+        if (_rx_pin != _tx_pin)
+            pinMode(_rx_pin, INPUT_DISABLE);
+        _rx_lexio = TeensyFlexIO();
     }
 }
 
@@ -136,8 +189,103 @@ void TeensyFlexSerial::flush(void) {
 }
 
 
+// In match mode the DMA destination is the head of the ring. The DMA does not
+// stop at the tail: when it went past it since the last look, the oldest bytes
+// are gone, keep the newest RX_BUFFER_SIZE - 1. The DMA interrupt makes sure
+// there is a look at least every RX_BUFFER_SIZE / 2 bytes.
+void TeensyFlexSerial::updateRxHead() {
+    if (!_dmaRX) return;
+    uint32_t primask;
+    asm volatile("mrs %0, primask" : "=r"(primask)::"memory");
+    __disable_irq();
+    uint32_t head = (uint8_t *)_dmaRX->destinationAddress() - _rx_buffer;
+    if (head >= RX_BUFFER_SIZE) head = 0;
+    if ((uint32_t)_rx_buffer >= 0x20200000u)
+        arm_dcache_delete(_rx_buffer, RX_BUFFER_SIZE);
+    uint32_t old_head = _rx_buffer_head;
+    uint32_t tail = _rx_buffer_tail;
+    uint32_t level = (old_head + RX_BUFFER_SIZE - tail) % RX_BUFFER_SIZE;
+    uint32_t moved = (head + RX_BUFFER_SIZE - old_head) % RX_BUFFER_SIZE;
+    if (level + moved >= RX_BUFFER_SIZE) {
+        _rx_overruns = _rx_overruns + 1;
+        tail = (head + 1) % RX_BUFFER_SIZE;
+        _rx_buffer_tail = tail;
+        _match_scan = tail;
+        _match_check = tail;
+    }
+    _rx_buffer_head = head;
+    updateRts();
+    if (!primask) __enable_irq();
+}
+
+// Match interrupt or DMA progress: signal when a match character has landed
+// in the ring. The match shifter can see it while the DMA request for it is
+// still pending, wait for that (well under a character time) before looking.
+// A match character found later, by the next look, is signalled then. This
+// also skips false matches from bits of two characters lining up.
+void TeensyFlexSerial::checkMatch(bool wait) {
+    if (wait) {
+        uint32_t start = ARM_DWT_CYCCNT;
+        while ((_rx_lexio.shifterStatus() & SHIFTER_MASK(_rx_shifter)) &&
+               ((ARM_DWT_CYCCNT - start) < (F_CPU_ACTUAL / 1000000)))
+            ;
+    }
+    updateRxHead();
+    uint32_t head = _rx_buffer_head;
+    uint32_t tail = _rx_buffer_tail;
+    uint32_t scan = _match_check;
+    // Restart at the tail if the reader took bytes not checked yet
+    if (((scan + RX_BUFFER_SIZE - tail) % RX_BUFFER_SIZE) > ((head + RX_BUFFER_SIZE - tail) % RX_BUFFER_SIZE))
+        scan = tail;
+    bool found = false;
+    while (scan != head) {
+        uint8_t c = _rx_buffer[scan];
+        if (++scan >= RX_BUFFER_SIZE) scan = 0;
+        if (!((c ^ _match_value) & _match_mask))
+            found = true;
+    }
+    _match_check = scan;
+    // A receive handler gets everything that landed, so its messages can be
+    // longer than the ring
+    if (_receive_handler)
+        feedReceiveHandler();
+    if (!found)
+        return;
+    _matches = _matches + 1;
+    if (_match_event)
+        _match_event->triggerEvent(_matches, this);
+}
+
+void TeensyFlexSerial::dma_rxisr(void) {
+    _dmaRX->clearInterrupt();
+    checkMatch(false);
+    asm volatile("dsb");
+}
+
+// Called from the main loop and the RX interrupts, the watermark state and
+// the pin have to change together
+void TeensyFlexSerial::updateRts() {
+    if (_rts_pin < 0) return;
+    uint32_t primask;
+    asm volatile("mrs %0, primask" : "=r"(primask)::"memory");
+    __disable_irq();
+    uint32_t head = _rx_buffer_head;
+    uint32_t tail = _rx_buffer_tail;
+    uint16_t level = (head >= tail) ? head - tail : RX_BUFFER_SIZE - tail + head;
+    digitalWriteFast(_rts_pin, _rts_watermark.update(level) ? LOW : HIGH);
+    if (!primask) __enable_irq();
+}
+
+// Match mode: the ring is circular (destination modulo), the DMA interrupts
+// after every segment. Half a ring catches overruns, with RTS the level is
+// looked at more often so RTS drops close to the high watermark.
+void TeensyFlexSerial::setMatchSegment(void) {
+    _dmaRX->transferCount((_rts_pin >= 0) ? RX_BUFFER_SIZE / 8 : RX_BUFFER_SIZE / 2);
+}
+
 int TeensyFlexSerial::available(void) {
     if(!_rx_lexio.isInitialized()) return -1;
+    updateRxHead();
 
 	uint32_t head, tail;
 
@@ -150,17 +298,22 @@ int TeensyFlexSerial::available(void) {
 
 int TeensyFlexSerial::peek(void) {
     if(!_rx_lexio.isInitialized()) return -1;
+    updateRxHead();
 	if (_rx_buffer_head == _rx_buffer_tail) return -1;
 	return _rx_buffer[_rx_buffer_tail] ;
 }
 
 int TeensyFlexSerial::read(void) {
     if(!_rx_lexio.isInitialized()) return -1;
+    updateRxHead();
 	int return_value = -1;
 	if (_rx_buffer_head != _rx_buffer_tail) {
-		return_value = _rx_buffer[_rx_buffer_tail++] ;
-		if (_rx_buffer_tail >= RX_BUFFER_SIZE) 
-			_rx_buffer_tail = 0;
+		uint32_t tail = _rx_buffer_tail;
+		return_value = _rx_buffer[tail++] ;
+		if (tail >= RX_BUFFER_SIZE) 
+			tail = 0;
+		_rx_buffer_tail = tail;
+		updateRts();
 	}
 
 	return return_value;
@@ -183,32 +336,56 @@ int TeensyFlexSerial::availableForWrite(void) {
 bool TeensyFlexSerial::call_back(FlexIOHandler *pflex) {
     if(pflex == _rx_lexio.getFlexIOHandler()){
         // Serial.printf("RX callback\n");
-        if (SHIFT_STAT(_rx_lexio) & SHIFTER_MASK(_rx_shifter)) {
+        if ((_match_shifter >= 0) && (_rx_lexio.shifterStatus() & SHIFTER_MASK(_match_shifter))) {
+            _rx_lexio.clearShifterStatus(_match_shifter);
+            checkMatch(true);
+        }
+        // In match mode the DMA takes the bytes
+        if ((_rx_lexio.shifterStatus() & SHIFTER_MASK(_rx_shifter)) && _rx_lexio.shifterInterruptEnabled(_rx_shifter)) {
   			uint8_t c = _rx_lexio.getFlexIOHandler()->port().SHIFTBUFBYS[_rx_shifter] & 0xff;
-			uint32_t head;
-			head = _rx_buffer_head;
-			if (++head >= RX_BUFFER_SIZE) head = 0;
-			// don't save char if buffer is full...
-			if (_rx_buffer_tail != head) {
-				_rx_buffer[_rx_buffer_head] = c;
-				_rx_buffer_head = head;
+			if (_read_callback) {
+				// readAsync waiting: straight into its buffer
+				size_t done = _read_done;
+				_read_buffer[done++] = c;
+				_read_done = done;
+				if (done == _read_count) {
+					void (*callback)(void *, size_t) = _read_callback;
+					_read_callback = nullptr;
+					callback(_read_context, done);
+				}
+			} else if (_receive_handler) {
+				_receive_handler(_receive_context, c);
+			} else {
+				uint32_t head;
+				head = _rx_buffer_head;
+				if (++head >= RX_BUFFER_SIZE) head = 0;
+				// don't save char if buffer is full...
+				if (_rx_buffer_tail != head) {
+					_rx_buffer[_rx_buffer_head] = c;
+					_rx_buffer_head = head;
+				}
+				updateRts();
 			}
 		}
     }
 
     if(pflex == _tx_flexio.getFlexIOHandler()){
         // Check if shifter is ready and interrupt is enabled
-        if ((SHIFT_STAT(_tx_flexio) & SHIFTER_MASK(_tx_shifter)) && (SHIFT_SIEN(_tx_flexio) & SHIFTER_MASK(_tx_shifter))) {
+        if ((_tx_flexio.shifterStatus() & SHIFTER_MASK(_tx_shifter)) && _tx_flexio.shifterInterruptEnabled(_tx_shifter)) {
             if (_tx_buffer_head != _tx_buffer_tail) {
                 // Write next byte from buffer to shifter
-                SHIFT_BUFFER(_tx_flexio, _tx_shifter) = _tx_buffer[_tx_buffer_tail++];
-                if (_tx_buffer_tail >= TX_BUFFER_SIZE) {
-                    _tx_buffer_tail = 0;
+                uint32_t tail = _tx_buffer_tail;
+                SHIFT_BUFFER(_tx_flexio, _tx_shifter) = _tx_buffer[tail++];
+                if (tail >= TX_BUFFER_SIZE) {
+                    tail = 0;
                 }
+                _tx_buffer_tail = tail;
+                _tx_service_stats[_tx_flexio.polling()].mark(ARM_DWT_CYCCNT);
             }
             
             // If buffer is empty, disable shifter interrupt and enable timer
             if (_tx_buffer_head == _tx_buffer_tail) {
+                _tx_service_stats[_tx_flexio.polling()].restart();
                 __disable_irq();
                 asm volatile("dsb");
                 _tx_flexio.disableShifterInterrupt(_tx_shifter);
@@ -220,14 +397,19 @@ bool TeensyFlexSerial::call_back(FlexIOHandler *pflex) {
         }
         
         // Handle timer interrupt (transmission complete)
-        if (TIME_IEN(_tx_flexio) & TIME_STAT(_tx_flexio) & TIMER_MASK(_tx_timer)) {
+        if (_tx_flexio.timerInterruptEnabled(_tx_timer) && (_tx_flexio.timerStatus() & TIMER_MASK(_tx_timer))) {
             __disable_irq();
             asm volatile("dsb");
             if (_transmitting >= 2) {
                 _tx_flexio.disableTimerInterrupt(_tx_timer);
                 _transmitting = 0;
+                if (_drain_callback) {
+                    void (*callback)(void *, size_t) = _drain_callback;
+                    _drain_callback = nullptr;
+                    callback(_drain_context, 0);
+                }
             } else {
-                _transmitting++;
+                _transmitting = _transmitting + 1;
             }
             _tx_flexio.clearTimerStatus(_tx_timer);
             asm volatile("dsb");
@@ -260,25 +442,634 @@ size_t TeensyFlexSerial::write(uint8_t c) {
 
     // Wait if buffer is full
     while (_tx_buffer_tail == head) {
-        Serial.printf("Buffer full, waiting... (head=%d, tail=%d)\n", head, _tx_buffer_tail);
         yield();
     }
 
     // Store character and update state
     _tx_buffer[_tx_buffer_head] = c;
+    startTransmit(head);
+    return 1;
+}
+
+uint8_t *TeensyFlexSerial::reserveWrite(size_t &length) {
+    length = 0;
+    if (!_tx_flexio.isInitialized())
+        return nullptr;
+    uint32_t head = _tx_buffer_head;
+    uint32_t tail = _tx_buffer_tail;
+    // One place stays free, head == tail is empty
+    if (tail > head)
+        length = tail - head - 1;
+    else
+        length = TX_BUFFER_SIZE - head - (tail == 0 ? 1 : 0);
+    return length ? &_tx_buffer[head] : nullptr;
+}
+
+void TeensyFlexSerial::commitWrite(size_t count) {
+    if (!count)
+        return;
+    uint32_t head = _tx_buffer_head + count;
+    if (head >= TX_BUFFER_SIZE)
+        head -= TX_BUFFER_SIZE;
+    startTransmit(head);
+}
+
+// Publish the new head and get the ISR going
+void TeensyFlexSerial::startTransmit(uint32_t head) {
     __disable_irq();
     asm volatile("dsb");
     _transmitting = 1;
     _tx_buffer_head = head;
     
-    // Enable shifter interrupt
-    uint32_t timer_mask = (1 << _tx_timer);
-    SHIFT_SIEN(_tx_flexio) |= SHIFTER_MASK(_tx_shifter);  // enable interrupt on this shifter
-    TIME_IEN(_tx_flexio) &= ~timer_mask;      // disable timer interrupt
-    TIME_STAT(_tx_flexio) = timer_mask;       // clear timer status
+    // Enable shifter interrupt. Both only reach the bus when they change, so a
+    // burst of writes costs one store. A writeAsync owns the shifter until its
+    // DMA is done, the ring is started from there.
+    if (!_write_callback) {
+        _tx_flexio.enableShifterInterrupt(_tx_shifter);  // enable interrupt on this shifter
+        if (_tx_flexio.timerInterruptEnabled(_tx_timer)) {
+            _tx_flexio.disableTimerInterrupt(_tx_timer);  // disable timer interrupt
+            _tx_flexio.clearTimerStatus(_tx_timer);       // clear timer status
+        }
+    }
     asm volatile("dsb");
     __enable_irq();
-    return 1;
+}
+
+bool TeensyFlexSerial::enableMatch(uint8_t value, uint8_t mask) {
+    if (!_rx_lexio.isInitialized() || _dmaRX)
+        return false;
+    uint8_t dma_source = _rx_lexio.shiftersDMAChannel(_rx_shifter);
+    if (dma_source == 0xff)
+        return false;
+    int8_t shifter = _rx_lexio.requestShifter();
+    if (shifter < 0)
+        return false;
+    _dmaRX = new DMAChannel();
+    if (_dmaRX == nullptr) {
+        _rx_lexio.releaseShifter(shifter);
+        return false;
+    }
+    _match_value = value;
+    _match_mask = mask;
+
+    // Watches the same pin on the same timer as the receive shifter
+    ShifterConfig matchConfig;
+    matchConfig.mode = ShifterMode::MatchContinuous;
+    matchConfig.pinSelect = _rx_pin;
+    matchConfig.pinPolarity = PinPolarity::ActiveHigh;
+    matchConfig.timerPolarity = TimerPolarity::ActiveLow;
+    matchConfig.timerSelect = _rx_timer;
+    _rx_lexio.configureShifter(shifter, matchConfig);
+    // SHIFTBUF[31:16] is compared with the shifter, SHIFTBUF[15:0] masks it
+    // (1 = don't care). After the last data bit the character is in [31:24].
+    // Bits of two characters can line up as a false match, readUntilMatch
+    // checks the stored bytes so that only costs a wakeup.
+    _rx_lexio.writeShifter(shifter, ((uint32_t)value << 24) | ((uint32_t)(uint8_t)~mask << 8) | 0xff);
+
+    _dmaRX->disable();
+    _dmaRX->source(*(volatile uint8_t *)&_rx_lexio.getFlexIO()->SHIFTBUFBYS[_rx_shifter]);
+    _dmaRX->destinationCircular(_rx_buffer, RX_BUFFER_SIZE);
+    setMatchSegment();
+    _dmaRX->triggerAtHardwareEvent(dma_source);
+    _dmaRX->interruptAtCompletion();
+    _dmaRX->attachInterrupt(TeensyFlexDMADispatch::attach(
+        _dmaRX->channel, &TeensyFlexDMADispatch::member<TeensyFlexSerial, &TeensyFlexSerial::dma_rxisr>, this));
+
+    __disable_irq();
+    _rx_lexio.disableShifterInterrupt(_rx_shifter);
+    _rx_buffer_head = 0;
+    _rx_buffer_tail = 0;
+    _match_scan = 0;
+    _match_check = 0;
+    _matches = 0;
+    _rx_overruns = 0;
+    updateRts();
+    (void)_rx_lexio.getFlexIO()->SHIFTBUF[_rx_shifter];
+    _rx_lexio.enableDMARequests(SHIFTER_MASK(_rx_shifter));
+    _dmaRX->enable();
+    _match_shifter = shifter;
+    _rx_lexio.clearShifterStatus(shifter);
+    _rx_lexio.enableShifterInterrupt(shifter);
+    __enable_irq();
+    return true;
+}
+
+void TeensyFlexSerial::disableMatch(void) {
+    if (!_dmaRX)
+        return;
+    __disable_irq();
+    _rx_lexio.disableShifterInterrupt(_match_shifter);
+    _rx_lexio.disableDMARequests(SHIFTER_MASK(_rx_shifter));
+    _dmaRX->disable();
+    updateRxHead();
+    // Back to a byte per interrupt, into the same ring
+    _rx_lexio.enableShifterInterrupt(_rx_shifter);
+    __enable_irq();
+
+    _rx_lexio.configureShifter(_match_shifter, ShifterConfig());
+    _rx_lexio.releaseShifter(_match_shifter);
+    _match_shifter = -1;
+    TeensyFlexDMADispatch::detach(_dmaRX->channel);
+    delete _dmaRX;
+    _dmaRX = nullptr;
+}
+
+size_t TeensyFlexSerial::readUntilMatch(uint8_t *buffer, size_t size) {
+    if (!_rx_lexio.isInitialized() || !size)
+        return 0;
+    updateRxHead();
+    uint16_t head = _rx_buffer_head;
+    uint16_t tail = _rx_buffer_tail;
+    uint16_t pending = (head + RX_BUFFER_SIZE - tail) % RX_BUFFER_SIZE;
+
+    // Carry on where the last call stopped, unless read() took those bytes
+    uint16_t scan = _match_scan;
+    if ((uint16_t)((scan + RX_BUFFER_SIZE - tail) % RX_BUFFER_SIZE) > pending)
+        scan = tail;
+    bool found = false;
+    while (scan != head) {
+        uint8_t c = _rx_buffer[scan];
+        if (++scan >= RX_BUFFER_SIZE) scan = 0;
+        if (!((c ^ _match_value) & _match_mask)) {
+            found = true;
+            break;
+        }
+    }
+    _match_scan = scan;
+
+    size_t length = found ? (scan + RX_BUFFER_SIZE - tail) % RX_BUFFER_SIZE : pending;
+    // No match yet: wait, unless the caller's buffer (or the ring) is full
+    if (!found && (length < size) && (length < RX_BUFFER_SIZE - 1u))
+        return 0;
+    if (length > size)
+        length = size;
+
+    // One piece up to the end of the ring, maybe a second from the start
+    size_t first = RX_BUFFER_SIZE - tail;
+    if (first > length) first = length;
+    memcpy(buffer, &_rx_buffer[tail], first);
+    memcpy(buffer + first, _rx_buffer, length - first);
+    tail = (tail + length) % RX_BUFFER_SIZE;
+    _rx_buffer_tail = tail;
+    _match_scan = tail;
+    updateRts();
+    return length;
+}
+
+// Same divider as begin(), bits_in_word 0xF in the upper byte
+static uint32_t baudCompare(float clock, uint32_t baud) {
+    uint32_t div = roundf(clock / (float)(baud * 2));
+    if (div > 255) div = 255;
+    if (div < 1) div = 1;
+    return 0x0F00 | div;
+}
+
+bool TeensyFlexSerial::setBaud(uint32_t baud) {
+    if (!baud || (!_tx_flexio.isInitialized() && !_rx_lexio.isInitialized()))
+        return false;
+    uint32_t tx_cmp = 0, rx_cmp = 0;
+    if (_tx_flexio.isInitialized()) {
+        tx_cmp = baudCompare(_tx_flexio.getFlexIOHandler()->computeClockRate(), baud);
+        // The RS-485 pre delay has to stay within a character
+        if (tx_cmp && (_de_pre_timer >= 0) && !TeensyFlexRS485Timing::preDelayFits(_de_pre_clocks, tx_cmp))
+            return false;
+    }
+    if (_rx_lexio.isInitialized())
+        rx_cmp = baudCompare(_rx_lexio.getFlexIOHandler()->computeClockRate(), baud);
+    __disable_irq();
+    if (tx_cmp) _tx_flexio.getFlexIO()->TIMCMP[_tx_timer] = tx_cmp;
+    if (rx_cmp) _rx_lexio.getFlexIO()->TIMCMP[_rx_timer] = rx_cmp;
+    updateRS485Timing();
+    __enable_irq();
+    return true;
+}
+
+uint32_t TeensyFlexSerial::autobaud(uint32_t timeoutMs, bool standardRate) {
+    if (!_rx_lexio.isInitialized() || _dmaRX)
+        return 0;
+    IMXRT_FLEXIO_t *port = _rx_lexio.getFlexIO();
+    uint32_t mask = SHIFTER_MASK(_rx_shifter);
+
+    // The registers go back unchanged (readShifterConfig gives FXIO pin numbers)
+    uint32_t shiftcfg = port->SHIFTCFG[_rx_shifter];
+    uint32_t shiftctl = port->SHIFTCTL[_rx_shifter];
+    uint32_t timcfg = port->TIMCFG[_rx_timer];
+    uint32_t timctl = port->TIMCTL[_rx_timer];
+    uint32_t timcmp = port->TIMCMP[_rx_timer];
+    bool rx_interrupt = _rx_lexio.shifterInterruptEnabled(_rx_shifter);
+    _rx_lexio.disableShifterInterrupt(_rx_shifter);
+
+    // One sample per 2 * div FlexIO clocks, about 8 samples per bit at 3 Mbaud
+    const uint32_t SAMPLE_RATE = 24000000;
+    uint32_t clock_speed = _rx_lexio.getFlexIOHandler()->computeClockRate();
+    uint32_t div = (clock_speed / 2 + SAMPLE_RATE / 2) / SAMPLE_RATE;
+    if (div < 1) div = 1;
+    else if (div > 256) div = 256;
+    uint32_t sample_rate = clock_speed / (2 * div);
+
+    ShifterConfig sampleConfig;
+    sampleConfig.mode = ShifterMode::Receive;
+    sampleConfig.pinSelect = _rx_pin;
+    sampleConfig.timerSelect = _rx_timer;
+    sampleConfig.timerPolarity = TimerPolarity::ActiveHigh;
+    sampleConfig.parallelWidth = 0;
+    _rx_lexio.configureShifter(_rx_shifter, sampleConfig);
+
+    TimerConfig timerConfig;
+    timerConfig.mode = TimerMode::Baud;
+    timerConfig.timerEnable = TimerEnable::Always;
+    timerConfig.timerDisable = TimerDisable::Never;
+    timerConfig.timerReset = TimerReset::Never;
+    timerConfig.timerDecrement = TimerDecrement::FlexIOClock;
+    timerConfig.timerOutput = TimerOutput::One;
+    timerConfig.asDual().bits_in_word = 32 * 2 - 1;
+    timerConfig.asDual().baud_rate_div = div - 1;
+    _rx_lexio.configureTimer(_rx_timer, timerConfig);
+
+    TeensyFlexAutobaud estimator;
+    estimator.reset();
+    (void)port->SHIFTBUF[_rx_shifter];
+    _rx_lexio.clearShifterError(_rx_shifter);
+    uint8_t runs = 0;
+    bool ready = false;
+    uint32_t start = millis();
+    while (!ready && ((millis() - start) < timeoutMs)) {
+        if (port->SHIFTERR & mask) {
+            // An interrupt kept us away for more than a word
+            _rx_lexio.clearShifterError(_rx_shifter);
+            estimator.gap();
+        }
+        if (port->SHIFTSTAT & mask) {
+            estimator.feed(port->SHIFTBUF[_rx_shifter]);
+            if (estimator.runCount() != runs) {
+                runs = estimator.runCount();
+                ready = estimator.ready();
+            }
+        }
+    }
+
+    port->SHIFTCTL[_rx_shifter] = 0;
+    port->SHIFTCFG[_rx_shifter] = shiftcfg;
+    port->TIMCTL[_rx_timer] = 0;
+    port->TIMCMP[_rx_timer] = timcmp;
+    port->TIMCFG[_rx_timer] = timcfg;
+    port->TIMCTL[_rx_timer] = timctl;
+    port->SHIFTCTL[_rx_shifter] = shiftctl;
+
+    uint32_t baud = ready ? estimator.baud(sample_rate, standardRate) : 0;
+    if (baud)
+        setBaud(baud);
+
+    __disable_irq();
+    (void)port->SHIFTBUF[_rx_shifter];
+    _rx_lexio.clearShifterError(_rx_shifter);
+    _rx_buffer_head = 0;
+    _rx_buffer_tail = 0;
+    updateRts();
+    if (rx_interrupt)
+        _rx_lexio.enableShifterInterrupt(_rx_shifter);
+    __enable_irq();
+    return baud;
+}
+
+bool TeensyFlexSerial::enableRS485(int8_t dePin, uint32_t postDelayNs, bool activeLow, uint32_t preDelayNs) {
+    if (!_tx_flexio.isInitialized() || (_de_timer >= 0))
+        return false;
+    float clock = _tx_flexio.getFlexIOHandler()->computeClockRate();
+    uint32_t pre_clocks = (uint32_t)((float)preDelayNs * clock / 1000000000.0f + 0.5f);
+    uint32_t post_clocks = (uint32_t)((float)postDelayNs * clock / 1000000000.0f + 0.5f);
+    if (!TeensyFlexRS485Timing::preDelayFits(pre_clocks, _tx_flexio.getFlexIO()->TIMCMP[_tx_timer]) ||
+        (post_clocks > 0xC000))
+        return false;
+    int8_t timer = _tx_flexio.requestTimer();
+    if (timer < 0)
+        return false;
+    int8_t pre_timer = -1;
+    if (pre_clocks && ((pre_timer = _tx_flexio.requestTimer()) < 0)) {
+        _tx_flexio.releaseTimer(timer);
+        return false;
+    }
+    if (!_tx_flexio.setPinFlexioMode(dePin)) {
+        if (pre_timer >= 0) _tx_flexio.releaseTimer(pre_timer);
+        _tx_flexio.releaseTimer(timer);
+        return false;
+    }
+    flush();
+    IMXRT_FLEXIO_t *port = _tx_flexio.getFlexIO();
+    // The TX timer's own trigger: a byte waits in the TX buffer
+    uint8_t pending = (port->TIMCTL[_tx_timer] >> 24) & 0x3f;
+
+    // DE: on as soon as a byte waits in the TX buffer. The counter reloads
+    // while one waits, once the last byte went to the shift register it runs
+    // out one character plus the post delay later (updateRS485Timing()), so
+    // the compare never lands inside a frame.
+    TimerConfig timerConfig;
+    timerConfig.mode = TimerMode::SingleCounter;
+    timerConfig.pinSelect = dePin;
+    timerConfig.pinConfig = PinConfig::Output;
+    timerConfig.pinPolarity = activeLow ? PinPolarity::ActiveLow : PinPolarity::ActiveHigh;
+    timerConfig.triggerSource = TriggerSource::Internal;
+    timerConfig.triggerPolarity = TriggerPolarity::ActiveLow;
+    timerConfig.triggerSelect = pending;
+    timerConfig.timerOutput = TimerOutput::One;
+    timerConfig.timerEnable = TimerEnable::TriggerHigh;
+    timerConfig.timerDisable = TimerDisable::OnCompare;
+    timerConfig.timerReset = TimerReset::TriggerHigh;
+    timerConfig.timerDecrement = TimerDecrement::FlexIOClock;
+    _tx_flexio.configureTimer(timer, timerConfig);
+
+    if (pre_timer >= 0) {
+        // Pre delay: the same trigger delayed by pre_clocks on both edges.
+        // The output toggles after counting while it differs from the
+        // trigger and is held by the reset while they agree. The TX timer
+        // starts from it instead of the shifter flag, so the first start bit
+        // comes pre_clocks after DE.
+        TimerConfig preConfig;
+        preConfig.mode = TimerMode::SingleCounter;
+        preConfig.pinConfig = PinConfig::Disabled;
+        preConfig.triggerSource = TriggerSource::Internal;
+        preConfig.triggerPolarity = TriggerPolarity::ActiveLow;
+        preConfig.triggerSelect = pending;
+        preConfig.timerOutput = TimerOutput::Zero;
+        preConfig.timerEnable = TimerEnable::Always;
+        preConfig.timerDisable = TimerDisable::Never;
+        preConfig.timerReset = TimerReset::TriggerEqualOutput;
+        preConfig.timerDecrement = TimerDecrement::FlexIOClock;
+        preConfig.asCounter().compareValue = (pre_clocks - 1) >> 8;
+        preConfig.asCounter().reloadValue = (pre_clocks - 1) & 0xff;
+        _tx_flexio.configureTimer(pre_timer, preConfig);
+    }
+
+    __disable_irq();
+    _de_timer = timer;
+    _de_pre_timer = pre_timer;
+    _de_pre_clocks = pre_clocks;
+    _de_post_clocks = post_clocks;
+    updateRS485Timing();
+    if (pre_timer >= 0)
+        port->TIMCTL[_tx_timer] = (port->TIMCTL[_tx_timer] & ~(FLEXIO_TIMCTL_TRGSEL(0x3f) | FLEXIO_TIMCTL_TRGPOL)) |
+                                  FLEXIO_TIMCTL_TRGSEL(_tx_flexio.calculateTriggerSelect(TriggerType::TIMER, pre_timer));
+    __enable_irq();
+    return true;
+}
+
+// DE hold after the last byte left the buffer: its character (start, data and
+// stop bits at the current baud) and the post delay
+void TeensyFlexSerial::updateRS485Timing(void) {
+    if (_de_timer < 0)
+        return;
+    IMXRT_FLEXIO_t *port = _tx_flexio.getFlexIO();
+    port->TIMCMP[_de_timer] = TeensyFlexRS485Timing::holdCompare(port->TIMCMP[_tx_timer], _de_post_clocks);
+}
+
+void TeensyFlexSerial::disableRS485(void) {
+    if (_de_timer < 0)
+        return;
+    flush();
+    if (_de_pre_timer >= 0) {
+        // Back to the trigger the pre delay timer was following
+        IMXRT_FLEXIO_t *port = _tx_flexio.getFlexIO();
+        __disable_irq();
+        port->TIMCTL[_tx_timer] = (port->TIMCTL[_tx_timer] & ~FLEXIO_TIMCTL_TRGSEL(0x3f)) |
+                                  (port->TIMCTL[_de_pre_timer] & FLEXIO_TIMCTL_TRGSEL(0x3f)) |
+                                  FLEXIO_TIMCTL_TRGPOL;
+        __enable_irq();
+        _tx_flexio.configureTimer(_de_pre_timer, TimerConfig());
+        _tx_flexio.releaseTimer(_de_pre_timer);
+        _de_pre_timer = -1;
+    }
+    _tx_flexio.configureTimer(_de_timer, TimerConfig());
+    _tx_flexio.releaseTimer(_de_timer);
+    _de_timer = -1;
+}
+
+bool TeensyFlexSerial::enableHalfDuplex(void) {
+    if (!_tx_flexio.isInitialized() || !_rx_lexio.isInitialized() || _half_duplex)
+        return false;
+    if ((_tx_pin != _rx_pin) || (_tx_flex_number != _rx_flex_number))
+        return false;
+    IMXRT_FLEXIO_t *port = _tx_flexio.getFlexIO();
+
+    flush();
+    __disable_irq();
+    port->SHIFTCTL[_tx_shifter] = (port->SHIFTCTL[_tx_shifter] & ~FLEXIO_SHIFTCTL_PINCFG(3)) |
+                                  FLEXIO_SHIFTCTL_PINCFG((uint8_t)PinConfig::OpenDrain);
+    // RX timer: start bit edge only while the TX timer is off
+    port->TIMCFG[_rx_timer] = (port->TIMCFG[_rx_timer] & ~FLEXIO_TIMCFG_TIMENA(7)) |
+                              FLEXIO_TIMCFG_TIMENA((uint8_t)TimerEnable::PinRisingTriggerHigh);
+    port->TIMCTL[_rx_timer] = (port->TIMCTL[_rx_timer] & ~(FLEXIO_TIMCTL_TRGSEL(0x3f) | FLEXIO_TIMCTL_TRGPOL)) |
+                              FLEXIO_TIMCTL_TRGSEL(_tx_flexio.calculateTriggerSelect(TriggerType::TIMER, _tx_timer)) |
+                              FLEXIO_TIMCTL_TRGPOL | FLEXIO_TIMCTL_TRGSRC;
+    __enable_irq();
+    _tx_flexio.setPinParameters(_tx_pin, PullUp::PULLUP_22K);
+    _half_duplex = true;
+    return true;
+}
+
+void TeensyFlexSerial::disableHalfDuplex(void) {
+    if (!_half_duplex)
+        return;
+    flush();
+    IMXRT_FLEXIO_t *port = _tx_flexio.getFlexIO();
+    __disable_irq();
+    port->SHIFTCTL[_tx_shifter] = (port->SHIFTCTL[_tx_shifter] & ~FLEXIO_SHIFTCTL_PINCFG(3)) |
+                                  FLEXIO_SHIFTCTL_PINCFG((uint8_t)PinConfig::Output);
+    port->TIMCFG[_rx_timer] = (port->TIMCFG[_rx_timer] & ~FLEXIO_TIMCFG_TIMENA(7)) |
+                              FLEXIO_TIMCFG_TIMENA((uint8_t)TimerEnable::PinRising);
+    port->TIMCTL[_rx_timer] = port->TIMCTL[_rx_timer] & ~(FLEXIO_TIMCTL_TRGSEL(0x3f) | FLEXIO_TIMCTL_TRGPOL | FLEXIO_TIMCTL_TRGSRC);
+    __enable_irq();
+    _half_duplex = false;
+}
+
+bool TeensyFlexSerial::writeAsync(const uint8_t *buffer, size_t count, void (*callback)(void *context, size_t count), void *context) {
+    if (!_tx_flexio.isInitialized() || _write_callback || !callback || !count || (count > 32767))
+        return false;
+    uint8_t dma_source = _tx_flexio.shiftersDMAChannel(_tx_shifter);
+    if (dma_source == 0xff)
+        return false;
+    if (!_dmaTX) {
+        _dmaTX = new DMAChannel();
+        _dmaTX->disable();
+        _dmaTX->destination(*(volatile uint8_t *)&_tx_flexio.getFlexIO()->SHIFTBUF[_tx_shifter]);
+        _dmaTX->disableOnCompletion();
+        _dmaTX->interruptAtCompletion();
+        _dmaTX->triggerAtHardwareEvent(dma_source);
+        _dmaTX->attachInterrupt(TeensyFlexDMADispatch::attach(
+            _dmaTX->channel, &TeensyFlexDMADispatch::member<TeensyFlexSerial, &TeensyFlexSerial::dma_txisr>, this));
+    }
+    if ((uint32_t)buffer >= 0x20200000u)
+        arm_dcache_flush((void *)buffer, count);
+
+    __disable_irq();
+    // Bytes already queued go first
+    if (_tx_buffer_head != _tx_buffer_tail) {
+        __enable_irq();
+        return false;
+    }
+    _dmaTX->sourceBuffer(buffer, count);
+    _write_count = count;
+    _write_context = context;
+    _write_callback = callback;
+    _transmitting = 1;
+    _tx_flexio.disableShifterInterrupt(_tx_shifter);
+    if (_tx_flexio.timerInterruptEnabled(_tx_timer)) {
+        _tx_flexio.disableTimerInterrupt(_tx_timer);
+        _tx_flexio.clearTimerStatus(_tx_timer);
+    }
+    _tx_flexio.enableDMARequests(SHIFTER_MASK(_tx_shifter));
+    _dmaTX->enable();
+    __enable_irq();
+    return true;
+}
+
+void TeensyFlexSerial::dma_txisr(void) {
+    _dmaTX->clearInterrupt();
+    _dmaTX->clearComplete();
+
+    __disable_irq();
+    _tx_flexio.disableDMARequests(SHIFTER_MASK(_tx_shifter));
+    void (*callback)(void *, size_t) = _write_callback;
+    _write_callback = nullptr;
+    // Continue with what write() queued meanwhile, or wait for the last stop
+    // bit like the interrupt path does
+    if (_tx_buffer_head != _tx_buffer_tail) {
+        _tx_flexio.enableShifterInterrupt(_tx_shifter);
+    } else {
+        _tx_flexio.enableTimerInterrupt(_tx_timer);
+        _tx_flexio.clearTimerStatus(_tx_timer);
+    }
+    __enable_irq();
+    if (callback)
+        callback(_write_context, _write_count);
+    asm volatile("dsb");
+}
+
+void TeensyFlexSerial::setReceiveHandler(void (*handler)(void *context, uint8_t c), void *context) {
+    __disable_irq();
+    _receive_context = context;
+    _receive_handler = handler;
+    __enable_irq();
+    if (handler && _dmaRX) {
+        // What the DMA already stored
+        __disable_irq();
+        feedReceiveHandler();
+        __enable_irq();
+    }
+}
+
+// Match mode: hand everything the DMA stored so far to the receive handler
+void TeensyFlexSerial::feedReceiveHandler() {
+    updateRxHead();
+    uint32_t tail = _rx_buffer_tail;
+    uint32_t head = _rx_buffer_head;
+    while (tail != head) {
+        _receive_handler(_receive_context, _rx_buffer[tail]);
+        if (++tail >= RX_BUFFER_SIZE)
+            tail = 0;
+    }
+    _rx_buffer_tail = tail;
+    _match_scan = tail;
+    updateRts();
+}
+
+bool TeensyFlexSerial::attachRts(int8_t pin) {
+    if (!_rx_lexio.isInitialized() || (pin < 0))
+        return false;
+    pinMode(pin, OUTPUT);
+    digitalWriteFast(pin, LOW);
+    __disable_irq();
+    _rts_pin = pin;
+    if (_dmaRX) {
+        // A byte arriving meanwhile waits in the shifter for its DMA request
+        _dmaRX->disable();
+        setMatchSegment();
+        _dmaRX->enable();
+    }
+    updateRts();
+    __enable_irq();
+    return true;
+}
+
+bool TeensyFlexSerial::attachCts(int8_t pin) {
+    if (!_tx_flexio.isInitialized() || (pin < 0) || (_cts_pin >= 0))
+        return false;
+    uint8_t flex_pin = _tx_flexio.getFlexIOHandler()->mapIOPinToFlexPin(pin);
+    if ((flex_pin == 0xff) || !_tx_flexio.setPinFlexioMode(pin))
+        return false;
+    _tx_flexio.setPinParameters(pin, PullUp::PULLUP_22K);
+
+    // The TX timer starts a character on the shifter trigger and, now, only
+    // while the (inverted) CTS pin is high. A character already started is
+    // finished, the next one waits for CTS in hardware.
+    IMXRT_FLEXIO_t *port = _tx_flexio.getFlexIO();
+    __disable_irq();
+    port->TIMCFG[_tx_timer] = (port->TIMCFG[_tx_timer] & ~FLEXIO_TIMCFG_TIMENA(7)) |
+                              FLEXIO_TIMCFG_TIMENA((uint8_t)TimerEnable::TriggerHighPinHigh);
+    port->TIMCTL[_tx_timer] = (port->TIMCTL[_tx_timer] & ~(FLEXIO_TIMCTL_PINSEL(0x1f) | FLEXIO_TIMCTL_PINCFG(3))) |
+                              FLEXIO_TIMCTL_PINSEL(flex_pin) | FLEXIO_TIMCTL_PINPOL;
+    _cts_pin = pin;
+    __enable_irq();
+    return true;
+}
+
+bool TeensyFlexSerial::setRtsWatermarks(uint16_t high, uint16_t low) {
+    if (high >= RX_BUFFER_SIZE)
+        return false;
+    __disable_irq();
+    bool ok = _rts_watermark.setLevels(high, low);
+    updateRts();
+    __enable_irq();
+    return ok;
+}
+
+void TeensyFlexSerial::resetServiceStats(void) {
+    __disable_irq();
+    _tx_service_stats[0].reset();
+    _tx_service_stats[1].reset();
+    __enable_irq();
+}
+
+bool TeensyFlexSerial::readAsync(uint8_t *buffer, size_t count, void (*callback)(void *context, size_t count), void *context) {
+    if (!_rx_lexio.isInitialized() || _read_callback || !callback || _dmaRX)
+        return false;
+
+    // Take what is already buffered first
+    size_t done = 0;
+    __disable_irq();
+    uint32_t tail = _rx_buffer_tail;
+    while ((done < count) && (_rx_buffer_head != tail)) {
+        buffer[done++] = _rx_buffer[tail++];
+        if (tail >= RX_BUFFER_SIZE)
+            tail = 0;
+    }
+    _rx_buffer_tail = tail;
+    updateRts();
+    if (done < count) {
+        _read_buffer = buffer;
+        _read_count = count;
+        _read_done = done;
+        _read_context = context;
+        _read_callback = callback;
+    }
+    __enable_irq();
+    if (done == count)
+        callback(context, count);
+    return true;
+}
+
+bool TeensyFlexSerial::drainAsync(void (*callback)(void *context, size_t count), void *context) {
+    if (!_tx_flexio.isInitialized() || _drain_callback || !callback)
+        return false;
+    __disable_irq();
+    bool idle = !_transmitting;
+    if (!idle) {
+        _drain_context = context;
+        _drain_callback = callback;
+    }
+    __enable_irq();
+    if (idle)
+        callback(context, 0);
+    return true;
 }
 
 float TeensyFlexSerial::setClock(float frequency){
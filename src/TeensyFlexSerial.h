@@ -8,6 +8,49 @@
 
 #include "Flexio_t4.h"
 #include "TeensyFlexIO.h"
+#include <DMAChannel.h>
+#include <EventResponder.h>
+#include "TeensyFlexCoroutine.h"
+#include "TeensyFlexServiceStats.h"
+#include "TeensyFlexAutobaud.h"
+#include "TeensyFlexFlowControl.h"
+#include "TeensyFlexDMADispatch.h"
+
+class TeensyFlexSerial;
+
+#if defined(__cpp_impl_coroutine)
+// co_await serial.readAsync(buffer, count) - the number of bytes read
+class TeensyFlexSerialRead {
+  public:
+    TeensyFlexSerialRead(TeensyFlexSerial &serial, uint8_t *buffer, size_t count)
+        : _serial(serial), _buffer(buffer), _count(count) {}
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle);
+    size_t await_resume() const noexcept { return _started ? (size_t)_completion.status() : 0; }
+
+  private:
+    static void done(void *context, size_t count) { ((TeensyFlexSerialRead *)context)->_completion.complete(count); }
+    TeensyFlexSerial &_serial;
+    uint8_t *_buffer;
+    size_t _count;
+    bool _started = false;
+    TeensyFlexCompletion _completion;
+};
+
+// co_await serial.drain() - resumes once the last stop bit is out
+class TeensyFlexSerialDrain {
+  public:
+    explicit TeensyFlexSerialDrain(TeensyFlexSerial &serial) : _serial(serial) {}
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle);
+    void await_resume() const noexcept {}
+
+  private:
+    static void done(void *context, size_t count) { ((TeensyFlexSerialDrain *)context)->_completion.complete(0); }
+    TeensyFlexSerial &_serial;
+    TeensyFlexCompletion _completion;
+};
+#endif
 
 class TeensyFlexSerial : public Stream, public FlexIOHandlerCallback {
 private:
@@ -28,12 +71,70 @@ private:
     volatile uint16_t _tx_buffer_head = 0;
     volatile uint16_t _tx_buffer_tail = 0;
     volatile uint8_t _transmitting = 0;
-    static const uint16_t RX_BUFFER_SIZE = 40;
-    uint8_t _rx_buffer[RX_BUFFER_SIZE];
+    // Whole cache lines, DMA fills it in match mode with destination modulo
+    // addressing, which needs a power of two aligned to its size
+    static const uint16_t RX_BUFFER_SIZE = 64;
+    static_assert((RX_BUFFER_SIZE & (RX_BUFFER_SIZE - 1)) == 0, "RX_BUFFER_SIZE must be a power of two");
+    uint8_t _rx_buffer[RX_BUFFER_SIZE] __attribute__((aligned(RX_BUFFER_SIZE)));
     volatile uint16_t _rx_buffer_head = 0;
     volatile uint16_t _rx_buffer_tail = 0;
     static const uint32_t FLUSH_TIMEOUT = 1000;	
 
+    // Pending readAsync: the ISR stores straight into the caller's buffer
+    uint8_t *_read_buffer = nullptr;
+    size_t _read_count = 0;
+    volatile size_t _read_done = 0;
+    void (*_read_callback)(void *context, size_t count) = nullptr;
+    void *_read_context = nullptr;
+    // Pending drainAsync
+    void (*_drain_callback)(void *context, size_t count) = nullptr;
+    void *_drain_context = nullptr;
+    // Pending writeAsync: DMA feeds the TX shifter, the ring waits behind it
+    DMAChannel *_dmaTX = nullptr;
+    size_t _write_count = 0;
+    void (*_write_callback)(void *context, size_t count) = nullptr;
+    void *_write_context = nullptr;
+    void dma_txisr(void);
+    // Received bytes to a decoder instead of the buffer
+    void (*_receive_handler)(void *context, uint8_t c) = nullptr;
+    void *_receive_context = nullptr;
+    void feedReceiveHandler();
+    void startTransmit(uint32_t head);
+
+    // TX refill timing, [0] from the interrupt, [1] from TeensyFlexIO::poll()
+    TeensyFlexServiceStats _tx_service_stats[2];
+
+    // Match mode: RX bytes go to _rx_buffer by DMA, a MatchContinuous shifter
+    // on the RX pin interrupts for the match character only
+    DMAChannel *_dmaRX = nullptr;
+    int8_t _match_shifter = -1;
+    uint8_t _match_value = '\n';
+    uint8_t _match_mask = 0xff;
+    uint16_t _match_scan = 0; // readUntilMatch has looked at everything before this
+    uint16_t _match_check = 0; // checkMatch has looked at everything before this
+    volatile uint32_t _matches = 0;
+    volatile uint32_t _rx_overruns = 0;
+    EventResponder *_match_event = nullptr;
+    void updateRxHead();
+    void checkMatch(bool wait);
+    void setMatchSegment(void);
+    void dma_rxisr(void);
+
+    // RS-485 driver enable and its optional pre delay timer
+    int8_t _de_timer = -1;
+    int8_t _de_pre_timer = -1;
+    uint32_t _de_pre_clocks = 0;
+    uint32_t _de_post_clocks = 0;
+    void updateRS485Timing(void);
+    // Single wire, open drain
+    bool _half_duplex = false;
+
+    // Flow control: CTS gates the TX timer enable, RTS is a GPIO
+    int8_t _rts_pin = -1;
+    int8_t _cts_pin = -1;
+    TeensyFlexRtsWatermark _rts_watermark{RX_BUFFER_SIZE * 3 / 4, RX_BUFFER_SIZE / 4};
+    void updateRts();
+
     void printDebugInfo();
 
 public:
@@ -49,7 +150,10 @@ public:
     ~TeensyFlexSerial();
 
     void begin(uint32_t baud = 115200, uint16_t format = 0);
-    void end(void){};
+    // Waits for the TX buffer (FLUSH_TIMEOUT), then undoes begin() and every
+    // enable/attach call. Pending async operations are dropped without their
+    // callback.
+    void end(void);
     int availableForWrite(void);
     void clear(void);
     int available(void);
@@ -66,4 +170,108 @@ public:
 
     // Move our writeChar method here
     size_t write(uint8_t c);
-};
\ No newline at end of file
+
+    // Wake on a character instead of every byte: value is compared on the bits
+    // set in mask ('\n', or an address byte). Call right after begin(), bytes
+    // not read yet are dropped. Needs an RX shifter with a DMA request (0-3).
+    // The DMA does not wait for the reader: when it falls RX_BUFFER_SIZE bytes
+    // behind the oldest bytes are lost and counted in rxOverruns(), so
+    // messages have to be shorter than RX_BUFFER_SIZE.
+    bool enableMatch(uint8_t value = '\n', uint8_t mask = 0xff);
+    void disableMatch(void);
+    bool matchEnabled() { return _dmaRX != nullptr; }
+    // Wakeups since enableMatch, the event status is that count
+    uint32_t matchCount() { return _matches; }
+    // Times the DMA overtook the reader since enableMatch
+    uint32_t rxOverruns() { return _rx_overruns; }
+    void setMatchEvent(EventResponderRef event_responder) { _match_event = &event_responder; }
+    // Copies the oldest message up to and including the match character into
+    // buffer and returns its length, 0 while none is complete. A message longer
+    // than size comes back in size pieces. Works without enableMatch too.
+    size_t readUntilMatch(uint8_t *buffer, size_t size);
+
+    // Change the rate of both directions at once (between characters)
+    bool setBaud(uint32_t baud);
+    // Borrows the RX shifter and timer to sample the RX pin, measures the bit
+    // time from the first characters (send 'U' or any text) and switches both
+    // directions to it. standardRate: snap to a common rate within 3%.
+    // Returns the new rate, 0 on timeout. Blocks, bytes seen meanwhile are lost.
+    uint32_t autobaud(uint32_t timeoutMs = 1000, bool standardRate = true);
+
+    // RS-485 half duplex: a timer on the TX buffer state drives dePin, so DE
+    // rises preDelayNs before the first start bit and falls postDelayNs after
+    // the last stop bit, no software turnaround. Needs a free timer (two with
+    // a pre delay) and dePin on the TX FlexIO module. The pre delay can be one
+    // character at most, setBaud() fails for a rate that makes it longer.
+    // Call after begin().
+    bool enableRS485(int8_t dePin, uint32_t postDelayNs = 0, bool activeLow = false, uint32_t preDelayNs = 0);
+    void disableRS485(void);
+
+    // Single wire half duplex (Dynamixel, LX-16A, UPDI): construct with the
+    // same pin and FlexIO for TX and RX, then call after begin(). The RX timer
+    // only starts on a start bit while the TX timer is idle, so our own bytes
+    // are not received, and it is ready again right after the last stop bit.
+    // The pin is open drain with its 22k pull-up, add a stronger external
+    // pull-up above ~1 Mbaud.
+    bool enableHalfDuplex(void);
+    void disableHalfDuplex(void);
+    bool halfDuplex() { return _half_duplex; }
+
+    // Flow control. RTS (output, low = send) follows the RX buffer level between
+    // the watermarks. CTS (input, low = clear to send, a pin on the TX FlexIO)
+    // is part of the TX timer enable condition, so a character only starts
+    // while CTS is low and transmission pauses without software. In match mode
+    // the DMA interrupt looks at the level every RX_BUFFER_SIZE / 8 bytes, so
+    // RTS can drop that much late: keep it free above the high watermark.
+    // Call after begin().
+    bool attachRts(int8_t pin);
+    bool attachCts(int8_t pin);
+    bool setRtsWatermarks(uint16_t high, uint16_t low);
+
+    // Statistics: interval between TX shifter refills while streaming, in CPU
+    // cycles, for interrupt (polled = false) or TeensyFlexIO::poll() service
+    const TeensyFlexServiceStats &txServiceStats(bool polled) { return _tx_service_stats[polled]; }
+    void resetServiceStats(void);
+
+    // Read exactly count bytes in the background, the callback runs from the
+    // ISR (or right away when they are already buffered). One read at a time.
+    bool readAsync(uint8_t *buffer, size_t count, void (*callback)(void *context, size_t count), void *context);
+    // Callback once everything written has left the shifter
+    bool drainAsync(void (*callback)(void *context, size_t count), void *context);
+    // Send count bytes by DMA, no interrupt per byte. Starts only when the TX
+    // buffer is empty (false otherwise, try again later); write() meanwhile
+    // queues behind it. The callback runs from the DMA ISR once the last byte
+    // is in the shifter, buffer can be reused then. One at a time, needs a TX
+    // shifter with a DMA request (0-3).
+    bool writeAsync(const uint8_t *buffer, size_t count, void (*callback)(void *context, size_t count), void *context);
+    bool writeAsyncActive() { return _write_callback != nullptr; }
+
+    // Zero copy writes: the free space at the head of the TX buffer, filled by
+    // the caller and then sent with commitWrite(). nullptr while it is full.
+    // The space may be shorter than availableForWrite() where the buffer wraps.
+    uint8_t *reserveWrite(size_t &length);
+    void commitWrite(size_t count);
+    // Every received byte goes to handler, from the ISR, instead of the
+    // buffer (nullptr: back to the buffer). In match mode the handler gets
+    // the bytes up to each match at once. readAsync takes precedence.
+    void setReceiveHandler(void (*handler)(void *context, uint8_t c), void *context);
+
+    // The FlexIO modules, for layers that add their own timers (TeensyFlexMIDI)
+    TeensyFlexIO &txFlexIO() { return _tx_flexio; }
+    TeensyFlexIO &rxFlexIO() { return _rx_lexio; }
+#if defined(__cpp_impl_coroutine)
+    TeensyFlexSerialRead readAsync(uint8_t *buffer, size_t count) { return TeensyFlexSerialRead(*this, buffer, count); }
+    TeensyFlexSerialDrain drain() { return TeensyFlexSerialDrain(*this); }
+#endif
+};
+
+#if defined(__cpp_impl_coroutine)
+inline bool TeensyFlexSerialRead::await_suspend(std::coroutine_handle<> handle) {
+    _started = _serial.readAsync(_buffer, _count, &done, this);
+    return _started && _completion.await_suspend(handle);
+}
+
+inline bool TeensyFlexSerialDrain::await_suspend(std::coroutine_handle<> handle) {
+    return _serial.drainAsync(&done, this) && _completion.await_suspend(handle);
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,61 @@
+#ifndef _TEENSY_FLEX_SERVICE_STATS_H_
+#define _TEENSY_FLEX_SERVICE_STATS_H_
+
+// Timing of a driver's periodic service (one TX refill per character time, ...)
+// in CPU cycles. mark() is called each time the hardware is serviced, the
+// spread of the intervals is the service jitter. restart() ends a series, so
+// the idle gap before the next burst is not counted.
+#include <math.h>
+#include <stdint.h>
+
+class TeensyFlexServiceStats {
+  public:
+    void reset() {
+        _count = 0;
+        _min = UINT32_MAX;
+        _max = 0;
+        _mean = 0.0f;
+        _m2 = 0.0f;
+        _marked = false;
+    }
+
+    void restart() { _marked = false; }
+
+    void mark(uint32_t cycles) {
+        if (_marked)
+            add(cycles - _last);
+        _last = cycles;
+        _marked = true;
+    }
+
+    void add(uint32_t interval) {
+        _count++;
+        if (interval < _min)
+            _min = interval;
+        if (interval > _max)
+            _max = interval;
+        // Welford, stays accurate over long runs
+        float delta = (float)interval - _mean;
+        _mean += delta / (float)_count;
+        _m2 += delta * ((float)interval - _mean);
+    }
+
+    uint32_t count() const { return _count; }
+    uint32_t minCycles() const { return _count ? _min : 0; }
+    uint32_t maxCycles() const { return _max; }
+    float meanCycles() const { return _mean; }
+    float stddevCycles() const { return (_count > 1) ? sqrtf(_m2 / (float)(_count - 1)) : 0.0f; }
+    // Peak to peak spread of the service interval
+    uint32_t jitterCycles() const { return _count ? _max - _min : 0; }
+
+  private:
+    uint32_t _count = 0;
+    uint32_t _min = UINT32_MAX;
+    uint32_t _max = 0;
+    float _mean = 0.0f;
+    float _m2 = 0.0f;
+    uint32_t _last = 0;
+    bool _marked = false;
+};
+
+#endif // _TEENSY_FLEX_SERVICE_STATS_H_
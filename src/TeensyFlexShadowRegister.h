@@ -0,0 +1,44 @@
+#ifndef _TEENSY_FLEX_SHADOW_REGISTER_H_
+#define _TEENSY_FLEX_SHADOW_REGISTER_H_
+
+// RAM copy of a peripheral register that only software changes (interrupt
+// enables, DMA enables, CTRL). Reads come from the copy, and a write reaches
+// the bus only when the value really changes. set() and clear() are a
+// read-modify-write of the copy and are not atomic: when an interrupt handler
+// changes the same register, mask interrupts around every change (TeensyFlexIO
+// does). Reg is volatile uint32_t on the Teensy.
+#include <stdint.h>
+
+template <typename Reg>
+class TeensyFlexShadowRegister {
+  public:
+    // Reads the register once to start from its current value
+    void attach(Reg *reg) {
+        _reg = reg;
+        _value = *reg;
+    }
+    bool attached() const { return _reg != nullptr; }
+    // Read the register again after something wrote it behind our back
+    void sync() {
+        if (_reg)
+            _value = *_reg;
+    }
+
+    uint32_t value() const { return _value; }
+    bool test(uint32_t mask) const { return (_value & mask) != 0; }
+
+    void set(uint32_t mask) { write(_value | mask); }
+    void clear(uint32_t mask) { write(_value & ~mask); }
+    void write(uint32_t value) {
+        if (value == _value)
+            return;
+        _value = value;
+        *_reg = value;
+    }
+
+  private:
+    Reg *_reg = nullptr;
+    uint32_t _value = 0;
+};
+
+#endif // _TEENSY_FLEX_SHADOW_REGISTER_H_
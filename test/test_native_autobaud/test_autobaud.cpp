@@ -0,0 +1,150 @@
+#include <unity.h>
+#include <stdlib.h>
+#include "TeensyFlexAutobaud.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// Synthesizes what the sampling shifter sees: 8N1 characters on an idle high
+// line, sampled at sampleRate, packed 32 samples a word (oldest in bit 0).
+struct LineSynth {
+    double bitSamples;
+    double t = 0.0;       // time in samples
+    double jitter = 0.0;  // +- samples of edge noise
+    // Edges as (time, level after the edge)
+    double edges[512];
+    uint8_t levels[512];
+    int count = 0;
+
+    LineSynth(uint32_t sampleRate, uint32_t baud, double idleBits) : bitSamples((double)sampleRate / baud) {
+        t = idleBits * bitSamples + 0.37; // arbitrary phase against the sample clock
+    }
+
+    void edge(uint8_t level) {
+        double noise = jitter ? jitter * (2.0 * rand() / RAND_MAX - 1.0) : 0.0;
+        edges[count] = t + noise;
+        levels[count++] = level;
+    }
+
+    void character(uint8_t c) {
+        uint8_t bits[10];
+        bits[0] = 0;
+        for (int i = 0; i < 8; i++)
+            bits[i + 1] = (c >> i) & 1;
+        bits[9] = 1;
+        uint8_t level = 1;
+        for (int i = 0; i < 10; i++) {
+            if (bits[i] != level) {
+                level = bits[i];
+                edge(level);
+            }
+            t += bitSamples;
+        }
+    }
+
+    uint8_t at(uint64_t sample) const {
+        uint8_t level = 1;
+        for (int i = 0; i < count && edges[i] <= (double)sample; i++)
+            level = levels[i];
+        return level;
+    }
+
+    // Feeds words until the estimate is ready, returns the samples used
+    uint64_t run(TeensyFlexAutobaud &estimator, uint64_t limit) const {
+        uint64_t sample = 0;
+        while (sample < limit && !estimator.ready()) {
+            uint32_t word = 0;
+            for (int i = 0; i < 32; i++)
+                word |= (uint32_t)at(sample + i) << i;
+            estimator.feed(word);
+            sample += 32;
+        }
+        return sample;
+    }
+};
+
+static void check_rate(uint32_t sampleRate, uint32_t baud, const char *text) {
+    LineSynth line(sampleRate, baud, 3);
+    for (const char *p = text; *p; p++)
+        line.character(*p);
+    TeensyFlexAutobaud estimator;
+    estimator.reset();
+    uint64_t used = line.run(estimator, (uint64_t)(line.t + 64));
+    TEST_ASSERT_TRUE(estimator.ready());
+    // Within the idle lead-in plus two characters (and one word to notice)
+    TEST_ASSERT_TRUE(used <= (uint64_t)(23 * line.bitSamples) + 64);
+    TEST_ASSERT_EQUAL_UINT32(baud, estimator.baud(sampleRate));
+}
+
+void test_sync_character_up_to_3_mbaud(void) {
+    check_rate(24000000, 3000000, "UUUU");
+    check_rate(24000000, 921600, "UUUU");
+    check_rate(24000000, 115200, "UUUU");
+    check_rate(24000000, 9600, "UU");
+}
+
+void test_ordinary_text(void) {
+    check_rate(24000000, 3000000, "AT\r\n");
+    check_rate(24000000, 57600, "AT\r\n");
+    check_rate(15000000, 2000000, "hello");
+}
+
+void test_exact_rate_when_not_standard(void) {
+    LineSynth line(24000000, 100000, 2);
+    line.character('U');
+    line.character('U');
+    line.character('U');
+    TeensyFlexAutobaud estimator;
+    estimator.reset();
+    line.run(estimator, (uint64_t)(line.t + 64));
+    TEST_ASSERT_TRUE(estimator.ready());
+    uint32_t baud = estimator.baud(24000000, false);
+    TEST_ASSERT_UINT32_WITHIN(1000, 100000, baud);
+    // 100000 is not within 3% of any standard rate either
+    TEST_ASSERT_UINT32_WITHIN(1000, 100000, estimator.baud(24000000, true));
+}
+
+void test_edge_jitter_averages_out(void) {
+    srand(46);
+    LineSynth line(24000000, 1000000, 2);
+    line.jitter = 3.0; // +-3 samples on 24 sample bits
+    const char *text = "UUUUUU";
+    for (const char *p = text; *p; p++)
+        line.character(*p);
+    TeensyFlexAutobaud estimator;
+    estimator.reset();
+    line.run(estimator, (uint64_t)(line.t + 64));
+    TEST_ASSERT_EQUAL_UINT32(1000000, estimator.baud(24000000));
+}
+
+void test_gap_drops_the_cut_run(void) {
+    TeensyFlexAutobaud estimator;
+    estimator.reset();
+    estimator.feed(0xFFFF0000u); // 16 low from before sampling, 16 high
+    TEST_ASSERT_EQUAL(0, estimator.runCount());
+    estimator.feed(0x0000FFFFu); // 32 high, 16 low
+    TEST_ASSERT_EQUAL(1, estimator.runCount());
+    estimator.feed(0x000000FFu); // 16 low end, 8 high, 24 low
+    TEST_ASSERT_EQUAL(3, estimator.runCount());
+    estimator.gap();
+    estimator.feed(0xFFFFFF00u); // lost samples: these 8 low are not a pulse
+    TEST_ASSERT_EQUAL(3, estimator.runCount());
+}
+
+void test_closest_standard(void) {
+    TEST_ASSERT_EQUAL_UINT32(115200, TeensyFlexAutobaud::closestStandard(114000));
+    TEST_ASSERT_EQUAL_UINT32(3000000, TeensyFlexAutobaud::closestStandard(2950000));
+    TEST_ASSERT_EQUAL_UINT32(250000, TeensyFlexAutobaud::closestStandard(248000));
+    TEST_ASSERT_EQUAL_UINT32(170000, TeensyFlexAutobaud::closestStandard(170000));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_sync_character_up_to_3_mbaud);
+    RUN_TEST(test_ordinary_text);
+    RUN_TEST(test_exact_rate_when_not_standard);
+    RUN_TEST(test_edge_jitter_averages_out);
+    RUN_TEST(test_gap_drops_the_cut_run);
+    RUN_TEST(test_closest_standard);
+    return UNITY_END();
+}
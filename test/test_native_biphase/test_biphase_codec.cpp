@@ -0,0 +1,139 @@
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "TeensyFlexBiphaseCodec.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static TeensyFlexBiphaseCodec codec;
+
+void test_manchester_table(void) {
+    uint8_t level = 0;
+    TEST_ASSERT_EQUAL_HEX16(0x5555, codec.encode(BiphaseCoding::Manchester, 0x00, level));
+    TEST_ASSERT_EQUAL_HEX16(0xaaaa, codec.encode(BiphaseCoding::Manchester, 0xff, level));
+    TEST_ASSERT_EQUAL_HEX16(0x5556, codec.encode(BiphaseCoding::Manchester, 0x01, level));
+    uint8_t value;
+    TEST_ASSERT_FALSE(codec.decode(BiphaseCoding::Manchester, 0x0000, 0, value));
+    TEST_ASSERT_FALSE(codec.decode(BiphaseCoding::Manchester, 0x5557, 0, value));
+}
+
+void test_bmc_table(void) {
+    uint8_t level = 0;
+    TEST_ASSERT_EQUAL_HEX16(0x3333, codec.encode(BiphaseCoding::BiphaseMark, 0x00, level));
+    TEST_ASSERT_EQUAL(0, level);
+    TEST_ASSERT_EQUAL_HEX16(0x5555, codec.encode(BiphaseCoding::BiphaseMark, 0xff, level));
+    TEST_ASSERT_EQUAL(0, level);
+    // Starting high inverts every symbol
+    level = 1;
+    TEST_ASSERT_EQUAL_HEX16(0xcccc, codec.encode(BiphaseCoding::BiphaseMark, 0x00, level));
+    // Missing transition at the start of the byte
+    uint8_t value;
+    TEST_ASSERT_FALSE(codec.decode(BiphaseCoding::BiphaseMark, 0x3333, 1, value));
+    TEST_ASSERT_TRUE(codec.decode(BiphaseCoding::BiphaseMark, 0x3333, 0, value));
+    TEST_ASSERT_EQUAL_HEX8(0x00, value);
+}
+
+void test_every_byte_round_trips(void) {
+    const BiphaseCoding codings[2] = {BiphaseCoding::Manchester, BiphaseCoding::BiphaseMark};
+    for (uint8_t c = 0; c < 2; c++) {
+        for (uint8_t start = 0; start < 2; start++) {
+            for (uint32_t x = 0; x < 256; x++) {
+                uint8_t level = start;
+                uint16_t symbols = codec.encode(codings[c], x, level);
+                uint8_t last = (codings[c] == BiphaseCoding::BiphaseMark) ? start : 0;
+                uint8_t value = 0;
+                TEST_ASSERT_TRUE(codec.decode(codings[c], symbols, last, value));
+                TEST_ASSERT_EQUAL_HEX8(x, value);
+            }
+        }
+    }
+}
+
+// Pack a frame into 32 bit symbol words starting 'offset' half bits into the stream
+static std::vector<uint32_t> line_words(BiphaseCoding coding, const uint8_t *data, size_t count, uint8_t offset) {
+    std::vector<uint16_t> symbols(count + 8);
+    uint8_t header[3] = {TeensyFlexBiphaseCodec::PREAMBLE, TeensyFlexBiphaseCodec::PREAMBLE, TeensyFlexBiphaseCodec::SYNC};
+    symbols[0] = TeensyFlexBiphaseCodec::idle(coding, 0);
+    uint8_t level = codec.encode(coding, header, 3, &symbols[1], 0);
+    level = codec.encode(coding, data, count, &symbols[4], level);
+    for (size_t i = 4 + count; i < symbols.size(); i++)
+        symbols[i] = TeensyFlexBiphaseCodec::idle(coding, level);
+
+    std::vector<uint32_t> words((symbols.size() * 16 + offset + 31) / 32 + 1, 0);
+    size_t pos = offset;
+    for (uint16_t s : symbols) {
+        for (uint8_t b = 0; b < 16; b++, pos++) {
+            if ((s >> b) & 1)
+                words[pos / 32] |= 1u << (pos % 32);
+        }
+    }
+    return words;
+}
+
+void test_stream_decoder_finds_frames(void) {
+    const BiphaseCoding codings[2] = {BiphaseCoding::Manchester, BiphaseCoding::BiphaseMark};
+    uint8_t data[40];
+    srand(30);
+    for (uint8_t c = 0; c < 2; c++) {
+        for (uint8_t offset = 0; offset < 32; offset++) {
+            for (size_t i = 0; i < sizeof(data); i++)
+                data[i] = rand();
+            std::vector<uint32_t> words = line_words(codings[c], data, sizeof(data), offset);
+            TeensyFlexBiphaseDecoder decoder(codec, codings[c]);
+            uint8_t out[64];
+            size_t count = 0;
+            for (uint32_t w : words)
+                count += decoder.feed(w, out + count, sizeof(out) - count);
+            TEST_ASSERT_EQUAL(sizeof(data), count);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(data, out, sizeof(data));
+            TEST_ASSERT_FALSE(decoder.locked());
+        }
+    }
+}
+
+// Line rate (half bits per second) the table codec sustains on the host
+void test_throughput(void) {
+    const size_t size = 1 << 20;
+    std::vector<uint8_t> data(size), decoded(size);
+    std::vector<uint16_t> symbols(size);
+    for (size_t i = 0; i < size; i++)
+        data[i] = i * 7;
+    const BiphaseCoding codings[2] = {BiphaseCoding::Manchester, BiphaseCoding::BiphaseMark};
+    for (uint8_t c = 0; c < 2; c++) {
+        auto start = std::chrono::steady_clock::now();
+        codec.encode(codings[c], data.data(), size, symbols.data(), 0);
+        double encode_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        uint8_t last = 0;
+        for (size_t i = 0; i < size; i++) {
+            codec.decode(codings[c], symbols[i], last, decoded[i]);
+            last = symbols[i] >> 15;
+        }
+        double decode_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(data.data(), decoded.data(), size);
+
+        double encode_mbps = size * 16 / encode_s / 1e6;
+        double decode_mbps = size * 16 / decode_s / 1e6;
+        char msg[96];
+        snprintf(msg, sizeof(msg), "%s: encode %.0f Mbps, decode %.0f Mbps line rate",
+                 c ? "BMC" : "Manchester", encode_mbps, decode_mbps);
+        TEST_MESSAGE(msg);
+        TEST_ASSERT_TRUE(encode_mbps > 10.0);
+        TEST_ASSERT_TRUE(decode_mbps > 10.0);
+    }
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_manchester_table);
+    RUN_TEST(test_bmc_table);
+    RUN_TEST(test_every_byte_round_trips);
+    RUN_TEST(test_stream_decoder_finds_frames);
+    RUN_TEST(test_throughput);
+    return UNITY_END();
+}
@@ -0,0 +1,111 @@
+#include <unity.h>
+#include "TeensyFlexCoroutine.h"
+
+// Stands in for a driver: start() arms the completion, the "ISR" fires it later
+struct FakeTransfer {
+    TeensyFlexCompletion completion;
+    bool started = false;
+
+    void start() {
+        completion.reset();
+        started = true;
+    }
+};
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static TeensyFlexTask two_transfers(FakeTransfer &first, FakeTransfer &second, int &result, int &steps) {
+    steps++;
+    first.start();
+    int a = co_await first.completion;
+    steps++;
+    second.start();
+    int b = co_await second.completion;
+    steps++;
+    result = a * 10 + b;
+}
+
+void test_resumes_from_the_executor_not_the_isr(void) {
+    FakeTransfer first, second;
+    int result = 0, steps = 0;
+    TeensyFlexTask task = two_transfers(first, second, result, steps);
+    TEST_ASSERT_TRUE(task.started());
+    TEST_ASSERT_EQUAL(1, steps);
+    TEST_ASSERT_EQUAL(1, TeensyFlexCoroutineFrames::inUse());
+
+    first.completion.complete(4); // "ISR"
+    TEST_ASSERT_EQUAL(1, steps);
+    TEST_ASSERT_EQUAL(1, TeensyFlexExecutor::global().run());
+    TEST_ASSERT_EQUAL(2, steps);
+    TEST_ASSERT_EQUAL(0, TeensyFlexExecutor::global().run());
+
+    second.completion.complete(2);
+    TeensyFlexExecutor::global().run();
+    TEST_ASSERT_EQUAL(3, steps);
+    TEST_ASSERT_EQUAL(42, result);
+    TEST_ASSERT_EQUAL(0, TeensyFlexCoroutineFrames::inUse());
+}
+
+static TeensyFlexTask await_one(TeensyFlexCompletion &completion, int &result) {
+    result = co_await completion;
+}
+
+void test_completed_before_await_does_not_suspend(void) {
+    TeensyFlexCompletion completion;
+    completion.complete(7);
+    int result = 0;
+    TeensyFlexTask task = await_one(completion, result);
+    TEST_ASSERT_TRUE(task.started());
+    TEST_ASSERT_EQUAL(7, result);
+    TEST_ASSERT_EQUAL(0, TeensyFlexExecutor::global().run());
+    TEST_ASSERT_EQUAL(0, TeensyFlexCoroutineFrames::inUse());
+}
+
+void test_out_of_order_completions(void) {
+    const int TASKS = 4;
+    TeensyFlexCompletion completions[TASKS];
+    int results[TASKS] = {0};
+    for (int i = 0; i < TASKS; i++)
+        TEST_ASSERT_TRUE(await_one(completions[i], results[i]).started());
+    TEST_ASSERT_EQUAL(TASKS, TeensyFlexCoroutineFrames::inUse());
+
+    const int order[TASKS] = {2, 0, 3, 1};
+    for (int i = 0; i < TASKS; i++)
+        completions[order[i]].complete(100 + order[i]);
+    TEST_ASSERT_EQUAL(TASKS, TeensyFlexExecutor::global().run());
+    for (int i = 0; i < TASKS; i++)
+        TEST_ASSERT_EQUAL(100 + i, results[i]);
+    TEST_ASSERT_EQUAL(0, TeensyFlexCoroutineFrames::inUse());
+}
+
+void test_pool_exhaustion_and_reuse(void) {
+    TeensyFlexCompletion completions[TeensyFlexCoroutineFrames::FRAMES + 1];
+    int results[TeensyFlexCoroutineFrames::FRAMES + 1] = {0};
+    for (int i = 0; i < TeensyFlexCoroutineFrames::FRAMES; i++)
+        TEST_ASSERT_TRUE(await_one(completions[i], results[i]).started());
+
+    // No frame left, nothing is run and nothing leaks
+    TEST_ASSERT_FALSE(await_one(completions[TeensyFlexCoroutineFrames::FRAMES], results[TeensyFlexCoroutineFrames::FRAMES]).started());
+    TEST_ASSERT_EQUAL(TeensyFlexCoroutineFrames::FRAMES, TeensyFlexCoroutineFrames::inUse());
+
+    completions[3].complete(1);
+    TeensyFlexExecutor::global().run();
+    TEST_ASSERT_EQUAL(TeensyFlexCoroutineFrames::FRAMES - 1, TeensyFlexCoroutineFrames::inUse());
+    TEST_ASSERT_TRUE(await_one(completions[TeensyFlexCoroutineFrames::FRAMES], results[TeensyFlexCoroutineFrames::FRAMES]).started());
+
+    for (int i = 0; i <= TeensyFlexCoroutineFrames::FRAMES; i++)
+        if (i != 3)
+            completions[i].complete(i);
+    TeensyFlexExecutor::global().run();
+    TEST_ASSERT_EQUAL(0, TeensyFlexCoroutineFrames::inUse());
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_resumes_from_the_executor_not_the_isr);
+    RUN_TEST(test_completed_before_await_does_not_suspend);
+    RUN_TEST(test_out_of_order_completions);
+    RUN_TEST(test_pool_exhaustion_and_reuse);
+    return UNITY_END();
+}
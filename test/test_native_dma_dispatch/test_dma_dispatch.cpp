@@ -0,0 +1,127 @@
+#include <unity.h>
+#include <stdlib.h>
+#include "TeensyFlexDMADispatch.h"
+
+void setUp(void) {
+    for (uint8_t ch = 0; ch < TeensyFlexDMADispatch::CHANNELS; ch++)
+        TeensyFlexDMADispatch::detach(ch);
+    for (uint8_t pin = 0; pin < TeensyFlexPinDispatch::CHANNELS; pin++)
+        TeensyFlexPinDispatch::detach(pin);
+}
+void tearDown(void) {}
+
+// Stands in for a bus that runs a long transfer as several DMA chunks, each
+// completion re-arms the next one like TeensyFlexSPI::dma_rxisr does.
+struct FakeBus {
+    uint8_t channel;
+    uint32_t chunks_left;
+    uint32_t completions;
+    bool done;
+    TeensyFlexDMADispatch::Isr isr;
+
+    void dma_rxisr(void) {
+        completions++;
+        if (chunks_left)
+            chunks_left--;
+        else
+            done = true;
+    }
+    bool pending() const { return !done; }
+};
+
+static FakeBus make_bus(uint8_t channel, uint32_t chunks) {
+    FakeBus bus = {channel, chunks, 0, false, nullptr};
+    return bus;
+}
+
+void test_attach_returns_per_channel_trampolines(void) {
+    FakeBus a = make_bus(3, 0), b = make_bus(17, 0);
+    a.isr = TeensyFlexDMADispatch::attach(a.channel, &TeensyFlexDMADispatch::member<FakeBus, &FakeBus::dma_rxisr>, &a);
+    b.isr = TeensyFlexDMADispatch::attach(b.channel, &TeensyFlexDMADispatch::member<FakeBus, &FakeBus::dma_rxisr>, &b);
+    TEST_ASSERT_NOT_NULL(a.isr);
+    TEST_ASSERT_NOT_NULL(b.isr);
+    TEST_ASSERT_TRUE(a.isr != b.isr);
+    TEST_ASSERT_EQUAL_PTR(&a, TeensyFlexDMADispatch::context(3));
+
+    b.isr();
+    TEST_ASSERT_EQUAL(0, a.completions);
+    TEST_ASSERT_EQUAL(1, b.completions);
+}
+
+void test_rejects_bad_channel(void) {
+    FakeBus a = make_bus(0, 0);
+    TEST_ASSERT_NULL(TeensyFlexDMADispatch::attach(TeensyFlexDMADispatch::CHANNELS, &TeensyFlexDMADispatch::member<FakeBus, &FakeBus::dma_rxisr>, &a));
+    TEST_ASSERT_NULL(TeensyFlexDMADispatch::attach(0, nullptr, &a));
+}
+
+void test_detached_channel_is_ignored(void) {
+    FakeBus a = make_bus(5, 0);
+    a.isr = TeensyFlexDMADispatch::attach(a.channel, &TeensyFlexDMADispatch::member<FakeBus, &FakeBus::dma_rxisr>, &a);
+    TeensyFlexDMADispatch::detach(a.channel);
+    a.isr();
+    TEST_ASSERT_EQUAL(0, a.completions);
+    TEST_ASSERT_NULL(TeensyFlexDMADispatch::context(5));
+}
+
+// Four buses, the old per module slots would have put the last three in one slot
+void test_four_buses_in_flight(void) {
+    const uint8_t BUSES = 4;
+    const uint8_t channels[BUSES] = {0, 2, 4, 6};
+    const uint32_t chunks[BUSES] = {3, 10, 1, 7};
+    FakeBus buses[BUSES];
+    for (uint8_t i = 0; i < BUSES; i++) {
+        buses[i] = make_bus(channels[i], chunks[i]);
+        buses[i].isr = TeensyFlexDMADispatch::attach(channels[i], &TeensyFlexDMADispatch::member<FakeBus, &FakeBus::dma_rxisr>, &buses[i]);
+    }
+
+    // Completions arrive in any order while the others are still running
+    srand(38);
+    uint32_t fired = 0;
+    for (;;) {
+        uint8_t running = 0;
+        for (uint8_t i = 0; i < BUSES; i++)
+            running += buses[i].pending();
+        if (!running)
+            break;
+        uint8_t i = rand() % BUSES;
+        if (buses[i].pending()) {
+            buses[i].isr();
+            fired++;
+        }
+    }
+    uint32_t expected = 0;
+    for (uint8_t i = 0; i < BUSES; i++) {
+        TEST_ASSERT_TRUE(buses[i].done);
+        TEST_ASSERT_EQUAL(chunks[i] + 1, buses[i].completions);
+        expected += chunks[i] + 1;
+    }
+    TEST_ASSERT_EQUAL(expected, fired);
+}
+
+// A capture uses DMA channel 7 for its lines and pin 7 for VSYNC, the two must not collide
+void test_pin_and_dma_tables_are_separate(void) {
+    FakeBus line = make_bus(7, 0), vsync = make_bus(7, 0);
+    line.isr = TeensyFlexDMADispatch::attach(7, &TeensyFlexDMADispatch::member<FakeBus, &FakeBus::dma_rxisr>, &line);
+    vsync.isr = TeensyFlexPinDispatch::attach(7, &TeensyFlexPinDispatch::member<FakeBus, &FakeBus::dma_rxisr>, &vsync);
+    TEST_ASSERT_TRUE(line.isr != vsync.isr);
+    TEST_ASSERT_NOT_NULL(TeensyFlexPinDispatch::attach(TeensyFlexPinDispatch::CHANNELS - 1, &TeensyFlexPinDispatch::member<FakeBus, &FakeBus::dma_rxisr>, &vsync));
+
+    vsync.isr();
+    TEST_ASSERT_EQUAL(0, line.completions);
+    TEST_ASSERT_EQUAL(1, vsync.completions);
+    TeensyFlexPinDispatch::detach(7);
+    line.isr();
+    vsync.isr();
+    TEST_ASSERT_EQUAL(1, line.completions);
+    TEST_ASSERT_EQUAL(1, vsync.completions);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_attach_returns_per_channel_trampolines);
+    RUN_TEST(test_rejects_bad_channel);
+    RUN_TEST(test_detached_channel_is_ignored);
+    RUN_TEST(test_four_buses_in_flight);
+    RUN_TEST(test_pin_and_dma_tables_are_separate);
+    return UNITY_END();
+}
@@ -0,0 +1,211 @@
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "TeensyFlexDShotCodec.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static TeensyFlexDShotCodec codec;
+
+// Rebuild the frame of one motor by counting its high slots per bit
+static uint16_t frame_from_slots(const uint32_t *words, uint8_t motor, bool inverted) {
+    const uint8_t *slots = (const uint8_t *)words;
+    uint16_t frame = 0;
+    for (uint8_t bit = 0; bit < TeensyFlexDShotCodec::FRAME_BITS; bit++) {
+        uint8_t high = 0;
+        for (uint8_t s = 0; s < TeensyFlexDShotCodec::SLOTS_PER_BIT; s++) {
+            uint8_t level = (slots[bit * TeensyFlexDShotCodec::SLOTS_PER_BIT + s] >> motor) & 1;
+            high += inverted ? !level : level;
+        }
+        TEST_ASSERT_TRUE(high == TeensyFlexDShotCodec::ZERO_HIGH_SLOTS || high == TeensyFlexDShotCodec::ONE_HIGH_SLOTS);
+        frame = (frame << 1) | (high == TeensyFlexDShotCodec::ONE_HIGH_SLOTS);
+    }
+    return frame;
+}
+
+void test_frame_checksum(void) {
+    TEST_ASSERT_EQUAL_HEX16(0x82c6, TeensyFlexDShotCodec::frame(1046));
+    // Bidirectional frames carry the inverted checksum
+    TEST_ASSERT_EQUAL_HEX16(0x82c9, TeensyFlexDShotCodec::frame(1046, false, true));
+    TEST_ASSERT_EQUAL_HEX16(0x0000, TeensyFlexDShotCodec::frame(0));
+}
+
+void test_encode_parallel_slots(void) {
+    uint32_t out[TeensyFlexDShotCodec::FRAME_WORDS];
+    uint16_t frames[TeensyFlexDShotCodec::MOTORS];
+    srand(29);
+    for (int pass = 0; pass < 200; pass++) {
+        bool inverted = pass & 1;
+        for (uint8_t m = 0; m < TeensyFlexDShotCodec::MOTORS; m++)
+            frames[m] = TeensyFlexDShotCodec::frame(rand() & 0x7ff, rand() & 1, inverted);
+        codec.encode(frames, out, 0xff, inverted);
+        for (uint8_t m = 0; m < TeensyFlexDShotCodec::MOTORS; m++)
+            TEST_ASSERT_EQUAL_HEX16(frames[m], frame_from_slots(out, m, inverted));
+
+        // Trailing slots hold the idle level
+        const uint8_t *slots = (const uint8_t *)out;
+        for (size_t i = TeensyFlexDShotCodec::FRAME_BITS * TeensyFlexDShotCodec::SLOTS_PER_BIT;
+             i < TeensyFlexDShotCodec::FRAME_BYTES; i++)
+            TEST_ASSERT_EQUAL_HEX8(inverted ? 0xff : 0x00, slots[i]);
+    }
+}
+
+void test_masked_motors_stay_idle(void) {
+    uint32_t out[TeensyFlexDShotCodec::FRAME_WORDS];
+    uint16_t frames[TeensyFlexDShotCodec::MOTORS];
+    for (uint8_t m = 0; m < TeensyFlexDShotCodec::MOTORS; m++)
+        frames[m] = TeensyFlexDShotCodec::frame(2047);
+    codec.encode(frames, out, 0x0f);
+    const uint8_t *slots = (const uint8_t *)out;
+    for (size_t i = 0; i < TeensyFlexDShotCodec::FRAME_BYTES; i++)
+        TEST_ASSERT_EQUAL_HEX8(0, slots[i] & 0xf0);
+}
+
+// Render the line bits of one motor into parallel samples, idle high
+static size_t render_telemetry(uint8_t *samples, size_t count, uint8_t motor, uint32_t line, float samples_per_bit,
+                               size_t lead) {
+    uint8_t mask = 1 << motor;
+    uint8_t level = 1;
+    for (size_t i = 0; i < count; i++) {
+        if (i >= lead) {
+            float t = (i - lead) / samples_per_bit;
+            int bit = (int)t;
+            if (bit < TeensyFlexDShotCodec::TELEMETRY_BITS) {
+                // Recompute the level from the transitions seen so far
+                level = 1;
+                for (int b = 0; b <= bit; b++)
+                    if (line & (1u << (TeensyFlexDShotCodec::TELEMETRY_BITS - 1 - b)))
+                        level ^= 1;
+            } else {
+                level = 1;
+            }
+        }
+        if (level)
+            samples[i] |= mask;
+        else
+            samples[i] &= ~mask;
+    }
+    return count;
+}
+
+void test_telemetry_round_trip(void) {
+    // Periods the 9 bit mantissa / 3 bit exponent can hold exactly
+    const uint32_t periods[8] = {0, 1, 511, 1024, 4000, 12345 & ~0x1f, 510 << 7, 300};
+    uint8_t samples[512];
+    const float samples_per_bit = TeensyFlexDShotCodec::SLOTS_PER_BIT / 1.25f;
+    memset(samples, 0xff, sizeof(samples));
+    for (uint8_t m = 0; m < 8; m++)
+        render_telemetry(samples, sizeof(samples), m, TeensyFlexDShotCodec::encodeLine(periods[m]), samples_per_bit,
+                         120 + m * 7);
+    for (uint8_t m = 0; m < 8; m++) {
+        TEST_ASSERT_EQUAL_UINT32(periods[m], TeensyFlexDShotCodec::decodeLine(TeensyFlexDShotCodec::encodeLine(periods[m])));
+        TEST_ASSERT_EQUAL_UINT32(periods[m], TeensyFlexDShotCodec::decodeTelemetry(samples, sizeof(samples), m, samples_per_bit));
+    }
+    TEST_ASSERT_EQUAL_UINT32(6000, TeensyFlexDShotCodec::periodToERPM(10000));
+}
+
+void test_telemetry_rejects_noise(void) {
+    uint8_t samples[512];
+    memset(samples, 0xff, sizeof(samples));
+    TEST_ASSERT_EQUAL_UINT32(TeensyFlexDShotCodec::TELEMETRY_INVALID,
+                             TeensyFlexDShotCodec::decodeTelemetry(samples, sizeof(samples), 0, 6.4f));
+    // A flipped line bit breaks the GCR code or the checksum
+    uint32_t line = TeensyFlexDShotCodec::encodeLine(4000) ^ (1u << 7);
+    TEST_ASSERT_EQUAL_UINT32(TeensyFlexDShotCodec::TELEMETRY_INVALID, TeensyFlexDShotCodec::decodeLine(line));
+}
+
+// Host model of the encode cost for 8 motors
+void test_encode_time(void) {
+    uint32_t out[TeensyFlexDShotCodec::FRAME_WORDS];
+    uint16_t frames[TeensyFlexDShotCodec::MOTORS];
+    const int loops = 100000;
+    uint32_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < loops; i++) {
+        for (uint8_t m = 0; m < TeensyFlexDShotCodec::MOTORS; m++)
+            frames[m] = TeensyFlexDShotCodec::frame((i + m * 211) & 0x7ff, false, true);
+        codec.encode(frames, out, 0xff, true);
+        sink += out[i % TeensyFlexDShotCodec::FRAME_WORDS];
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / loops;
+    char msg[96];
+    snprintf(msg, sizeof(msg), "encode 8 motors: %.1f ns per frame (sink %u)", ns, sink);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE(ns < 20000.0);
+}
+
+// Edge placement of the shifter output against the nominal DShot timing
+static float max_edge_error_ns(uint32_t flexio_clock, DShotSpeed speed) {
+    TeensyFlexDShotTiming t = TeensyFlexDShotCodec::timing(flexio_clock, speed);
+    float slot_ns = 1e9f / t.slotRate;
+    float bit_ns = 1e6f / (uint32_t)speed;
+    uint32_t out[TeensyFlexDShotCodec::FRAME_WORDS];
+    uint16_t frames[TeensyFlexDShotCodec::MOTORS] = {};
+    frames[0] = TeensyFlexDShotCodec::frame(0x555);
+    codec.encode(frames, out, 0x01);
+    const uint8_t *slots = (const uint8_t *)out;
+
+    float worst = 0;
+    uint8_t level = 0;
+    for (size_t i = 0; i < TeensyFlexDShotCodec::FRAME_BITS * TeensyFlexDShotCodec::SLOTS_PER_BIT; i++) {
+        uint8_t s = slots[i] & 1;
+        if (s == level)
+            continue;
+        level = s;
+        uint32_t bit = i / TeensyFlexDShotCodec::SLOTS_PER_BIT;
+        float ideal = bit * bit_ns;
+        if (!s)
+            ideal += bit_ns * ((frames[0] >> (15 - bit)) & 1 ? 0.75f : 0.375f);
+        float error = i * slot_ns - ideal;
+        if (error < 0)
+            error = -error;
+        if (error > worst)
+            worst = error;
+    }
+    return worst;
+}
+
+void test_output_jitter_profile(void) {
+    const DShotSpeed speeds[4] = {DShotSpeed::DShot150, DShotSpeed::DShot300, DShotSpeed::DShot600, DShotSpeed::DShot1200};
+    const uint32_t clocks[3] = {96000000, 120000000, 30000000};
+    char msg[128];
+    for (uint8_t c = 0; c < 3; c++) {
+        for (uint8_t s = 0; s < 4; s++) {
+            TeensyFlexDShotTiming t = TeensyFlexDShotCodec::timing(clocks[c], speeds[s]);
+            float worst = max_edge_error_ns(clocks[c], speeds[s]);
+            snprintf(msg, sizeof(msg), "clk %3u MHz DShot%-4u: bit %7.1f ns (%+.2f%%), worst edge error %6.1f ns%s",
+                     clocks[c] / 1000000, (unsigned)speeds[s], t.bitNs, t.errorPercent, worst,
+                     TeensyFlexDShotCodec::usable(t) ? "" : ", rejected");
+            TEST_MESSAGE(msg);
+            // 96 MHz has no quantization error at all
+            if (clocks[c] == 96000000) {
+                TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.0f, t.errorPercent);
+                TEST_ASSERT_FLOAT_WITHIN(1.0f, 0.0f, worst);
+                TEST_ASSERT_TRUE(TeensyFlexDShotCodec::usable(t));
+            }
+        }
+    }
+}
+
+// begin() keeps the module clock and refuses speeds it can't make
+void test_clock_too_slow_is_rejected(void) {
+    TEST_ASSERT_TRUE(TeensyFlexDShotCodec::usable(TeensyFlexDShotCodec::timing(120000000, DShotSpeed::DShot600)));
+    TEST_ASSERT_FALSE(TeensyFlexDShotCodec::usable(TeensyFlexDShotCodec::timing(30000000, DShotSpeed::DShot1200)));
+    TEST_ASSERT_FALSE(TeensyFlexDShotCodec::usable(TeensyFlexDShotCodec::timing(1000000, DShotSpeed::DShot600)));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_frame_checksum);
+    RUN_TEST(test_encode_parallel_slots);
+    RUN_TEST(test_masked_motors_stay_idle);
+    RUN_TEST(test_telemetry_round_trip);
+    RUN_TEST(test_telemetry_rejects_noise);
+    RUN_TEST(test_encode_time);
+    RUN_TEST(test_output_jitter_profile);
+    RUN_TEST(test_clock_too_slow_is_rejected);
+    return UNITY_END();
+}
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <unity.h>
+#include "TeensyFlexFlowControl.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_hysteresis(void) {
+    TeensyFlexRtsWatermark rts(48, 16);
+    TEST_ASSERT_TRUE(rts.update(0));
+    TEST_ASSERT_TRUE(rts.update(47));
+    TEST_ASSERT_FALSE(rts.update(48));
+    // Stays stopped until the buffer is down to the low mark
+    TEST_ASSERT_FALSE(rts.update(30));
+    TEST_ASSERT_FALSE(rts.update(17));
+    TEST_ASSERT_TRUE(rts.update(16));
+    TEST_ASSERT_TRUE(rts.update(40));
+    TEST_ASSERT_TRUE(rts.ready());
+}
+
+void test_set_levels(void) {
+    TeensyFlexRtsWatermark rts(48, 16);
+    TEST_ASSERT_FALSE(rts.setLevels(10, 10));
+    TEST_ASSERT_FALSE(rts.setLevels(8, 20));
+    TEST_ASSERT_EQUAL(48, rts.high());
+    TEST_ASSERT_TRUE(rts.setLevels(56, 8));
+    TEST_ASSERT_EQUAL(56, rts.high());
+    TEST_ASSERT_EQUAL(8, rts.low());
+}
+
+// One direction of an 8N1 link, simulated one bit time at a time (167 ns at
+// 6 Mbaud). The sender starts a character only when the receiver's RTS, as it
+// saw it latencyBits ago, says so. The receiver ISR puts each character in the
+// ring a few bits after its stop bit and updates RTS, the application reads in
+// bursts and now and then not at all for a while.
+struct LinkResult {
+    uint32_t received;
+    uint32_t dropped;
+    uint32_t out_of_order;
+    uint32_t bits;
+};
+
+static LinkResult run_link(bool flowControl, uint32_t latencyBits, uint16_t ringSize,
+                           uint16_t high, uint16_t low, uint32_t chars) {
+    const uint32_t CHAR_BITS = 10;
+    const uint32_t ISR_DELAY = 4;
+    const uint32_t READ_PERIOD = 160; // 12 bytes each 16 character times
+    const uint32_t READ_BURST = 12;
+    const uint32_t STALL_EVERY = 20000;
+    const uint32_t STALL_BITS = 2000;
+    const uint32_t HISTORY = 256;
+
+    TeensyFlexRtsWatermark rts(high, low);
+    uint8_t ring[64];
+    uint32_t head = 0, tail = 0;
+    bool rts_history[HISTORY];
+    for (bool &state : rts_history)
+        state = true;
+    bool rts_state = true;
+
+    LinkResult result = {0, 0, 0, 0};
+    uint32_t sent = 0;
+    uint8_t next_tx = 0, next_rx = 0;
+    uint32_t char_left = 0;
+    uint8_t on_wire = 0;
+    bool pending = false;
+    uint32_t pending_at = 0;
+    uint8_t pending_byte = 0;
+
+    uint32_t t = 0;
+    for (; result.received + result.dropped < chars; t++) {
+        // Sender, a character at a time
+        if (!char_left && (sent < chars)) {
+            bool clear = !flowControl || (t < latencyBits) || rts_history[(t - latencyBits) % HISTORY];
+            if (clear) {
+                on_wire = next_tx++;
+                char_left = CHAR_BITS;
+                sent++;
+            }
+        }
+        if (char_left && !--char_left) {
+            pending = true;
+            pending_at = t + ISR_DELAY;
+            pending_byte = on_wire;
+        }
+
+        // Receive ISR
+        if (pending && (pending_at == t)) {
+            pending = false;
+            uint32_t next = (head + 1) % ringSize;
+            if (next != tail) {
+                ring[head] = pending_byte;
+                head = next;
+            } else {
+                result.dropped++;
+            }
+            rts_state = rts.update((head + ringSize - tail) % ringSize);
+        }
+
+        // Application
+        bool stalled = (t % STALL_EVERY) >= (STALL_EVERY - STALL_BITS);
+        if (!stalled && !(t % READ_PERIOD)) {
+            for (uint32_t i = 0; (i < READ_BURST) && (head != tail); i++) {
+                uint8_t c = ring[tail];
+                tail = (tail + 1) % ringSize;
+                if (c != next_rx)
+                    result.out_of_order++;
+                next_rx = c + 1;
+                result.received++;
+            }
+            rts_state = rts.update((head + ringSize - tail) % ringSize);
+        }
+        rts_history[t % HISTORY] = rts_state;
+    }
+    result.bits = t;
+    return result;
+}
+
+static void report(const char *name, const LinkResult &result) {
+    // Bit times at 6 Mbaud
+    float seconds = (float)result.bits / 6000000.0f;
+    printf("%s: %u received, %u dropped, %.0f bytes/s\n", name, (unsigned)result.received,
+           (unsigned)result.dropped, (float)result.received / seconds);
+}
+
+void test_overflows_without_flow_control(void) {
+    LinkResult result = run_link(false, 0, 64, 48, 16, 100000);
+    report("no flow control", result);
+    TEST_ASSERT_GREATER_THAN(0, result.dropped);
+}
+
+// RTS from the 64 byte RX ring, a remote that reacts within two characters
+void test_rts_is_lossless_at_6mbaud(void) {
+    LinkResult result = run_link(true, 20, 64, 48, 16, 100000);
+    report("RTS, 2 character latency", result);
+    TEST_ASSERT_EQUAL(0, result.dropped);
+    TEST_ASSERT_EQUAL(0, result.out_of_order);
+    TEST_ASSERT_EQUAL(100000, result.received);
+    // The application takes 75% of the line rate and stalls 10% of the time,
+    // the link keeps up with it
+    TEST_ASSERT_GREATER_OR_EQUAL(65, (uint32_t)(result.received * 10ull * 100 / result.bits));
+}
+
+// The space above the high mark covers what a slow remote still sends
+void test_rts_headroom_covers_slow_remote(void) {
+    // 16 bytes of headroom: up to 14 characters of reaction time
+    LinkResult result = run_link(true, 130, 64, 48, 16, 50000);
+    TEST_ASSERT_EQUAL(0, result.dropped);
+    result = run_link(true, 200, 64, 48, 16, 50000);
+    TEST_ASSERT_GREATER_THAN(0, result.dropped);
+}
+
+// Our TX gated by CTS: the TX timer samples the pin when it starts a
+// character, so the reaction time is below one bit even for a remote with
+// a small FIFO and a tight high mark.
+void test_cts_gating_with_small_remote_fifo(void) {
+    LinkResult result = run_link(true, 1, 16, 14, 4, 100000);
+    report("CTS, 16 byte remote FIFO", result);
+    TEST_ASSERT_EQUAL(0, result.dropped);
+    TEST_ASSERT_EQUAL(0, result.out_of_order);
+}
+
+// 8N1 with a half bit of 5 clocks (TIMCMP 0x0F04): 10 bits of 10 clocks
+void test_rs485_pre_delay_bound(void) {
+    const uint32_t tx_cmp = 0x0F04;
+    TEST_ASSERT_EQUAL(100, TeensyFlexRS485Timing::characterClocks(tx_cmp));
+    TEST_ASSERT_TRUE(TeensyFlexRS485Timing::preDelayFits(0, tx_cmp));
+    TEST_ASSERT_TRUE(TeensyFlexRS485Timing::preDelayFits(100, tx_cmp));
+    TEST_ASSERT_FALSE(TeensyFlexRS485Timing::preDelayFits(101, tx_cmp));
+    // A faster rate shortens the character below the same pre delay
+    TEST_ASSERT_FALSE(TeensyFlexRS485Timing::preDelayFits(100, 0x0F03));
+    // 7 data bits: 9 bits
+    TEST_ASSERT_EQUAL(90, TeensyFlexRS485Timing::characterClocks(0x0D04));
+}
+
+void test_rs485_hold(void) {
+    TEST_ASSERT_EQUAL(100 + 30 - 1, TeensyFlexRS485Timing::holdCompare(0x0F04, 30));
+    // Clamped to the 16 bit counter
+    TEST_ASSERT_EQUAL(0xffff, TeensyFlexRS485Timing::holdCompare(0x0Fff, 0xF000));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_hysteresis);
+    RUN_TEST(test_set_levels);
+    RUN_TEST(test_overflows_without_flow_control);
+    RUN_TEST(test_rts_is_lossless_at_6mbaud);
+    RUN_TEST(test_rts_headroom_covers_slow_remote);
+    RUN_TEST(test_cts_gating_with_small_remote_fifo);
+    RUN_TEST(test_rs485_pre_delay_bound);
+    RUN_TEST(test_rs485_hold);
+    return UNITY_END();
+}
@@ -0,0 +1,341 @@
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include "TeensyFlexFraming.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static size_t encode(TeensyFlexFraming::Mode mode, const uint8_t *packet, size_t length, bool crc,
+                     uint8_t *out, size_t size) {
+    TeensyFlexBufferSink sink(out, size);
+    return TeensyFlexFraming::encode(mode, packet, length, crc, sink);
+}
+
+static void check_cobs(const uint8_t *packet, size_t length, const uint8_t *expected, size_t expected_length) {
+    uint8_t out[300];
+    TEST_ASSERT_EQUAL(expected_length, encode(TeensyFlexFraming::COBS, packet, length, false, out, sizeof(out)));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, out, expected_length);
+}
+
+void test_cobs_vectors(void) {
+    {
+        const uint8_t in[] = {0x00}, out[] = {0x01, 0x01, 0x00};
+        check_cobs(in, sizeof(in), out, sizeof(out));
+    }
+    {
+        const uint8_t in[] = {0x00, 0x11, 0x00}, out[] = {0x01, 0x02, 0x11, 0x01, 0x00};
+        check_cobs(in, sizeof(in), out, sizeof(out));
+    }
+    {
+        const uint8_t in[] = {0x11, 0x22, 0x00, 0x33}, out[] = {0x03, 0x11, 0x22, 0x02, 0x33, 0x00};
+        check_cobs(in, sizeof(in), out, sizeof(out));
+    }
+    {
+        const uint8_t in[] = {0x11, 0x00, 0x00, 0x00}, out[] = {0x02, 0x11, 0x01, 0x01, 0x01, 0x00};
+        check_cobs(in, sizeof(in), out, sizeof(out));
+    }
+    // 254 and 255 bytes without a zero
+    uint8_t in[256], out[260];
+    for (int i = 0; i < 255; i++)
+        in[i] = i + 1;
+    out[0] = 0xFF;
+    memcpy(out + 1, in, 254);
+    out[255] = 0x00;
+    check_cobs(in, 254, out, 256);
+    out[255] = 0x02;
+    out[256] = 0xFF;
+    out[257] = 0x00;
+    check_cobs(in, 255, out, 258);
+    // Leading zero, then 254 non zero bytes
+    in[0] = 0;
+    for (int i = 1; i < 255; i++)
+        in[i] = i;
+    out[0] = 0x01;
+    out[1] = 0xFF;
+    memcpy(out + 2, in + 1, 254);
+    out[256] = 0x00;
+    check_cobs(in, 255, out, 257);
+}
+
+void test_slip_escapes(void) {
+    const uint8_t in[] = {0x01, 0xC0, 0xDB, 0x02};
+    const uint8_t expected[] = {0x01, 0xDB, 0xDC, 0xDB, 0xDD, 0x02, 0xC0};
+    uint8_t out[16];
+    TEST_ASSERT_EQUAL(sizeof(expected), encode(TeensyFlexFraming::SLIP, in, sizeof(in), false, out, sizeof(out)));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, out, sizeof(expected));
+    // No room: nothing claimed
+    TEST_ASSERT_EQUAL(0, encode(TeensyFlexFraming::SLIP, in, sizeof(in), false, out, 4));
+}
+
+void test_crc16(void) {
+    const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    TEST_ASSERT_EQUAL_HEX16(0x29B1, TeensyFlexCrc16::compute(check, sizeof(check)));
+    uint8_t with_crc[11];
+    memcpy(with_crc, check, 9);
+    with_crc[9] = 0x29;
+    with_crc[10] = 0xB1;
+    TEST_ASSERT_EQUAL_HEX16(0, TeensyFlexCrc16::compute(with_crc, sizeof(with_crc)));
+}
+
+struct Received {
+    uint8_t *packet[64];
+    size_t length[64];
+    int count = 0;
+};
+
+static void on_packet(void *context, uint8_t *packet, size_t length) {
+    Received *r = (Received *)context;
+    r->packet[r->count] = packet;
+    r->length[r->count] = length;
+    r->count++;
+}
+
+static uint32_t lcg(uint32_t &seed) {
+    seed = seed * 1664525u + 1013904223u;
+    return seed >> 8;
+}
+
+// Random packets, sent as 1-3 segments, through the encoder and back through
+// the decoder into the caller's buffers
+static void round_trip(TeensyFlexFraming::Mode mode, bool crc) {
+    static uint8_t packet[800], line[1700], buffers[2][800];
+    uint32_t seed = 99 + mode * 2 + crc;
+    for (int n = 0; n < 300; n++) {
+        size_t length = lcg(seed) % 700;
+        uint32_t zeros = lcg(seed) % 4; // none, some, many special bytes
+        for (size_t i = 0; i < length; i++) {
+            uint32_t r = lcg(seed);
+            packet[i] = (zeros && (r % (1 << (2 * zeros))) == 0) ? ((r & 0x100) ? 0 : 0xC0) : (uint8_t)(r >> 12);
+            if ((zeros == 3) && (r & 1))
+                packet[i] = (r & 2) ? 0xDB : 0;
+        }
+        // Header, payload and trailer, as the caller has them
+        uint8_t count = 1 + n % 3;
+        size_t cut1 = (count > 1) && length ? lcg(seed) % length : length;
+        size_t cut2 = (count > 2) ? cut1 + (length - cut1) / 2 : length;
+        TeensyFlexFrameSegment segments[3] = {{packet, cut1}, {packet + cut1, cut2 - cut1}, {packet + cut2, length - cut2}};
+        TeensyFlexBufferSink sink(line, sizeof(line));
+        size_t encoded = TeensyFlexFraming::encode(mode, segments, count, crc, sink);
+        TEST_ASSERT_TRUE(encoded > 0);
+        TEST_ASSERT_TRUE(encoded <= TeensyFlexFraming::maxEncodedLength(mode, length, crc));
+        for (size_t i = 0; i + 1 < encoded; i++)
+            TEST_ASSERT_NOT_EQUAL(TeensyFlexFraming::delimiter(mode), line[i]);
+        TEST_ASSERT_EQUAL(TeensyFlexFraming::delimiter(mode), line[encoded - 1]);
+
+        Received received;
+        TeensyFlexFrameDecoder decoder;
+        decoder.begin(mode, crc, &on_packet, &received);
+        decoder.addBuffer(buffers[n & 1], sizeof(buffers[0]));
+        for (size_t i = 0; i < encoded; i++)
+            decoder.feed(line[i]);
+        if (!length && !crc) {
+            // COBS "01 00" / SLIP "C0": nothing to hand over
+            TEST_ASSERT_EQUAL(0, received.count);
+            continue;
+        }
+        TEST_ASSERT_EQUAL(1, received.count);
+        TEST_ASSERT_EQUAL_PTR(buffers[n & 1], received.packet[0]);
+        TEST_ASSERT_EQUAL(length, received.length[0]);
+        if (length)
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(packet, received.packet[0], length);
+    }
+}
+
+void test_round_trip_cobs(void) {
+    round_trip(TeensyFlexFraming::COBS, false);
+    round_trip(TeensyFlexFraming::COBS, true);
+}
+
+void test_round_trip_slip(void) {
+    round_trip(TeensyFlexFraming::SLIP, false);
+    round_trip(TeensyFlexFraming::SLIP, true);
+}
+
+void test_decoder_drops_bad_frames(void) {
+    uint8_t line[64], buffer[8], small[4];
+    const uint8_t packet[] = {1, 2, 0, 3, 4};
+    Received received;
+    TeensyFlexFrameDecoder decoder;
+    decoder.begin(TeensyFlexFraming::COBS, true, &on_packet, &received);
+
+    // No buffer yet
+    size_t n = encode(TeensyFlexFraming::COBS, packet, sizeof(packet), true, line, sizeof(line));
+    for (size_t i = 0; i < n; i++)
+        decoder.feed(line[i]);
+    TEST_ASSERT_EQUAL(1, decoder.noBuffer());
+
+    // Corrupted: CRC error, the buffer stays for the next frame
+    decoder.addBuffer(buffer, sizeof(buffer));
+    line[1] ^= 0x40;
+    for (size_t i = 0; i < n; i++)
+        decoder.feed(line[i]);
+    TEST_ASSERT_EQUAL(1, decoder.crcErrors());
+    line[1] ^= 0x40;
+    for (size_t i = 0; i < n; i++)
+        decoder.feed(line[i]);
+    TEST_ASSERT_EQUAL(1, received.count);
+    TEST_ASSERT_EQUAL_PTR(buffer, received.packet[0]);
+
+    // Too long for the buffer
+    decoder.addBuffer(small, sizeof(small));
+    for (size_t i = 0; i < n; i++)
+        decoder.feed(line[i]);
+    TEST_ASSERT_EQUAL(1, decoder.overruns());
+
+    // Cut inside a block, then a frame that fits goes to the buffer the
+    // dropped ones left behind
+    decoder.feed(0x05);
+    decoder.feed(0x01);
+    decoder.feed(0x00);
+    TEST_ASSERT_EQUAL(1, decoder.errors());
+    const uint8_t short_packet[] = {7};
+    n = encode(TeensyFlexFraming::COBS, short_packet, sizeof(short_packet), true, line, sizeof(line));
+    for (size_t i = 0; i < n; i++)
+        decoder.feed(line[i]);
+    TEST_ASSERT_EQUAL(1, decoder.overruns());
+    TEST_ASSERT_EQUAL(2, decoder.frames());
+    TEST_ASSERT_EQUAL_PTR(small, received.packet[1]);
+    TEST_ASSERT_EQUAL(1, received.length[1]);
+}
+
+// A TX ring like TeensyFlexSerial's with its reserveWrite()/commitWrite(), and
+// a consumer that empties it whenever it is full (the ISR)
+struct Ring {
+    static const size_t SIZE = 64;
+    uint8_t data[SIZE];
+    size_t head = 0, tail = 0;
+    uint32_t drained = 0;
+    uint32_t checksum = 0;
+
+    uint8_t *reserve(size_t &length) {
+        length = (tail > head) ? tail - head - 1 : SIZE - head - (tail == 0 ? 1 : 0);
+        return length ? &data[head] : nullptr;
+    }
+    void commit(size_t count) { head = (head + count) % SIZE; }
+    void drain() {
+        while (tail != head) {
+            checksum = checksum * 31 + data[tail];
+            tail = (tail + 1) % SIZE;
+            drained++;
+        }
+    }
+    // The old path: one write() per byte
+    void write(uint8_t c) {
+        size_t next = (head + 1) % SIZE;
+        if (next == tail)
+            drain();
+        data[head] = c;
+        head = next;
+    }
+};
+
+struct RingSink {
+    Ring &ring;
+    uint8_t *span = nullptr;
+    size_t room = 0, used = 0;
+    uint32_t puts = 0;
+    explicit RingSink(Ring &r) : ring(r) {}
+    bool put(uint8_t c) {
+        if (used == room) {
+            flush();
+            while (!(span = ring.reserve(room)))
+                ring.drain();
+        }
+        span[used++] = c;
+        puts++;
+        return true;
+    }
+    void flush() {
+        ring.commit(used);
+        used = room = 0;
+    }
+};
+
+static double ns_per_byte(std::chrono::steady_clock::time_point start, uint64_t bytes) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    return (double)ns / (double)bytes;
+}
+
+// Telemetry packets of 48 bytes: cost per payload byte of framing them into
+// the TX ring in place, of the old encode-then-write() path and of decoding.
+void test_benchmark(void) {
+    const int PACKETS = 20000;
+    const size_t LENGTH = 48;
+    static uint8_t packets[16][LENGTH];
+    uint32_t seed = 7;
+    for (auto &p : packets)
+        for (uint8_t &b : p)
+            b = (lcg(seed) % 8) ? (uint8_t)lcg(seed) : 0;
+
+    for (int m = 0; m < 2; m++) {
+        TeensyFlexFraming::Mode mode = m ? TeensyFlexFraming::SLIP : TeensyFlexFraming::COBS;
+        Ring ring;
+        RingSink sink(ring);
+        uint32_t encoded = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < PACKETS; i++)
+            encoded += TeensyFlexFraming::encode(mode, packets[i & 15], LENGTH, true, sink);
+        ring.drain();
+        double in_place = ns_per_byte(start, (uint64_t)PACKETS * LENGTH);
+        // Every framed byte was stored once, directly in the ring
+        TEST_ASSERT_EQUAL_UINT32(encoded, sink.puts);
+        TEST_ASSERT_EQUAL_UINT32(encoded, ring.drained);
+        uint32_t checksum = ring.checksum;
+
+        Ring legacy;
+        uint8_t temp[128];
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < PACKETS; i++) {
+            size_t n = encode(mode, packets[i & 15], LENGTH, true, temp, sizeof(temp));
+            for (size_t j = 0; j < n; j++)
+                legacy.write(temp[j]);
+        }
+        legacy.drain();
+        double staged = ns_per_byte(start, (uint64_t)PACKETS * LENGTH);
+        TEST_ASSERT_EQUAL_UINT32(checksum, legacy.checksum);
+
+        // Decode the same stream into two rotating buffers
+        static uint8_t line[PACKETS * 80];
+        TeensyFlexBufferSink line_sink(line, sizeof(line));
+        for (int i = 0; i < PACKETS; i++)
+            TeensyFlexFraming::encode(mode, packets[i & 15], LENGTH, true, line_sink);
+        static uint8_t buffers[2][LENGTH + 2];
+        struct Rotate {
+            TeensyFlexFrameDecoder *decoder;
+            uint32_t frames = 0;
+        } rotate;
+        TeensyFlexFrameDecoder decoder;
+        rotate.decoder = &decoder;
+        decoder.begin(mode, true, [](void *context, uint8_t *packet, size_t) {
+            Rotate *r = (Rotate *)context;
+            r->frames++;
+            r->decoder->addBuffer(packet, LENGTH + 2);
+        }, &rotate);
+        decoder.addBuffer(buffers[0], sizeof(buffers[0]));
+        decoder.addBuffer(buffers[1], sizeof(buffers[1]));
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < line_sink.length(); i++)
+            decoder.feed(line[i]);
+        double decode = ns_per_byte(start, (uint64_t)PACKETS * LENGTH);
+        TEST_ASSERT_EQUAL(PACKETS, rotate.frames);
+        TEST_ASSERT_EQUAL(0, decoder.crcErrors());
+
+        printf("%s + CRC, %u byte packets: encode in place %.2f ns/byte, encode + write() %.2f ns/byte, "
+               "decode %.2f ns/byte, %.3f line bytes per payload byte\n",
+               m ? "SLIP" : "COBS", (unsigned)LENGTH, in_place, staged, decode, (double)encoded / (PACKETS * LENGTH));
+    }
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_cobs_vectors);
+    RUN_TEST(test_slip_escapes);
+    RUN_TEST(test_crc16);
+    RUN_TEST(test_round_trip_cobs);
+    RUN_TEST(test_round_trip_slip);
+    RUN_TEST(test_decoder_drops_bad_frames);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include "TeensyFlexMIDICodec.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static TeensyFlexMIDIEvent make(uint8_t status, uint8_t data1 = 0, uint8_t data2 = 0) {
+    TeensyFlexMIDIEvent event;
+    event.time = 0;
+    event.length = TeensyFlexMIDICodec::dataBytes(status) + 1;
+    event.status = status;
+    event.data1 = data1;
+    event.data2 = data2;
+    return event;
+}
+
+void test_running_status(void) {
+    TeensyFlexMIDIEncoder encoder;
+    uint8_t out[3];
+    TEST_ASSERT_EQUAL(3, encoder.encode(make(0xB0, 1, 64), out));
+    TEST_ASSERT_EQUAL(2, encoder.encode(make(0xB0, 1, 65), out));
+    TEST_ASSERT_EQUAL_HEX8(1, out[0]);
+    TEST_ASSERT_EQUAL_HEX8(65, out[1]);
+    // Real time in between keeps it
+    TEST_ASSERT_EQUAL(1, encoder.encode(make(0xF8), out));
+    TEST_ASSERT_EQUAL(2, encoder.encode(make(0xB0, 7, 100), out));
+    // Another channel, then system common, cancel it
+    TEST_ASSERT_EQUAL(3, encoder.encode(make(0xB1, 7, 100), out));
+    TEST_ASSERT_EQUAL(2, encoder.encode(make(0xF3, 5), out));
+    TEST_ASSERT_EQUAL(3, encoder.encode(make(0xB1, 7, 101), out));
+    TEST_ASSERT_EQUAL(2, encoder.encode(make(0xC1, 9), out));
+    TEST_ASSERT_EQUAL(1, encoder.encode(make(0xC1, 10), out));
+    // SysEx is not encoded here
+    TEST_ASSERT_EQUAL(0, encoder.encode(make(0xF0), out));
+
+    encoder.setRunningStatus(false);
+    TEST_ASSERT_EQUAL(3, encoder.encode(make(0xB0, 1, 64), out));
+    TEST_ASSERT_EQUAL(3, encoder.encode(make(0xB0, 1, 65), out));
+}
+
+static uint8_t parse(TeensyFlexMIDIParser &parser, const uint8_t *bytes, size_t count,
+                     TeensyFlexMIDIEvent *events, uint8_t max) {
+    uint8_t n = 0;
+    TeensyFlexMIDIEvent event;
+    for (size_t i = 0; i < count; i++) {
+        if (parser.feed(bytes[i], event) && (n < max))
+            events[n++] = event;
+    }
+    return n;
+}
+
+void test_parser_running_status_and_real_time(void) {
+    TeensyFlexMIDIParser parser;
+    // Note on, two more by running status with a clock in the middle of one,
+    // a stray data byte after a system common message
+    const uint8_t bytes[] = {0x90, 60, 100, 62, 0xF8, 101, 64, 0, 0xF6, 5, 0xC2, 7, 8};
+    TeensyFlexMIDIEvent events[8];
+    uint8_t n = parse(parser, bytes, sizeof(bytes), events, 8);
+    TEST_ASSERT_EQUAL(7, n);
+    TEST_ASSERT_EQUAL_HEX8(0x90, events[0].status);
+    TEST_ASSERT_EQUAL(60, events[0].data1);
+    TEST_ASSERT_EQUAL(100, events[0].data2);
+    TEST_ASSERT_EQUAL_HEX8(0xF8, events[1].status);
+    TEST_ASSERT_EQUAL_HEX8(0x90, events[2].status);
+    TEST_ASSERT_EQUAL(62, events[2].data1);
+    TEST_ASSERT_EQUAL(101, events[2].data2);
+    TEST_ASSERT_EQUAL(0, events[3].data2);
+    TEST_ASSERT_EQUAL_HEX8(0xF6, events[4].status);
+    TEST_ASSERT_EQUAL_HEX8(0xC2, events[5].status);
+    TEST_ASSERT_EQUAL(7, events[5].data1);
+    TEST_ASSERT_EQUAL(8, events[6].data1);
+}
+
+void test_parser_sysex(void) {
+    TeensyFlexMIDIParser parser;
+    uint8_t buffer[8];
+    parser.setSysExBuffer(buffer, sizeof(buffer));
+    const uint8_t bytes[] = {0xF0, 0x7E, 0x7F, 0xFE, 0x06, 0x01, 0xF7, 0xB0, 1, 2};
+    TeensyFlexMIDIEvent events[4];
+    uint8_t n = parse(parser, bytes, sizeof(bytes), events, 4);
+    TEST_ASSERT_EQUAL(3, n);
+    TEST_ASSERT_EQUAL_HEX8(0xFE, events[0].status);
+    TEST_ASSERT_EQUAL_HEX8(0xF0, events[1].status);
+    TEST_ASSERT_EQUAL(6, events[1].length);
+    const uint8_t expected[] = {0xF0, 0x7E, 0x7F, 0x06, 0x01, 0xF7};
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, buffer, 6);
+    TEST_ASSERT_EQUAL_HEX8(0xB0, events[2].status);
+
+    // Too long: cut at the buffer size
+    const uint8_t longer[] = {0xF0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0xF7};
+    n = parse(parser, longer, sizeof(longer), events, 4);
+    TEST_ASSERT_EQUAL(1, n);
+    TEST_ASSERT_EQUAL(8, events[0].length);
+
+    // Ended by a status byte instead of 0xF7: dropped, the status counts
+    const uint8_t broken[] = {0xF0, 1, 2, 0x80, 60, 0};
+    n = parse(parser, broken, sizeof(broken), events, 4);
+    TEST_ASSERT_EQUAL(1, n);
+    TEST_ASSERT_EQUAL_HEX8(0x80, events[0].status);
+}
+
+void test_round_trip(void) {
+    TeensyFlexMIDIEncoder encoder;
+    TeensyFlexMIDIParser parser;
+    uint32_t seed = 12345;
+    uint8_t stream[4000];
+    size_t length = 0;
+    TeensyFlexMIDIEvent sent[1000];
+    for (int i = 0; i < 1000; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        static const uint8_t kinds[] = {0x80, 0x90, 0xA0, 0xB0, 0xC0, 0xD0, 0xE0, 0xB0, 0xB0, 0xB0};
+        uint8_t status = kinds[(seed >> 24) % 10] | ((seed >> 8) & 1);
+        if (((seed >> 16) & 31) == 0)
+            status = 0xF8;
+        sent[i] = make(status, (seed >> 4) & 0x7f, (seed >> 12) & 0x7f);
+        if (TeensyFlexMIDICodec::dataBytes(status) < 2)
+            sent[i].data2 = 0;
+        if (TeensyFlexMIDICodec::dataBytes(status) < 1)
+            sent[i].data1 = 0;
+        length += encoder.encode(sent[i], stream + length);
+    }
+    TeensyFlexMIDIEvent event;
+    int received = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (parser.feed(stream[i], event)) {
+            TEST_ASSERT_EQUAL_HEX8(sent[received].status, event.status);
+            TEST_ASSERT_EQUAL(sent[received].data1, event.data1);
+            TEST_ASSERT_EQUAL(sent[received].data2, event.data2);
+            received++;
+        }
+    }
+    TEST_ASSERT_EQUAL(1000, received);
+}
+
+void test_queue(void) {
+    TeensyFlexMIDIQueue<8> queue;
+    TeensyFlexMIDIEvent event;
+    TEST_ASSERT_NULL(queue.peek());
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 7; i++)
+            TEST_ASSERT_TRUE(queue.push(make(0x90, i)));
+        TEST_ASSERT_FALSE(queue.push(make(0x90, 7)));
+        TEST_ASSERT_EQUAL(7, queue.count());
+        TEST_ASSERT_EQUAL(0, queue.space());
+        for (int i = 0; i < 5; i++) {
+            TEST_ASSERT_TRUE(queue.pop(event));
+            TEST_ASSERT_EQUAL(i, event.data1);
+        }
+        TEST_ASSERT_TRUE(queue.push(make(0x90, 7)));
+        while (queue.pop(event))
+            ;
+        TEST_ASSERT_EQUAL(0, queue.count());
+    }
+}
+
+void test_queue_time_keeps_order(void) {
+    uint32_t time = 0;
+    // Nothing waiting (last in the past): any time goes, 0 is now
+    TEST_ASSERT_TRUE(TeensyFlexMIDICodec::queueTime(0, 1000, 500, time));
+    TEST_ASSERT_EQUAL(1000, time);
+    TEST_ASSERT_TRUE(TeensyFlexMIDICodec::queueTime(700, 1000, 500, time));
+    TEST_ASSERT_EQUAL(700, time);
+    // An event at 5000 still waits: later and equal times queue behind it,
+    // earlier ones would leave late and are refused, 0 goes right behind it
+    TEST_ASSERT_TRUE(TeensyFlexMIDICodec::queueTime(6000, 1000, 5000, time));
+    TEST_ASSERT_EQUAL(6000, time);
+    TEST_ASSERT_TRUE(TeensyFlexMIDICodec::queueTime(5000, 1000, 5000, time));
+    TEST_ASSERT_FALSE(TeensyFlexMIDICodec::queueTime(4000, 1000, 5000, time));
+    TEST_ASSERT_FALSE(TeensyFlexMIDICodec::queueTime(1200, 1000, 5000, time));
+    TEST_ASSERT_TRUE(TeensyFlexMIDICodec::queueTime(0, 1000, 5000, time));
+    TEST_ASSERT_EQUAL(5000, time);
+    // Across the 32 bit wrap of the tick clock
+    TEST_ASSERT_TRUE(TeensyFlexMIDICodec::queueTime(100, 0xFFFFFF00u, 50, time));
+    TEST_ASSERT_FALSE(TeensyFlexMIDICodec::queueTime(0xFFFFFFF0u, 0xFFFFFF00u, 50, time));
+}
+
+// Dense automation: two controllers swept on one channel, a clock every 24
+// events. Events per second at 31250 baud (3125 bytes/s) with and without
+// running status.
+static float events_per_second(bool runningStatus) {
+    TeensyFlexMIDIEncoder encoder;
+    encoder.setRunningStatus(runningStatus);
+    uint8_t out[3];
+    uint32_t bytes = 0, events = 0;
+    for (int i = 0; i < 24000; i++) {
+        TeensyFlexMIDIEvent event = (i % 24 == 23) ? make(0xF8) : make(0xB0, 1 + (i & 1), i & 0x7f);
+        bytes += encoder.encode(event, out);
+        events++;
+    }
+    return 3125.0f * (float)events / (float)bytes;
+}
+
+void test_more_events_per_second(void) {
+    float plain = events_per_second(false);
+    float running = events_per_second(true);
+    printf("events/s at 31250 baud: %.0f plain, %.0f running status (x%.2f)\n", plain, running, running / plain);
+    TEST_ASSERT_GREATER_THAN(1.45f * plain, running);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_running_status);
+    RUN_TEST(test_parser_running_status_and_real_time);
+    RUN_TEST(test_parser_sysex);
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_queue);
+    RUN_TEST(test_queue_time_keeps_order);
+    RUN_TEST(test_more_events_per_second);
+    return UNITY_END();
+}
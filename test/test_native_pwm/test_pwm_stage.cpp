@@ -0,0 +1,161 @@
+#include <unity.h>
+#include "TeensyFlexPWMStage.h"
+
+// One channel timer, clocked by hand: started by the period edges, reset by
+// them while running, disabled on compare after TIMCMP + 1 clocks
+struct ModelTimer {
+    bool mode_on = false;
+    uint16_t timcmp = 0;
+    bool enabled = false;
+    uint32_t counter = 0;
+    bool output = false;
+    bool status = false;
+    bool watching = false;
+
+    void setCompare(uint16_t compare) { timcmp = compare; }
+    void start() { mode_on = true; }
+    void stop() {
+        mode_on = false;
+        enabled = false;
+        output = false;
+    }
+    void watchPulseEnd(bool on) {
+        if (on)
+            status = false;
+        watching = on;
+    }
+
+    void clock(bool edge) {
+        if (enabled) {
+            if (edge) {
+                counter = timcmp;
+            } else if (counter == 0) {
+                enabled = false;
+                output = false;
+                status = true;
+            } else {
+                counter--;
+            }
+        } else if (edge && mode_on) {
+            enabled = true;
+            counter = timcmp;
+            output = true;
+        }
+    }
+};
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static const uint32_t PERIOD = 1000;
+static const uint32_t PERIODS = 8;
+static const uint32_t CHANGE = 3;
+
+// Runs at duty 'from', asks for 'to' in period CHANGE (the boundary interrupt
+// comes 'latency' clocks after its edge, the compare status one as well) and
+// records the clocks the output is on in each period
+static void run(uint16_t from, uint16_t to, uint32_t latency, uint32_t *on) {
+    ModelTimer timer;
+    TeensyFlexPWMStage::State state = TeensyFlexPWMStage::Off;
+    TeensyFlexPWMStage::commit(timer, state, from, PERIOD);
+    uint32_t status_at = 0;
+    bool status_seen = false;
+    for (uint32_t t = 0; t < PERIODS * PERIOD; t++) {
+        uint32_t period = t / PERIOD;
+        if (t % PERIOD == 0)
+            on[period] = 0;
+        timer.clock(t % PERIOD == 0);
+        if (timer.output)
+            on[period]++;
+        if ((period == CHANGE) && (t % PERIOD == latency))
+            TeensyFlexPWMStage::commit(timer, state, to, PERIOD);
+        if (timer.watching && timer.status && !status_seen) {
+            status_seen = true;
+            status_at = t + latency;
+        }
+        if (status_seen && (t == status_at)) {
+            TeensyFlexPWMStage::pulseEnded(timer, state);
+            status_seen = false;
+        }
+    }
+}
+
+static uint32_t clocks(uint16_t duty) { return TeensyFlexPWMStage::clocks(duty, PERIOD); }
+
+// Whole pulses of the old duty up to and including the period of the
+// request, the new one from the next period on
+static void expect_switch(const uint32_t *on, uint32_t before, uint32_t after) {
+    for (uint32_t i = 1; i <= CHANGE; i++)
+        TEST_ASSERT_EQUAL_UINT32(before, on[i]);
+    for (uint32_t i = CHANGE + 1; i < PERIODS; i++)
+        TEST_ASSERT_EQUAL_UINT32(after, on[i]);
+}
+
+void test_duty_to_duty(void) {
+    uint32_t on[PERIODS];
+    run(0x4000, 0xc000, 20, on);
+    expect_switch(on, clocks(0x4000), clocks(0xc000));
+}
+
+void test_duty_to_zero_keeps_the_running_pulse(void) {
+    uint32_t on[PERIODS];
+    run(0x8000, 0, 20, on);
+    expect_switch(on, clocks(0x8000), 0);
+}
+
+void test_zero_to_duty(void) {
+    uint32_t on[PERIODS];
+    run(0, 0x8000, 20, on);
+    expect_switch(on, 0, clocks(0x8000));
+}
+
+void test_duty_to_full(void) {
+    uint32_t on[PERIODS];
+    run(0x8000, TeensyFlexPWMStage::DUTY_MAX, 20, on);
+    expect_switch(on, clocks(0x8000), PERIOD);
+}
+
+void test_full_to_duty_keeps_the_full_period(void) {
+    uint32_t on[PERIODS];
+    run(TeensyFlexPWMStage::DUTY_MAX, 0x8000, 20, on);
+    expect_switch(on, PERIOD, clocks(0x8000));
+}
+
+void test_zero_to_full_and_back(void) {
+    uint32_t on[PERIODS];
+    run(0, TeensyFlexPWMStage::DUTY_MAX, 20, on);
+    expect_switch(on, 0, PERIOD);
+
+    // The reset that ends the last full period loads the one clock compare
+    run(TeensyFlexPWMStage::DUTY_MAX, 0, 20, on);
+    for (uint32_t i = 1; i <= CHANGE; i++)
+        TEST_ASSERT_EQUAL_UINT32(PERIOD, on[i]);
+    TEST_ASSERT_EQUAL_UINT32(1, on[CHANGE + 1]);
+    for (uint32_t i = CHANGE + 2; i < PERIODS; i++)
+        TEST_ASSERT_EQUAL_UINT32(0, on[i]);
+}
+
+// The status interrupt comes after the next edge: that period gets the one
+// clock pulse that was staged, never a cut or stretched one
+void test_late_status_costs_one_clock(void) {
+    uint32_t on[PERIODS];
+    uint16_t duty = 0xfc00; // ends 16 clocks before the edge
+    run(duty, 0, 40, on);
+    for (uint32_t i = 1; i <= CHANGE; i++)
+        TEST_ASSERT_EQUAL_UINT32(clocks(duty), on[i]);
+    TEST_ASSERT_EQUAL_UINT32(1, on[CHANGE + 1]);
+    for (uint32_t i = CHANGE + 2; i < PERIODS; i++)
+        TEST_ASSERT_EQUAL_UINT32(0, on[i]);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_duty_to_duty);
+    RUN_TEST(test_duty_to_zero_keeps_the_running_pulse);
+    RUN_TEST(test_zero_to_duty);
+    RUN_TEST(test_duty_to_full);
+    RUN_TEST(test_full_to_duty_keeps_the_full_period);
+    RUN_TEST(test_zero_to_full_and_back);
+    RUN_TEST(test_late_status_costs_one_clock);
+    return UNITY_END();
+}
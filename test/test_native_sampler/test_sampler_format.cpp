@@ -0,0 +1,129 @@
+#include <unity.h>
+#include <stdlib.h>
+#include "TeensyFlexSamplerFormat.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// Decode a capture back into one byte per sample
+static uint32_t decode_all(const uint8_t *in, size_t length, uint8_t *samples, uint32_t max_samples,
+                           TeensyFlexSampleHeader *header) {
+    TeensyFlexSampleDecoder decoder;
+    TEST_ASSERT_TRUE(decoder.begin(in, length));
+    *header = decoder.header();
+    uint32_t count = 0;
+    uint8_t value;
+    uint32_t run;
+    while (decoder.next(value, run)) {
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32(max_samples, count + run);
+        for (uint32_t i = 0; i < run; i++) samples[count++] = value;
+    }
+    return count;
+}
+
+void test_header_round_trip(void) {
+    uint8_t out[64];
+    TeensyFlexSampleHeader header;
+    header.channels = 5;
+    header.sampleRate = 15000000;
+    header.triggerIndex = 1234;
+
+    TeensyFlexSampleEncoder encoder;
+    TEST_ASSERT_TRUE(encoder.begin(out, sizeof(out), header));
+    encoder.push(0x1f);
+    size_t size = encoder.finish();
+    TEST_ASSERT_EQUAL(TeensyFlexSampleHeader::SIZE + 2, size);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY("FXLA", out, 4);
+
+    TeensyFlexSampleDecoder decoder;
+    TEST_ASSERT_TRUE(decoder.begin(out, size));
+    TEST_ASSERT_EQUAL(5, decoder.header().channels);
+    TEST_ASSERT_EQUAL_UINT32(15000000, decoder.header().sampleRate);
+    TEST_ASSERT_EQUAL_UINT32(1, decoder.header().sampleCount);
+    TEST_ASSERT_EQUAL_UINT32(1234, decoder.header().triggerIndex);
+}
+
+void test_long_runs_use_varints(void) {
+    uint8_t out[64];
+    TeensyFlexSampleHeader header;
+    header.channels = 1;
+    TeensyFlexSampleEncoder encoder;
+    encoder.begin(out, sizeof(out), header);
+    for (uint32_t i = 0; i < 100000; i++) encoder.push(1);
+    for (uint32_t i = 0; i < 128; i++) encoder.push(0);
+    size_t size = encoder.finish();
+    // 1 + 3 byte varint for 99999, 1 + 1 byte varint for 127
+    TEST_ASSERT_EQUAL(TeensyFlexSampleHeader::SIZE + 4 + 2, size);
+
+    TeensyFlexSampleDecoder decoder;
+    TEST_ASSERT_TRUE(decoder.begin(out, size));
+    uint8_t value;
+    uint32_t run;
+    TEST_ASSERT_TRUE(decoder.next(value, run));
+    TEST_ASSERT_EQUAL(1, value);
+    TEST_ASSERT_EQUAL_UINT32(100000, run);
+    TEST_ASSERT_TRUE(decoder.next(value, run));
+    TEST_ASSERT_EQUAL(0, value);
+    TEST_ASSERT_EQUAL_UINT32(128, run);
+    TEST_ASSERT_FALSE(decoder.next(value, run));
+}
+
+void test_random_capture_round_trip(void) {
+    static uint8_t samples[20000];
+    static uint8_t decoded[20000];
+    static uint8_t out[64000];
+    srand(42);
+    // Mix of slow and glitchy signals on 8 channels
+    uint8_t value = 0;
+    for (uint32_t i = 0; i < sizeof(samples); i++) {
+        if ((rand() % 16) == 0) value ^= 1 << (rand() % 8);
+        samples[i] = value;
+    }
+
+    TeensyFlexSampleHeader header;
+    header.channels = 8;
+    header.sampleRate = 1000000;
+    header.triggerIndex = 5000;
+    TeensyFlexSampleEncoder encoder;
+    encoder.begin(out, sizeof(out), header);
+    for (uint32_t i = 0; i < sizeof(samples); i++) encoder.push(samples[i]);
+    size_t size = encoder.finish();
+    TEST_ASSERT_GREATER_THAN(0, size);
+    TEST_ASSERT_LESS_THAN(sizeof(samples), size);
+
+    TeensyFlexSampleHeader decoded_header;
+    uint32_t count = decode_all(out, size, decoded, sizeof(decoded), &decoded_header);
+    TEST_ASSERT_EQUAL_UINT32(sizeof(samples), count);
+    TEST_ASSERT_EQUAL_UINT32(sizeof(samples), decoded_header.sampleCount);
+    TEST_ASSERT_EQUAL_UINT32(5000, decoded_header.triggerIndex);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(samples, decoded, sizeof(samples));
+}
+
+void test_overflow_is_reported(void) {
+    uint8_t out[TeensyFlexSampleHeader::SIZE + 3];
+    TeensyFlexSampleHeader header;
+    TeensyFlexSampleEncoder encoder;
+    encoder.begin(out, sizeof(out), header);
+    encoder.push(1);
+    encoder.push(2);
+    encoder.push(3);
+    TEST_ASSERT_EQUAL(0, encoder.finish());
+    TEST_ASSERT_TRUE(encoder.overflow());
+}
+
+void test_rejects_bad_header(void) {
+    uint8_t junk[TeensyFlexSampleHeader::SIZE] = {'F', 'X', 'L', 'B'};
+    TeensyFlexSampleDecoder decoder;
+    TEST_ASSERT_FALSE(decoder.begin(junk, sizeof(junk)));
+    TEST_ASSERT_FALSE(decoder.begin(junk, 4));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_header_round_trip);
+    RUN_TEST(test_long_runs_use_varints);
+    RUN_TEST(test_random_capture_round_trip);
+    RUN_TEST(test_overflow_is_reported);
+    RUN_TEST(test_rejects_bad_header);
+    return UNITY_END();
+}
@@ -0,0 +1,64 @@
+#include <unity.h>
+#include "TeensyFlexServiceStats.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_steady_service_has_no_jitter(void) {
+    TeensyFlexServiceStats stats;
+    for (uint32_t i = 0; i < 100; i++)
+        stats.mark(1000 + i * 52083); // 115200 baud character at 600 MHz
+    TEST_ASSERT_EQUAL(99, stats.count());
+    TEST_ASSERT_EQUAL(52083, stats.minCycles());
+    TEST_ASSERT_EQUAL(52083, stats.maxCycles());
+    TEST_ASSERT_EQUAL(0, stats.jitterCycles());
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, 52083.0f, stats.meanCycles());
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, 0.0f, stats.stddevCycles());
+}
+
+void test_late_service_shows_as_jitter(void) {
+    TeensyFlexServiceStats stats;
+    // Every 4th refill 300 cycles late (an interrupt of higher priority)
+    uint32_t t = 0;
+    for (uint32_t i = 0; i < 40; i++) {
+        uint32_t late = (i % 4 == 3) ? 300 : 0;
+        stats.mark(t + late);
+        t += 10000;
+    }
+    TEST_ASSERT_EQUAL(9700, stats.minCycles());
+    TEST_ASSERT_EQUAL(10300, stats.maxCycles());
+    TEST_ASSERT_EQUAL(600, stats.jitterCycles());
+    TEST_ASSERT_TRUE(stats.stddevCycles() > 100.0f);
+}
+
+void test_restart_skips_the_idle_gap(void) {
+    TeensyFlexServiceStats stats;
+    stats.mark(0);
+    stats.mark(500);
+    stats.restart(); // buffer drained
+    stats.mark(1000000);
+    stats.mark(1000500);
+    TEST_ASSERT_EQUAL(2, stats.count());
+    TEST_ASSERT_EQUAL(0, stats.jitterCycles());
+}
+
+void test_counter_wrap_and_reset(void) {
+    TeensyFlexServiceStats stats;
+    stats.mark(0xFFFFFF00u);
+    stats.mark(0x00000100u);
+    TEST_ASSERT_EQUAL(0x200, stats.maxCycles());
+    stats.reset();
+    TEST_ASSERT_EQUAL(0, stats.count());
+    TEST_ASSERT_EQUAL(0, stats.minCycles());
+    stats.mark(10);
+    TEST_ASSERT_EQUAL(0, stats.count());
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_steady_service_has_no_jitter);
+    RUN_TEST(test_late_service_shows_as_jitter);
+    RUN_TEST(test_restart_skips_the_idle_gap);
+    RUN_TEST(test_counter_wrap_and_reset);
+    return UNITY_END();
+}
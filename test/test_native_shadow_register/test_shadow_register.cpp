@@ -0,0 +1,67 @@
+#include <unity.h>
+#include "TeensyFlexShadowRegister.h"
+
+// A register that counts its bus accesses
+struct CountingRegister {
+    uint32_t value = 0;
+    mutable uint32_t reads = 0;
+    uint32_t writes = 0;
+
+    operator uint32_t() const {
+        reads++;
+        return value;
+    }
+    CountingRegister &operator=(uint32_t v) {
+        writes++;
+        value = v;
+        return *this;
+    }
+    uint32_t accesses() const { return reads + writes; }
+};
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_attach_reads_once_and_mirrors(void) {
+    CountingRegister reg;
+    reg.value = 0x05;
+    TeensyFlexShadowRegister<CountingRegister> shadow;
+    shadow.attach(&reg);
+    TEST_ASSERT_EQUAL(1, reg.reads);
+    TEST_ASSERT_TRUE(shadow.test(0x04));
+    TEST_ASSERT_FALSE(shadow.test(0x02));
+
+    shadow.set(0x02);
+    shadow.clear(0x01);
+    TEST_ASSERT_EQUAL_HEX32(0x06, reg.value);
+    TEST_ASSERT_EQUAL(1, reg.reads);
+    TEST_ASSERT_EQUAL(2, reg.writes);
+}
+
+void test_unchanged_writes_skip_the_bus(void) {
+    CountingRegister reg;
+    TeensyFlexShadowRegister<CountingRegister> shadow;
+    shadow.attach(&reg);
+    for (int i = 0; i < 10; i++)
+        shadow.set(0x10);
+    TEST_ASSERT_EQUAL(1, reg.writes);
+    shadow.clear(0x20);
+    TEST_ASSERT_EQUAL(1, reg.writes);
+}
+
+void test_sync_picks_up_direct_writes(void) {
+    CountingRegister reg;
+    TeensyFlexShadowRegister<CountingRegister> shadow;
+    shadow.attach(&reg);
+    reg.value = 0x40; // someone else wrote it
+    shadow.sync();
+    TEST_ASSERT_TRUE(shadow.test(0x40));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_attach_reads_once_and_mirrors);
+    RUN_TEST(test_unchanged_writes_skip_the_bus);
+    RUN_TEST(test_sync_picks_up_direct_writes);
+    return UNITY_END();
+}
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""Convert a TeensyFlexSampler capture (see src/TeensyFlexSamplerFormat.h) to VCD.
+
+usage: flexsampler_vcd.py capture.bin [capture.vcd]
+"""
+import struct
+import sys
+
+MAGIC = b"FXLA"
+HEADER_SIZE = 20
+
+
+def read_capture(data):
+    if len(data) < HEADER_SIZE or data[0:4] != MAGIC or data[4] != 1:
+        raise ValueError("not a FXLA version 1 capture")
+    channels = data[5]
+    sample_rate, sample_count, trigger_index = struct.unpack_from("<III", data, 8)
+    runs = []
+    pos = HEADER_SIZE
+    decoded = 0
+    while pos < len(data) and decoded < sample_count:
+        value = data[pos]
+        pos += 1
+        extra = 0
+        shift = 0
+        while True:
+            b = data[pos]
+            pos += 1
+            extra |= (b & 0x7F) << shift
+            if not b & 0x80:
+                break
+            shift += 7
+        runs.append((value, extra + 1))
+        decoded += extra + 1
+    return channels, sample_rate, trigger_index, runs
+
+
+def write_vcd(out, channels, sample_rate, trigger_index, runs):
+    # Use a 1 ns timescale, each sample lasts 1e9 / sample_rate ns
+    ns_per_sample = 1e9 / sample_rate if sample_rate else 1
+    ids = [chr(ord("!") + ch) for ch in range(channels)]
+    trigger_id = chr(ord("!") + channels)
+    out.write("$timescale 1ns $end\n$scope module flexsampler $end\n")
+    for ch in range(channels):
+        out.write("$var wire 1 %s ch%d $end\n" % (ids[ch], ch))
+    out.write("$var event 1 %s trigger $end\n" % trigger_id)
+    out.write("$upscope $end\n$enddefinitions $end\n")
+
+    sample = 0
+    last = None
+    for value, run in runs:
+        out.write("#%d\n" % round(sample * ns_per_sample))
+        if sample == trigger_index:
+            out.write("1%s\n" % trigger_id)
+        for ch in range(channels):
+            bit = (value >> ch) & 1
+            if last is None or ((last >> ch) & 1) != bit:
+                out.write("%d%s\n" % (bit, ids[ch]))
+        if sample < trigger_index < sample + run:
+            out.write("#%d\n1%s\n" % (round(trigger_index * ns_per_sample), trigger_id))
+        last = value
+        sample += run
+    out.write("#%d\n" % round(sample * ns_per_sample))
+
+
+def main(argv):
+    if len(argv) < 2:
+        print(__doc__)
+        return 1
+    with open(argv[1], "rb") as f:
+        capture = read_capture(f.read())
+    out_name = argv[2] if len(argv) > 2 else argv[1].rsplit(".", 1)[0] + ".vcd"
+    with open(out_name, "w") as out:
+        write_vcd(out, *capture)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))